@@ -45,6 +45,7 @@ void aesCbcInitForEncr(struct AesCbcContext *ctx, const uint32_t *k, const uint3
 void aesCbcInitForDecr(struct AesCbcContext *ctx, const uint32_t *k, const uint32_t *iv);
 void aesCbcEncr(struct AesCbcContext *ctx, const uint32_t *src, uint32_t *dst); //encrypts AES_BLOCK_WORDS words
 void aesCbcDecr(struct AesCbcContext *ctx, const uint32_t *src, uint32_t *dst); //encrypts AES_BLOCK_WORDS words
+void aesCbcDecrBlocks(struct AesCbcContext *ctx, const uint32_t *src, uint32_t *dst, uint32_t numBlocks); //decrypts numBlocks * AES_BLOCK_WORDS words, src may equal dst
 
 
 #endif
@@ -0,0 +1,59 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _APP_INDEX_H_
+#define _APP_INDEX_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * The shared flash area is a log of segments: a byte with the segment type in
+ * both nibbles, a 24-bit big endian length, the data padded to 4 bytes and a
+ * CRC over all of it. Every successful app upload appends an index segment
+ * listing the app segments in front of it and which of them were verified,
+ * so boot can skip the CRC of images it already knows to be good and check
+ * them in the background instead.
+ */
+
+#define APP_INDEX_SEG_ID        0x8        /* next to BL_FLASH_*_ID, the bootloader ignores it */
+#define APP_INDEX_VERIFIED      0x56455249 /* "VERI" */
+
+struct AppIndexEntry {
+    uint64_t appId;
+    uint32_t offset;  /* of the segment, from the start of the shared area */
+    uint32_t len;     /* segment data length, as in its header */
+    uint32_t crc;     /* the CRC stored at the end of the segment */
+    uint32_t status;  /* APP_INDEX_VERIFIED or 0 */
+};
+
+//total flash used by the segment at seg, header and CRC included
+uint32_t appIndexSegSize(const uint8_t *seg);
+
+//newest intact index in the shared area, NULL if there is none
+const struct AppIndexEntry *appIndexFind(uint32_t *numEntries);
+
+//true if seg is listed as verified and its header and stored CRC still match
+bool appIndexIsVerified(const struct AppIndexEntry *index, uint32_t numEntries, const uint8_t *seg);
+
+//append an index at 'at' (the end of the log) with verifiedSeg and previously verified apps marked as such
+bool appIndexWrite(uint8_t *at, const uint8_t *verifiedSeg);
+
+//mark a segment erased so it is skipped from the next boot on
+void appIndexInvalidate(const uint8_t *seg);
+
+#endif
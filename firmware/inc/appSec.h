@@ -28,6 +28,8 @@ typedef uint32_t AppSecErr;
 typedef AppSecErr (*AppSecWriteCbk)(const void *data, uint32_t len);
 typedef AppSecErr (*AppSecPubKeyFindCbk)(const uint32_t *gotKey, bool *foundP); // fill in *foundP on result of lookup
 typedef AppSecErr (*AppSecGetAesKeyCbk)(uint64_t keyIdx, void *keyBuf); // return APP_SEC_KEY_NOT_FOUND or APP_SEC_NO_ERROR
+typedef bool (*AppSecSigCacheFindCbk)(const uint32_t *imageHash, uint32_t *rootKeyHash); // true if this image hash already passed verification, fill in *rootKeyHash with the hash of the root key it chained to
+typedef AppSecErr (*AppSecSizeCbk)(uint32_t len); // compressed apps: len is how many bytes writeCbk will get in total, told before any of them
 
 //return values
 #define APP_SEC_NO_ERROR            0 //all went ok
@@ -43,13 +45,16 @@ typedef AppSecErr (*AppSecGetAesKeyCbk)(uint64_t keyIdx, void *keyBuf); // retur
 #define APP_SEC_BAD                10 //something irrecoverably bad happened and we gave up. Sorry...
 
 //init/deinit
-struct AppSecState *appSecInit(AppSecWriteCbk writeCbk, AppSecPubKeyFindCbk pubKeyFindCbk, AppSecGetAesKeyCbk aesKeyAccessCbk, bool mandateSigning);
+struct AppSecState *appSecInit(AppSecWriteCbk writeCbk, AppSecPubKeyFindCbk pubKeyFindCbk, AppSecGetAesKeyCbk aesKeyAccessCbk, AppSecSigCacheFindCbk sigCacheFindCbk, AppSecSizeCbk sizeCbk, bool mandateSigning); //sigCacheFindCbk and sizeCbk may be NULL
 void appSecDeinit (struct AppSecState *state);
 
 //actually doing things
 AppSecErr appSecRxData(struct AppSecState *state, const void *data, uint32_t len);
 AppSecErr appSecRxDataOver(struct AppSecState *state); //caleed when there is no more data
 
+//once all data is in, true if the signature chain was checked with RSA this time, with the hashes of the signed image and of its root key (for caching)
+bool appSecGetVerifiedSig(struct AppSecState *state, uint32_t *imageHash, uint32_t *rootKeyHash);
+
 
 
 
@@ -17,6 +17,9 @@
 #ifndef _APP_RELOC_FORMAT_H_
 #define _APP_RELOC_FORMAT_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 
 /*
  * INTRODUCTION
@@ -57,6 +60,17 @@
  *                          output list.
  *  TOKEN_RELOC_TYPE_NEXT: a TYPE_CHANGE token with a value of 1 is added to
  *                          the output list.
+ *  TOKEN_RELOC_TYPE_CHG followed by RELOC_EXT_STRIDE_RUN:
+ *                          3 more bytes follow: a gap G no bigger than
+ *                          MAX_STRIDE_GAP, then a 16-bit little-endian count.
+ *                          MIN_STRIDE_RUN is added to the count, and that many
+ *                          NUMBERS, each of value G, are added to the output
+ *                          list. This describes a run of relocs every G + 1
+ *                          words, such as a long GOT or an array of structs
+ *                          holding pointers, in 5 bytes.
+ *                          Loaders that predate it see a type change to a type
+ *                          that does not exist, then G as a NUMBER of that
+ *                          type, and refuse the app.
  *
  *
  * PASS #2 - decoding
@@ -92,6 +106,14 @@
 #define MAX_24_BIT_NUM		(0xFFFFFF + MAX_16_BIT_NUM)
 #define MIN_RUN_LEN		3 //run count does not include first element
 #define MAX_RUN_LEN		(0xff + MIN_RUN_LEN)
+#define RELOC_EXT_STRIDE_RUN	0xFF // TOKEN_RELOC_TYPE_CHG argument that is really an extended token: stride run
+#define MIN_STRIDE_RUN		6 //5 bytes of stride run is break-even against 1-byte numbers
+#define MAX_STRIDE_RUN		(0xffff + MIN_STRIDE_RUN)
+#define MAX_STRIDE_GAP		MAX_8_BIT_NUM //so the gap byte reads as a NUMBER to old loaders
+
+
+//apply the packed relocs in [relStart, relEnd) to mem, adding flashStart or ramStart by type. false if they are malformed
+bool appRelocsApply(const uint8_t *relStart, const uint8_t *relEnd, uint32_t flashStart, uint32_t ramStart, void *mem);
 
 
 
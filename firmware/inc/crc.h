@@ -38,4 +38,10 @@
  */
 uint32_t crc32(const void *buf, size_t size, uint32_t crc);
 
+/**
+ * Copies size bytes from src to dst (which must not overlap) and returns
+ * crc32(src, size, crc), touching the data only once where possible.
+ */
+uint32_t crc32Copy(void *dst, const void *src, size_t size, uint32_t crc);
+
 #endif /* __CRC_H */
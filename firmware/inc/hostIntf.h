@@ -32,7 +32,11 @@ void hostInfClearInterrupt(uint32_t bit);
 void hostIntfSetInterruptMask(uint32_t bit);
 void hostInfClearInterruptMask(uint32_t bit);
 void hostIntfPacketFree(void *ptr);
-bool hostIntfPacketDequeue(void *ptr);
+bool hostIntfPacketDequeue(void *ptr, uint32_t maxLength);
+void hostIntfGetDropCounts(uint32_t *wakeup, uint32_t *nonwakeup);
 void hostIntfSetBusy(bool busy);
+void hostIntfSetParking(bool park); /* park upload requests that come while busy instead of NAKing them */
+void *hostIntfBulkAlloc(uint32_t maxLen, uint32_t *len); /* for a command handler: space sent right after its response */
+void hostIntfBulkCommit(uint32_t len);
 
 #endif /* __HOSTINTF_H */
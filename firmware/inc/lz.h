@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _LZ_H_
+#define _LZ_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * LZ4-style compressed stream, as produced by nanoapp_postprocess -c. It is
+ * a run of sequences, each:
+ *
+ *   token        high nibble: literal count, low nibble: match length - LZ_MIN_MATCH
+ *   [len bytes]  if a nibble is 15, bytes to add to it follow, until one is not 255
+ *   literals
+ *   offset       16-bit LE, 1..LZ_WINDOW_SIZE bytes back in the output
+ *   [len bytes]  for the match length, as above
+ *
+ * The last sequence has only the token and literals; the stream ends right
+ * after them. Unlike LZ4 the window is small so the decoder fits in RAM.
+ */
+
+#define LZ_WINDOW_SIZE      4096    //must be a power of two
+#define LZ_MIN_MATCH        4
+#define LZ_LEN_MORE         15      //nibble value meaning "length bytes follow"
+
+struct LzDecoder {
+    uint8_t *window;       //LZ_WINDOW_SIZE bytes, also the output buffer
+    uint32_t outPos;       //bytes produced so far
+    uint32_t flushedPos;   //bytes handed to the write callback so far
+    uint32_t inLeft;
+    uint32_t outLeft;
+    uint32_t litLen;       //literal bytes still to copy
+    uint32_t matchLen;
+    uint16_t offset;
+    uint8_t state;
+};
+
+typedef bool (*LzWriteF)(void *userData, const void *data, uint32_t len); //return false to abort decoding
+
+void lzDecInit(struct LzDecoder *dec, uint8_t *window, uint32_t compressedLen, uint32_t origLen);
+bool lzDecProcess(struct LzDecoder *dec, const void *data, uint32_t len, LzWriteF writeF, void *writeD); //false on bad data or a failed write
+bool lzDecFinish(struct LzDecoder *dec, LzWriteF writeF, void *writeD); //writes out the rest, true if the stream was complete
+
+#endif
@@ -22,6 +22,7 @@ struct NanohubCommand {
     size_t (*handler)(void *, uint8_t, void *, uint64_t);
     uint8_t minDataLen;
     uint8_t maxDataLen;
+    bool waitIdle; /* while busy: ACK, park the request and run the handler once hostIntf is idle again */
 };
 
 const struct NanohubCommand *nanohubFindCommand(uint32_t packetReason);
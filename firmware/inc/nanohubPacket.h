@@ -66,6 +66,23 @@ static inline struct NanohubPacketFooter *nanohubGetPacketFooter(struct NanohubP
 #define NANOHUB_ACK_PREAMBLE_LEN      16
 #define NANOHUB_PAYLOAD_PREAMBLE_LEN  512
 
+/**
+ * Compact NUM_AXIS_THREE sensor data, sent for sensors the AP enabled with the
+ * compact config flag. Such packets have firstSample.encoding set to
+ * NANOHUB_SENSOR_ENCODING_COMPACT, and after firstSample they contain:
+ *
+ *   float scale
+ *   sample 0: __le16 x, y, z
+ *   sample n: zigzag varint (deltaTime[n] - deltaTime[n-1]), __le16 x, y, z
+ *
+ * Each axis is the int16 value times scale. An x of NANOHUB_COMPACT_ESCAPE means
+ * the sample did not fit the scale; three floats follow instead of y and z.
+ */
+#define NANOHUB_SENSOR_ENCODING_RAW       0
+#define NANOHUB_SENSOR_ENCODING_COMPACT   1
+
+#define NANOHUB_COMPACT_ESCAPE        0x8000
+
 #define NANOHUB_INT_BOOT_COMPLETE     0
 #define NANOHUB_INT_WAKE_COMPLETE     0
 #define NANOHUB_INT_WAKEUP            1
@@ -76,6 +93,20 @@ static inline struct NanohubPacketFooter *nanohubGetPacketFooter(struct NanohubP
 #define NANOHUB_REASON_NAK                    0x00000001
 #define NANOHUB_REASON_NAK_BUSY               0x00000002
 
+/**
+ * Once an upload was started with NANOHUB_FIRMWARE_UPLOAD_FLAG_PARK granted, a
+ * START_FIRMWARE_UPLOAD or FIRMWARE_CHUNK that arrives while the previous
+ * chunk is still being written is ACKed and parked, and the hub goes back to
+ * receiving; other requests (READ_EVENT, ...) are served in the meantime. The
+ * AP collects the parked response by resending the request with the same
+ * reason and seq, or (I2C) by reading without writing first. Until the
+ * response is ready that gets NAK_BUSY carrying the parked seq. An upload
+ * request with a new seq drops responses that were never collected. A new
+ * upload request that finds no room to park is NAKed with NAK_BUSY as before,
+ * and must be resent later. Without the flag every request is NAKed with
+ * NAK_BUSY while the hub is busy.
+ */
+
 /**
  * INFORMATIONAL
  */
@@ -117,14 +148,28 @@ struct NanohubAppInfoResponse {
 
 #define NANOHUB_REASON_START_FIRMWARE_UPLOAD  0x00001040
 
+#define NANOHUB_FIRMWARE_UPLOAD_FLAG_WINDOWED  0x01 /* chunks are staged in RAM and answered with NanohubFirmwareChunkWindowResponse */
+#define NANOHUB_FIRMWARE_UPLOAD_FLAG_RESUME    0x02 /* continue an interrupted upload of the same image if the hub still has it */
+#define NANOHUB_FIRMWARE_UPLOAD_FLAG_PARK      0x04 /* requests sent while the hub is busy are parked, see NANOHUB_REASON_NAK_BUSY */
+
 struct NanohubStartFirmwareUploadRequest {
     __le32 size;
     __le32 crc;
     uint8_t type;
+    uint8_t flags; /* optional, NANOHUB_FIRMWARE_UPLOAD_FLAG_*. Older firmware NAKs requests carrying it */
 } __attribute__((packed));
 
+/*
+ * The fields after 'accepted' are only sent if the request had flags. When
+ * RESUME is granted the host sends its next chunk at resumeOffset; the bytes
+ * before it have been CRC checked and are either in flash or staged for it.
+ * 'written' is how far appSec has got with them (image bytes in flash).
+ */
 struct NanohubStartFirmwareUploadResponse {
     uint8_t accepted;
+    uint8_t flags; /* the ones granted */
+    __le32 resumeOffset;
+    __le32 written;
 } __attribute__((packed));
 
 #define NANOHUB_REASON_FIRMWARE_CHUNK         0x00001041
@@ -141,12 +186,18 @@ enum NanohubFirmwareChunkReply {
     NANOHUB_FIRMWARE_CHUNK_REPLY_RESTART,
     NANOHUB_FIRMWARE_CHUNK_REPLY_CANCEL,
     NANOHUB_FIRMWARE_CHUNK_REPLY_CANCEL_NO_RETRY,
+    NANOHUB_FIRMWARE_CHUNK_REPLY_RESEND_FROM, /* windowed only: continue from nextOffset */
 };
 
 struct NanohubFirmwareChunkResponse {
     uint8_t chunkReply;
 } __attribute__ ((packed));
 
+struct NanohubFirmwareChunkWindowResponse {
+    uint8_t chunkReply;
+    __le32 nextOffset; /* first byte the hub has not accepted yet */
+} __attribute__ ((packed));
+
 #define NANOHUB_REASON_GET_INTERRUPT          0x00001080
 
 struct NanohubGetInterruptRequest {
@@ -178,8 +229,11 @@ struct NanohubUnmaskInterruptResponse {
 
 #define NANOHUB_REASON_READ_EVENT             0x00001090
 
+#define NANOHUB_READ_EVENT_CAP_MULTI          0x01 /* AP understands NanohubReadEventMultiResponse */
+
 struct NanohubReadEventRequest {
     __le64 apBootTime;
+    uint8_t caps; /* optional, NANOHUB_READ_EVENT_CAP_*. Older firmware NAKs requests carrying it */
 } __attribute__((packed));
 
 struct NanohubReadEventResponse {
@@ -187,6 +241,56 @@ struct NanohubReadEventResponse {
     uint8_t evtData[NANOHUB_PACKET_PAYLOAD_MAX - sizeof(__le32)];
 } __attribute__ ((packed));
 
+/**
+ * Sent instead of NanohubReadEventResponse only to an AP that set
+ * NANOHUB_READ_EVENT_CAP_MULTI, whenever more than one queued event fits in the
+ * payload. A lone queued event, or one too large for this layout, still goes out
+ * as a plain NanohubReadEventResponse, so the AP must check evtType first.
+ */
+#define NANOHUB_EVT_MULTI                     0x544C554D /* "MULT" */
+#define NANOHUB_READ_EVENT_MULTI_VERSION      1
+
+struct NanohubReadEventMultiEntry {
+    __le32 evtType;
+    uint8_t len; /* bytes of evtData */
+    uint8_t evtData[0];
+} __attribute__((packed));
+
+struct NanohubReadEventMultiResponse {
+    __le32 evtType; /* NANOHUB_EVT_MULTI */
+    uint8_t version;
+    uint8_t numEvents;
+    uint8_t evtData[NANOHUB_PACKET_PAYLOAD_MAX - sizeof(__le32) - 2 * sizeof(uint8_t)]; /* numEvents x NanohubReadEventMultiEntry */
+} __attribute__((packed));
+
+/**
+ * Drains up to maxBytes of queued events in one bus transaction. The response
+ * packet (with its own CRC) is immediately followed by numFrames frames,
+ * length bytes in total, before the trailing preamble:
+ *
+ *   struct NanohubBulkFrame, uint8_t evtData[len], __le32 crc
+ *
+ * evtData matches NanohubReadEventResponse.evtData, and crc covers the frame
+ * header and evtData. The hub may send less than asked for, or no frames.
+ */
+#define NANOHUB_REASON_READ_EVENTS_BULK       0x00001092
+
+struct NanohubReadEventsBulkRequest {
+    __le64 apBootTime;
+    __le32 maxBytes;
+} __attribute__((packed));
+
+struct NanohubReadEventsBulkResponse {
+    __le32 length;
+    __le16 numFrames;
+} __attribute__((packed));
+
+struct NanohubBulkFrame {
+    __le32 evtType;
+    uint8_t len;
+    uint8_t evtData[0];
+} __attribute__((packed));
+
 #define NANOHUB_REASON_WRITE_EVENT            0x00001091
 
 struct NanohubWriteEventRequest {
@@ -105,7 +105,9 @@ union OsApiSlabItem { //main OS "things" slab must fit this
 #define SYSCALL_OS_MAIN_SENSOR_RELEASE       7 // (uint32_t clientId, uint32_t sensorHandle) -> bool success
 #define SYSCALL_OS_MAIN_SENSOR_TRIGGER       8 // (uint32_t clientId, uint32_t sensorHandle) -> bool success
 #define SYSCALL_OS_MAIN_SENSOR_GET_RATE      9 // (uint32_t sensorHandle) -> uint32_t rate
-#define SYSCALL_OS_MAIN_SENSOR_LAST         10 // always last. holes are allowed, but not immediately before this
+#define SYSCALL_OS_MAIN_SENSOR_BATCH        10 // (uint32_t handle, uint32_t time_lo, uint32_t time_hi, const void *sample) -> bool success
+#define SYSCALL_OS_MAIN_SENSOR_BATCH_FLUSH  11 // (uint32_t handle) -> bool success
+#define SYSCALL_OS_MAIN_SENSOR_LAST         12 // always last. holes are allowed, but not immediately before this
 
 //level 3 indices in the OS.main.timer table
 #define SYSCALL_OS_MAIN_TIME_GET_TIME     0 // (uint64_t *timeNanos) -> void
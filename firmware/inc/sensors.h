@@ -27,8 +27,9 @@ extern "C" {
 #include <eventnums.h>
 #include <sensType.h>
 
-#define MAX_REGISTERED_SENSORS  32 /* this may need to be revisted later */
+#define MAX_REGISTERED_SENSORS  64 /* lookups are indexed, so this only costs RAM. must stay under 255 */
 #define MAX_MIN_SAMPLES         3000
+#define SENSOR_BATCH_MAX_SAMPLES 128 /* cap on a framework batching ring (sensorBatchSample()), also keeps one delivery under 256 samples */
 
 enum NumAxis {
     NUM_AXIS_EMBEDDED = 0,   // data = (uint32_t)evtData
@@ -44,7 +45,7 @@ struct SensorFirstSample
     uint8_t biasCurrent : 1;
     uint8_t biasPresent : 1;
     uint8_t biasSample : 6;
-    uint8_t pad;
+    uint8_t encoding; /* only used in host-bound packets (NANOHUB_SENSOR_ENCODING_*), 0 everywhere else */
 };
 
 // NUM_AXIS_EMBEDDED data format
@@ -172,8 +173,11 @@ struct SensorInfo {
     uint8_t numAxis; /* enum NumAxis */
     uint8_t interrupt; /* interrupt to generate to AP */
     uint16_t minSamples; /* minimum host fifo size (in # of samples) */
+    uint8_t flags1; /* SENSOR_INFO_FLAGS1_* */
 };
 
+#define SENSOR_INFO_FLAGS1_DECIM_AVG   0x01 /* float data: average dropped samples when decimating for slower clients */
+
 
 /*
  * Sensor rate is encoded as a 32-bit integer as number of samples it can
@@ -198,6 +202,7 @@ struct SensorInfo {
  * sensors module api
  */
 bool sensorsInit(void);
+const void* sensorDecimateForClient(uint32_t clientTid, uint32_t evtType, const void *evtData); /* NULL -> client gets nothing. result valid until next call */
 
 /*
  * Api for sensor drivers
@@ -211,6 +216,8 @@ uint32_t sensorRegisterAsApp(const struct SensorInfo *si, uint32_t tid, void *ca
 bool sensorRegisterInitComplete(uint32_t handle);
 bool sensorUnregister(uint32_t handle); /* your job to be sure it is off already */
 bool sensorSignalInternalEvt(uint32_t handle, uint32_t intEvtNum, uint32_t value1, uint64_t value2);
+bool sensorBatchSample(uint32_t handle, uint64_t time, const void *sample); /* framework batching for NUM_AXIS_ONE/THREE sensors. sample is the data part of one point (no deltaTime). task context only */
+bool sensorBatchFlush(uint32_t handle); /* deliver what sensorBatchSample() holds now, e.g. ahead of a flush marker or bias event. task context only */
 
 #define sensorGetMyEventType(_sensorType) (EVT_NO_FIRST_SENSOR_EVENT + (_sensorType))
 
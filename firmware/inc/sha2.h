@@ -17,12 +17,11 @@
 #ifndef _SHA2_H_
 #define _SHA2_H_
 
-//this is neither the fastest nor the smallest. but it is simple and matches the spec. cool.
+//this is not the smallest, but whole blocks are hashed straight from the caller's buffer with an unrolled core (or SHA-NI on hosts built with -msha)
 
 #include <stdint.h>
 
 #define SHA2_BLOCK_SIZE         64 //in bytes
-#define SHA2_WORDS_STATE_SIZE   64 //in words
 
 #define SHA2_HASH_SIZE          32 //in bytes
 #define SHA2_HASH_WORDS         8  //in words
@@ -31,7 +30,7 @@ struct Sha2state {
     uint32_t h[8];
     uint64_t msgLen;
     union {
-        uint32_t w[SHA2_WORDS_STATE_SIZE];
+        uint32_t w[SHA2_BLOCK_SIZE / sizeof(uint32_t)];
         uint8_t b[SHA2_BLOCK_SIZE];
     };
     uint8_t bufBytesUsed;
@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef _SIG_CACHE_H_
+#define _SIG_CACHE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Remembers which signed images already passed the RSA chain, so re-uploading
+ * one of them needs only its hash. The table is a segment in the shared flash
+ * area, rewritten next to the app index after each verified upload. It holds
+ * at most SIG_CACHE_MAX_ENTRIES (image hash, root key hash) pairs, newest
+ * first, and is tied to a hash of all of .pubkeys: any change to the built-in
+ * keys makes every cached result void.
+ */
+
+#define SIG_CACHE_SEG_ID        0x9        /* next to APP_INDEX_SEG_ID, the bootloader ignores it */
+#define SIG_CACHE_MAX_ENTRIES   8
+
+//true if imageHash was verified against a root key we still have, *rootKeyHash is the hash of that key
+bool sigCacheFind(const uint32_t *imageHash, uint32_t *rootKeyHash);
+
+//append a table at 'at' (the end of the log) with the given pair first, followed by what is still valid of the old one
+bool sigCacheWrite(uint8_t *at, const uint32_t *imageHash, const uint32_t *rootKeyHash);
+
+#endif
@@ -32,6 +32,7 @@ struct SimpleQueue* simpleQueueAlloc(uint32_t numEntries, uint32_t entrySz, Simp
 void simpleQueueDestroy(struct SimpleQueue* sq); //will call discard, but in no particular order!
 bool simpleQueueEnqueue(struct SimpleQueue* sq, const void *data, bool possiblyDiscardable);
 bool simpleQueueDequeue(struct SimpleQueue* sq, void *dataVal);
+const void* simpleQueuePeek(struct SimpleQueue* sq); //consumer only: oldest entry in place, or NULL if empty. valid until next dequeue/enqueue
 
 
 #endif
@@ -190,6 +190,19 @@ static inline uint32_t eOsSensorGetCurRate(uint32_t sensorHandle)
     return syscallDo1P(SYSCALL_NO(SYSCALL_DOMAIN_OS, SYSCALL_OS_MAIN, SYSCALL_OS_MAIN_SENSOR, SYSCALL_OS_MAIN_SENSOR_GET_RATE), sensorHandle);
 }
 
+static inline bool eOsSensorBatchSample(uint32_t handle, uint64_t time, const void *sample)
+{
+    uint32_t time_lo = time;
+    uint32_t time_hi = time >> 32;
+
+    return syscallDo4P(SYSCALL_NO(SYSCALL_DOMAIN_OS, SYSCALL_OS_MAIN, SYSCALL_OS_MAIN_SENSOR, SYSCALL_OS_MAIN_SENSOR_BATCH), handle, time_lo, time_hi, sample);
+}
+
+static inline bool eOsSensorBatchFlush(uint32_t handle)
+{
+    return syscallDo1P(SYSCALL_NO(SYSCALL_DOMAIN_OS, SYSCALL_OS_MAIN, SYSCALL_OS_MAIN_SENSOR, SYSCALL_OS_MAIN_SENSOR_BATCH_FLUSH), handle);
+}
+
 static inline uint64_t eOsTimGetTime(void)
 {
     uint64_t timeNanos;
@@ -131,25 +131,8 @@ static const uint32_t RevTab0[] = { //other 3 tables are this same table, RORed
     0x39A80171, 0x080CB3DE, 0xD8B4E49C, 0x6456C190, 0x7BCB8461, 0xD532B670, 0x486C5C74, 0xD0B85742,
 };
 
-#ifdef ARM
-
-    #define STRINFIGY2(b) #b
-    #define STRINGIFY(b) STRINFIGY2(b)
-    #define ror(v, b) ({uint32_t ret; if (b) asm("ror %0, #" STRINGIFY(b) :"=r"(ret):"0"(v)); else ret = v; ret;})
-
-#else
-
-    inline static uint32_t ror(uint32_t val, uint32_t by)
-    {
-        if (!by)
-            return val;
-
-        val = (val >> by) | (val << (32 - by));
-
-        return val;
-    }
-
-#endif
+//plain C so the compiler can fold the rotate into the eor (ARM's barrel shifter makes it free). ror(v, 0) is v
+#define ror(v, b) (((v) >> (b)) | ((v) << ((32 - (b)) & 31)))
 
 
 void aesInitForEncr(struct AesContext *ctx, const uint32_t *k)
@@ -368,14 +351,23 @@ void aesCbcEncr(struct AesCbcContext *ctx, const uint32_t *src, uint32_t *dst)
 
 void aesCbcDecr(struct AesCbcContext *ctx, const uint32_t *src, uint32_t *dst)
 {
-    uint32_t i, tmp[AES_BLOCK_WORDS];
+    aesCbcDecrBlocks(ctx, src, dst, 1);
+}
 
-    aesDecr(&ctx->aes, src, tmp);
-    for (i = 0; i < AES_BLOCK_WORDS; i++)
-        tmp[i] ^= ctx->iv[i];
+void aesCbcDecrBlocks(struct AesCbcContext *ctx, const uint32_t *src, uint32_t *dst, uint32_t numBlocks)
+{
+    uint32_t i, ct[AES_BLOCK_WORDS];
 
-    memcpy(ctx->iv, src, sizeof(uint32_t[AES_BLOCK_WORDS]));
-    memcpy(dst, tmp, sizeof(uint32_t[AES_BLOCK_WORDS]));
+    for (; numBlocks; numBlocks--, src += AES_BLOCK_WORDS, dst += AES_BLOCK_WORDS) {
+
+        //keep the ciphertext, it is the next block's iv and dst may overwrite it
+        memcpy(ct, src, sizeof(uint32_t[AES_BLOCK_WORDS]));
+        aesDecr(&ctx->aes, ct, dst);
+        for (i = 0; i < AES_BLOCK_WORDS; i++) {
+            dst[i] ^= ctx->iv[i];
+            ctx->iv[i] = ct[i];
+        }
+    }
 }
 
 
@@ -0,0 +1,153 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <plat/inc/bl.h>
+#include <string.h>
+
+#include <appIndex.h>
+#include <crc.h>
+#include <heap.h>
+#include <mpu.h>
+#include <seos.h>
+
+extern char __shared_start[];
+extern char __shared_end[];
+
+static uint32_t appIndexSegLen(const uint8_t *seg)
+{
+    return (seg[1] << 16) | (seg[2] << 8) | seg[3];
+}
+
+static uint32_t appIndexSegCrc(const uint8_t *seg)
+{
+    uint32_t crc;
+
+    memcpy(&crc, seg + appIndexSegSize(seg) - sizeof(uint32_t), sizeof(crc));
+    return crc;
+}
+
+static bool appIndexIsApp(const uint8_t *seg)
+{
+    return seg[0] == ((BL_FLASH_APP_ID << 4) | BL_FLASH_APP_ID);
+}
+
+uint32_t appIndexSegSize(const uint8_t *seg)
+{
+    return sizeof(uint32_t) + ((appIndexSegLen(seg) + 3) & ~3) + sizeof(uint32_t);
+}
+
+const struct AppIndexEntry *appIndexFind(uint32_t *numEntries)
+{
+    uint8_t *shared_end = (uint8_t *)&__shared_end;
+    const uint8_t *shared, *index = NULL;
+
+    //only headers are read, and the CRC of index segments, which are small
+    for (shared = (uint8_t *)&__shared_start;
+         shared < shared_end && shared[0] != 0xFF && shared + appIndexSegSize(shared) <= shared_end;
+         shared += appIndexSegSize(shared)) {
+        if (shared[0] == ((APP_INDEX_SEG_ID << 4) | APP_INDEX_SEG_ID) && crc32(shared, appIndexSegSize(shared), ~0) == CRC_RESIDUE)
+            index = shared;
+    }
+
+    if (!index)
+        return NULL;
+
+    *numEntries = appIndexSegLen(index) / sizeof(struct AppIndexEntry);
+    return (const struct AppIndexEntry *)(index + sizeof(uint32_t));
+}
+
+bool appIndexIsVerified(const struct AppIndexEntry *index, uint32_t numEntries, const uint8_t *seg)
+{
+    uint32_t i, offset = seg - (uint8_t *)&__shared_start;
+
+    for (i = 0; i < numEntries; i++) {
+        if (index[i].offset == offset)
+            return index[i].status == APP_INDEX_VERIFIED && index[i].len == appIndexSegLen(seg) && index[i].crc == appIndexSegCrc(seg);
+    }
+
+    return false;
+}
+
+bool appIndexWrite(uint8_t *at, const uint8_t *verifiedSeg)
+{
+    uint8_t *shared_start = (uint8_t *)&__shared_start;
+    uint8_t *shared_end = (uint8_t *)&__shared_end;
+    const struct AppIndexEntry *old;
+    struct AppIndexEntry *entries;
+    const struct AppHdr *app;
+    uint32_t numOld = 0, num = 0, len, crc;
+    uint8_t *shared, *buf;
+    int ret;
+
+    old = appIndexFind(&numOld);
+
+    for (shared = shared_start; shared < at; shared += appIndexSegSize(shared))
+        if (appIndexIsApp(shared))
+            num++;
+
+    len = num * sizeof(struct AppIndexEntry);
+    if (at + sizeof(uint32_t) + len + sizeof(uint32_t) > shared_end)
+        return false;
+
+    buf = heapAlloc(sizeof(uint32_t) + len + sizeof(uint32_t));
+    if (!buf)
+        return false;
+
+    buf[0] = (APP_INDEX_SEG_ID << 4) | APP_INDEX_SEG_ID;
+    buf[1] = len >> 16;
+    buf[2] = len >> 8;
+    buf[3] = len;
+
+    entries = (struct AppIndexEntry *)(buf + sizeof(uint32_t));
+    for (shared = shared_start; shared < at; shared += appIndexSegSize(shared)) {
+        if (!appIndexIsApp(shared))
+            continue;
+
+        app = (const struct AppHdr *)(shared + sizeof(uint32_t));
+        entries->appId = appIndexSegLen(shared) >= sizeof(struct AppHdr) ? app->appId : 0;
+        entries->offset = shared - shared_start;
+        entries->len = appIndexSegLen(shared);
+        entries->crc = appIndexSegCrc(shared);
+        entries->status = (shared == verifiedSeg || appIndexIsVerified(old, numOld, shared)) ? APP_INDEX_VERIFIED : 0;
+        entries++;
+    }
+
+    crc = ~crc32(buf, sizeof(uint32_t) + len, ~0);
+    memcpy(buf + sizeof(uint32_t) + len, &crc, sizeof(crc));
+
+    mpuAllowRamExecution(true);
+    mpuAllowRomWrite(true);
+    ret = BL.blProgramShared(at, buf, sizeof(uint32_t) + len + sizeof(uint32_t), BL_FLASH_KEY1, BL_FLASH_KEY2);
+    mpuAllowRomWrite(false);
+    mpuAllowRamExecution(false);
+
+    heapFree(buf);
+
+    return ret >= 0;
+}
+
+void appIndexInvalidate(const uint8_t *seg)
+{
+    // clearing the upper nibble of the type is how the bootloader marks segments erased too
+    uint8_t erased = seg[0] & 0x0F;
+
+    mpuAllowRamExecution(true);
+    mpuAllowRomWrite(true);
+    BL.blProgramShared((uint8_t *)seg, &erased, 1, BL_FLASH_KEY1, BL_FLASH_KEY2);
+    mpuAllowRomWrite(false);
+    mpuAllowRamExecution(false);
+}
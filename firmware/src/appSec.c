@@ -21,11 +21,13 @@
 #include <sha2.h>
 #include <rsa.h>
 #include <aes.h>
+#include <lz.h>
 
 
 #define APP_HDR_SIZE                32                                    //headers are this size
 #define APP_DATA_CHUNK_SIZE         (AES_BLOCK_WORDS * sizeof(uint32_t))  //data blocks are this size
 #define APP_SIG_SIZE                RSA_BYTES
+#define APP_DATA_BATCH_SIZE         1024                                  //app data is hashed, decrypted and written out in runs of up to this size
 
 #define RSA_WORDS                   (RSA_BYTES / sizeof(uint32_t))
 
@@ -49,17 +51,23 @@ struct AppSecState {
         };
         struct RsaState rsa;
     };
-    uint32_t rsaTmp[RSA_WORDS];
+    uint32_t rsaTmp[RSA_WORDS];       //when the sig cache vouches for the image, holds the expected root key hash instead
     uint32_t lastHash[SHA2_HASH_WORDS];
+    uint32_t imageHash[SHA2_HASH_WORDS];
+    struct LzDecoder lz;              //window is only allocated for compressed apps
+    AppSecErr lzWriteErr;
 
     AppSecWriteCbk writeCbk;
     AppSecPubKeyFindCbk pubKeyFindCbk;
     AppSecGetAesKeyCbk aesKeyAccessCbk;
+    AppSecSigCacheFindCbk sigCacheFindCbk;
+    AppSecSizeCbk sizeCbk;
 
     union {
         union { //make the compiler work to make sure we have enough space
             uint8_t placeholderAppHdr[APP_HDR_SIZE];
             uint8_t placeholderDataChunk[APP_DATA_CHUNK_SIZE];
+            uint8_t placeholderDataBatch[APP_DATA_BATCH_SIZE];
             uint8_t placeholderSigChunk[APP_SIG_SIZE];
             uint8_t placeholderAesKey[AES_KEY_WORDS * sizeof(uint32_t)];
         };
@@ -78,6 +86,9 @@ struct AppSecState {
     uint8_t needSig    :1;
     uint8_t haveSig    :1;
     uint8_t haveEncr   :1;
+    uint8_t sigCached  :1;    //image hash was verified before, signatures are only checked for shape and root
+    uint8_t sigChecked :1;    //signature chain was checked with RSA
+    uint8_t haveComp   :1;
 };
 
 struct AppSecSigHdr {
@@ -86,6 +97,12 @@ struct AppSecSigHdr {
     uint32_t numSigs;
 };
 
+struct AppSecCompHdr {
+    uint8_t magic[8];
+    uint32_t compressedLen;
+    uint32_t origLen;
+};
+
 struct AppSecEncrHdr {
     uint8_t magic[4];
     uint32_t dataLen;
@@ -94,7 +111,7 @@ struct AppSecEncrHdr {
 };
 
 //init/deinit
-struct AppSecState *appSecInit(AppSecWriteCbk writeCbk, AppSecPubKeyFindCbk pubKeyFindCbk, AppSecGetAesKeyCbk aesKeyAccessCbk, bool mandateSigning)
+struct AppSecState *appSecInit(AppSecWriteCbk writeCbk, AppSecPubKeyFindCbk pubKeyFindCbk, AppSecGetAesKeyCbk aesKeyAccessCbk, AppSecSigCacheFindCbk sigCacheFindCbk, AppSecSizeCbk sizeCbk, bool mandateSigning)
 {
     struct AppSecState *state = heapAlloc(sizeof(struct AppSecState));
 
@@ -106,6 +123,8 @@ struct AppSecState *appSecInit(AppSecWriteCbk writeCbk, AppSecPubKeyFindCbk pubK
     state->writeCbk = writeCbk;
     state->pubKeyFindCbk = pubKeyFindCbk;
     state->aesKeyAccessCbk = aesKeyAccessCbk;
+    state->sigCacheFindCbk = sigCacheFindCbk;
+    state->sizeCbk = sizeCbk;
     state->curState = STATE_INIT;
     if (mandateSigning)
         state->needSig = 1;
@@ -115,6 +134,8 @@ struct AppSecState *appSecInit(AppSecWriteCbk writeCbk, AppSecPubKeyFindCbk pubK
 
 void appSecDeinit(struct AppSecState *state)
 {
+    if (state->lz.window)
+        heapFree(state->lz.window);
     heapFree(state);
 }
 
@@ -142,8 +163,7 @@ static AppSecErr appSecBlockRx(struct AppSecState *state)
     //decrypt if encryption is on
     if (state->haveEncr) {
 
-        uint32_t *dataP = state->dataWords;
-        uint32_t i, numBlocks = state->haveBytes / APP_DATA_CHUNK_SIZE;
+        uint32_t numBlocks = state->haveBytes / APP_DATA_CHUNK_SIZE;
 
         //we should not be called with partial encr blocks
         if (state->haveBytes % APP_DATA_CHUNK_SIZE)
@@ -155,8 +175,7 @@ static AppSecErr appSecBlockRx(struct AppSecState *state)
         state->encryptedBytesIn -= state->haveBytes;
 
         //decrypt
-        for (i = 0; i < numBlocks; i++, dataP += AES_BLOCK_WORDS)
-            aesCbcDecr(&state->cbc, dataP, dataP);
+        aesCbcDecrBlocks(&state->cbc, state->dataWords, state->dataWords, numBlocks);
 
         //make sure we do not produce too much data (discard padding) & make sure we account for it
         if (state->encryptedBytesOut < state->haveBytes)
@@ -174,6 +193,7 @@ static AppSecErr appSecProcessIncomingHdr(struct AppSecState *state, bool *sendD
     static const char hdrNanoApp[] = "GoogleNanoApp\x00\xff\xff"; //we check marker is set to 0xFF and version set to 0, as we must as per spec
     static const char hdrEncrHdr[] = "Encr";
     static const char hdrSigHdr[] = "SigndApp";
+    static const char hdrCompHdr[] = "PackdApp";
 
     //check for signature header
     if (!memcmp(state->dataBytes, hdrSigHdr, sizeof(hdrSigHdr) - 1)) {
@@ -223,6 +243,39 @@ static AppSecErr appSecProcessIncomingHdr(struct AppSecState *state, bool *sendD
         return APP_SEC_NO_ERROR;
     }
 
+    //check for compression header: what follows is decompressed on the way to the caller
+    if (!memcmp(state->dataBytes, hdrCompHdr, sizeof(hdrCompHdr) - 1)) {
+
+        struct AppSecCompHdr *compHdr = (struct AppSecCompHdr*)state->dataBytes;
+        uint8_t *window;
+
+        if (state->haveComp) //we do not allow compression of already-compressed data
+            return APP_SEC_INVALID_DATA;
+
+        if (!compHdr->compressedLen || !compHdr->origLen)
+            return APP_SEC_INVALID_DATA;
+
+        if (!state->haveSig && state->needSig)
+            return APP_SEC_SIG_VERIFY_FAIL;
+
+        //the upload size only covers the compressed stream, let the caller make room for what we will write
+        if (state->sizeCbk) {
+            AppSecErr ret = state->sizeCbk(compHdr->origLen);
+            if (ret)
+                return ret;
+        }
+
+        window = heapAlloc(LZ_WINDOW_SIZE);
+        if (!window)
+            return APP_SEC_MEMORY_ERROR;
+
+        lzDecInit(&state->lz, window, compHdr->compressedLen, compHdr->origLen);
+        state->haveComp = 1;
+        state->curState = STATE_RXING_DATA;
+
+        return APP_SEC_NO_ERROR;
+    }
+
     //check for valid app or something else that we pass directly to caller
     if (memcmp(state->dataBytes, hdrAddEncrKey, sizeof(hdrAddEncrKey) - 1) && memcmp(state->dataBytes, hdrDelEncrKey, sizeof(hdrDelEncrKey) - 1) && memcmp(state->dataBytes, hdrNanoApp, sizeof(hdrNanoApp) - 1))
         return APP_SEC_HEADER_ERROR;
@@ -239,6 +292,14 @@ static AppSecErr appSecProcessIncomingHdr(struct AppSecState *state, bool *sendD
     return APP_SEC_NO_ERROR;
 }
 
+static bool appSecLzWrite(void *userData, const void *data, uint32_t len)
+{
+    struct AppSecState *state = (struct AppSecState*)userData;
+
+    state->lzWriteErr = state->writeCbk(data, len);
+    return state->lzWriteErr == APP_SEC_NO_ERROR;
+}
+
 static AppSecErr appSecProcessIncomingData(struct AppSecState *state)
 {
     //check for data-ending conditions
@@ -249,6 +310,11 @@ static AppSecErr appSecProcessIncomingData(struct AppSecState *state)
 
         //collect the hash
         memcpy(state->lastHash, sha2finish(&state->sha), SHA2_HASH_SIZE);
+        memcpy(state->imageHash, state->lastHash, SHA2_HASH_SIZE);
+
+        //an image we already verified needs no RSA, as long as it comes with the same root key
+        if (state->sigCacheFindCbk && state->sigCacheFindCbk(state->imageHash, state->rsaTmp))
+            state->sigCached = 1;
     }
     else if (state->haveEncr && !state->encryptedBytesIn) { //we're all done with encrypted bytes
         if (state->haveSig && state->signedBytesIn)           //somehow we still have more "signed" bytes now - this is not valid
@@ -256,7 +322,14 @@ static AppSecErr appSecProcessIncomingData(struct AppSecState *state)
         state->curState = STATE_DONE;
     }
 
-    //pass to caller
+    //pass to caller, decompressing first if need be
+    if (state->haveComp) {
+        state->lzWriteErr = APP_SEC_NO_ERROR;
+        if (!lzDecProcess(&state->lz, state->dataBytes, state->haveBytes, appSecLzWrite, state))
+            return state->lzWriteErr != APP_SEC_NO_ERROR ? state->lzWriteErr : APP_SEC_INVALID_DATA;
+        return APP_SEC_NO_ERROR;
+    }
+
     return state->writeCbk(state->dataBytes, state->haveBytes);
 }
 
@@ -271,7 +344,8 @@ static AppSecErr appSecProcessIncomingSigData(struct AppSecState *state)
             return APP_SEC_TOO_MUCH_DATA;
 
         state->numSigs--;
-        memcpy(state->rsaTmp, state->dataWords, APP_SIG_SIZE);
+        if (!state->sigCached)
+            memcpy(state->rsaTmp, state->dataWords, APP_SIG_SIZE);
         state->curState = STATE_RXING_SIG_PUBKEY;
         return APP_SEC_NO_ERROR;
     }
@@ -288,6 +362,22 @@ static AppSecErr appSecProcessIncomingSigData(struct AppSecState *state)
             return APP_SEC_SIG_ROOT_UNKNOWN;
     }
 
+    //cached: skip the intermediate keys, the root must be the one the image was verified against
+    if (state->sigCached) {
+        if (state->numSigs) {
+            state->curState = STATE_RXING_SIG_HASH;
+            return APP_SEC_NO_ERROR;
+        }
+
+        sha2init(&state->sha);
+        sha2processBytes(&state->sha, state->dataBytes, APP_SIG_SIZE);
+        if (memcmp(state->rsaTmp, sha2finish(&state->sha), SHA2_HASH_SIZE))
+            return APP_SEC_SIG_VERIFY_FAIL;
+
+        state->curState = STATE_DONE;
+        return APP_SEC_NO_ERROR;
+    }
+
     //we now have the pubKey. decrypt.
     result = rsaPubOp(&state->rsa, state->rsaTmp, state->dataWords);
 
@@ -317,30 +407,69 @@ static AppSecErr appSecProcessIncomingSigData(struct AppSecState *state)
     if (memcmp(state->lastHash, result, SHA2_HASH_SIZE))
         return APP_SEC_SIG_VERIFY_FAIL;
 
-    //hash the provided pubkey if it is not the last
-    if (state->numSigs) {
-        sha2init(&state->sha);
-        sha2processBytes(&state->sha, state->dataBytes, APP_SIG_SIZE);
-        memcpy(state->lastHash, sha2finish(&state->sha), SHA2_HASH_SIZE);
+    //hash the provided pubkey: the next signature must be of it, or if it is the root, it is kept for the sig cache
+    sha2init(&state->sha);
+    sha2processBytes(&state->sha, state->dataBytes, APP_SIG_SIZE);
+    memcpy(state->lastHash, sha2finish(&state->sha), SHA2_HASH_SIZE);
+    if (state->numSigs)
         state->curState = STATE_RXING_SIG_HASH;
-    }
-    else
+    else {
+        state->sigChecked = 1;
         state->curState = STATE_DONE;
+    }
 
     return APP_SEC_NO_ERROR;
 }
 
+static uint32_t appSecDataBatchSize(const struct AppSecState *state) //how much data to gather before processing it
+{
+    uint32_t want = APP_DATA_BATCH_SIZE;
+
+    //never gather past the end of the signed or encrypted region, the signatures follow it (both are APP_DATA_CHUNK_SIZE aligned)
+    if (state->haveSig && want > state->signedBytesIn)
+        want = state->signedBytesIn;
+    if (state->haveEncr && want > state->encryptedBytesIn)
+        want = state->encryptedBytesIn;
+
+    return want;
+}
+
 AppSecErr appSecRxData(struct AppSecState *state, const void *dataP, uint32_t len)
 {
     const uint8_t *data = (const uint8_t*)dataP;
     AppSecErr ret = APP_SEC_NO_ERROR;
     bool sendToDataHandler = false;
+    uint32_t want, copy;
 
     if (state->curState == STATE_INIT)
         state->curState = STATE_RXING_HEADERS;
 
-    while (len--) {
+    while (len && ret == APP_SEC_NO_ERROR) {
+
+        //app data is gathered in bulk so it is hashed, decrypted and written in as few calls as possible
+        if (state->curState == STATE_RXING_DATA) {
+            want = appSecDataBatchSize(state);
+            copy = want - state->haveBytes;
+            if (copy > len)
+                copy = len;
+
+            memcpy(state->dataBytes + state->haveBytes, data, copy);
+            state->haveBytes += copy;
+            data += copy;
+            len -= copy;
+
+            if (state->haveBytes == want) {
+                ret = appSecBlockRx(state);
+                if (ret == APP_SEC_NO_ERROR)
+                    ret = appSecProcessIncomingData(state);
+                state->haveBytes = 0;
+            }
+            continue;
+        }
+
+        //headers and signatures are small and go a byte at a time
         state->dataBytes[state->haveBytes++] = *data++;
+        len--;
         switch (state->curState) {
 
         case STATE_RXING_HEADERS:
@@ -353,31 +482,13 @@ AppSecErr appSecRxData(struct AppSecState *state, const void *dataP, uint32_t le
                 ret = appSecProcessIncomingHdr(state, &sendToDataHandler);
                 if (ret != APP_SEC_NO_ERROR)
                     break;
-                if (!sendToDataHandler) {
-                    state->haveBytes = 0;
-                    break;
-                }
-                //fallthrough
-            }
-            else
-                break;
-
-        case STATE_RXING_DATA:
-            if (state->haveBytes >= APP_DATA_CHUNK_SIZE) {
 
-                //if data is already processed, do not re-process it
-                if (sendToDataHandler)
+                //the app header is already processed, pass it on as is
+                if (sendToDataHandler) {
                     sendToDataHandler = false;
-                else {
-                    ret = appSecBlockRx(state);
-                    if (ret != APP_SEC_NO_ERROR)
-                        break;
+                    ret = appSecProcessIncomingData(state);
                 }
-
-                ret = appSecProcessIncomingData(state);
                 state->haveBytes = 0;
-                if (ret != APP_SEC_NO_ERROR)
-                    break;
             }
             break;
 
@@ -432,6 +543,15 @@ AppSecErr appSecRxDataOver(struct AppSecState *state)
     if (!state->haveSig && !state->haveEncr && state->curState == STATE_RXING_DATA)
         state->curState = STATE_DONE;
 
+    //compressed data is written out as the window fills, the last of it goes now
+    if (state->curState == STATE_DONE && state->haveComp) {
+        state->lzWriteErr = APP_SEC_NO_ERROR;
+        if (!lzDecFinish(&state->lz, appSecLzWrite, state)) {
+            state->curState = STATE_BAD;
+            return state->lzWriteErr != APP_SEC_NO_ERROR ? state->lzWriteErr : APP_SEC_TOO_LITTLE_DATA;
+        }
+    }
+
     //Check the state and return our verdict
     if(state->curState == STATE_DONE)
         return APP_SEC_NO_ERROR;
@@ -440,6 +560,15 @@ AppSecErr appSecRxDataOver(struct AppSecState *state)
     return APP_SEC_TOO_LITTLE_DATA;
 }
 
+bool appSecGetVerifiedSig(struct AppSecState *state, uint32_t *imageHash, uint32_t *rootKeyHash)
+{
+    if (state->curState != STATE_DONE || !state->sigChecked)
+        return false;
+
+    memcpy(imageHash, state->imageHash, SHA2_HASH_SIZE);
+    memcpy(rootKeyHash, state->lastHash, SHA2_HASH_SIZE);
+    return true;
+}
 
 
 
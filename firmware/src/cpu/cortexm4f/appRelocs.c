@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cpu/inc/appRelocFormat.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+
+//reloc types for this cpu type
+#define NANO_RELOC_TYPE_RAM	0
+#define NANO_RELOC_TYPE_FLASH	1
+
+
+//relocate 'count' words, each 'gap' words past the one before (the first is 'gap' words past *ofstP)
+static bool handleRelRun(uint32_t *ofstP, uint32_t type, uint32_t flashAddr, uint32_t ramAddr, uint32_t *mem, uint32_t gap, uint32_t count)
+{
+    uint32_t base, where;
+
+    switch (type) {
+
+    case NANO_RELOC_TYPE_RAM:
+        base = ramAddr;
+        break;
+
+    case NANO_RELOC_TYPE_FLASH:
+        base = flashAddr;
+        break;
+
+    default:
+        return false;
+    }
+
+    where = *ofstP;
+
+    if (!gap) {
+        while (count--)
+            mem[where++] += base;
+    } else {
+        while (count--) {
+            where += gap;
+            mem[where++] += base;
+        }
+    }
+
+    *ofstP = where;
+
+    return true;
+}
+
+bool appRelocsApply(const uint8_t *relStart, const uint8_t *relEnd, uint32_t flashStart, uint32_t ramStart, void *mem)
+{
+    uint32_t ofst = 0;
+    uint32_t type = 0;
+
+    while (relStart != relEnd) {
+
+        uint32_t rel = *relStart++;
+
+        if (rel <= MAX_8_BIT_NUM) {
+
+            if (!handleRelRun(&ofst, type, flashStart, ramStart, mem, rel, 1))
+                return false;
+        }
+        else switch (rel) {
+
+        case TOKEN_32BIT_OFST:
+            if (relEnd - relStart < 4)
+                return false;
+            rel = *(uint32_t*)relStart;
+            relStart += sizeof(uint32_t);
+            if (!handleRelRun(&ofst, type, flashStart, ramStart, mem, rel, 1))
+                return false;
+            break;
+
+        case TOKEN_24BIT_OFST:
+            if (relEnd - relStart < 3)
+                return false;
+            rel = *(uint16_t*)relStart;
+            relStart += sizeof(uint16_t);
+            rel += ((uint32_t)(*relStart++)) << 16;
+            if (!handleRelRun(&ofst, type, flashStart, ramStart, mem, rel + MAX_16_BIT_NUM, 1))
+                return false;
+            break;
+
+        case TOKEN_16BIT_OFST:
+            if (relEnd - relStart < 2)
+                return false;
+            rel = *(uint16_t*)relStart;
+            relStart += sizeof(uint16_t);
+            if (!handleRelRun(&ofst, type, flashStart, ramStart, mem, rel + MAX_8_BIT_NUM, 1))
+                return false;
+            break;
+
+        case TOKEN_CONSECUTIVE:
+            if (relEnd - relStart < 1)
+                return false;
+            rel = *relStart++;
+            if (!handleRelRun(&ofst, type, flashStart, ramStart, mem, 0, rel + MIN_RUN_LEN))
+                return false;
+            break;
+
+        case TOKEN_RELOC_TYPE_CHG:
+            if (relEnd - relStart < 1)
+                return false;
+            rel = *relStart++;
+            if (rel == RELOC_EXT_STRIDE_RUN) {
+                if (relEnd - relStart < 3)
+                    return false;
+                rel = *relStart++;
+                if (rel > MAX_STRIDE_GAP)
+                    return false;
+                if (!handleRelRun(&ofst, type, flashStart, ramStart, mem, rel, *(uint16_t*)relStart + MIN_STRIDE_RUN))
+                    return false;
+                relStart += sizeof(uint16_t);
+                break;
+            }
+            rel++;
+            type += rel;
+            ofst = 0;
+            break;
+
+        case TOKEN_RELOC_TYPE_NEXT:
+            type++;
+            ofst = 0;
+            break;
+        }
+    }
+
+    return true;
+}
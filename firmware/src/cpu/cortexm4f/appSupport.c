@@ -23,110 +23,6 @@
 
 
 
-//reloc types for this cpu type
-#define NANO_RELOC_TYPE_RAM	0
-#define NANO_RELOC_TYPE_FLASH	1
-
-
-static bool handleRelNumber(uint32_t *ofstP, uint32_t type, uint32_t flashAddr, uint32_t ramAddr, uint32_t *mem, uint32_t value)
-{
-    uint32_t base, where;
-
-    switch (type) {
-
-    case NANO_RELOC_TYPE_RAM:
-        base = ramAddr;
-        break;
-
-    case NANO_RELOC_TYPE_FLASH:
-        base = flashAddr;
-        break;
-
-    default:
-        return false;
-    }
-
-    where = *ofstP + value;
-    *ofstP = where + 1;
-
-    mem[where] += base;
-
-    return true;
-}
-
-static bool handleRelocs(const uint8_t *relStart, const uint8_t *relEnd, uint32_t flashStart, uint32_t ramStart, void *mem)
-{
-    uint32_t ofst = 0;
-    uint32_t type = 0;
-
-    while (relStart != relEnd) {
-
-        uint32_t rel = *relStart++;
-
-        if (rel <= MAX_8_BIT_NUM) {
-
-            if (!handleRelNumber(&ofst, type, flashStart, ramStart, mem, rel))
-                return false;
-        }
-        else switch (rel) {
-
-        case TOKEN_32BIT_OFST:
-            if (relEnd - relStart < 4)
-                return false;
-            rel = *(uint32_t*)relStart;
-            relStart += sizeof(uint32_t);
-            if (!handleRelNumber(&ofst, type, flashStart, ramStart, mem, rel))
-                return false;
-            break;
-
-        case TOKEN_24BIT_OFST:
-            if (relEnd - relStart < 3)
-                return false;
-            rel = *(uint16_t*)relStart;
-            relStart += sizeof(uint16_t);
-            rel += ((uint32_t)(*relStart++)) << 16;
-            if (!handleRelNumber(&ofst, type, flashStart, ramStart, mem, rel + MAX_16_BIT_NUM))
-                return false;
-            break;
-
-        case TOKEN_16BIT_OFST:
-            if (relEnd - relStart < 2)
-                return false;
-            rel = *(uint16_t*)relStart;
-            relStart += sizeof(uint16_t);
-            if (!handleRelNumber(&ofst, type, flashStart, ramStart, mem, rel + MAX_8_BIT_NUM))
-                return false;
-            break;
-
-        case TOKEN_CONSECUTIVE:
-            if (relEnd - relStart < 1)
-                return false;
-            rel = *relStart++;
-            rel += MIN_RUN_LEN;
-            while (rel--)
-                if (!handleRelNumber(&ofst, type, flashStart, ramStart, mem, 0))
-                	return false;
-            break;
-
-        case TOKEN_RELOC_TYPE_CHG:
-            if (relEnd - relStart < 1)
-                return false;
-            rel = *relStart++;
-            rel++;
-            type += rel;
-            ofst = 0;
-            break;
-
-        case TOKEN_RELOC_TYPE_NEXT:
-            type++;
-            ofst = 0;
-            break;
-        }
-    }
-
-    return true;
-}
-
 bool cpuInternalAppLoad(const struct AppHdr *appHdr, struct PlatAppInfo *platInfo)
 {
     platInfo->got = 0x00000000;
@@ -153,7 +49,7 @@ bool cpuAppLoad(const struct AppHdr *appHdr, struct PlatAppInfo *platInfo)
     memcpy(mem + appHdr->data_start, ((uint8_t*)appHdr) + appHdr->data_data, appHdr->got_end - appHdr->data_start);
 
     //perform relocs
-    if (!handleRelocs(relocsStart, relocsEnd, (uintptr_t)appHdr, (uintptr_t)mem, (void*)mem)) {
+    if (!appRelocsApply(relocsStart, relocsEnd, (uintptr_t)appHdr, (uintptr_t)mem, (void*)mem)) {
         osLog(LOG_ERROR, "Relocs are invalid in this app. Aborting app load\n");
         heapFree(mem);
         return false;
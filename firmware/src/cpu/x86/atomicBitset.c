@@ -79,7 +79,7 @@ int32_t atomicBitsetFindClearAndSet(struct AtomicBitset *set)
         }
     }
 
-    return false;
+    return -1;
 }
 
 
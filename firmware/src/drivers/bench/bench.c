@@ -0,0 +1,258 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <eventnums.h>
+#include <floatRt.h>
+#include <printf.h>
+#include <seos.h>
+#include <timer.h>
+#include <sha2.h>
+#include <aes.h>
+#include <rsa.h>
+#include <crc.h>
+
+/*
+ * Microbenchmarks for the crypto, checksum and runtime helpers the OS relies
+ * on. Each case runs over fixed vectors until BENCH_MIN_NS has passed, one
+ * case per deferred step so the event loop keeps moving. Results are written
+ * as CSV, one line per case:
+ *
+ *   name,value,unit,ops
+ *
+ * where value is in nanoseconds with three decimals and ops is how many times
+ * the case ran.
+ *
+ * NANOHUB_BENCH - file to write results to, "-" for stdout. Unset: no run.
+ */
+
+#define BENCH_DATA_SIZE         4096
+#define BENCH_MIN_NS            200000000ULL
+#define BENCH_MIN_OPS           4
+#define BENCH_NUM_FLOATS        256
+
+struct BenchCase
+{
+    const char *name;
+    const char *unit;
+    uint32_t unitsPerOp;
+    void (*op)(void);
+};
+
+static struct BenchTask
+{
+    FILE *f;
+    uint32_t tid;
+    uint32_t next;
+} mTask;
+
+static uint32_t mData[BENCH_DATA_SIZE / sizeof(uint32_t)];
+static uint32_t mOut[BENCH_DATA_SIZE / sizeof(uint32_t)];
+static uint32_t mRsaMod[RSA_LIMBS];
+static uint32_t mRsaVal[RSA_LIMBS];
+static uint64_t mFloatIn[BENCH_NUM_FLOATS];
+static struct RsaState mRsaState;
+static char mPrintfBuf[128];
+static uint32_t mPrintfLen;
+static volatile uint32_t mSink;
+
+static void benchFill(void)
+{
+    uint32_t i, v = 0x12345678;
+
+    for (i = 0; i < BENCH_DATA_SIZE / sizeof(uint32_t); i++) {
+        v = v * 1664525 + 1013904223;
+        mData[i] = v;
+    }
+
+    for (i = 0; i < RSA_LIMBS; i++) {
+        mRsaMod[i] = mData[i];
+        mRsaVal[i] = mData[RSA_LIMBS + i];
+    }
+    mRsaMod[0] |= 1;                          // modulus must be odd
+    mRsaMod[RSA_LIMBS - 1] |= 0x80000000UL;   // and exactly RSA_LEN bits long
+    mRsaVal[RSA_LIMBS - 1] &= 0x7FFFFFFFUL;   // value must be below it
+
+    for (i = 0; i < BENCH_NUM_FLOATS; i++)
+        mFloatIn[i] = (((uint64_t)mData[2 * i]) << 32 | mData[2 * i + 1]) >> (i & 63);
+}
+
+static void benchSha2(void)
+{
+    struct Sha2state state;
+
+    sha2init(&state);
+    sha2processBytes(&state, mData, sizeof(mData));
+    mSink = sha2finish(&state)[0];
+}
+
+static void benchAesCbcDecr(void)
+{
+    static const uint32_t key[AES_KEY_WORDS] = {1, 2, 3, 4, 5, 6, 7, 8};
+    static const uint32_t iv[AES_BLOCK_WORDS] = {9, 10, 11, 12};
+    struct AesCbcContext ctx;
+    uint32_t i;
+
+    aesCbcInitForDecr(&ctx, key, iv);
+    for (i = 0; i < BENCH_DATA_SIZE / sizeof(uint32_t); i += AES_BLOCK_WORDS)
+        aesCbcDecr(&ctx, mData + i, mOut + i);
+    mSink = mOut[0];
+}
+
+//in place, a run of blocks at a time, as appSec decrypts an upload
+static void benchAesCbcDecrBlocks(void)
+{
+    static const uint32_t key[AES_KEY_WORDS] = {1, 2, 3, 4, 5, 6, 7, 8};
+    static const uint32_t iv[AES_BLOCK_WORDS] = {9, 10, 11, 12};
+    struct AesCbcContext ctx;
+
+    memcpy(mOut, mData, sizeof(mOut));
+    aesCbcInitForDecr(&ctx, key, iv);
+    aesCbcDecrBlocks(&ctx, mOut, mOut, BENCH_DATA_SIZE / sizeof(uint32_t[AES_BLOCK_WORDS]));
+    mSink = mOut[0];
+}
+
+static void benchRsaPubOp(void)
+{
+    mSink = rsaPubOp(&mRsaState, mRsaVal, mRsaMod)[0];
+}
+
+static void benchCrc32(void)
+{
+    mSink = crc32(mData, sizeof(mData), ~0);
+}
+
+static void benchFloatFromUint64(void)
+{
+    float sum = 0.0f;
+    uint32_t i;
+
+    for (i = 0; i < BENCH_NUM_FLOATS; i++)
+        sum += floatFromUint64(mFloatIn[i]);
+    mSink = (uint32_t)sum;
+}
+
+static bool benchPrintfWrite(void *userData, char c)
+{
+    if (mPrintfLen < sizeof(mPrintfBuf))
+        mPrintfBuf[mPrintfLen++] = c;
+
+    return true;
+}
+
+static void benchPrintf(const char *fmt, ...)
+{
+    va_list vl;
+
+    mPrintfLen = 0;
+    va_start(vl, fmt);
+    cvprintf(benchPrintfWrite, NULL, fmt, vl);
+    va_end(vl);
+}
+
+static void benchCvprintf(void)
+{
+    benchPrintf("%s: evt 0x%08" PRIX32 " len %" PRIu32 " t=%" PRIu64 " %c%d\n", "BENCH",
+                mData[0], mData[1] & 0xFFFF, ((uint64_t)mData[2]) << 20, 'x', -12345);
+    mSink = mPrintfLen;
+}
+
+static const struct BenchCase mCases[] =
+{
+    { "sha2processBytes", "ns/byte", BENCH_DATA_SIZE, benchSha2 },
+    { "aesCbcDecr", "ns/byte", BENCH_DATA_SIZE, benchAesCbcDecr },
+    { "aesCbcDecrBlocks", "ns/byte", BENCH_DATA_SIZE, benchAesCbcDecrBlocks },
+    { "rsaPubOp", "ns/op", 1, benchRsaPubOp },
+    { "crc32", "ns/byte", BENCH_DATA_SIZE, benchCrc32 },
+    { "floatFromUint64", "ns/op", BENCH_NUM_FLOATS, benchFloatFromUint64 },
+    { "cvprintf", "ns/op", 1, benchCvprintf },
+};
+
+static void benchRun(const struct BenchCase *bc)
+{
+    uint64_t start, elapsed, milliNs;
+    uint32_t ops = 0;
+
+    bc->op(); // warm up caches and any lazily built state
+    start = timGetTime();
+    do {
+        bc->op();
+        ops++;
+        elapsed = timGetTime() - start;
+    } while (ops < BENCH_MIN_OPS || elapsed < BENCH_MIN_NS);
+
+    milliNs = elapsed * 1000 / ((uint64_t)ops * bc->unitsPerOp);
+    fprintf(mTask.f, "%s,%llu.%03llu,%s,%lu\n", bc->name, (unsigned long long)(milliNs / 1000),
+            (unsigned long long)(milliNs % 1000), bc->unit, (unsigned long)ops);
+    fflush(mTask.f);
+}
+
+static void benchStep(void *cookie)
+{
+    if (mTask.next < sizeof(mCases) / sizeof(mCases[0])) {
+        benchRun(mCases + mTask.next++);
+        osDefer(benchStep, NULL, false);
+        return;
+    }
+
+    osLog(LOG_INFO, "BENCH: %lu cases done\n", (unsigned long)mTask.next);
+    if (mTask.f != stdout)
+        fclose(mTask.f);
+    mTask.f = NULL;
+}
+
+static void handleEvent(uint32_t evtType, const void* evtData)
+{
+    if (evtType == EVT_APP_START) {
+        osEventUnsubscribe(mTask.tid, EVT_APP_START);
+        fprintf(mTask.f, "name,value,unit,ops\n");
+        benchFill();
+        osDefer(benchStep, NULL, false);
+    }
+}
+
+static bool startTask(uint32_t taskId)
+{
+    const char *path = getenv("NANOHUB_BENCH");
+
+    mTask.tid = taskId;
+
+    if (!path)
+        return true;
+
+    mTask.f = strcmp(path, "-") ? fopen(path, "w") : stdout;
+    if (!mTask.f) {
+        osLog(LOG_ERROR, "BENCH: cannot open %s\n", path);
+        return true;
+    }
+
+    osEventSubscribe(taskId, EVT_APP_START);
+    return true;
+}
+
+static void endTask(void)
+{
+    if (mTask.f && mTask.f != stdout)
+        fclose(mTask.f);
+    memset(&mTask, 0, sizeof(struct BenchTask));
+}
+
+INTERNAL_APP_INIT(APP_ID_MAKE(APP_ID_VENDOR_GOOGLE, 13), 0, startTask, endTask, handleEvent);
@@ -44,7 +44,6 @@
 #define BMI160_SPI_READ          0x80
 
 #define USE_LOW_POWER                   0
-#define CALCULATE_WATERMARK_LEVEL       1
 
 #define BMI160_SPI_BUS_ID         1
 #define BMI160_SPI_SPEED_HZ       4000000
@@ -274,7 +273,6 @@ struct ConfigStat {
 
 struct BMI160Sensor {
     struct ConfigStat pConfig; // pending config status request
-    struct TripleAxisDataEvent *data_evt;
     uint32_t handle;
     uint32_t rate;
     uint64_t latency;
@@ -336,6 +334,7 @@ struct BMI160Task {
     uint64_t next_delta[3];
     bool pending_delta[3];
     bool fifo_enabled[3];
+    bool fifo_spans_latency; // the watermark was not cut short, so a read is all the clients wait for
     uint64_t last_sensortime;
     uint64_t frame_sensortime;
     uint64_t prev_frame_time[3];
@@ -385,8 +384,8 @@ static struct SlabAllocator *mDataSlab;
 
 static const struct SensorInfo mSensorInfo[NUM_OF_SENSOR] =
 {
-    {"Accelerometer",      AccRates, SENS_TYPE_ACCEL,       NUM_AXIS_THREE,    NANOHUB_INT_NONWAKEUP, 3000},
-    {"Gyroscope",          GyrRates, SENS_TYPE_GYRO,        NUM_AXIS_THREE,    NANOHUB_INT_NONWAKEUP,   20},
+    {"Accelerometer",      AccRates, SENS_TYPE_ACCEL,       NUM_AXIS_THREE,    NANOHUB_INT_NONWAKEUP, 3000, SENSOR_INFO_FLAGS1_DECIM_AVG},
+    {"Gyroscope",          GyrRates, SENS_TYPE_GYRO,        NUM_AXIS_THREE,    NANOHUB_INT_NONWAKEUP,   20, SENSOR_INFO_FLAGS1_DECIM_AVG},
     {"Magnetometer",       MagRates, SENS_TYPE_MAG,         NUM_AXIS_THREE,    NANOHUB_INT_NONWAKEUP,   20},
     {"Step Detector",      NULL,     SENS_TYPE_STEP_DETECT, NUM_AXIS_EMBEDDED, NANOHUB_INT_NONWAKEUP,  100},
     {"Double Tap",         NULL,     SENS_TYPE_DOUBLE_TAP,  NUM_AXIS_EMBEDDED, NANOHUB_INT_NONWAKEUP,   20},
@@ -564,27 +563,29 @@ static bool disableInterrupt(struct Gpio *pin, struct ChainedIsr *isr)
 
 static void magBias(void)
 {
-    struct TripleAxisDataEvent *evt = mTask.sensors[MAG].data_evt;
-    uint8_t idx;
+    struct TripleAxisDataEvent *evt;
 
+    // the new bias applies from here on, so the samples batched before it go out first
+    sensorBatchFlush(mTask.sensors[MAG].handle);
+
+    evt = slabAllocatorAlloc(mDataSlab);
     if (evt == NULL) {
-        idx = 0;
-        evt = slabAllocatorAlloc(mDataSlab);
-        if (evt == NULL) {
-            // slab allocation failed
-            osLog(LOG_ERROR, "Slab allocation failed for MAG bias event\n");
-            return;
-        }
-        evt->referenceTime = timGetTime();
-    } else {
-        idx = evt->samples[0].firstSample.numSamples++;
-        evt->samples[idx].deltaTime = timGetTime() - mTask.sensors[MAG].prev_rtc_time;
+        // slab allocation failed
+        osLog(LOG_ERROR, "Slab allocation failed for MAG bias event\n");
+        return;
     }
+
+    memset(&evt->samples[0].firstSample, 0, sizeof(evt->samples[0].firstSample));
+    evt->referenceTime = timGetTime();
+    evt->samples[0].firstSample.numSamples = 1;
     evt->samples[0].firstSample.biasPresent = 1;
-    evt->samples[0].firstSample.biasSample = idx;
-    evt->samples[idx].x = mTask.moc.x_bias;
-    evt->samples[idx].y = mTask.moc.y_bias;
-    evt->samples[idx].z = mTask.moc.z_bias;
+    evt->samples[0].firstSample.biasSample = 0;
+    evt->samples[0].x = mTask.moc.x_bias;
+    evt->samples[0].y = mTask.moc.y_bias;
+    evt->samples[0].z = mTask.moc.z_bias;
+
+    if (!osEnqueueEvt(EVENT_TYPE_BIT_DISCARDABLE | sensorGetMyEventType(mSensorInfo[MAG].sensorType), evt, dataEvtFree))
+        dataEvtFree(evt);
 }
 
 static void magConfigMagic(void)
@@ -726,6 +727,10 @@ static void configInt2(bool on)
     }
 }
 
+// The fifo holds the samples for the smallest latency asked for, so the hub
+// only wakes up once per latency to read it out. A read is passed on to the
+// framework batching (sensorBatchSample()) which cannot hold more than
+// SENSOR_BATCH_MAX_SAMPLES of a sensor, so never let more than that pile up.
 static uint8_t calcWaterMark(void)
 {
     int i;
@@ -737,6 +742,8 @@ static uint8_t calcWaterMark(void)
     uint32_t temp_cnt, total_cnt = 0;
     uint32_t header_cnt = ULONG_MAX;
 
+    mTask.fifo_spans_latency = true;
+
     for (i = ACC; i <= MAG; i++) {
         if (mTask.sensors[i].configed && mTask.sensors[i].latency != SENSOR_LATENCY_NODATA) {
             min_latency = mTask.sensors[i].latency < min_latency ? mTask.sensors[i].latency : min_latency;
@@ -764,6 +771,10 @@ static uint8_t calcWaterMark(void)
         if (mTask.sensors[i].configed && mTask.sensors[i].latency != SENSOR_LATENCY_NODATA) {
 
             temp_cnt = (uint32_t)U64_DIV_BY_U64_CONSTANT(min_latency * (mTask.sensors[i].rate / 1024), 1000000000ull);
+            if (temp_cnt > SENSOR_BATCH_MAX_SAMPLES) {
+                temp_cnt = SENSOR_BATCH_MAX_SAMPLES;
+                mTask.fifo_spans_latency = false;
+            }
             header_cnt = temp_cnt < header_cnt ? temp_cnt : header_cnt;
             total_cnt += temp_cnt * (i == MAG ? 8 : 6);
         }
@@ -771,7 +782,10 @@ static uint8_t calcWaterMark(void)
     total_cnt += header_cnt;
     water_mark = ((total_cnt / 4) < 0xff) ? (total_cnt / 4) : 0xff; // 4 bytes per count in the water_mark register.
     water_mark = water_mark < min_water_mark ? min_water_mark : water_mark;
-    water_mark = water_mark > max_water_mark ? max_water_mark : water_mark;
+    if (water_mark > max_water_mark) {
+        water_mark = max_water_mark;
+        mTask.fifo_spans_latency = false;
+    }
 
     return water_mark;
 }
@@ -1279,6 +1293,14 @@ static bool stepCntSetRate(uint32_t rate, uint64_t latency, void *cookie)
 
 static void sendFlushEvt(void)
 {
+    int i;
+
+    // batched samples must reach clients ahead of the flush marker
+    for (i = ACC; i <= MAG; i++) {
+        if (mTask.sensors[i].flush > 0)
+            sensorBatchFlush(mTask.sensors[i].handle);
+    }
+
     while (mTask.sensors[ACC].flush > 0) {
         osEnqueueEvt(EVT_SENSOR_ACC_DATA_RDY, SENSOR_DATA_EVENT_FLUSH, NULL);
         mTask.sensors[ACC].flush--;
@@ -1424,28 +1446,11 @@ static uint64_t parseSensortime(uint32_t sensor_time24)
     return (full -  0x1000000ull);
 }
 
-static void flushRawData(void)
-{
-    int i;
-    for (i = ACC; i <= MAG; i++) {
-        if (mTask.sensors[i].data_evt) {
-            if (!osEnqueueEvt(EVENT_TYPE_BIT_DISCARDABLE | sensorGetMyEventType(mSensorInfo[i].sensorType),
-                    mTask.sensors[i].data_evt, dataEvtFree)) {
-                // don't log error since queue is already full. silently drop
-                // this data event.
-                dataEvtFree(mTask.sensors[i].data_evt);
-            }
-            mTask.sensors[i].data_evt = NULL;
-        }
-    }
-}
-
 static void parseRawData(struct BMI160Sensor *mSensor, int i, float kScale, uint64_t sensorTime)
 {
     float x, y, z;
     int16_t raw_x, raw_y, raw_z;
-    struct TripleAxisDataPoint *sample;
-    uint32_t delta_time;
+    struct TripleAxisDataPoint sample;
     uint64_t rtc_time;
 
     if (!sensortime_to_rtc_time(sensorTime, &rtc_time)) {
@@ -1492,44 +1497,16 @@ static void parseRawData(struct BMI160Sensor *mSensor, int i, float kScale, uint
         z = (float)raw_z * kScale;
     }
 
-    if (mSensor->data_evt == NULL) {
-        mSensor->data_evt = slabAllocatorAlloc(mDataSlab);
-        if (mSensor->data_evt == NULL) {
-            // slab allocation failed
-            osLog(LOG_ERROR, "bmi160: IMU: Slab allocation failed\n");
-            return;
-        }
-        // delta time for the first sample is sample count
-        mSensor->data_evt->samples[0].firstSample.numSamples = 0;
-        mSensor->data_evt->referenceTime = rtc_time;
-        mSensor->prev_rtc_time = rtc_time;
-    }
-
-    if (mSensor->data_evt->samples[0].firstSample.numSamples >= MAX_NUM_COMMS_EVENT_SAMPLES) {
-        osLog(LOG_ERROR, "BAD INDEX\n");
-        return;
-    }
+    mSensor->prev_rtc_time = rtc_time;
 
-    sample = &mSensor->data_evt->samples[mSensor->data_evt->samples[0].firstSample.numSamples++];
-
-    // the first deltatime is for sample size
-    if (mSensor->data_evt->samples[0].firstSample.numSamples > 1) {
-        delta_time = rtc_time - mSensor->prev_rtc_time;
-        delta_time = delta_time < 0 ? 0 : delta_time;
-        sample->deltaTime = delta_time;
-        mSensor->prev_rtc_time = rtc_time;
-    }
-
-    sample->x = x;
-    sample->y = y;
-    sample->z = z;
+    sample.x = x;
+    sample.y = y;
+    sample.z = z;
 
     //osLog(LOG_INFO, "bmi160: x: %d, y: %d, z: %d\n", (int)(1000*x), (int)(1000*y), (int)(1000*z));
 
-    if (mSensor->data_evt->samples[0].firstSample.numSamples == MAX_NUM_COMMS_EVENT_SAMPLES) {
-        flushRawData();
-    }
-
+    // the framework holds samples for as long as the clients' latency allows and sends them out in bulk
+    sensorBatchSample(mSensor->handle, rtc_time, &sample.x);
 }
 
 static void dispatchData(void)
@@ -1652,11 +1629,14 @@ static void dispatchData(void)
         }
     }
 
+    // the fifo already held these for the whole latency, do not make them wait for it again
+    if (mTask.fifo_spans_latency) {
+        for (j = ACC; j <= MAG; j++)
+            sensorBatchFlush(mTask.sensors[j].handle);
+    }
+
     if (mTask.new_mag_bias)
         magBias();
-
-    // flush data events.
-    flushRawData();
 }
 
 /*
@@ -2334,7 +2314,6 @@ static void initSensorStruct(struct BMI160Sensor *sensor, enum SensorIndex idx)
     sensor->offset[1] = 0;
     sensor->offset[2] = 0;
     sensor->latency = 0;
-    sensor->data_evt = NULL;
     sensor->flush = 0;
     sensor->prev_rtc_time = 0;
 }
@@ -2383,14 +2362,10 @@ static bool startTask(uint32_t task_id)
             0.0f, 1.0f, 0.0f,      // c10, c11, c12
             0.0f, 0.0f, 1.0f);     // c20, c21, c22
 
-    slabSize = sizeof(struct TripleAxisDataEvent) +
-        MAX_NUM_COMMS_EVENT_SAMPLES * sizeof(struct TripleAxisDataPoint);
-
-    // each event has 15 samples, with 7 bytes per sample from the fifo.
-    // the fifo size is 1K.
-    // 20 slabs because some slabs may only hold 1-2 samples.
-    // XXX: this consumes too much memeory, need to optimize
-    mDataSlab = slabAllocatorNew(slabSize, 4, 20);
+    // data samples are batched by the framework, we only send mag bias
+    // events ourselves, a single sample each.
+    slabSize = sizeof(struct TripleAxisDataEvent) + sizeof(struct TripleAxisDataPoint);
+    mDataSlab = slabAllocatorNew(slabSize, 4, 4);
     if (!mDataSlab) {
         osLog(LOG_INFO, "Slab allocation failed\n");
         return false;
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <eventnums.h>
+#include <sensors.h>
+#include <seos.h>
+#include <timer.h>
+
+#include "sensor_replay.h"
+
+/*
+ * Captures every sensor data event into the file named by NANOHUB_RECORD_FILE.
+ * Only sensors registered by the time EVT_APP_START is broadcast are recorded.
+ * The recorder never requests a sensor, it only listens to what others enabled.
+ */
+
+#define NUM_AXIS_NOT_RECORDED   0xFF
+
+static struct RecordTask
+{
+    FILE *f;
+    uint32_t tid;
+    uint8_t numAxis[SENS_TYPE_LAST_USER + 1]; /* by sensor type */
+} mTask;
+
+static void recordWriteSensor(const struct SensorInfo *si)
+{
+    struct SensorReplaySensorDesc desc;
+    uint32_t numRates = 0;
+
+    while (si->supportedRates && si->supportedRates[numRates] && numRates < SENSOR_REPLAY_MAX_RATES)
+        numRates++;
+
+    memset(&desc, 0, sizeof(desc));
+    desc.minSamples = si->minSamples;
+    desc.sensorType = si->sensorType;
+    desc.numAxis = si->numAxis;
+    desc.interrupt = si->interrupt;
+    desc.numRates = numRates;
+    desc.flags1 = si->flags1;
+
+    fwrite(&desc, sizeof(desc), 1, mTask.f);
+    if (numRates)
+        fwrite(si->supportedRates, sizeof(uint32_t), numRates, mTask.f);
+}
+
+static void recordStart(void)
+{
+    struct SensorReplayFileHdr hdr;
+    const struct SensorInfo *si;
+    uint32_t i;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = SENSOR_REPLAY_MAGIC;
+    hdr.version = SENSOR_REPLAY_VERSION;
+
+    for (i = SENS_TYPE_INVALID + 1; i <= SENS_TYPE_LAST_USER; i++) {
+        mTask.numAxis[i] = NUM_AXIS_NOT_RECORDED;
+        if (hdr.numSensors < SENSOR_REPLAY_MAX_SENSORS && (si = sensorFind(i, 0, NULL)) != NULL) {
+            mTask.numAxis[i] = si->numAxis;
+            hdr.numSensors++;
+        }
+    }
+
+    fwrite(&hdr, sizeof(hdr), 1, mTask.f);
+
+    for (i = SENS_TYPE_INVALID + 1; i <= SENS_TYPE_LAST_USER; i++) {
+        if (mTask.numAxis[i] == NUM_AXIS_NOT_RECORDED)
+            continue;
+        recordWriteSensor(sensorFind(i, 0, NULL));
+        osEventSubscribe(mTask.tid, sensorGetMyEventType(i));
+    }
+
+    fflush(mTask.f);
+    osLog(LOG_INFO, "RECORD: recording %u sensors\n", hdr.numSensors);
+}
+
+static uint32_t recordPayloadLen(uint32_t numAxis, const void *evtData)
+{
+    uint32_t numSamples = ((const struct SingleAxisDataEvent *)evtData)->samples[0].firstSample.numSamples;
+
+    switch (numAxis) {
+    case NUM_AXIS_EMBEDDED:
+        return sizeof(uint32_t);
+    case NUM_AXIS_ONE:
+        return sizeof(struct SingleAxisDataEvent) + numSamples * sizeof(struct SingleAxisDataPoint);
+    case NUM_AXIS_THREE:
+        return sizeof(struct TripleAxisDataEvent) + numSamples * sizeof(struct TripleAxisDataPoint);
+    case NUM_AXIS_WIFI:
+        return sizeof(struct WifiScanEvent) + numSamples * sizeof(struct WifiScanResult);
+    default:
+        return 0;
+    }
+}
+
+static void recordEvent(uint32_t sensorType, const void *evtData)
+{
+    struct SensorReplayRecordHdr rec;
+    union EmbeddedDataPoint sample;
+    uint32_t numAxis = mTask.numAxis[sensorType];
+
+    memset(&rec, 0, sizeof(rec));
+    rec.time = timGetTime();
+    rec.sensorType = sensorType;
+
+    if (evtData == SENSOR_DATA_EVENT_FLUSH) {
+        rec.kind = SENSOR_REPLAY_KIND_FLUSH;
+        fwrite(&rec, sizeof(rec), 1, mTask.f);
+    } else if (numAxis == NUM_AXIS_EMBEDDED) {
+        sample.vptr = (void *)evtData;
+        rec.kind = SENSOR_REPLAY_KIND_DATA;
+        rec.len = sizeof(sample.idata);
+        fwrite(&rec, sizeof(rec), 1, mTask.f);
+        fwrite(&sample.idata, sizeof(sample.idata), 1, mTask.f);
+    } else if ((rec.len = recordPayloadLen(numAxis, evtData)) != 0) {
+        rec.kind = SENSOR_REPLAY_KIND_DATA;
+        fwrite(&rec, sizeof(rec), 1, mTask.f);
+        fwrite(evtData, rec.len, 1, mTask.f);
+    }
+
+    /* a crash is usually what we are trying to capture, so do not sit on buffered data */
+    fflush(mTask.f);
+}
+
+static void handleEvent(uint32_t evtType, const void* evtData)
+{
+    uint32_t sensorType;
+
+    if (evtType == EVT_APP_START) {
+        osEventUnsubscribe(mTask.tid, EVT_APP_START);
+        recordStart();
+    } else if (evtType > EVT_NO_FIRST_SENSOR_EVENT && evtType < EVT_NO_SENSOR_CONFIG_EVENT) {
+        sensorType = evtType - EVT_NO_FIRST_SENSOR_EVENT;
+        if (sensorType <= SENS_TYPE_LAST_USER && mTask.numAxis[sensorType] != NUM_AXIS_NOT_RECORDED)
+            recordEvent(sensorType, evtData);
+    }
+}
+
+static bool startTask(uint32_t taskId)
+{
+    const char *path = getenv("NANOHUB_RECORD_FILE");
+
+    mTask.tid = taskId;
+
+    if (!path)
+        return true;
+
+    mTask.f = fopen(path, "wb");
+    if (!mTask.f) {
+        osLog(LOG_ERROR, "RECORD: cannot open %s\n", path);
+        return true;
+    }
+
+    osEventSubscribe(taskId, EVT_APP_START);
+    return true;
+}
+
+static void endTask(void)
+{
+    if (mTask.f)
+        fclose(mTask.f);
+    memset(&mTask, 0, sizeof(struct RecordTask));
+}
+
+INTERNAL_APP_INIT(APP_ID_MAKE(APP_ID_VENDOR_GOOGLE, 11), 0, startTask, endTask, handleEvent);
@@ -0,0 +1,381 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <eventnums.h>
+#include <heap.h>
+#include <sensors.h>
+#include <seos.h>
+#include <timer.h>
+
+#include "sensor_replay.h"
+
+/*
+ * Plays back a file written by sensor_record.c. Every recorded sensor is
+ * registered as a fake driver with the same SensorInfo, so the framework,
+ * hostIntf and any fusion apps see the original stream with its original
+ * timing. Data for sensors nobody has turned on is skipped, just like the
+ * real hardware would not have produced it.
+ *
+ * NANOHUB_REPLAY_FILE  - file to play
+ * NANOHUB_REPLAY_SPEED - 0 to play as fast as possible, otherwise a power of
+ *                        two speedup (1 = real time, 2 = twice as fast, ...)
+ */
+
+#define REPLAY_RECS_PER_STEP    16  /* records emitted before yielding to the event loop */
+#define REPLAY_MAX_SAMPLES      UINT8_MAX /* SensorFirstSample.numSamples is all an event can count to */
+
+struct ReplaySensor
+{
+    struct SensorInfo info;
+    uint32_t rates[SENSOR_REPLAY_MAX_RATES + 1];
+    uint32_t handle;
+    bool on;
+};
+
+static struct ReplayTask
+{
+    FILE *f;
+    struct ReplaySensor *sensors;
+    uint64_t startTime;      /* local time when playback began */
+    uint64_t firstRecTime;   /* recorded time of the first record */
+    uint64_t numRecs;
+    uint32_t tid;
+    uint32_t numSensors;
+    uint32_t speedShift;
+    bool fast;
+    bool haveRec;            /* rec was read but is not due yet */
+    struct SensorReplayRecordHdr rec;
+} mTask;
+
+static struct ReplaySensor* replayFindSensor(uint32_t sensorType)
+{
+    uint32_t i;
+
+    for (i = 0; i < mTask.numSensors; i++)
+        if (mTask.sensors[i].info.sensorType == sensorType)
+            return mTask.sensors + i;
+
+    return NULL;
+}
+
+static bool replayPower(bool on, void *cookie)
+{
+    struct ReplaySensor *rs = cookie;
+
+    rs->on = on;
+    return sensorSignalInternalEvt(rs->handle, SENSOR_INTERNAL_EVT_POWER_STATE_CHG, on, 0);
+}
+
+static bool replayFirmwareUpload(void *cookie)
+{
+    struct ReplaySensor *rs = cookie;
+
+    return sensorSignalInternalEvt(rs->handle, SENSOR_INTERNAL_EVT_FW_STATE_CHG, 1, 0);
+}
+
+static bool replaySetRate(uint32_t rate, uint64_t latency, void *cookie)
+{
+    struct ReplaySensor *rs = cookie;
+
+    return sensorSignalInternalEvt(rs->handle, SENSOR_INTERNAL_EVT_RATE_CHG, rate, latency);
+}
+
+static bool replayFlush(void *cookie)
+{
+    struct ReplaySensor *rs = cookie;
+
+    return osEnqueueEvt(sensorGetMyEventType(rs->info.sensorType), SENSOR_DATA_EVENT_FLUSH, NULL);
+}
+
+static const struct SensorOps mSensorOps =
+{
+    replayPower,
+    replayFirmwareUpload,
+    replaySetRate,
+    replayFlush,
+    NULL
+};
+
+static bool replayReadHeader(void)
+{
+    struct SensorReplayFileHdr hdr;
+    struct SensorReplaySensorDesc desc;
+    struct ReplaySensor *rs;
+    uint32_t i;
+
+    if (fread(&hdr, sizeof(hdr), 1, mTask.f) != 1 || hdr.magic != SENSOR_REPLAY_MAGIC || hdr.version != SENSOR_REPLAY_VERSION) {
+        osLog(LOG_ERROR, "REPLAY: bad file header\n");
+        return false;
+    }
+
+    if (hdr.numSensors > SENSOR_REPLAY_MAX_SENSORS) {
+        osLog(LOG_ERROR, "REPLAY: too many sensors (%u)\n", hdr.numSensors);
+        return false;
+    }
+
+    mTask.sensors = heapAlloc(sizeof(struct ReplaySensor) * hdr.numSensors);
+    if (hdr.numSensors && !mTask.sensors)
+        return false;
+    if (mTask.sensors)
+        memset(mTask.sensors, 0, sizeof(struct ReplaySensor) * hdr.numSensors);
+
+    for (i = 0; i < hdr.numSensors; i++) {
+        rs = mTask.sensors + i;
+        if (fread(&desc, sizeof(desc), 1, mTask.f) != 1 || desc.numRates > SENSOR_REPLAY_MAX_RATES ||
+            fread(rs->rates, sizeof(uint32_t), desc.numRates, mTask.f) != desc.numRates) {
+            osLog(LOG_ERROR, "REPLAY: truncated sensor list\n");
+            return false;
+        }
+
+        rs->rates[desc.numRates] = 0;
+        rs->info.sensorName = "Replay";
+        rs->info.supportedRates = desc.numRates ? rs->rates : NULL;
+        rs->info.sensorType = desc.sensorType;
+        rs->info.numAxis = desc.numAxis;
+        rs->info.interrupt = desc.interrupt;
+        rs->info.minSamples = desc.minSamples;
+        rs->info.flags1 = desc.flags1;
+        mTask.numSensors++;
+    }
+
+    return true;
+}
+
+static uint64_t replayDueTime(uint64_t recTime)
+{
+    /* sample timestamps can precede the first record that carried them */
+    if (recTime < mTask.firstRecTime)
+        return mTask.startTime - ((mTask.firstRecTime - recTime) >> mTask.speedShift);
+    else
+        return mTask.startTime + ((recTime - mTask.firstRecTime) >> mTask.speedShift);
+}
+
+static bool replayEmitEmbedded(uint32_t evtType, uint32_t len)
+{
+    union EmbeddedDataPoint sample;
+
+    if (len != sizeof(sample.idata) || fread(&sample.idata, len, 1, mTask.f) != 1)
+        return false;
+
+    return osEnqueueEvt(evtType, sample.vptr, NULL);
+}
+
+static uint32_t replayPointSize(uint32_t numAxis)
+{
+    switch (numAxis) {
+    case NUM_AXIS_ONE:
+        return sizeof(struct SingleAxisDataPoint);
+    case NUM_AXIS_THREE:
+        return sizeof(struct TripleAxisDataPoint);
+    case NUM_AXIS_WIFI:
+        return sizeof(struct WifiScanResult);
+    default:
+        return 0;
+    }
+}
+
+/* sample times are deltas from the previous sample, they have to shrink along with the referenceTime */
+static void replayScaleDeltas(uint8_t *evt, uint32_t numSamples, uint32_t pointSz, uint64_t recTime)
+{
+    uint64_t prevDue = replayDueTime(recTime), due;
+    uint32_t *delta;
+    uint32_t i;
+
+    for (i = 1; i < numSamples; i++) {
+        delta = (uint32_t *)(evt + sizeof(uint64_t) + i * pointSz);
+        recTime += *delta;
+        due = replayDueTime(recTime);
+        *delta = due - prevDue;
+        prevDue = due;
+    }
+}
+
+static bool replayEmitData(uint32_t numAxis, uint32_t evtType, uint32_t len)
+{
+    uint32_t pointSz = replayPointSize(numAxis);
+    uint32_t numSamples;
+    uint64_t *refTime;
+    void *evt;
+
+    /* all non-embedded events are a referenceTime followed by numSamples points */
+    if (!pointSz || len < sizeof(uint64_t) + pointSz || len > sizeof(uint64_t) + REPLAY_MAX_SAMPLES * pointSz)
+        return false;
+
+    evt = heapAlloc(len);
+    if (!evt)
+        return false;
+
+    if (fread(evt, len, 1, mTask.f) != 1) {
+        heapFree(evt);
+        return false;
+    }
+
+    numSamples = ((struct SingleAxisDataEvent *)evt)->samples[0].firstSample.numSamples;
+    if (len != sizeof(uint64_t) + numSamples * pointSz) {
+        heapFree(evt);
+        return false;
+    }
+
+    /* move the event into our timeline */
+    refTime = evt;
+    if (mTask.speedShift)
+        replayScaleDeltas(evt, numSamples, pointSz, *refTime);
+    *refTime = replayDueTime(*refTime);
+
+    if (!osEnqueueEvt(EVENT_TYPE_BIT_DISCARDABLE | evtType, evt, heapFree)) {
+        heapFree(evt);
+        return false;
+    }
+
+    return true;
+}
+
+static bool replayEmit(void)
+{
+    struct ReplaySensor *rs = replayFindSensor(mTask.rec.sensorType);
+    uint32_t evtType = sensorGetMyEventType(mTask.rec.sensorType);
+
+    if (!rs || !rs->on)
+        return !fseek(mTask.f, mTask.rec.len, SEEK_CUR);
+    else if (mTask.rec.kind == SENSOR_REPLAY_KIND_FLUSH)
+        return osEnqueueEvt(evtType, SENSOR_DATA_EVENT_FLUSH, NULL);
+    else if (rs->info.numAxis == NUM_AXIS_EMBEDDED)
+        return replayEmitEmbedded(evtType, mTask.rec.len);
+    else
+        return replayEmitData(rs->info.numAxis, evtType, mTask.rec.len);
+}
+
+static void replayFinish(void)
+{
+    osLog(LOG_INFO, "REPLAY: %llu records in %llu ns\n", (unsigned long long)mTask.numRecs,
+          (unsigned long long)(timGetTime() - mTask.startTime));
+    fclose(mTask.f);
+    mTask.f = NULL;
+}
+
+static void replayStep(void *cookie);
+
+static void replayTimerCbk(uint32_t timerId, void *data)
+{
+    osDefer(replayStep, NULL, false);
+}
+
+static void replayStep(void *cookie)
+{
+    uint64_t due, now;
+    uint32_t i;
+
+    for (i = 0; i < REPLAY_RECS_PER_STEP; i++) {
+        if (!mTask.haveRec) {
+            if (fread(&mTask.rec, sizeof(mTask.rec), 1, mTask.f) != 1) {
+                replayFinish();
+                return;
+            }
+            if (!mTask.numRecs)
+                mTask.firstRecTime = mTask.rec.time;
+            mTask.haveRec = true;
+        }
+
+        if (!mTask.fast) {
+            due = replayDueTime(mTask.rec.time);
+            now = timGetTime();
+            if (due > now) {
+                if (!timTimerSet(due - now, 0, 50, replayTimerCbk, NULL, true))
+                    break;
+                return;
+            }
+        }
+
+        mTask.haveRec = false;
+        mTask.numRecs++;
+        if (!replayEmit()) {
+            osLog(LOG_ERROR, "REPLAY: bad record %llu, stopping\n", (unsigned long long)mTask.numRecs);
+            replayFinish();
+            return;
+        }
+    }
+
+    osDefer(replayStep, NULL, false);
+}
+
+static void handleEvent(uint32_t evtType, const void* evtData)
+{
+    if (evtType == EVT_APP_START) {
+        osEventUnsubscribe(mTask.tid, EVT_APP_START);
+        mTask.startTime = timGetTime();
+        osDefer(replayStep, NULL, false);
+    }
+}
+
+static bool startTask(uint32_t taskId)
+{
+    const char *path = getenv("NANOHUB_REPLAY_FILE");
+    const char *speed = getenv("NANOHUB_REPLAY_SPEED");
+    uint32_t i, mult;
+
+    mTask.tid = taskId;
+
+    if (!path)
+        return true;
+
+    if (speed) {
+        mult = strtoul(speed, NULL, 0);
+        mTask.fast = !mult;
+        while (mult > 1) {
+            mult >>= 1;
+            mTask.speedShift++;
+        }
+    }
+
+    mTask.f = fopen(path, "rb");
+    if (!mTask.f) {
+        osLog(LOG_ERROR, "REPLAY: cannot open %s\n", path);
+        return true;
+    }
+
+    if (!replayReadHeader()) {
+        fclose(mTask.f);
+        mTask.f = NULL;
+        mTask.numSensors = 0;
+        return true;
+    }
+
+    for (i = 0; i < mTask.numSensors; i++)
+        mTask.sensors[i].handle = sensorRegister(&mTask.sensors[i].info, &mSensorOps, mTask.sensors + i, true);
+
+    osLog(LOG_INFO, "REPLAY: playing %u sensors from %s\n", mTask.numSensors, path);
+    osEventSubscribe(taskId, EVT_APP_START);
+    return true;
+}
+
+static void endTask(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < mTask.numSensors; i++)
+        sensorUnregister(mTask.sensors[i].handle);
+    if (mTask.f)
+        fclose(mTask.f);
+    if (mTask.sensors)
+        heapFree(mTask.sensors);
+    memset(&mTask, 0, sizeof(struct ReplayTask));
+}
+
+INTERNAL_APP_INIT(APP_ID_MAKE(APP_ID_VENDOR_GOOGLE, 12), 0, startTask, endTask, handleEvent);
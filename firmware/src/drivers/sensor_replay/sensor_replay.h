@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SENSOR_REPLAY_H_
+
+#define SENSOR_REPLAY_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Sensor stream file, as written by sensor_record.c and read by sensor_replay.c:
+ *
+ *   struct SensorReplayFileHdr
+ *   numSensors x (struct SensorReplaySensorDesc, uint32_t rates[numRates])
+ *   any number of (struct SensorReplayRecordHdr, uint8_t payload[len])
+ *
+ * All fields are in host byte order. A DATA payload is the event exactly as
+ * the driver emitted it: the 32-bit value for NUM_AXIS_EMBEDDED sensors, or
+ * the whole Single/TripleAxisDataEvent or WifiScanEvent otherwise.
+ */
+
+#define SENSOR_REPLAY_MAGIC         0x5253484EUL /* "NHSR" */
+#define SENSOR_REPLAY_VERSION       1
+#define SENSOR_REPLAY_MAX_SENSORS   32
+#define SENSOR_REPLAY_MAX_RATES     16
+
+#define SENSOR_REPLAY_KIND_DATA     0
+#define SENSOR_REPLAY_KIND_FLUSH    1 /* no payload */
+
+struct SensorReplayFileHdr {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t numSensors;
+    uint16_t rfu;
+} __attribute__((packed));
+
+struct SensorReplaySensorDesc {
+    uint16_t minSamples;
+    uint8_t sensorType;
+    uint8_t numAxis;
+    uint8_t interrupt;
+    uint8_t numRates;
+    uint8_t flags1;
+    uint8_t rfu;
+} __attribute__((packed));
+
+struct SensorReplayRecordHdr {
+    uint64_t time;       /* timGetTime() when the recorder saw the event */
+    uint16_t len;        /* payload bytes that follow */
+    uint8_t sensorType;
+    uint8_t kind;        /* SENSOR_REPLAY_KIND_* */
+} __attribute__((packed));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
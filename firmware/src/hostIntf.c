@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <float.h>
 #include <inttypes.h>
 #include <stdint.h>
 #include <sys/endian.h>
@@ -33,6 +34,7 @@
 #include <util.h>
 #include <atomicBitset.h>
 #include <atomic.h>
+#include <cpu.h>
 #include <gpio.h>
 #include <apInt.h>
 #include <sensors.h>
@@ -43,6 +45,18 @@
 #define MAX_NUM_BLOCKS      350 /* times 252 = 88200 bytes */
 #define SENSOR_INIT_DELAY   500000000 /* ns */
 
+#ifndef HOSTINTF_BULK_MAX
+#define HOSTINTF_BULK_MAX   4096 /* largest bulk read, in bytes of frames */
+#endif
+#define MAX_PARKED          2    /* waitIdle requests ACKed while busy, waiting for their turn or to be collected */
+
+#define BULK_HEADROOM       (1 + NANOHUB_PACKET_SIZE_MAX) /* prePreamble + response packet */
+
+#define COMPACT_SAMPLE_MAX  (5 + sizeof(uint16_t) + 3 * sizeof(float)) /* varint + escaped sample */
+#define COMPACT_QUANT_MAX   32767.0f
+#define COMPACT_MIN_RANGE   0.001f /* smallest full scale, so a quiet sensor does not escape on every wiggle */
+#define COMPACT_MAX_ABS     (FLT_MAX / 2) /* larger, infinite and NaN axes escape without sizing the scale */
+
 struct ConfigCmd
 {
     uint64_t latency;
@@ -55,7 +69,8 @@ struct ConfigCmd
             uint8_t enabled : 1;
             uint8_t flush : 1;
             uint8_t calibrate : 1;
-            uint8_t reserved : 5;
+            uint8_t compact : 1; /* NUM_AXIS_THREE only: send NANOHUB_SENSOR_ENCODING_COMPACT packets */
+            uint8_t reserved : 4;
         };
         uint8_t flags;
     };
@@ -86,25 +101,67 @@ struct ActiveSensor
     struct DataBuffer buffer;
     uint32_t rate;
     uint32_t sensorHandle;
+    uint32_t lastDelta;
+    float compactInvScale;
+    float compactMax;
     uint16_t minSamples;
     uint16_t curSamples;
     uint8_t numAxis;
     uint8_t interrupt;
     uint8_t numSamples;
     uint8_t packetSamples;
+    uint8_t dirtyPrev; /* neighbours in the partial buffer list, oldest first */
+    uint8_t dirtyNext;
     uint8_t oneshot : 1;
     uint8_t discard : 1;
-    uint8_t reserved : 6;
+    uint8_t compact : 1;
+    uint8_t reserved : 5;
 } __attribute__((packed));
 
+#define OUTPUT_Q_WAKEUP     0
+#define OUTPUT_Q_NONWAKEUP  1
+#define NUM_OUTPUT_Q        2
+
+struct OutputQueue
+{
+    struct SimpleQueue *sq;
+    uint32_t dropped;
+    uint32_t reported;
+};
+
 static uint8_t mSensorList[SENS_TYPE_LAST_USER];
-static struct SimpleQueue *mOutputQ;
+static struct OutputQueue mOutputQ[NUM_OUTPUT_Q]; /* wakeup data drains first, and is never evicted by non-wakeup data */
 static struct ActiveSensor *mActiveSensorTable;
 static uint8_t mNumSensors;
-static uint8_t mLastSensor;
+ATOMIC_BITSET_DECL(mDirtySensors, SENS_TYPE_LAST_USER, static); /* sensors with a partial buffer */
+static uint8_t mDirtyHead;
+static uint8_t mDirtyTail;
+
+#define DIRTY_NONE  0xFF
+
+#define PARKED_FREE         0
+#define PARKED_WAITING      1    /* handler not run yet */
+#define PARKED_DONE         2    /* resp is ready, the AP collects it by resending the request */
+
+/* a waitIdle request that arrived while busy; it is ACKed and RX moves on to the next request */
+struct ParkedRequest
+{
+    uint64_t timestamp;
+    const struct NanohubCommand *cmd;
+    uint32_t seq;
+    uint32_t order;
+    uint8_t state;
+    uint8_t respLen;
+    uint8_t buf[NANOHUB_PACKET_SIZE_MAX];
+    uint8_t resp[NANOHUB_PACKET_PAYLOAD_MAX];
+};
 
 static const struct HostIntfComm *mComm;
 static bool mBusy;
+static bool mParking;   /* the AP asked for NANOHUB_FIRMWARE_UPLOAD_FLAG_PARK */
+static struct ParkedRequest mParked[MAX_PARKED];
+static struct ParkedRequest *mRxParked; /* the request just received went to (or came from) this slot */
+static uint32_t mParkedOrder;
 static uint64_t mRxTimestamp;
 static uint8_t mRxBuf[NANOHUB_PACKET_SIZE_MAX];
 static size_t mRxSize;
@@ -118,6 +175,10 @@ static struct
 } mTxBuf;
 static size_t mTxSize;
 static uint8_t *mTxBufPtr;
+static uint8_t *mBulkBuf; /* BULK_HEADROOM, frames, postPreamble. kept for retransmits */
+static uint8_t *mBulkTxStart;
+static size_t mBulkLen;
+static size_t mBulkTxSize;
 static uint32_t mSeq;
 static const struct NanohubCommand *mRxCmd;
 ATOMIC_BITSET_DECL(mInterrupt, MAX_INTERRUPTS, static);
@@ -161,6 +222,17 @@ static inline __le32 hostIntfComputeCrc(uint8_t *buf)
     return htole32(crc);
 }
 
+/* responses the AP never collected, e.g. because it gave up and started over */
+static void hostIntfDropCollectable(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < MAX_PARKED; i++) {
+        if (mParked[i].state == PARKED_DONE)
+            mParked[i].state = PARKED_FREE;
+    }
+}
+
 static inline const struct NanohubCommand *hostIntfFindHandler(uint8_t *buf, size_t size, uint32_t *seq)
 {
     struct NanohubPacket *packet = (struct NanohubPacket *)buf;
@@ -168,6 +240,7 @@ static inline const struct NanohubCommand *hostIntfFindHandler(uint8_t *buf, siz
     __le32 packetCrc;
     uint32_t packetReason;
     const struct NanohubCommand *cmd;
+    uint32_t i;
 
     if (size < NANOHUB_PACKET_SIZE(0)) {
         osLog(LOG_WARN, "%s: received incomplete packet (size = %zu)\n", __func__, size);
@@ -188,6 +261,16 @@ static inline const struct NanohubCommand *hostIntfFindHandler(uint8_t *buf, siz
         return NULL;
     }
 
+    packetReason = le32toh(packet->reason);
+
+    for (i = 0; i < MAX_PARKED; i++) {
+        if (mParked[i].state != PARKED_FREE && mParked[i].seq == packet->seq && mParked[i].cmd->reason == packetReason) {
+            mRxParked = mParked + i;
+            *seq = packet->seq;
+            return mRxParked->cmd;
+        }
+    }
+
     if (mSeq == packet->seq) {
         mTxRetrans = true;
         return mRxCmd;
@@ -197,11 +280,9 @@ static inline const struct NanohubCommand *hostIntfFindHandler(uint8_t *buf, siz
 
     *seq = packet->seq;
 
-    if (mBusy)
+    if (mBusy && !mParking)
         return NULL;
 
-    packetReason = le32toh(packet->reason);
-
     if ((cmd = nanohubFindCommand(packetReason)) != NULL) {
         if (packet->len < cmd->minDataLen || packet->len > cmd->maxDataLen) {
             osLog(LOG_WARN, "%s: payload size mismatch (reason = %08" PRIx32 ", min sizeof(payload) = %zu, max sizeof(payload) = %zu, packet->len = %zu)\n",
@@ -210,6 +291,10 @@ static inline const struct NanohubCommand *hostIntfFindHandler(uint8_t *buf, siz
             return NULL;
         }
 
+        // the AP only sends a new upload request once it has the last one's answer
+        if (cmd->waitIdle)
+            hostIntfDropCollectable();
+
         return cmd;
     }
 
@@ -225,8 +310,7 @@ static void hostIntfTxBuf(int size, uint8_t *buf, HostIntfCommCallbackF callback
     mComm->txPacket(mTxBufPtr, mTxSize, callback);
 }
 
-static void hostIntfTxPacket(__le32 reason, uint8_t len, uint32_t seq,
-        HostIntfCommCallbackF callback)
+static void hostIntfPreparePacket(__le32 reason, uint8_t len, uint32_t seq)
 {
     struct NanohubPacket *txPacket = (struct NanohubPacket *)(mTxBuf.buf);
     txPacket->reason = reason;
@@ -236,11 +320,65 @@ static void hostIntfTxPacket(__le32 reason, uint8_t len, uint32_t seq,
 
     struct NanohubPacketFooter *txFooter = hostIntfGetFooter(mTxBuf.buf);
     txFooter->crc = hostIntfComputeCrc(mTxBuf.buf);
+}
+
+static void hostIntfTxPacket(__le32 reason, uint8_t len, uint32_t seq,
+        HostIntfCommCallbackF callback)
+{
+    hostIntfPreparePacket(reason, len, seq);
 
     // send starting with the prePremable byte
     hostIntfTxBuf(1+NANOHUB_PACKET_SIZE(len), &mTxBuf.prePreamble, callback);
 }
 
+static void hostIntfTxBulkPacket(__le32 reason, uint8_t len, uint32_t seq,
+        HostIntfCommCallbackF callback)
+{
+    hostIntfPreparePacket(reason, len, seq);
+
+    // the response goes out right in front of the bulk frames, in one transfer
+    mBulkTxSize = 1 + NANOHUB_PACKET_SIZE(len);
+    mBulkTxStart = mBulkBuf + BULK_HEADROOM - mBulkTxSize;
+    memcpy(mBulkTxStart, &mTxBuf.prePreamble, mBulkTxSize);
+    mBulkTxSize += mBulkLen;
+
+    hostIntfTxBuf(mBulkTxSize, mBulkTxStart, callback);
+}
+
+static void hostIntfBulkFree(void)
+{
+    if (mBulkBuf) {
+        heapFree(mBulkBuf);
+        mBulkBuf = NULL;
+        mBulkLen = 0;
+    }
+}
+
+void *hostIntfBulkAlloc(uint32_t maxLen, uint32_t *len)
+{
+    hostIntfBulkFree();
+
+    if (maxLen > HOSTINTF_BULK_MAX)
+        maxLen = HOSTINTF_BULK_MAX;
+
+    // settle for less rather than fail when the heap is tight
+    for (; maxLen >= NANOHUB_PACKET_PAYLOAD_MAX; maxLen >>= 1) {
+        mBulkBuf = heapAlloc(BULK_HEADROOM + maxLen + 1);
+        if (mBulkBuf) {
+            *len = maxLen;
+            return mBulkBuf + BULK_HEADROOM;
+        }
+    }
+
+    *len = 0;
+    return NULL;
+}
+
+void hostIntfBulkCommit(uint32_t len)
+{
+    mBulkLen = len;
+}
+
 static inline void hostIntfTxPacketDone(int err, size_t tx,
         HostIntfCommCallbackF callback)
 {
@@ -293,24 +431,92 @@ static void hostIntfRxDone(size_t rx, int err)
     hostIntfGenerateAck(NULL);
 }
 
+static struct ParkedRequest *hostIntfOldestParked(bool waitingOnly)
+{
+    struct ParkedRequest *oldest = NULL;
+    uint32_t i;
+
+    for (i = 0; i < MAX_PARKED; i++) {
+        if (mParked[i].state == PARKED_FREE || (waitingOnly && mParked[i].state != PARKED_WAITING))
+            continue;
+        if (!oldest || (int32_t)(mParked[i].order - oldest->order) < 0)
+            oldest = mParked + i;
+    }
+
+    return oldest;
+}
+
+static struct ParkedRequest *hostIntfPark(uint32_t seq)
+{
+    struct ParkedRequest *parked = NULL;
+    uint32_t i;
+
+    for (i = 0; i < MAX_PARKED && !parked; i++) {
+        if (mParked[i].state == PARKED_FREE)
+            parked = mParked + i;
+    }
+
+    if (parked) {
+        parked->timestamp = mRxTimestamp;
+        parked->cmd = mRxCmd;
+        parked->seq = seq;
+        parked->order = mParkedOrder++;
+        memcpy(parked->buf, mRxBuf, mRxSize);
+        parked->state = PARKED_WAITING;
+    }
+
+    return parked;
+}
+
 static void hostIntfGenerateAck(void *cookie)
 {
     uint32_t seq = 0;
 
-    mRxCmd = hostIntfFindHandler(mRxBuf, mRxSize, &seq);
+    mRxParked = NULL;
 
-    if (mRxCmd) {
+    // a read with nothing written first is the AP polling for a parked request
+    if (!mRxSize && (mRxParked = hostIntfOldestParked(false)) != NULL) {
+        mRxCmd = mRxParked->cmd;
+        seq = mRxParked->seq;
+    } else {
+        mRxCmd = hostIntfFindHandler(mRxBuf, mRxSize, &seq);
+    }
+
+    if (mRxParked) {
+        if (mRxParked->state == PARKED_DONE) {
+            // collected; from here on it is the last response sent, for retransmits
+            hostIntfBulkFree();
+            mSeq = seq;
+            memcpy(hostIntfGetPayload(mTxBuf.buf), mRxParked->resp, mRxParked->respLen);
+            mRxParked->state = PARKED_FREE;
+            hostIntfTxPacket(mRxCmd->reason, mRxParked->respLen, seq, hostIntfTxPayloadDone);
+        } else {
+            // accepted, but still waiting for the write in progress
+            hostIntfTxPacket(NANOHUB_REASON_NAK_BUSY, 0, seq, hostIntfTxAckDone);
+        }
+    } else if (mRxCmd) {
         if (mTxRetrans) {
-            hostIntfTxBuf(mTxSize, &mTxBuf.prePreamble, hostIntfTxPayloadDone);
+            if (mBulkBuf)
+                hostIntfTxBuf(mBulkTxSize, mBulkTxStart, hostIntfTxPayloadDone);
+            else
+                hostIntfTxBuf(mTxSize, &mTxBuf.prePreamble, hostIntfTxPayloadDone);
+        } else if (mRxCmd->waitIdle && (mBusy || hostIntfOldestParked(true))) {
+            // ACK and keep receiving; the handler runs once the hub is idle
+            if ((mRxParked = hostIntfPark(seq)) != NULL) {
+                hostIntfTxPacket(NANOHUB_REASON_ACK, 0, seq, hostIntfTxAckDone);
+            } else {
+                mRxCmd = NULL;
+                hostIntfTxPacket(NANOHUB_REASON_NAK_BUSY, 0, seq, hostIntfTxAckDone);
+            }
         } else {
+            hostIntfBulkFree();
             mSeq = seq;
             hostIntfTxPacket(NANOHUB_REASON_ACK, 0, seq, hostIntfTxAckDone);
         }
+    } else if (mBusy && !mParking) {
+        hostIntfTxPacket(NANOHUB_REASON_NAK_BUSY, 0, seq, hostIntfTxAckDone);
     } else {
-        if (mBusy)
-            hostIntfTxPacket(NANOHUB_REASON_NAK_BUSY, 0, seq, hostIntfTxAckDone);
-        else
-            hostIntfTxPacket(NANOHUB_REASON_NAK, 0, seq, hostIntfTxAckDone);
+        hostIntfTxPacket(NANOHUB_REASON_NAK, 0, seq, hostIntfTxAckDone);
     }
 }
 
@@ -324,8 +530,12 @@ static void hostIntfTxAckDone(size_t tx, int err)
         return;
     }
     if (!mRxCmd) {
-        if (!mBusy)
-            osLog(LOG_DEBUG, "%s: NACKed invalid request\n", __func__);
+        osLog(LOG_DEBUG, "%s: NACKed invalid request\n", __func__);
+        hostIntfRxPacket();
+        return;
+    }
+
+    if (mRxParked) {
         hostIntfRxPacket();
         return;
     }
@@ -340,7 +550,10 @@ static void hostIntfGenerateResponse(void *cookie)
     void *txPayload = hostIntfGetPayload(mTxBuf.buf);
     uint8_t respLen = mRxCmd->handler(rxPayload, rx_len, txPayload, mRxTimestamp);
 
-    hostIntfTxPacket(mRxCmd->reason, respLen, mSeq, hostIntfTxPayloadDone);
+    if (mBulkBuf)
+        hostIntfTxBulkPacket(mRxCmd->reason, respLen, mSeq, hostIntfTxPayloadDone);
+    else
+        hostIntfTxPacket(mRxCmd->reason, respLen, mSeq, hostIntfTxPayloadDone);
 }
 
 static void hostIntfTxPayloadDone(size_t tx, int err)
@@ -358,33 +571,158 @@ static void hostIntfRelease()
     mComm->release();
 }
 
+static void markDirty(struct ActiveSensor *sensor)
+{
+    uint8_t idx = sensor - mActiveSensorTable;
+    uint8_t pos = mDirtyTail;
+
+    if (atomicBitsetGetBit(mDirtySensors, idx))
+        return;
+    atomicBitsetSetBit(mDirtySensors, idx);
+
+    // keep the list ordered by first sample; a new buffer almost always goes last
+    while (pos != DIRTY_NONE && mActiveSensorTable[pos].buffer.referenceTime > sensor->buffer.referenceTime)
+        pos = mActiveSensorTable[pos].dirtyPrev;
+
+    sensor->dirtyPrev = pos;
+    if (pos == DIRTY_NONE) {
+        sensor->dirtyNext = mDirtyHead;
+        mDirtyHead = idx;
+    } else {
+        sensor->dirtyNext = mActiveSensorTable[pos].dirtyNext;
+        mActiveSensorTable[pos].dirtyNext = idx;
+    }
+
+    if (sensor->dirtyNext == DIRTY_NONE)
+        mDirtyTail = idx;
+    else
+        mActiveSensorTable[sensor->dirtyNext].dirtyPrev = idx;
+}
+
+static void clearDirty(struct ActiveSensor *sensor)
+{
+    uint8_t idx = sensor - mActiveSensorTable;
+
+    if (!atomicBitsetGetBit(mDirtySensors, idx))
+        return;
+    atomicBitsetClearBit(mDirtySensors, idx);
+
+    if (sensor->dirtyPrev == DIRTY_NONE)
+        mDirtyHead = sensor->dirtyNext;
+    else
+        mActiveSensorTable[sensor->dirtyPrev].dirtyNext = sensor->dirtyNext;
+
+    if (sensor->dirtyNext == DIRTY_NONE)
+        mDirtyTail = sensor->dirtyPrev;
+    else
+        mActiveSensorTable[sensor->dirtyNext].dirtyPrev = sensor->dirtyPrev;
+}
+
 static void resetBuffer(struct ActiveSensor *sensor)
 {
+    clearDirty(sensor);
     sensor->discard = true;
     sensor->buffer.length = 0;
     memset(&sensor->buffer.firstSample, 0x00, sizeof(struct SensorFirstSample));
 }
 
+static void hostIntfRunParked(void *cookie)
+{
+    struct ParkedRequest *parked;
+    uint64_t intSta;
+
+    // in arrival order; a handler that starts another write makes us busy and the rest wait for it
+    while (!mBusy && (parked = hostIntfOldestParked(true)) != NULL) {
+        parked->respLen = parked->cmd->handler(hostIntfGetPayload(parked->buf), hostIntfGetPayloadLen(parked->buf),
+                parked->resp, parked->timestamp);
+
+        intSta = cpuIntsOff();
+        parked->state = PARKED_DONE;
+        cpuIntsRestore(intSta);
+    }
+}
+
+void hostIntfSetParking(bool park)
+{
+    mParking = park;
+}
+
 void hostIntfSetBusy(bool busy)
 {
+    uint64_t intSta;
+    bool run;
+
+    intSta = cpuIntsOff();
     mBusy = busy;
+    run = !busy && hostIntfOldestParked(true);
+    cpuIntsRestore(intSta);
+
+    if (run)
+        osDefer(hostIntfRunParked, NULL, true);
+}
+
+static inline int getOutputQIdx(const struct ActiveSensor *sensor)
+{
+    return sensor->interrupt == NANOHUB_INT_WAKEUP ? OUTPUT_Q_WAKEUP : OUTPUT_Q_NONWAKEUP;
+}
+
+static bool outputEnqueue(int q, const void *buffer, bool discardable)
+{
+    if (simpleQueueEnqueue(mOutputQ[q].sq, buffer, discardable))
+        return true;
+
+    mOutputQ[q].dropped++;
+    return false;
 }
 
-bool hostIntfPacketDequeue(void *data)
+static bool queueEnqueue(const struct ActiveSensor *sensor)
+{
+    return outputEnqueue(getOutputQIdx(sensor), &sensor->buffer, sensor->discard);
+}
+
+void hostIntfGetDropCounts(uint32_t *wakeup, uint32_t *nonwakeup)
+{
+    *wakeup = mOutputQ[OUTPUT_Q_WAKEUP].dropped;
+    *nonwakeup = mOutputQ[OUTPUT_Q_NONWAKEUP].dropped;
+}
+
+static void reportDrops(void)
+{
+    struct OutputQueue *wake = mOutputQ + OUTPUT_Q_WAKEUP;
+    struct OutputQueue *nonWake = mOutputQ + OUTPUT_Q_NONWAKEUP;
+
+    if (wake->dropped != wake->reported || nonWake->dropped != nonWake->reported) {
+        osLog(LOG_WARN, "hostIntf: dropped %" PRIu32 " wakeup, %" PRIu32 " non-wakeup packets since last read\n",
+                wake->dropped - wake->reported, nonWake->dropped - nonWake->reported);
+        wake->reported = wake->dropped;
+        nonWake->reported = nonWake->dropped;
+    }
+}
+
+bool hostIntfPacketDequeue(void *data, uint32_t maxLength)
 {
     struct DataBuffer *buffer;
+    const struct DataBuffer *head = NULL;
     bool ret = false;
     struct ActiveSensor *sensor;
-    int i;
+    int i, q;
+
+    reportDrops();
 
-    if (!(ret = simpleQueueDequeue(mOutputQ, data))) {
-        // nothing in queue. look for partial buffers to flush
-        for (i = 0; i < mNumSensors; i++, mLastSensor = (mLastSensor + 1) % mNumSensors) {
-            if (mActiveSensorTable[mLastSensor].buffer.length > 0) {
-                memcpy(data, &mActiveSensorTable[mLastSensor].buffer, sizeof(struct DataBuffer));
-                resetBuffer(mActiveSensorTable + mLastSensor);
+    for (q = 0; q < NUM_OUTPUT_Q && !head; q++) {
+        // never skip ahead of a queue, or the host would see samples out of order
+        if ((head = simpleQueuePeek(mOutputQ[q].sq)) != NULL && head->length <= maxLength)
+            ret = simpleQueueDequeue(mOutputQ[q].sq, data);
+    }
+
+    if (!head) {
+        // nothing in queue. flush the partial buffer holding the oldest data
+        for (i = mDirtyHead; i != DIRTY_NONE; i = mActiveSensorTable[i].dirtyNext) {
+            sensor = mActiveSensorTable + i;
+            if (sensor->buffer.length <= maxLength) {
+                memcpy(data, &sensor->buffer, offsetof(struct DataBuffer, referenceTime) + sensor->buffer.length);
+                resetBuffer(sensor);
                 ret = true;
-                mLastSensor = (mLastSensor + 1) % mNumSensors;
                 break;
             }
         }
@@ -406,7 +744,7 @@ static void initCompleteCallback(uint32_t timerId, void *data)
     osEnqueuePrivateEvt(EVT_APP_START, NULL, NULL, mHostIntfTid);
 }
 
-static bool queueDiscard(void *data, bool onDelete)
+static bool queueDiscardWakeup(void *data, bool onDelete)
 {
     struct DataBuffer *buffer = data;
     struct ActiveSensor *sensor;
@@ -416,6 +754,8 @@ static bool queueDiscard(void *data, bool onDelete)
 
         if (sensor->curSamples - buffer->firstSample.numSamples >= sensor->minSamples || onDelete) {
             sensor->curSamples -= buffer->firstSample.numSamples;
+            if (!onDelete)
+                mOutputQ[OUTPUT_Q_WAKEUP].dropped++;
 
             return true;
         } else {
@@ -426,14 +766,35 @@ static bool queueDiscard(void *data, bool onDelete)
     }
 }
 
+// non-wakeup data is only worth its latest samples once the AP wakes up: plain drop-oldest
+static bool queueDiscardNonWakeup(void *data, bool onDelete)
+{
+    struct DataBuffer *buffer = data;
+    struct ActiveSensor *sensor;
+
+    if (buffer->sensType > SENS_TYPE_INVALID && buffer->sensType <= SENS_TYPE_LAST_USER && mSensorList[buffer->sensType - 1] < MAX_REGISTERED_SENSORS) { // data
+        sensor = mActiveSensorTable + mSensorList[buffer->sensType - 1];
+        sensor->curSamples -= buffer->firstSample.numSamples;
+    }
+
+    if (!onDelete)
+        mOutputQ[OUTPUT_Q_NONWAKEUP].dropped++;
+
+    return true;
+}
+
 static bool initSensors()
 {
-    int i, j, blocks, maxBlocks, numBlocks = 0, numAxis, packetSamples;
+    int i, j, blocks, maxBlocks, numAxis, packetSamples;
+    int numBlocks[NUM_OUTPUT_Q] = { 0, 0 };
+    int interrupt;
     bool present, error;
     const struct SensorInfo *si;
     uint32_t handle;
 
     mNumSensors = 0;
+    atomicBitsetInit(mDirtySensors, SENS_TYPE_LAST_USER);
+    mDirtyHead = mDirtyTail = DIRTY_NONE;
 
     for (i = SENS_TYPE_INVALID + 1; i <= SENS_TYPE_LAST_USER; i++) {
         for (j = 0, present = 0, error = 0; (si = sensorFind(i, j, &handle)) != NULL; j++) {
@@ -445,6 +806,7 @@ static bool initSensors()
                 if (!present) {
                     present = 1;
                     numAxis = si->numAxis;
+                    interrupt = si->interrupt;
                     switch (si->numAxis) {
                     case NUM_AXIS_EMBEDDED:
                     case NUM_AXIS_ONE:
@@ -481,16 +843,26 @@ static bool initSensors()
 
         if (present && !error) {
             mNumSensors ++;
-            numBlocks += maxBlocks;
+            numBlocks[interrupt == NANOHUB_INT_WAKEUP ? OUTPUT_Q_WAKEUP : OUTPUT_Q_NONWAKEUP] += maxBlocks;
         }
     }
 
-    if (numBlocks > MAX_NUM_BLOCKS) {
-        osLog(LOG_INFO, "initSensors: numBlocks of %d exceeds maximum of %d\n", numBlocks, MAX_NUM_BLOCKS);
-        numBlocks = MAX_NUM_BLOCKS;
+    // each queue needs a block at least; non-wakeup (and debug log) data gives way first
+    for (i = 0; i < NUM_OUTPUT_Q; i++)
+        if (numBlocks[i] < 1)
+            numBlocks[i] = 1;
+
+    if (numBlocks[OUTPUT_Q_WAKEUP] + numBlocks[OUTPUT_Q_NONWAKEUP] > MAX_NUM_BLOCKS) {
+        osLog(LOG_INFO, "initSensors: numBlocks of %d+%d exceeds maximum of %d\n",
+              numBlocks[OUTPUT_Q_WAKEUP], numBlocks[OUTPUT_Q_NONWAKEUP], MAX_NUM_BLOCKS);
+        if (numBlocks[OUTPUT_Q_WAKEUP] > MAX_NUM_BLOCKS - MAX_NUM_BLOCKS / 4)
+            numBlocks[OUTPUT_Q_WAKEUP] = MAX_NUM_BLOCKS - MAX_NUM_BLOCKS / 4;
+        if (numBlocks[OUTPUT_Q_NONWAKEUP] > MAX_NUM_BLOCKS - numBlocks[OUTPUT_Q_WAKEUP])
+            numBlocks[OUTPUT_Q_NONWAKEUP] = MAX_NUM_BLOCKS - numBlocks[OUTPUT_Q_WAKEUP];
     }
 
-    mOutputQ = simpleQueueAlloc(numBlocks, sizeof(struct DataBuffer), queueDiscard);
+    mOutputQ[OUTPUT_Q_WAKEUP].sq = simpleQueueAlloc(numBlocks[OUTPUT_Q_WAKEUP], sizeof(struct DataBuffer), queueDiscardWakeup);
+    mOutputQ[OUTPUT_Q_NONWAKEUP].sq = simpleQueueAlloc(numBlocks[OUTPUT_Q_NONWAKEUP], sizeof(struct DataBuffer), queueDiscardNonWakeup);
     mActiveSensorTable = heapAlloc(mNumSensors * sizeof(struct ActiveSensor));
     memset(mActiveSensorTable, 0x00, mNumSensors * sizeof(struct ActiveSensor));
 
@@ -541,7 +913,7 @@ static void copySingleSamples(struct ActiveSensor *sensor, const struct SingleAx
 
     for (i=0; i<single->samples[0].firstSample.numSamples; i++) {
         if (sensor->buffer.firstSample.numSamples == sensor->packetSamples) {
-            simpleQueueEnqueue(mOutputQ, &sensor->buffer, sensor->discard);
+            queueEnqueue(sensor);
             resetBuffer(sensor);
         }
 
@@ -560,11 +932,11 @@ static void copySingleSamples(struct ActiveSensor *sensor, const struct SingleAx
             if (i == 0) {
                 if (sensor->lastTime > single->referenceTime) {
                     // shouldn't happen. flush current packet
-                    simpleQueueEnqueue(mOutputQ, &sensor->buffer, sensor->discard);
+                    queueEnqueue(sensor);
                     resetBuffer(sensor);
                     i --;
                 } else if (single->referenceTime - sensor->lastTime > UINT32_MAX) {
-                    simpleQueueEnqueue(mOutputQ, &sensor->buffer, sensor->discard);
+                    queueEnqueue(sensor);
                     resetBuffer(sensor);
                     i --;
                 } else {
@@ -601,7 +973,7 @@ static void copyTripleSamples(struct ActiveSensor *sensor, const struct TripleAx
 
     for (i=0; i<triple->samples[0].firstSample.numSamples; i++) {
         if (sensor->buffer.firstSample.numSamples == sensor->packetSamples) {
-            simpleQueueEnqueue(mOutputQ, &sensor->buffer, sensor->discard);
+            queueEnqueue(sensor);
             resetBuffer(sensor);
         }
 
@@ -622,7 +994,7 @@ static void copyTripleSamples(struct ActiveSensor *sensor, const struct TripleAx
             if (i == 0) {
                 if (sensor->lastTime > triple->referenceTime) {
                     // shouldn't happen. flush current packet
-                    simpleQueueEnqueue(mOutputQ, &sensor->buffer, sensor->discard);
+                    queueEnqueue(sensor);
                     resetBuffer(sensor);
                     i --;
                 } else {
@@ -655,6 +1027,128 @@ static void copyTripleSamples(struct ActiveSensor *sensor, const struct TripleAx
     }
 }
 
+static inline float compactAbs(float v)
+{
+    v = v < 0.0f ? -v : v;
+
+    // written this way round so that NaN is dropped too
+    return v <= COMPACT_MAX_ABS ? v : 0.0f;
+}
+
+static inline float compactAbsMax(const struct TripleAxisDataPoint *sample)
+{
+    float x = compactAbs(sample->x);
+    float y = compactAbs(sample->y);
+    float z = compactAbs(sample->z);
+
+    x = x > y ? x : y;
+    return x > z ? x : z;
+}
+
+static uint32_t compactPutVarint(uint8_t *p, uint32_t val)
+{
+    uint32_t len = 0;
+
+    while (val >= 0x80) {
+        p[len++] = (val & 0x7F) | 0x80;
+        val >>= 7;
+    }
+    p[len++] = val;
+
+    return len;
+}
+
+static uint32_t compactPutSample(struct ActiveSensor *sensor, uint8_t *p, const struct TripleAxisDataPoint *sample)
+{
+    float q[3] = { sample->x * sensor->compactInvScale, sample->y * sensor->compactInvScale, sample->z * sensor->compactInvScale };
+    float absMax = compactAbsMax(sample);
+    uint16_t v;
+    int i;
+
+    if (absMax > sensor->compactMax)
+        sensor->compactMax = absMax;
+
+    // written this way round so that NaN escapes too
+    for (i = 0; i < 3; i++) {
+        if (!(q[i] <= COMPACT_QUANT_MAX && q[i] >= -COMPACT_QUANT_MAX)) {
+            v = htole16(NANOHUB_COMPACT_ESCAPE);
+            memcpy(p, &v, sizeof(v));
+            memcpy(p + sizeof(v), &sample->x, sizeof(float));
+            memcpy(p + sizeof(v) + sizeof(float), &sample->y, sizeof(float));
+            memcpy(p + sizeof(v) + 2 * sizeof(float), &sample->z, sizeof(float));
+            return sizeof(v) + 3 * sizeof(float);
+        }
+    }
+
+    for (i = 0; i < 3; i++) {
+        v = htole16((uint16_t)(int16_t)(q[i] >= 0.0f ? q[i] + 0.5f : q[i] - 0.5f));
+        memcpy(p + i * sizeof(v), &v, sizeof(v));
+    }
+
+    return 3 * sizeof(v);
+}
+
+static void compactStartBuffer(struct ActiveSensor *sensor, uint64_t time, const struct TripleAxisDataPoint *sample)
+{
+    float range = compactAbsMax(sample);
+    float scale;
+
+    // size the scale from the previous packet so a steady signal never escapes
+    if (sensor->compactMax > range)
+        range = sensor->compactMax;
+    range *= 2.0f;
+    if (range < COMPACT_MIN_RANGE)
+        range = COMPACT_MIN_RANGE;
+
+    scale = range / COMPACT_QUANT_MAX;
+    sensor->compactInvScale = COMPACT_QUANT_MAX / range;
+    sensor->compactMax = 0.0f;
+    sensor->lastDelta = 0;
+
+    sensor->lastTime = sensor->buffer.referenceTime = time;
+    sensor->buffer.firstSample.encoding = NANOHUB_SENSOR_ENCODING_COMPACT;
+    memcpy(sensor->buffer.buffer + sizeof(struct SensorFirstSample), &scale, sizeof(scale));
+    sensor->buffer.length = sizeof(sensor->buffer.referenceTime) + sizeof(struct SensorFirstSample) + sizeof(scale);
+}
+
+static void copyTripleSamplesCompact(struct ActiveSensor *sensor, const struct TripleAxisDataEvent *triple)
+{
+    int i;
+    uint64_t time;
+    uint32_t deltaTime, zigzag;
+    int32_t dd;
+    uint8_t *p;
+
+    for (i=0; i<triple->samples[0].firstSample.numSamples; i++) {
+        time = i ? sensor->lastTime + triple->samples[i].deltaTime : triple->referenceTime;
+
+        if (sensor->buffer.firstSample.numSamples > 0 &&
+            (sensor->lastTime > time || time - sensor->lastTime > UINT32_MAX ||
+             sensor->buffer.length + COMPACT_SAMPLE_MAX > sizeof(sensor->buffer.referenceTime) + NANOHUB_SENSOR_DATA_MAX)) {
+            queueEnqueue(sensor);
+            resetBuffer(sensor);
+        }
+
+        if (sensor->buffer.firstSample.numSamples == 0) {
+            compactStartBuffer(sensor, time, &triple->samples[i]);
+        } else {
+            // regular sample rates make this delta of deltas 0, i.e. one byte
+            deltaTime = time - sensor->lastTime;
+            dd = (int32_t)(deltaTime - sensor->lastDelta);
+            zigzag = ((uint32_t)dd << 1) ^ (uint32_t)(dd >> 31);
+            p = sensor->buffer.buffer + sensor->buffer.length - sizeof(sensor->buffer.referenceTime);
+            sensor->buffer.length += compactPutVarint(p, zigzag);
+            sensor->lastDelta = deltaTime;
+            sensor->lastTime = time;
+        }
+
+        p = sensor->buffer.buffer + sensor->buffer.length - sizeof(sensor->buffer.referenceTime);
+        sensor->buffer.length += compactPutSample(sensor, p, &triple->samples[i]);
+        sensor->buffer.firstSample.numSamples ++;
+        sensor->curSamples ++;
+    }
+}
+
 static void copyWifiSamples(struct ActiveSensor *sensor, const struct WifiScanEvent *wifiScanEvent)
 {
     int i;
@@ -663,7 +1157,7 @@ static void copyWifiSamples(struct ActiveSensor *sensor, const struct WifiScanEv
 
     for (i = 0; i < wifiScanEvent->results[0].firstSample.numSamples; i++) {
         if (sensor->buffer.firstSample.numSamples == sensor->packetSamples) {
-            simpleQueueEnqueue(mOutputQ, &sensor->buffer, sensor->discard);
+            queueEnqueue(sensor);
             resetBuffer(sensor);
         }
 
@@ -682,7 +1176,7 @@ static void copyWifiSamples(struct ActiveSensor *sensor, const struct WifiScanEv
             if (i == 0) {
                 if (sensor->lastTime > wifiScanEvent->referenceTime) {
                     // shouldn't happen. flush current packet
-                    simpleQueueEnqueue(mOutputQ, &sensor->buffer, sensor->discard);
+                    queueEnqueue(sensor);
                     resetBuffer(sensor);
                     i --;
                 } else {
@@ -709,6 +1203,69 @@ static void copyWifiSamples(struct ActiveSensor *sensor, const struct WifiScanEv
     }
 }
 
+static uint64_t getSensorDeadline(const struct ActiveSensor *sensor, uint64_t currentTime)
+{
+    uint64_t deadline, fill;
+    uint32_t room;
+
+    if (sensor->latency >= SENSOR_LATENCY_NODATA)
+        deadline = UINT64_MAX;
+    else
+        deadline = sensor->lastInterrupt + sensor->latency;
+
+    // the AP must also come before the queue runs out of room this sensor is guaranteed
+    if (sensor->minSamples && sensor->rate && sensor->rate < SENSOR_RATE_ONDEMAND) {
+        if (sensor->curSamples >= sensor->minSamples)
+            return currentTime;
+        room = sensor->minSamples - sensor->curSamples;
+        fill = currentTime + (uint64_t)(room * (1024000000000.0f / sensor->rate));
+        if (fill < deadline)
+            deadline = fill;
+    }
+
+    return deadline;
+}
+
+/*
+ * One interrupt serves every sensor routed to it, since the AP drains the
+ * whole queue when woken. So find the earliest deadline of all of them, raise
+ * once when it is due (or would be missed by waiting for the next hw
+ * delivery), and restart every sensor's latency window from there. Sensors
+ * with similar latencies thus fall into step instead of waking the AP one by
+ * one.
+ */
+static void hostIntfCoalesceInterrupt(uint32_t interrupt, uint64_t currentTime)
+{
+    struct ActiveSensor *sensor;
+    uint64_t deadline, hwLatency;
+    bool due = false;
+    int i;
+
+    for (i = 0; i < mNumSensors && !due; i++) {
+        sensor = mActiveSensorTable + i;
+        if (!sensor->sensorHandle || sensor->interrupt != interrupt)
+            continue;
+
+        deadline = getSensorDeadline(sensor, currentTime);
+        hwLatency = sensorGetCurLatency(sensor->sensorHandle);
+        if (sensor->latency <= hwLatency)
+            hwLatency = 0;
+
+        due = currentTime >= deadline || (deadline != UINT64_MAX && currentTime + hwLatency > deadline);
+    }
+
+    if (!due)
+        return;
+
+    hostIntfSetInterrupt(interrupt);
+
+    for (i = 0; i < mNumSensors; i++) {
+        sensor = mActiveSensorTable + i;
+        if (sensor->sensorHandle && sensor->interrupt == interrupt)
+            sensor->lastInterrupt = currentTime;
+    }
+}
+
 static void hostIntfHandleEvent(uint32_t evtType, const void* evtData)
 {
     struct ConfigCmd *cmd;
@@ -734,7 +1291,7 @@ static void hostIntfHandleEvent(uint32_t evtType, const void* evtData)
     else if (evtType == DEBUG_LOG_EVT) {
         data = (struct DataBuffer *)evtData;
         data->sensType = SENS_TYPE_INVALID;
-        simpleQueueEnqueue(mOutputQ, evtData, true);
+        outputEnqueue(OUTPUT_Q_NONWAKEUP, evtData, true);
     } else
 #endif
     if (evtType == EVT_NO_SENSOR_CONFIG_EVENT) { // config
@@ -748,6 +1305,7 @@ static void hostIntfHandleEvent(uint32_t evtType, const void* evtData)
                 } else if (cmd->enabled) {
                     if (sensorRequestRateChange(mHostIntfTid, sensor->sensorHandle, cmd->rate, cmd->latency)) {
                         sensor->rate = cmd->rate;
+                        sensor->compact = cmd->compact && sensor->numAxis == NUM_AXIS_THREE;
                         if (sensor->latency != cmd->latency) {
                             sensor->latency = cmd->latency;
                             sensor->lastInterrupt = timGetTime();
@@ -758,7 +1316,7 @@ static void hostIntfHandleEvent(uint32_t evtType, const void* evtData)
                     osEventUnsubscribe(mHostIntfTid, sensorGetMyEventType(cmd->sensType));
                     sensor->sensorHandle = 0;
                     if (sensor->buffer.length) {
-                        simpleQueueEnqueue(mOutputQ, &sensor->buffer, sensor->discard);
+                        queueEnqueue(sensor);
                         hostIntfSetInterrupt(sensor->interrupt);
                         resetBuffer(sensor);
                     }
@@ -774,6 +1332,7 @@ static void hostIntfHandleEvent(uint32_t evtType, const void* evtData)
 
                     if (sensorRequest(mHostIntfTid, sensor->sensorHandle, cmd->rate, cmd->latency)) {
                         sensor->rate = cmd->rate;
+                        sensor->compact = cmd->compact && sensor->numAxis == NUM_AXIS_THREE;
                         sensor->latency = cmd->latency;
                         sensor->lastInterrupt = timGetTime();
                         osEventSubscribe(mHostIntfTid, sensorGetMyEventType(cmd->sensType));
@@ -804,12 +1363,13 @@ static void hostIntfHandleEvent(uint32_t evtType, const void* evtData)
             } else {
                 if (sensor->buffer.length > 0) {
                     if (sensor->buffer.firstSample.numFlushes > 0) {
-                        if (!(simpleQueueEnqueue(mOutputQ, &sensor->buffer, sensor->discard)))
+                        if (!(queueEnqueue(sensor)))
                             return; // flushes more important than samples
                         else
                             resetBuffer(sensor);
-                    } else if (sensor->buffer.firstSample.numSamples == sensor->packetSamples) {
-                        simpleQueueEnqueue(mOutputQ, &sensor->buffer, sensor->discard);
+                    } else if (sensor->buffer.firstSample.numSamples == sensor->packetSamples &&
+                               sensor->buffer.firstSample.encoding == NANOHUB_SENSOR_ENCODING_RAW) {
+                        queueEnqueue(sensor);
                         resetBuffer(sensor);
                     }
                 }
@@ -818,7 +1378,7 @@ static void hostIntfHandleEvent(uint32_t evtType, const void* evtData)
                 case NUM_AXIS_EMBEDDED:
                     rtcTime = rtcGetTime();
                     if (sensor->buffer.length > 0 && rtcTime - sensor->lastTime > UINT32_MAX) {
-                        simpleQueueEnqueue(mOutputQ, &sensor->buffer, sensor->discard);
+                        queueEnqueue(sensor);
                         resetBuffer(sensor);
                     }
                     if (sensor->buffer.length == 0) {
@@ -839,7 +1399,15 @@ static void hostIntfHandleEvent(uint32_t evtType, const void* evtData)
                     copySingleSamples(sensor, evtData);
                     break;
                 case NUM_AXIS_THREE:
-                    copyTripleSamples(sensor, evtData);
+                    if (sensor->buffer.firstSample.numSamples > 0 &&
+                        (sensor->buffer.firstSample.encoding == NANOHUB_SENSOR_ENCODING_COMPACT) != sensor->compact) {
+                        queueEnqueue(sensor);
+                        resetBuffer(sensor);
+                    }
+                    if (sensor->compact)
+                        copyTripleSamplesCompact(sensor, evtData);
+                    else
+                        copyTripleSamples(sensor, evtData);
                     break;
                 case NUM_AXIS_WIFI:
                     copyWifiSamples(sensor, evtData);
@@ -849,13 +1417,11 @@ static void hostIntfHandleEvent(uint32_t evtType, const void* evtData)
                 }
             }
 
+            if (sensor->buffer.length > 0)
+                markDirty(sensor);
+
             currentTime = timGetTime();
-            if ((currentTime >= sensor->lastInterrupt + sensor->latency) ||
-                ((sensor->latency > sensorGetCurLatency(sensor->sensorHandle)) &&
-                    (currentTime + sensorGetCurLatency(sensor->sensorHandle) > sensor->lastInterrupt + sensor->latency))) {
-                hostIntfSetInterrupt(sensor->interrupt);
-                sensor->lastInterrupt += sensor->latency;
-            }
+            hostIntfCoalesceInterrupt(sensor->interrupt, currentTime);
 
             if (sensor->oneshot) {
                 sensorRelease(mHostIntfTid, sensor->sensorHandle);
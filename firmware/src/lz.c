@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+#include <lz.h>
+
+#define LZ_WINDOW_MASK          (LZ_WINDOW_SIZE - 1)
+
+#define LZ_STATE_TOKEN          0
+#define LZ_STATE_LIT_LEN        1
+#define LZ_STATE_LITERALS       2
+#define LZ_STATE_OFST_LO        3
+#define LZ_STATE_OFST_HI        4
+#define LZ_STATE_MATCH_LEN      5
+#define LZ_STATE_DONE           6
+#define LZ_STATE_BAD            7
+
+void lzDecInit(struct LzDecoder *dec, uint8_t *window, uint32_t compressedLen, uint32_t origLen)
+{
+    memset(dec, 0, sizeof(struct LzDecoder));
+    dec->window = window;
+    dec->inLeft = compressedLen;
+    dec->outLeft = origLen;
+    dec->state = LZ_STATE_TOKEN;
+}
+
+//hand whatever is in the window but not yet written out to the caller
+static bool lzDecFlush(struct LzDecoder *dec, LzWriteF writeF, void *writeD)
+{
+    uint32_t len = dec->outPos - dec->flushedPos;
+
+    if (!len)
+        return true;
+
+    if (!writeF(writeD, dec->window + (dec->flushedPos & LZ_WINDOW_MASK), len))
+        return false;
+
+    dec->flushedPos = dec->outPos;
+    return true;
+}
+
+//account for n bytes just placed at the write position, n never crosses the end of the window
+static bool lzDecProduced(struct LzDecoder *dec, uint32_t n, LzWriteF writeF, void *writeD)
+{
+    dec->outPos += n;
+    dec->outLeft -= n;
+
+    //window is full: write it out before it gets overwritten
+    if (!(dec->outPos & LZ_WINDOW_MASK))
+        return lzDecFlush(dec, writeF, writeD);
+
+    return true;
+}
+
+static uint32_t lzDecRoom(const struct LzDecoder *dec, uint32_t want)
+{
+    uint32_t room = LZ_WINDOW_SIZE - (dec->outPos & LZ_WINDOW_MASK);
+
+    return want < room ? want : room;
+}
+
+static bool lzDecMatch(struct LzDecoder *dec, LzWriteF writeF, void *writeD)
+{
+    uint8_t *dst, *src;
+    uint32_t n, i, srcIdx;
+
+    if (dec->matchLen > dec->outLeft)
+        return false;
+
+    while (dec->matchLen) {
+        srcIdx = (dec->outPos - dec->offset) & LZ_WINDOW_MASK;
+        n = lzDecRoom(dec, dec->matchLen);
+        if (n > LZ_WINDOW_SIZE - srcIdx)
+            n = LZ_WINDOW_SIZE - srcIdx;
+
+        dst = dec->window + (dec->outPos & LZ_WINDOW_MASK);
+        src = dec->window + srcIdx;
+        if (dec->offset >= n)
+            memmove(dst, src, n);
+        else for (i = 0; i < n; i++) //overlapping match repeats the last 'offset' bytes
+            dst[i] = src[i];
+
+        dec->matchLen -= n;
+        if (!lzDecProduced(dec, n, writeF, writeD))
+            return false;
+    }
+
+    return true;
+}
+
+bool lzDecProcess(struct LzDecoder *dec, const void *data, uint32_t len, LzWriteF writeF, void *writeD)
+{
+    const uint8_t *in = (const uint8_t *)data;
+    uint32_t n;
+    uint8_t c;
+
+    if (len > dec->inLeft)
+        dec->state = LZ_STATE_BAD;
+
+    while (len && dec->state != LZ_STATE_BAD) {
+
+        //literals are copied in bulk, everything else is a byte at a time
+        if (dec->state == LZ_STATE_LITERALS) {
+            n = lzDecRoom(dec, dec->litLen);
+            if (n > len)
+                n = len;
+            if (n > dec->outLeft) {
+                dec->state = LZ_STATE_BAD;
+                break;
+            }
+
+            memcpy(dec->window + (dec->outPos & LZ_WINDOW_MASK), in, n);
+            in += n;
+            len -= n;
+            dec->inLeft -= n;
+            dec->litLen -= n;
+            if (!lzDecProduced(dec, n, writeF, writeD))
+                dec->state = LZ_STATE_BAD;
+            else if (!dec->litLen)
+                dec->state = dec->inLeft ? LZ_STATE_OFST_LO : LZ_STATE_DONE;
+            continue;
+        }
+
+        c = *in++;
+        len--;
+        dec->inLeft--;
+
+        switch (dec->state) {
+        case LZ_STATE_TOKEN:
+            dec->litLen = c >> 4;
+            dec->matchLen = (c & 0x0F) + LZ_MIN_MATCH;
+            if (dec->litLen == LZ_LEN_MORE)
+                dec->state = LZ_STATE_LIT_LEN;
+            else if (dec->litLen)
+                dec->state = LZ_STATE_LITERALS;
+            else
+                dec->state = dec->inLeft ? LZ_STATE_OFST_LO : LZ_STATE_DONE;
+            break;
+
+        case LZ_STATE_LIT_LEN:
+            dec->litLen += c;
+            if (c != 0xFF)
+                dec->state = LZ_STATE_LITERALS;
+            break;
+
+        case LZ_STATE_OFST_LO:
+            dec->offset = c;
+            dec->state = LZ_STATE_OFST_HI;
+            break;
+
+        case LZ_STATE_OFST_HI:
+            dec->offset |= c << 8;
+            if (!dec->offset || dec->offset > LZ_WINDOW_SIZE || dec->offset > dec->outPos)
+                dec->state = LZ_STATE_BAD;
+            else if (dec->matchLen == LZ_LEN_MORE + LZ_MIN_MATCH)
+                dec->state = LZ_STATE_MATCH_LEN;
+            else
+                dec->state = lzDecMatch(dec, writeF, writeD) ? LZ_STATE_TOKEN : LZ_STATE_BAD;
+            break;
+
+        case LZ_STATE_MATCH_LEN:
+            dec->matchLen += c;
+            if (c != 0xFF)
+                dec->state = lzDecMatch(dec, writeF, writeD) ? LZ_STATE_TOKEN : LZ_STATE_BAD;
+            break;
+
+        default: //data after the end of the stream
+            dec->state = LZ_STATE_BAD;
+            break;
+        }
+    }
+
+    return dec->state != LZ_STATE_BAD;
+}
+
+bool lzDecFinish(struct LzDecoder *dec, LzWriteF writeF, void *writeD)
+{
+    if (dec->state != LZ_STATE_DONE || dec->outLeft)
+        return false;
+
+    return lzDecFlush(dec, writeF, writeD);
+}
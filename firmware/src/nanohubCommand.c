@@ -17,6 +17,7 @@
 #include <plat/inc/taggedPtr.h>
 #include <plat/inc/rtc.h>
 #include <inttypes.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdint.h>
 #include <sys/endian.h>
@@ -33,8 +34,12 @@
 #include <sensType.h>
 #include <timer.h>
 #include <crc.h>
+#include <floatRt.h>
 #include <rsa.h>
+#include <sha2.h>
 #include <appSec.h>
+#include <appIndex.h>
+#include <sigCache.h>
 #include <plat/inc/bl.h>
 #include <plat/inc/plat.h>
 #include <variant/inc/variant.h>
@@ -43,6 +48,20 @@
         { .reason = _reason, .handler = _handler, \
           .minDataLen = sizeof(_minReqType), .maxDataLen = sizeof(_maxReqType) }
 
+#define NANOHUB_COMMAND_WAIT_IDLE(_reason, _handler, _minReqType, _maxReqType) \
+        { .reason = _reason, .handler = _handler, \
+          .minDataLen = sizeof(_minReqType), .maxDataLen = sizeof(_maxReqType), \
+          .waitIdle = true }
+
+/*
+ * Windowed uploads accept a chunk as soon as it is copied into the staging
+ * ring and write flash in FIRMWARE_WRITE_SIZE pieces behind the host's back.
+ * We only go busy (parking the next chunk) when the ring cannot take another
+ * full chunk, so the host normally streams at bus speed.
+ */
+#define FIRMWARE_WRITE_SIZE     1024
+#define FIRMWARE_STAGE_SIZE     (4 * FIRMWARE_WRITE_SIZE)
+
 static struct DownloadState
 {
     struct AppSecState *appSecState;
@@ -52,13 +71,19 @@ static struct DownloadState
     uint8_t *start;
     uint32_t crc;
     uint32_t srcCrc;
+    uint8_t *stage;          /* windowed uploads only */
+    uint32_t stageHead;      /* next byte to write to flash */
+    uint32_t stageUsed;
     uint8_t  data[NANOHUB_PACKET_PAYLOAD_MAX];
     uint8_t  len;
     uint8_t  chunkReply;
     uint8_t  type;
     bool     erase;
+    bool     writing;        /* firmwareWriteStaged is scheduled */
 } *mDownloadState;
 
+static uint8_t firmwareFinish(bool valid);
+
 static size_t getOsHwVersion(void *rx, uint8_t rx_len, void *tx, uint64_t timestamp)
 {
     struct NanohubOsHwVersionsResponse *resp = tx;
@@ -104,8 +129,13 @@ static size_t queryAppInfo(void *rx, uint8_t rx_len, void *tx, uint64_t timestam
 
 static AppSecErr writeCbk(const void *data, uint32_t len)
 {
+    extern char __shared_end[];
     AppSecErr ret;
 
+    // decompressed apps outgrow the upload size that room was found for; keep space for padding and the CRC
+    if (mDownloadState->start + mDownloadState->dstOffset + len + 3 + sizeof(uint32_t) > (uint8_t *)&__shared_end)
+        return APP_SEC_TOO_MUCH_DATA;
+
     mpuAllowRamExecution(true);
     mpuAllowRomWrite(true);
     if (BL.blProgramShared(mDownloadState->start + mDownloadState->dstOffset, (uint8_t *)data, len, BL_FLASH_KEY1, BL_FLASH_KEY2) < 0) {
@@ -120,6 +150,42 @@ static AppSecErr writeCbk(const void *data, uint32_t len)
     return ret;
 }
 
+// a segment is a 4-byte header, the data padded to 4 bytes and a CRC
+static bool segmentFits(const uint8_t *start, uint32_t len)
+{
+    extern char __shared_end[];
+
+    return start + sizeof(uint32_t) + ((len + 3) & ~3) + sizeof(uint32_t) < (uint8_t *)&__shared_end;
+}
+
+/*
+ * Room after the last segment was found for the upload size, which for a
+ * compressed app is only the size of the stream. Once appSec knows how big
+ * the app really is, and before any of it is written, fall back to erasing
+ * the shared area if it does not fit where we were going to put it.
+ */
+static AppSecErr sizeCbk(uint32_t len)
+{
+    extern char __shared_start[];
+
+    if (segmentFits(mDownloadState->start, len))
+        return APP_SEC_NO_ERROR;
+
+    if (mDownloadState->start == (uint8_t *)&__shared_start || mDownloadState->dstOffset != 4 ||
+            !segmentFits((uint8_t *)&__shared_start, len))
+        return APP_SEC_TOO_MUCH_DATA;
+
+    osLog(LOG_INFO, "Unpacked app needs %" PRIu32 " bytes, erasing shared flash\n", len);
+    mpuAllowRamExecution(true);
+    mpuAllowRomWrite(true);
+    BL.blEraseShared(BL_FLASH_KEY1, BL_FLASH_KEY2);
+    mpuAllowRomWrite(false);
+    mpuAllowRamExecution(false);
+    mDownloadState->start = (uint8_t *)&__shared_start;
+
+    return APP_SEC_NO_ERROR;
+}
+
 static AppSecErr pubKeyFindCbk(const uint32_t *gotKey, bool *foundP)
 {
     const uint32_t *ptr;
@@ -165,10 +231,48 @@ static void resetDownloadState()
 {
     if (mDownloadState->appSecState)
         appSecDeinit(mDownloadState->appSecState);
-    mDownloadState->appSecState = appSecInit(writeCbk, pubKeyFindCbk, aesKeyAccessCbk, false);
+    mDownloadState->appSecState = appSecInit(writeCbk, pubKeyFindCbk, aesKeyAccessCbk, sigCacheFind, sizeCbk, false);
     mDownloadState->srcOffset = 0;
     mDownloadState->srcCrc = ~0;
     mDownloadState->dstOffset = 4; // skip over header
+    mDownloadState->stageHead = 0;
+    mDownloadState->stageUsed = 0;
+}
+
+static void freeDownloadState()
+{
+    if (mDownloadState->appSecState)
+        appSecDeinit(mDownloadState->appSecState);
+    if (mDownloadState->stage)
+        heapFree(mDownloadState->stage);
+    heapFree(mDownloadState);
+    mDownloadState = NULL;
+}
+
+/*
+ * An upload that was cut short (AP suspend, bus error, host driver reload)
+ * is still in mDownloadState with its appSec state, so if the host starts the
+ * same image again we can carry on where it stopped instead of erasing and
+ * starting over. The image is identified by its size, CRC and type.
+ */
+static bool canResumeUpload(const struct NanohubStartFirmwareUploadRequest *req)
+{
+    return mDownloadState &&
+           mDownloadState->chunkReply == NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED &&
+           mDownloadState->type == req->type &&
+           mDownloadState->size == le32toh(req->size) &&
+           mDownloadState->crc == le32toh(req->crc) &&
+           !mDownloadState->stage == !(req->flags & NANOHUB_FIRMWARE_UPLOAD_FLAG_WINDOWED);
+}
+
+/*
+ * Only images the bootloader applies may be uploaded. The app index and the
+ * signature cache are trusted at boot, so they must only ever be written by
+ * firmwareFinish() after an app checked out.
+ */
+static bool isUploadType(uint8_t type)
+{
+    return type == BL_FLASH_KERNEL_ID || type == BL_FLASH_EEDATA_ID || type == BL_FLASH_APP_ID;
 }
 
 static size_t startFirmwareUpload(void *rx, uint8_t rx_len, void *tx, uint64_t timestamp)
@@ -181,9 +285,47 @@ static size_t startFirmwareUpload(void *rx, uint8_t rx_len, void *tx, uint64_t t
     uint8_t *shared_end = (uint8_t *)&__shared_end;
     uint8_t *shared;
     int len, total_len;
+    bool haveFlags = rx_len > offsetof(struct NanohubStartFirmwareUploadRequest, flags);
+    uint8_t park = haveFlags ? req->flags & NANOHUB_FIRMWARE_UPLOAD_FLAG_PARK : 0;
 
-    if (!mDownloadState)
+    if (!isUploadType(req->type)) {
+        osLog(LOG_WARN, "Refusing upload of segment type 0x%x\n", req->type);
+        resp->accepted = 0;
+        return sizeof(resp->accepted);
+    }
+
+    if (haveFlags && (req->flags & NANOHUB_FIRMWARE_UPLOAD_FLAG_RESUME) && canResumeUpload(req)) {
+        osLog(LOG_INFO, "Resuming upload at %" PRIu32 " of %" PRIu32 " bytes\n", mDownloadState->srcOffset, mDownloadState->size);
+        hostIntfSetParking(park);
+        resp->accepted = 1;
+        resp->flags = NANOHUB_FIRMWARE_UPLOAD_FLAG_RESUME | (mDownloadState->stage ? NANOHUB_FIRMWARE_UPLOAD_FLAG_WINDOWED : 0) | park;
+        resp->resumeOffset = htole32(mDownloadState->srcOffset);
+        resp->written = htole32(mDownloadState->dstOffset - 4);
+        return sizeof(*resp);
+    }
+
+    // a restarted upload must not leave the previous one's staged data behind
+    if (mDownloadState && mDownloadState->writing)
+        return 0;
+
+    // nor program over what it wrote: close that as a deleted segment first
+    if (mDownloadState && mDownloadState->dstOffset > 4)
+        firmwareFinish(false);
+
+    if (!mDownloadState) {
         mDownloadState = heapAlloc(sizeof(struct DownloadState));
+        if (!mDownloadState)
+            return 0;
+        memset(mDownloadState, 0x00, sizeof(struct DownloadState));
+    }
+
+    if (haveFlags && (req->flags & NANOHUB_FIRMWARE_UPLOAD_FLAG_WINDOWED)) {
+        if (!mDownloadState->stage)
+            mDownloadState->stage = heapAlloc(FIRMWARE_STAGE_SIZE);
+    } else if (mDownloadState->stage) {
+        heapFree(mDownloadState->stage);
+        mDownloadState->stage = NULL;
+    }
 
     mDownloadState->type = req->type;
     mDownloadState->size = le32toh(req->size);
@@ -197,7 +339,7 @@ static size_t startFirmwareUpload(void *rx, uint8_t rx_len, void *tx, uint64_t t
         total_len = sizeof(uint32_t) + ((len + 3) & ~3) + sizeof(uint32_t);
     }
 
-    if (shared + sizeof(uint32_t) + ((mDownloadState->size + 3) & ~3) + sizeof(uint32_t) < shared_end) {
+    if (segmentFits(shared, mDownloadState->size)) {
         mDownloadState->start = shared;
         mDownloadState->erase = false;
     } else {
@@ -205,10 +347,19 @@ static size_t startFirmwareUpload(void *rx, uint8_t rx_len, void *tx, uint64_t t
         mDownloadState->erase = true;
     }
     resetDownloadState();
+    hostIntfSetParking(park);
 
     resp->accepted = 1;
 
-    return sizeof(*resp);
+    if (haveFlags) {
+        // no staging memory means the host falls back to stop-and-wait
+        resp->flags = (mDownloadState->stage ? NANOHUB_FIRMWARE_UPLOAD_FLAG_WINDOWED : 0) | park;
+        resp->resumeOffset = htole32(0);
+        resp->written = htole32(0);
+        return sizeof(*resp);
+    }
+
+    return sizeof(resp->accepted);
 }
 
 static void firmwareErase(void *cookie)
@@ -230,7 +381,9 @@ static uint8_t firmwareFinish(bool valid)
     uint8_t buffer[7];
     int padlen;
     uint32_t crc;
-    uint16_t marker;
+    uint32_t imageHash[SHA2_HASH_WORDS], rootKeyHash[SHA2_HASH_WORDS];
+    uint8_t *end;
+    uint16_t marker = APP_HDR_MARKER_DELETED;
     static const char magic[] = APP_HDR_MAGIC;
     const struct AppHdr *app;
     AppSecErr ret;
@@ -292,8 +445,20 @@ static uint8_t firmwareFinish(bool valid)
 
     mpuAllowRomWrite(false);
     mpuAllowRamExecution(false);
-    heapFree(mDownloadState);
-    mDownloadState = NULL;
+
+    if (ret == APP_SEC_NO_ERROR && valid && mDownloadState->type == BL_FLASH_APP_ID && marker == APP_HDR_MARKER_VALID) {
+        end = mDownloadState->start + mDownloadState->size;
+
+        // let a re-upload of this image skip the RSA chain
+        if (appSecGetVerifiedSig(mDownloadState->appSecState, imageHash, rootKeyHash) && sigCacheWrite(end, imageHash, rootKeyHash))
+            end += appIndexSegSize(end);
+
+        // let the next boot start this app without rescanning the shared area
+        if (!appIndexWrite(end, mDownloadState->start))
+            osLog(LOG_WARN, "No room for the app index, next boot will check every app\n");
+    }
+
+    freeDownloadState();
 
     return NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED;
 }
@@ -301,6 +466,7 @@ static uint8_t firmwareFinish(bool valid)
 static void firmwareWrite(void *cookie)
 {
     AppSecErr ret;
+    uint8_t reply;
 
     if (mDownloadState->type == BL_FLASH_APP_ID)
         ret = appSecRxData(mDownloadState->appSecState, mDownloadState->data, mDownloadState->len);
@@ -309,7 +475,10 @@ static void firmwareWrite(void *cookie)
 
     if (ret == APP_SEC_NO_ERROR) {
         if (mDownloadState->srcOffset == mDownloadState->size && mDownloadState->crc == ~mDownloadState->srcCrc) {
-            mDownloadState->chunkReply = firmwareFinish(true);
+            // a finished upload has no state left to put the reply in
+            reply = firmwareFinish(true);
+            if (mDownloadState)
+                mDownloadState->chunkReply = reply;
         } else {
             mDownloadState->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED;
         }
@@ -319,6 +488,119 @@ static void firmwareWrite(void *cookie)
     hostIntfSetBusy(false);
 }
 
+static void firmwareWriteStaged(void *cookie)
+{
+    uint32_t len = mDownloadState->stageUsed;
+    bool done = mDownloadState->srcOffset == mDownloadState->size;
+    AppSecErr ret;
+
+    // the ring is a multiple of FIRMWARE_WRITE_SIZE, so a piece never wraps
+    if (len > FIRMWARE_WRITE_SIZE)
+        len = FIRMWARE_WRITE_SIZE;
+
+    if (mDownloadState->chunkReply == NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED && (len == FIRMWARE_WRITE_SIZE || (done && len))) {
+        if (mDownloadState->type == BL_FLASH_APP_ID)
+            ret = appSecRxData(mDownloadState->appSecState, mDownloadState->stage + mDownloadState->stageHead, len);
+        else
+            ret = writeCbk(mDownloadState->stage + mDownloadState->stageHead, len);
+
+        if (ret != APP_SEC_NO_ERROR) {
+            mDownloadState->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_CANCEL;
+            mDownloadState->stageUsed = 0;
+        } else {
+            mDownloadState->stageHead = (mDownloadState->stageHead + len) % FIRMWARE_STAGE_SIZE;
+            mDownloadState->stageUsed -= len;
+        }
+    }
+
+    // a failed write or a bad image CRC: close the segment so the next upload
+    // does not program over flash that is still partly written
+    if (mDownloadState->chunkReply != NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED) {
+        mDownloadState->writing = false;
+        firmwareFinish(false);
+        hostIntfSetBusy(false);
+    } else if (mDownloadState->stageUsed >= FIRMWARE_WRITE_SIZE || (done && mDownloadState->stageUsed)) {
+        // write one piece per pass so other work is not held up for a whole ring
+        osDefer(firmwareWriteStaged, NULL, false);
+    } else {
+        mDownloadState->writing = false;
+        hostIntfSetBusy(false);
+    }
+}
+
+static void firmwareStage(const uint8_t *data, uint32_t len)
+{
+    uint32_t tail = (mDownloadState->stageHead + mDownloadState->stageUsed) % FIRMWARE_STAGE_SIZE;
+    uint32_t first = FIRMWARE_STAGE_SIZE - tail;
+
+    if (first > len)
+        first = len;
+    memcpy(mDownloadState->stage + tail, data, first);
+    memcpy(mDownloadState->stage, data + first, len - first);
+    mDownloadState->stageUsed += len;
+
+    if (!mDownloadState->writing && (mDownloadState->stageUsed >= FIRMWARE_WRITE_SIZE || mDownloadState->srcOffset == mDownloadState->size)) {
+        mDownloadState->writing = true;
+        osDefer(firmwareWriteStaged, NULL, false);
+    }
+
+    // park the next chunk until the ring has room for it, or, after the last
+    // chunk, until everything is in flash and the host can ask for the result
+    if (mDownloadState->writing && (FIRMWARE_STAGE_SIZE - mDownloadState->stageUsed < NANOHUB_PACKET_PAYLOAD_MAX - sizeof(__le32) ||
+                                    mDownloadState->srcOffset == mDownloadState->size))
+        hostIntfSetBusy(true);
+}
+
+/*
+ * Windowed uploads: every accepted chunk is answered immediately with the next
+ * offset we expect. A chunk at any other offset (a lost or repeated packet)
+ * is answered with RESEND_FROM and the host continues from nextOffset instead
+ * of restarting the whole image. Once all data is sent the host sends an
+ * empty chunk at offset == size; it is parked until the ring is flushed and
+ * answered with the final result.
+ */
+static size_t firmwareChunkWindowed(struct NanohubFirmwareChunkRequest *req, uint8_t len, struct NanohubFirmwareChunkWindowResponse *resp)
+{
+    uint32_t offset = le32toh(req->offset);
+
+    if (mDownloadState->chunkReply != NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED) {
+        resp->chunkReply = mDownloadState->chunkReply;
+    } else if (mDownloadState->erase == true) {
+        resp->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_WAIT;
+        osDefer(firmwareErase, NULL, false);
+    } else if (offset != mDownloadState->srcOffset) {
+        resp->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_RESEND_FROM;
+    } else if (!len) {
+        if (mDownloadState->srcOffset != mDownloadState->size || mDownloadState->writing) {
+            resp->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_WAIT;
+        } else {
+            resp->chunkReply = firmwareFinish(true);
+            if (mDownloadState)
+                mDownloadState->chunkReply = resp->chunkReply;
+        }
+    } else if (len > FIRMWARE_STAGE_SIZE - mDownloadState->stageUsed) {
+        resp->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_WAIT;
+    } else {
+        mDownloadState->srcCrc = crc32(req->data, len, mDownloadState->srcCrc);
+        mDownloadState->srcOffset += len;
+        if ((mDownloadState->srcOffset == mDownloadState->size && mDownloadState->crc != ~mDownloadState->srcCrc) || (mDownloadState->srcOffset > mDownloadState->size)) {
+            mDownloadState->srcOffset -= len;
+            resp->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_CANCEL;
+            if (!mDownloadState->writing)
+                firmwareFinish(false);
+            else
+                mDownloadState->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_CANCEL; // firmwareWriteStaged finishes it
+        } else {
+            firmwareStage(req->data, len);
+            resp->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED;
+        }
+    }
+
+    resp->nextOffset = htole32(mDownloadState ? mDownloadState->srcOffset : offset);
+
+    return sizeof(*resp);
+}
+
 static size_t firmwareChunk(void *rx, uint8_t rx_len, void *tx, uint64_t timestamp)
 {
     uint32_t offset;
@@ -329,7 +611,9 @@ static size_t firmwareChunk(void *rx, uint8_t rx_len, void *tx, uint64_t timesta
     offset = le32toh(req->offset);
     len = rx_len - sizeof(req->offset);
 
-    if (!mDownloadState) {
+    if (mDownloadState && mDownloadState->stage) {
+        return firmwareChunkWindowed(req, len, tx);
+    } else if (!mDownloadState) {
         resp->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_CANCEL_NO_RETRY;
     } else if (mDownloadState->chunkReply != NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED) {
         resp->chunkReply = mDownloadState->chunkReply;
@@ -340,13 +624,12 @@ static size_t firmwareChunk(void *rx, uint8_t rx_len, void *tx, uint64_t timesta
         resp->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_RESTART;
         resetDownloadState();
     } else {
-        mDownloadState->srcCrc = crc32(req->data, len, mDownloadState->srcCrc);
+        mDownloadState->srcCrc = crc32Copy(mDownloadState->data, req->data, len, mDownloadState->srcCrc);
         mDownloadState->srcOffset += len;
         if ((mDownloadState->srcOffset == mDownloadState->size && mDownloadState->crc != ~mDownloadState->srcCrc) || (mDownloadState->srcOffset > mDownloadState->size)) {
             firmwareFinish(false);
             resp->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_CANCEL;
         } else {
-            memcpy(mDownloadState->data, req->data, len);
             mDownloadState->len = len;
             resp->chunkReply = NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED;
             hostIntfSetBusy(true);
@@ -399,53 +682,174 @@ struct EvtPacket
     uint8_t data[NANOHUB_SENSOR_DATA_MAX];
 } __attribute__((packed));
 
-#define SYNC_DATAPOINTS 16
-#define SYNC_RESET      10000000000ULL /* 10 seconds, ~100us drift */
+#define SYNC_DATAPOINTS   16
+#define SYNC_MIN_FIT      4          /* points needed before outliers can be told apart */
+#define SYNC_OUTLIER      2000000LL  /* 2ms off the fit is bus or scheduling latency, not drift */
+#define SYNC_MAX_OUTLIERS 4          /* that many in a row means a clock jumped: start over */
+#define SYNC_MAX_SKEW     0.0005f    /* 500ppm, far beyond any real crystal */
 
+/*
+ * Online least squares fit of (apTime - hubTime) = offset + skew * hubTime,
+ * over the last SYNC_DATAPOINTS READ_EVENT requests. Everything is kept
+ * relative to the oldest point so that floats hold enough precision.
+ */
 struct TimeSync
 {
-    uint64_t lastTime;
-    uint64_t delta[SYNC_DATAPOINTS];
-    uint64_t avgDelta;
+    uint64_t hubTime[SYNC_DATAPOINTS];
+    uint64_t apTime[SYNC_DATAPOINTS];
+    uint64_t hubBase;
+    uint64_t deltaBase;
+    float offset;
+    float skew;
     uint8_t cnt;
     uint8_t tail;
-} __attribute__((packed));
+    uint8_t outliers;
+    bool fitValid;
+};
 
-static uint64_t getAvgDelta(struct TimeSync *sync);
+static struct TimeSync mTimeSync;
 
-static void addDelta(struct TimeSync *sync, uint64_t apTime, uint64_t hubTime)
+static void timeSyncFit(struct TimeSync *sync)
 {
-    if (apTime - sync->lastTime > SYNC_RESET) {
-        sync->tail = 0;
-        sync->cnt = 0;
+    float meanX = 0.0f, meanY = 0.0f, sxx = 0.0f, sxy = 0.0f, invN, x, y;
+    int i, idx, oldest;
+
+    oldest = sync->cnt < SYNC_DATAPOINTS ? 0 : sync->tail;
+    sync->hubBase = sync->hubTime[oldest];
+    sync->deltaBase = sync->apTime[oldest] - sync->hubTime[oldest];
+    invN = 1.0f / sync->cnt;
+
+    for (i = 0, idx = oldest; i < sync->cnt; i++, idx = (idx + 1) % SYNC_DATAPOINTS) {
+        meanX += floatFromUint64(sync->hubTime[idx] - sync->hubBase) * invN;
+        meanY += floatFromInt64((int64_t)(sync->apTime[idx] - sync->hubTime[idx] - sync->deltaBase)) * invN;
     }
 
-    sync->delta[sync->tail++] = apTime - hubTime;
+    for (i = 0, idx = oldest; i < sync->cnt; i++, idx = (idx + 1) % SYNC_DATAPOINTS) {
+        x = floatFromUint64(sync->hubTime[idx] - sync->hubBase) - meanX;
+        y = floatFromInt64((int64_t)(sync->apTime[idx] - sync->hubTime[idx] - sync->deltaBase)) - meanY;
+        sxx += x * x;
+        sxy += x * y;
+    }
+
+    sync->skew = sxx > 0.0f ? sxy / sxx : 0.0f;
+    if (sync->skew > SYNC_MAX_SKEW)
+        sync->skew = SYNC_MAX_SKEW;
+    else if (sync->skew < -SYNC_MAX_SKEW)
+        sync->skew = -SYNC_MAX_SKEW;
+    sync->offset = meanY - sync->skew * meanX;
+    sync->fitValid = true;
+}
+
+// apTime - hubTime, as predicted for the given hub time
+static uint64_t getDelta(struct TimeSync *sync, uint64_t hubTime)
+{
+    if (!sync->cnt)
+        return 0ULL;
+
+    if (!sync->fitValid)
+        timeSyncFit(sync);
 
-    sync->lastTime = apTime;
+    return sync->deltaBase + floatToInt64(sync->offset + sync->skew * floatFromInt64((int64_t)(hubTime - sync->hubBase)));
+}
 
-    if (sync->tail >= SYNC_DATAPOINTS)
+static void addDelta(struct TimeSync *sync, uint64_t apTime, uint64_t hubTime)
+{
+    int64_t residual;
+    int last = (sync->tail + SYNC_DATAPOINTS - 1) % SYNC_DATAPOINTS;
+
+    // AP rebooted (or hub time went backwards): nothing we have is valid
+    if (sync->cnt && (apTime < sync->apTime[last] || hubTime < sync->hubTime[last]))
+        sync->cnt = sync->tail = sync->outliers = 0;
+
+    if (sync->cnt >= SYNC_MIN_FIT) {
+        residual = (int64_t)(apTime - hubTime - getDelta(sync, hubTime));
+        if (residual > SYNC_OUTLIER || residual < -SYNC_OUTLIER) {
+            if (++sync->outliers < SYNC_MAX_OUTLIERS)
+                return;
+            sync->cnt = sync->tail = 0;
+        }
+    }
+    sync->outliers = 0;
+
+    sync->hubTime[sync->tail] = hubTime;
+    sync->apTime[sync->tail] = apTime;
+
+    if (++sync->tail >= SYNC_DATAPOINTS)
         sync->tail = 0;
 
     if (sync->cnt < SYNC_DATAPOINTS)
         sync->cnt ++;
 
-    sync->avgDelta = 0ULL;
+    sync->fitValid = false;
 }
 
-static uint64_t getAvgDelta(struct TimeSync *sync)
+static uint32_t readEventPrepare(struct EvtPacket *packet, struct TimeSync *sync)
 {
-    int i;
-    int32_t avg;
+    if (packet->sensType == SENS_TYPE_INVALID) {
+#ifdef DEBUG_LOG_EVT
+        return DEBUG_LOG_EVT;
+#else
+        return 0x00000000;
+#endif
+    }
 
-    if (!sync->cnt)
-        return 0ULL;
-    else if (!sync->avgDelta) {
-        for (i=1, avg=0; i<sync->cnt; i++)
-            avg += (int32_t)(sync->delta[i] - sync->delta[0]);
-        sync->avgDelta = (avg / sync->cnt) + sync->delta[0];
+    // the fit is evaluated at the packet's own time, so drift since the last request is accounted for
+    if (packet->timestamp)
+        packet->timestamp += getDelta(sync, packet->timestamp);
+
+    return EVT_NO_FIRST_SENSOR_EVENT + packet->sensType;
+}
+
+static size_t readEventMulti(void *tx, struct TimeSync *sync)
+{
+    struct NanohubReadEventMultiResponse *resp = tx;
+    struct NanohubReadEventMultiEntry *entry;
+    struct EvtPacket packet;
+    uint32_t evtType;
+    size_t length = offsetof(struct NanohubReadEventMultiResponse, evtData);
+
+    if (!hostIntfPacketDequeue(&packet, NANOHUB_PACKET_PAYLOAD_MAX - sizeof(resp->evtType)))
+        return 0;
+
+    evtType = readEventPrepare(&packet, sync);
+
+    // too big to share a packet with anything; send it as a plain response
+    if (length + sizeof(*entry) + packet.length > NANOHUB_PACKET_PAYLOAD_MAX) {
+        memmove((uint8_t *)tx + sizeof(resp->evtType), &packet.timestamp, packet.length);
+        resp->evtType = htole32(evtType);
+        return sizeof(resp->evtType) + packet.length;
+    }
+
+    resp->evtType = htole32(NANOHUB_EVT_MULTI);
+    resp->version = NANOHUB_READ_EVENT_MULTI_VERSION;
+    resp->numEvents = 0;
+
+    while (1) {
+        entry = (struct NanohubReadEventMultiEntry *)((uint8_t *)tx + length);
+        entry->evtType = htole32(evtType);
+        entry->len = packet.length;
+        memcpy(entry->evtData, &packet.timestamp, packet.length);
+        length += sizeof(*entry) + packet.length;
+        resp->numEvents++;
+
+        // keep filling until the next queued event no longer fits
+        if (length + sizeof(*entry) >= NANOHUB_PACKET_PAYLOAD_MAX ||
+            !hostIntfPacketDequeue(&packet, NANOHUB_PACKET_PAYLOAD_MAX - length - sizeof(*entry)))
+            break;
+
+        evtType = readEventPrepare(&packet, sync);
     }
-    return sync->avgDelta;
+
+    // nothing else was queued; the plain layout carries a lone event with less overhead
+    if (resp->numEvents == 1) {
+        entry = (struct NanohubReadEventMultiEntry *)resp->evtData;
+        length = entry->len;
+        memmove((uint8_t *)tx + sizeof(resp->evtType), entry->evtData, length);
+        resp->evtType = htole32(evtType);
+        return sizeof(resp->evtType) + length;
+    }
+
+    return length;
 }
 
 static size_t readEvent(void *rx, uint8_t rx_len, void *tx, uint64_t timestamp)
@@ -453,26 +857,19 @@ static size_t readEvent(void *rx, uint8_t rx_len, void *tx, uint64_t timestamp)
     struct NanohubReadEventRequest *req = rx;
     struct NanohubReadEventResponse *resp = tx;
     struct EvtPacket *packet = tx;
-    int length, sensor;
-    static struct TimeSync timeSync = { };
+    uint32_t evtType;
+    int length;
+
+    addDelta(&mTimeSync, req->apBootTime, timestamp);
 
-    addDelta(&timeSync, req->apBootTime, timestamp);
+    if (rx_len >= sizeof(*req) && (req->caps & NANOHUB_READ_EVENT_CAP_MULTI))
+        return readEventMulti(tx, &mTimeSync);
 
-    if (hostIntfPacketDequeue(packet)) {
+    // the response is built in place over the dequeued packet
+    if (hostIntfPacketDequeue(packet, sizeof(resp->evtData))) {
         length = packet->length + sizeof(resp->evtType);
-        sensor = packet->sensType;
-        // TODO combine messages if multiple can fit in a single packet
-        if (sensor == SENS_TYPE_INVALID) {
-#ifdef DEBUG_LOG_EVT
-            resp->evtType = htole32(DEBUG_LOG_EVT);
-#else
-            resp->evtType = 0x00000000;
-#endif
-        } else {
-            resp->evtType = htole32(EVT_NO_FIRST_SENSOR_EVENT + sensor);
-            if (packet->timestamp)
-                packet->timestamp += getAvgDelta(&timeSync);
-        }
+        evtType = readEventPrepare(packet, &mTimeSync);
+        resp->evtType = htole32(evtType);
     } else {
         length = 0;
     }
@@ -480,6 +877,39 @@ static size_t readEvent(void *rx, uint8_t rx_len, void *tx, uint64_t timestamp)
     return length;
 }
 
+static size_t readEventsBulk(void *rx, uint8_t rx_len, void *tx, uint64_t timestamp)
+{
+    struct NanohubReadEventsBulkRequest *req = rx;
+    struct NanohubReadEventsBulkResponse *resp = tx;
+    struct NanohubBulkFrame *frame;
+    struct EvtPacket packet;
+    uint8_t *buf;
+    uint32_t size, len = 0, numFrames = 0, overhead = sizeof(*frame) + sizeof(uint32_t);
+    __le32 crc;
+
+    addDelta(&mTimeSync, req->apBootTime, timestamp);
+
+    buf = hostIntfBulkAlloc(le32toh(req->maxBytes), &size);
+    if (buf) {
+        while (len + overhead < size && hostIntfPacketDequeue(&packet, size - len - overhead)) {
+            frame = (struct NanohubBulkFrame *)(buf + len);
+            frame->evtType = htole32(readEventPrepare(&packet, &mTimeSync));
+            frame->len = packet.length;
+            memcpy(frame->evtData, &packet.timestamp, packet.length);
+            crc = htole32(crc32(frame, sizeof(*frame) + packet.length, CRC_INIT));
+            memcpy(frame->evtData + packet.length, &crc, sizeof(crc));
+            len += overhead + packet.length;
+            numFrames++;
+        }
+        hostIntfBulkCommit(len);
+    }
+
+    resp->length = htole32(len);
+    resp->numFrames = htole16(numFrames);
+
+    return sizeof(*resp);
+}
+
 static size_t writeEvent(void *rx, uint8_t rx_len, void *tx, uint64_t timestamp)
 {
     struct NanohubWriteEventRequest *req = rx;
@@ -507,11 +937,11 @@ const static struct NanohubCommand mBuiltinCommands[] = {
                 queryAppInfo,
                 struct NanohubAppInfoRequest,
                 struct NanohubAppInfoRequest),
-        NANOHUB_COMMAND(NANOHUB_REASON_START_FIRMWARE_UPLOAD,
+        NANOHUB_COMMAND_WAIT_IDLE(NANOHUB_REASON_START_FIRMWARE_UPLOAD,
                 startFirmwareUpload,
-                struct NanohubStartFirmwareUploadRequest,
+                uint8_t[offsetof(struct NanohubStartFirmwareUploadRequest, flags)],
                 struct NanohubStartFirmwareUploadRequest),
-        NANOHUB_COMMAND(NANOHUB_REASON_FIRMWARE_CHUNK,
+        NANOHUB_COMMAND_WAIT_IDLE(NANOHUB_REASON_FIRMWARE_CHUNK,
                 firmwareChunk,
                 __le32,
                 struct NanohubFirmwareChunkRequest),
@@ -529,8 +959,12 @@ const static struct NanohubCommand mBuiltinCommands[] = {
                 struct NanohubUnmaskInterruptRequest),
         NANOHUB_COMMAND(NANOHUB_REASON_READ_EVENT,
                 readEvent,
-                struct NanohubReadEventRequest,
+                __le64,
                 struct NanohubReadEventRequest),
+        NANOHUB_COMMAND(NANOHUB_REASON_READ_EVENTS_BULK,
+                readEventsBulk,
+                struct NanohubReadEventsBulkRequest,
+                struct NanohubReadEventsBulkRequest),
         NANOHUB_COMMAND(NANOHUB_REASON_WRITE_EVENT,
                 writeEvent,
                 __le32,
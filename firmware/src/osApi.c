@@ -165,6 +165,24 @@ static void osExpApiSensorGetRate(uintptr_t *retValP, va_list args)
     *retValP = sensorGetCurRate(sensorHandle);
 }
 
+static void osExpApiSensorBatch(uintptr_t *retValP, va_list args)
+{
+    uint32_t handle = va_arg(args, uint32_t);
+    uint32_t time_lo = va_arg(args, uint32_t);
+    uint32_t time_hi = va_arg(args, uint32_t);
+    const void *sample = va_arg(args, const void *);
+    uint64_t time = (((uint64_t)time_hi) << 32) + time_lo;
+
+    *retValP = sensorBatchSample(handle, time, sample);
+}
+
+static void osExpApiSensorBatchFlush(uintptr_t *retValP, va_list args)
+{
+    uint32_t handle = va_arg(args, uint32_t);
+
+    *retValP = sensorBatchFlush(handle);
+}
+
 static void osExpApiTimGetTime(uintptr_t *retValP, va_list args)
 {
     uint64_t *timeNanos = va_arg(args, uint64_t *);
@@ -470,6 +488,8 @@ void osApiExport(struct SlabAllocator *mainSlubAllocator)
             [SYSCALL_OS_MAIN_SENSOR_RELEASE]       = { .func = osExpApiSensorRel,     },
             [SYSCALL_OS_MAIN_SENSOR_TRIGGER]       = { .func = osExpApiSensorTrigger, },
             [SYSCALL_OS_MAIN_SENSOR_GET_RATE]      = { .func = osExpApiSensorGetRate, },
+            [SYSCALL_OS_MAIN_SENSOR_BATCH]         = { .func = osExpApiSensorBatch,   },
+            [SYSCALL_OS_MAIN_SENSOR_BATCH_FLUSH]   = { .func = osExpApiSensorBatchFlush, },
 
         },
     };
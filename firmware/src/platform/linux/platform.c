@@ -18,6 +18,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 #include <pthread.h>
 #include <unistd.h>
 #include <platform.h>
@@ -60,9 +61,10 @@ void platInitialize(void)
 
 uint64_t platGetTicks(void)
 {
-    //TODO
+    struct timespec ts;
 
-    return 0;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
 int main(int argc, char** argv)
@@ -81,3 +81,10 @@ uint32_t crc32(const void *buf, size_t size, uint32_t crc)
     pwrUnitClock(PERIPH_BUS_AHB1, PERIPH_AHB1_CRC, false);
     return crc;
 }
+
+uint32_t crc32Copy(void *dst, const void *src, size_t size, uint32_t crc)
+{
+    /* the crc unit is faster than anything we could fuse into the copy */
+    memcpy(dst, src, size);
+    return crc32(dst, size, crc);
+}
@@ -90,6 +90,7 @@ dont_subtract:
     }
 }
 
+#if defined(RSA_SUPPORT_PRIV_OP_LOWRAM) || defined (RSA_SUPPORT_PRIV_OP_BIGRAM)
 static void biMul(uint32_t *ret, const uint32_t *a, const uint32_t *b) //ret = a * b
 {
     uint32_t i, j, c;
@@ -116,22 +117,92 @@ static void biMul(uint32_t *ret, const uint32_t *a, const uint32_t *b) //ret = a
         }
     }
 }
+#endif
 
-const uint32_t* rsaPubOp(struct RsaState* state, const uint32_t *a, const uint32_t *c)
+static uint32_t biMontInv(uint32_t n0) //returns -1 / n0 mod 2^32, n0 must be odd
 {
+    uint32_t x = n0; //n0 * n0 == 1 mod 8, so this is already good to 3 bits
     uint32_t i;
 
-    //calculate a ^ 65536 mod c into state->tmpB
-    memcpy(state->tmpB, a, RSA_BYTES);
+    //each newton step doubles the number of good bits: 6, 12, 24, 48
+    for (i = 0; i < 4; i++)
+        x *= 2 - n0 * x;
+
+    return -x;
+}
+
+static void biMontMul(uint32_t *t, const uint32_t *a, const uint32_t *b, const uint32_t *n, uint32_t nInv) //t = a * b / 2^RSA_LEN mod n where t is RSA_LEN + limb_sz, a < n and t may not alias a or b
+{
+    uint32_t i, j, c, m, top;
+    uint64_t r;
+
+    memset(t, 0, RSA_BYTES + sizeof(uint32_t));
+
+    //CIOS: interleave one row of the product with one limb of reduction so t never grows past RSA_LEN + 2 limbs
+    for (i = 0; i < RSA_LIMBS; i++) {
+
+        //t += a * b[i]
+        c = 0;
+        for (j = 0; j < RSA_LIMBS; j++) {
+            r = (uint64_t)a[j] * b[i] + t[j] + c;
+            t[j] = r;
+            c = r >> 32;
+        }
+        r = (uint64_t)t[RSA_LIMBS] + c;
+        t[RSA_LIMBS] = r;
+        top = r >> 32;
+
+        //t = (t + m * n) >> 32, with m picked to make the low limb zero
+        m = t[0] * nInv;
+        r = (uint64_t)m * n[0] + t[0];
+        c = r >> 32;
+        for (j = 1; j < RSA_LIMBS; j++) {
+            r = (uint64_t)m * n[j] + t[j] + c;
+            t[j - 1] = r;
+            c = r >> 32;
+        }
+        r = (uint64_t)t[RSA_LIMBS] + c;
+        t[RSA_LIMBS - 1] = r;
+        t[RSA_LIMBS] = top + (r >> 32);
+    }
+
+    //a < n and b < 2^RSA_LEN keep t < 2n, so one subtraction is enough
+    if (!t[RSA_LIMBS]) {
+        for (i = RSA_LIMBS; i > 0; i--) {
+            if (t[i - 1] < n[i - 1])
+                return;
+            if (t[i - 1] > n[i - 1])
+                break;
+        }
+    }
+
+    r = 0;
+    for (i = 0; i < RSA_LIMBS; i++) {
+        r = (uint64_t)t[i] - n[i] - (uint32_t)r;
+        t[i] = r;
+        r = (r >> 32) & 1;
+    }
+    t[RSA_LIMBS] = 0;
+}
+
+const uint32_t* rsaPubOp(struct RsaState* state, const uint32_t *a, const uint32_t *c)
+{
+    uint32_t i, nInv = biMontInv(c[0]);
+
+    //move a into montgomery form (a * 2^RSA_LEN mod c) into state->tmpB. this is the only biMod left
+    memset(state->tmpA, 0, RSA_BYTES);
+    memcpy(state->tmpA + RSA_LIMBS, a, RSA_BYTES);
+    biMod(state->tmpA, c, state->tmpB);
+    memcpy(state->tmpB, state->tmpA, RSA_BYTES);
+
+    //calculate a ^ 65536 mod c into state->tmpB, still in montgomery form
     for (i = 0; i < 16; i++) {
-        biMul(state->tmpA, state->tmpB, state->tmpB);
-        biMod(state->tmpA, c, state->tmpB);
+        biMontMul(state->tmpA, state->tmpB, state->tmpB, c, nInv);
         memcpy(state->tmpB, state->tmpA, RSA_BYTES);
     }
 
-    //calculate a ^ 65537 mod c into state->tmpA [ at this point this means do state->tmpA = (state->tmpB * a) % c ]
-    biMul(state->tmpA, state->tmpB, a);
-    biMod(state->tmpA, c, state->tmpB);
+    //calculate a ^ 65537 mod c into state->tmpA. multiplying by a plain a also takes the result out of montgomery form
+    biMontMul(state->tmpA, state->tmpB, a, c, nInv);
 
     //return result
     return state->tmpA;
@@ -19,12 +19,14 @@
 #include <atomicBitset.h>
 #include <sensors.h>
 #include <atomic.h>
+#include <string.h>
 #include <stdio.h>
 #include <slab.h>
+#include <timer.h>
 #include <seos.h>
+#include <heap.h>
 
 #define MAX_INTERNAL_EVENTS       32 //also used for external app sensors' setRate() calls
-#define MAX_CLI_SENS_MATRIX_SZ    64 /* MAX(numClients * numSensors) */
 
 #define SENSOR_RATE_OFF           0x00000000UL /* used in sensor state machine */
 #define SENSOR_RATE_POWERING_ON   0xFFFFFFF0UL /* used in sensor state machine */
@@ -33,13 +35,47 @@
 #define SENSOR_RATE_IMPOSSIBLE    0xFFFFFFF3UL /* used in rate calc to indicate impossible combinations */
 #define SENSOR_LATENCY_INVALID    0xFFFFFFFFFFFFFFFFULL
 
+#define SENSOR_HANDLE_SLOT_BITS   8    /* low bits of a handle are its slot in mSensors[], the rest is a generation count */
+#define SENSOR_HANDLE_SLOT_MASK   ((1UL << SENSOR_HANDLE_SLOT_BITS) - 1)
+#define SENSOR_SLOT_NONE          0xFF /* end of a per-type chain */
+#define SENSOR_NUM_TYPES          256  /* SensorInfo.sensorType is a uint8_t */
+
+
+#if MAX_REGISTERED_SENSORS >= SENSOR_SLOT_NONE
+#error "sensor slots must fit in a uint8_t chain link"
+#endif
+
+struct SensorsClientRequest {
+    uint64_t latency;
+    struct SensorsClientRequest *next; /* next request for the same sensor */
+    uint32_t clientTid;
+    uint32_t rate;
+    uint32_t decimPhase;     /* accumulates client rate per hw sample, a sample is kept each time it passes hw rate */
+    uint32_t decimCnt;       /* samples summed into decimSum since the last kept one */
+    float decimSum[3];
+};
+
+struct SensorBatch {
+    uint64_t since;          /* when the oldest buffered sample came in */
+    uint64_t deadline;       /* oldest buffered sample must go out by this time */
+    uint16_t size;           /* ring capacity in samples */
+    uint16_t head;           /* oldest sample */
+    uint16_t count;
+    uint16_t watermark;      /* deliver as soon as this many samples are buffered */
+    uint8_t sampleSz;        /* bytes of data per sample, timestamp not included */
+    uint64_t times[];        /* followed by size * sampleSz bytes of sample data */
+};
+
 struct Sensor {
     const struct SensorInfo *si;
+    struct SensorsClientRequest *requests; /* list of client requests for this sensor, heap allocated */
+    struct SensorBatch *batch;             /* framework batching ring, allocated by the first sensorBatchSample() */
     uint32_t handle;         /* here 0 means invalid */
     uint64_t currentLatency; /* here 0 means no batching */
     uint32_t currentRate;    /* here 0 means off */
     TaggedPtr callInfo;      /* pointer to ops struct or app tid */
     void *callData;
+    uint8_t nextOfType;      /* next slot with the same sensor type, in slot order, or SENSOR_SLOT_NONE */
     uint32_t initComplete:1; /* sensor finished initializing */
     uint32_t hasOnchange :1; /* sensor supports onchange and wants to be notified to send new clients current state */
     uint32_t hasOndemand :1; /* sensor supports ondemand and wants to get triggers */
@@ -58,18 +94,16 @@ struct SensorsInternalEvent {
     };
 };
 
-struct SensorsClientRequest {
-    uint32_t handle;
-    uint32_t clientTid;
-    uint64_t latency;
-    uint32_t rate;
-};
-
 static struct Sensor mSensors[MAX_REGISTERED_SENSORS];
 ATOMIC_BITSET_DECL(mSensorsUsed, MAX_REGISTERED_SENSORS, static);
+static uint8_t mSensorsByType[SENSOR_NUM_TYPES]; /* first slot of each sensor type, or SENSOR_SLOT_NONE */
 static struct SlabAllocator *mInternalEvents;
-static struct SlabAllocator *mCliSensMatrix;
 static uint32_t mNextSensorHandle;
+static void *mDecimBuf;
+static uint32_t mDecimBufSz;
+static uint32_t mBatchTimer;
+static uint64_t mBatchTimerDeadline;
+static bool mBatchDeferred;
 struct SingleAxisDataEvent singleAxisFlush = { .referenceTime = 0 };
 struct TripleAxisDataEvent tripleAxisFlush = { .referenceTime = 0 };
 
@@ -79,31 +113,47 @@ struct TripleAxisDataEvent tripleAxisFlush = { .referenceTime = 0 };
 bool sensorsInit(void)
 {
     atomicBitsetInit(mSensorsUsed, MAX_REGISTERED_SENSORS);
+    memset(mSensorsByType, SENSOR_SLOT_NONE, sizeof(mSensorsByType));
 
     mInternalEvents = slabAllocatorNew(sizeof(struct SensorsInternalEvent), 4, MAX_INTERNAL_EVENTS);
-    if (!mInternalEvents)
-        return false;
-
-    mCliSensMatrix = slabAllocatorNew(sizeof(struct SensorsClientRequest), 4, MAX_CLI_SENS_MATRIX_SZ);
-    if (mCliSensMatrix)
-        return true;
-
-    slabAllocatorDestroy(mInternalEvents);
 
-    return false;
+    return mInternalEvents != NULL;
 }
 
 static struct Sensor* sensorFindByHandle(uint32_t handle)
 {
-    uint32_t i;
+    uint32_t idx = handle & SENSOR_HANDLE_SLOT_MASK;
 
-    for (i = 0; i < MAX_REGISTERED_SENSORS; i++)
-        if (mSensors[i].handle == handle)
-            return mSensors + i;
+    if (handle && idx < MAX_REGISTERED_SENSORS && mSensors[idx].handle == handle)
+        return mSensors + idx;
 
     return NULL;
 }
 
+static void sensorTypeLink(uint32_t idx)
+{
+    uint8_t *linkP = &mSensorsByType[mSensors[idx].si->sensorType];
+
+    /* keep chains in slot order so sensorFind() enumerates the same way a full scan would */
+    while (*linkP != SENSOR_SLOT_NONE && *linkP < idx)
+        linkP = &mSensors[*linkP].nextOfType;
+
+    mSensors[idx].nextOfType = *linkP;
+    mem_reorder_barrier();
+    *linkP = idx;
+}
+
+static void sensorTypeUnlink(uint32_t idx)
+{
+    uint8_t *linkP = &mSensorsByType[mSensors[idx].si->sensorType];
+
+    while (*linkP != SENSOR_SLOT_NONE && *linkP != idx)
+        linkP = &mSensors[*linkP].nextOfType;
+
+    if (*linkP == idx)
+        *linkP = mSensors[idx].nextOfType;
+}
+
 static uint32_t sensorRegisterEx(const struct SensorInfo *si, TaggedPtr callInfo, void *callData, bool initComplete)
 {
     int32_t idx = atomicBitsetFindClearAndSet(mSensorsUsed);
@@ -114,10 +164,10 @@ static uint32_t sensorRegisterEx(const struct SensorInfo *si, TaggedPtr callInfo
     if (idx < 0)
         return 0;
 
-    /* grab a handle */
+    /* grab a handle. slot bits make it unique among live handles, generation bits catch stale ones */
     do {
-        handle = atomicAdd(&mNextSensorHandle, 1);
-    } while (!handle || sensorFindByHandle(handle)); /* this is safe since nobody else could have "JUST" taken this handle, we'll need to circle around 32bits before that happens */
+        handle = (atomicAdd(&mNextSensorHandle, 1) << SENSOR_HANDLE_SLOT_BITS) | idx;
+    } while (!handle);
 
     /* fill the struct in and mark it valid (by setting handle) */
     s = mSensors + idx;
@@ -126,7 +176,10 @@ static uint32_t sensorRegisterEx(const struct SensorInfo *si, TaggedPtr callInfo
     s->currentLatency = SENSOR_LATENCY_INVALID;
     s->callInfo = callInfo;
     s->callData = callData;
+    s->requests = NULL;
+    s->batch = NULL;
     s->initComplete = initComplete ? 1 : 0;
+    sensorTypeLink(idx);
     mem_reorder_barrier();
     s->handle = handle;
     s->hasOnchange = 0;
@@ -168,6 +221,7 @@ bool sensorRegisterInitComplete(uint32_t handle)
 bool sensorUnregister(uint32_t handle)
 {
     struct Sensor *s = sensorFindByHandle(handle);
+    struct SensorsClientRequest *req;
 
     if (!s)
         return false;
@@ -175,6 +229,15 @@ bool sensorUnregister(uint32_t handle)
     /* mark as invalid */
     s->handle = 0;
     mem_reorder_barrier();
+    sensorTypeUnlink(s - mSensors);
+
+    /* drop any requests clients did not release */
+    while ((req = s->requests)) {
+        s->requests = req->next;
+        heapFree(req);
+    }
+    heapFree(s->batch);
+    s->batch = NULL;
 
     /* free struct */
     atomicBitsetClearBit(mSensorsUsed, s - mSensors);
@@ -286,8 +349,135 @@ static bool sensorCallFuncSendOneDirectEvt(struct Sensor* s, uint32_t tid)
     return false;
 }
 
+static bool sensorBatchDeliver(struct Sensor *s)
+{
+    struct SensorBatch *b = s->batch;
+    uint32_t pointSz = sizeof(uint32_t) + b->sampleSz;
+    uint8_t *data = (uint8_t*)(b->times + b->size);
+    struct SensorFirstSample firstSample;
+    struct SingleAxisDataEvent *evt;
+    uint32_t i, n, idx, prev, delta;
+    uint8_t *point;
+
+    while (b->count) {
+        /* take as many samples as we can whose deltas still fit in 32 bits */
+        for (n = 1, prev = b->head; n < b->count; n++, prev = idx) {
+            idx = b->head + n;
+            if (idx >= b->size)
+                idx -= b->size;
+            if (b->times[idx] - b->times[prev] > UINT32_MAX)
+                break;
+        }
+
+        evt = heapAlloc(sizeof(struct SingleAxisDataEvent) + n * pointSz);
+        if (!evt)
+            return false;
+
+        evt->referenceTime = b->times[b->head];
+        for (i = 0, idx = prev = b->head; i < n; i++, prev = idx++) {
+            if (idx >= b->size)
+                idx -= b->size;
+            point = (uint8_t*)evt->samples + i * pointSz;
+            if (i) {
+                delta = b->times[idx] - b->times[prev];
+                memcpy(point, &delta, sizeof(delta));
+            }
+            memcpy(point + sizeof(uint32_t), data + idx * b->sampleSz, b->sampleSz);
+        }
+
+        memset(&firstSample, 0, sizeof(firstSample));
+        firstSample.numSamples = n;
+        memcpy(evt->samples, &firstSample, sizeof(firstSample));
+
+        if (!osEnqueueEvt(EVENT_TYPE_BIT_DISCARDABLE | sensorGetMyEventType(s->si->sensorType), evt, heapFree)) {
+            heapFree(evt);
+            return false;
+        }
+
+        b->head = (b->head + n) % b->size;
+        b->count -= n;
+    }
+
+    return true;
+}
+
+static void sensorBatchTimerExpired(void *cookie);
+static void sensorBatchDeferred(void *cookie);
+
+static void sensorBatchTimerCbk(uint32_t timerId, void *data)
+{
+    osDefer(sensorBatchTimerExpired, NULL, false);
+}
+
+static void sensorBatchArmTimer(uint64_t deadline)
+{
+    uint64_t now = timGetTime();
+
+    /* already due: deliver once the caller is done, so a burst read out of a hw fifo goes out as one event */
+    if (deadline <= now) {
+        if (!mBatchDeferred)
+            mBatchDeferred = osDefer(sensorBatchDeferred, NULL, false);
+        return;
+    }
+
+    /* one timer serves all batching sensors, it always points at the earliest deadline */
+    if (mBatchTimer && mBatchTimerDeadline <= deadline)
+        return;
+    if (mBatchTimer)
+        timTimerCancel(mBatchTimer);
+
+    mBatchTimerDeadline = deadline;
+    mBatchTimer = timTimerSet(deadline - now, 0, 50, sensorBatchTimerCbk, NULL, true);
+}
+
+static void sensorBatchDeliverDue(void)
+{
+    uint64_t now = timGetTime(), next = UINT64_MAX;
+    struct Sensor *s;
+    uint32_t i;
+
+    for (i = 0; i < MAX_REGISTERED_SENSORS; i++) {
+        s = mSensors + i;
+        if (!s->handle || !s->batch || !s->batch->count)
+            continue;
+
+        /* a failed delivery is retried by the next sample rather than spinning the timer on it */
+        if (s->batch->deadline <= now)
+            sensorBatchDeliver(s);
+        else if (s->batch->deadline < next)
+            next = s->batch->deadline;
+    }
+
+    if (next != UINT64_MAX)
+        sensorBatchArmTimer(next);
+}
+
+static void sensorBatchTimerExpired(void *cookie)
+{
+    mBatchTimer = 0;
+    sensorBatchDeliverDue();
+}
+
+static void sensorBatchDeferred(void *cookie)
+{
+    mBatchDeferred = false;
+    sensorBatchDeliverDue();
+}
+
+/* the tightest latency any client asked for decides how long the oldest sample may wait, no clients -> no reason to hold it */
+static void sensorBatchSetDeadline(struct SensorBatch *b, uint64_t latency)
+{
+    b->deadline = b->since + (latency >= SENSOR_LATENCY_NODATA ? 0 : latency);
+}
+
 static void sensorReconfig(struct Sensor* s, uint32_t newHwRate, uint64_t newHwLatency)
 {
+    /* what is already buffered must make the new latency too */
+    if (s->batch && s->batch->count) {
+        sensorBatchSetDeadline(s->batch, newHwLatency);
+        sensorBatchArmTimer(s->batch->deadline);
+    }
+
     if (s->currentRate == newHwRate && s->currentLatency == newHwLatency) {
         /* do nothing */
     }
@@ -311,7 +501,9 @@ static void sensorReconfig(struct Sensor* s, uint32_t newHwRate, uint64_t newHwL
         (void)sensorCallFuncSetRate(s, newHwRate, newHwLatency);
     }
     else {
-        /* powering off */
+        /* powering off, nobody to hold data for anymore */
+        if (s->batch && s->batch->count)
+            sensorBatchDeliver(s);
         if (sensorCallFuncPower(s, false)) {
             s->currentRate = SENSOR_RATE_POWERING_OFF;
             s->currentLatency = SENSOR_LATENCY_INVALID;
@@ -322,15 +514,9 @@ static void sensorReconfig(struct Sensor* s, uint32_t newHwRate, uint64_t newHwL
 static uint64_t sensorCalcHwLatency(struct Sensor* s)
 {
     uint64_t smallestLatency = SENSOR_LATENCY_INVALID;
-    uint32_t i;
-
-    for (i = 0; i < MAX_CLI_SENS_MATRIX_SZ; i++) {
-        struct SensorsClientRequest *req = slabAllocatorGetNth(mCliSensMatrix, i);
-
-        /* we only care about this sensor's stuff */
-        if (!req || req->handle != s->handle)
-            continue;
+    struct SensorsClientRequest *req;
 
+    for (req = s->requests; req; req = req->next) {
         if (smallestLatency > req->latency)
             smallestLatency = req->latency;
     }
@@ -341,6 +527,7 @@ static uint64_t sensorCalcHwLatency(struct Sensor* s)
 static uint32_t sensorCalcHwRate(struct Sensor* s, uint32_t extraReqedRate, uint32_t removedRate)
 {
     bool haveUsers = false, haveOnChange = extraReqedRate == SENSOR_RATE_ONCHANGE;
+    struct SensorsClientRequest *req;
     uint32_t highestReq = 0;
     uint32_t i;
 
@@ -349,13 +536,7 @@ static uint32_t sensorCalcHwRate(struct Sensor* s, uint32_t extraReqedRate, uint
          highestReq = (extraReqedRate == SENSOR_RATE_ONDEMAND || extraReqedRate == SENSOR_RATE_ONCHANGE) ? 0 : extraReqedRate;
     }
 
-    for (i = 0; i < MAX_CLI_SENS_MATRIX_SZ; i++) {
-        struct SensorsClientRequest *req = slabAllocatorGetNth(mCliSensMatrix, i);
-
-        /* we only care about this sensor's stuff */
-        if (!req || req->handle != s->handle)
-            continue;
-
+    for (req = s->requests; req; req = req->next) {
         /* skip an instance of a removed rate if one was given */
         if (req->rate == removedRate) {
             removedRate = SENSOR_RATE_OFF;
@@ -481,8 +662,11 @@ const struct SensorInfo* sensorFind(uint32_t sensorType, uint32_t idx, uint32_t
 {
     uint32_t i;
 
-    for (i = 0; i < MAX_REGISTERED_SENSORS; i++) {
-        if (mSensors[i].handle && mSensors[i].si->sensorType == sensorType && !idx--) {
+    if (sensorType >= SENSOR_NUM_TYPES)
+        return NULL;
+
+    for (i = mSensorsByType[sensorType]; i != SENSOR_SLOT_NONE; i = mSensors[i].nextOfType) {
+        if (mSensors[i].handle && !idx--) {
             if (handleP)
                 *handleP = mSensors[i].handle;
             return mSensors[i].si;
@@ -492,70 +676,75 @@ const struct SensorInfo* sensorFind(uint32_t sensorType, uint32_t idx, uint32_t
     return NULL;
 }
 
-static bool sensorAddRequestor(uint32_t sensorHandle, uint32_t clientTid, uint32_t rate, uint64_t latency)
+static struct SensorsClientRequest* sensorFindRequestor(struct Sensor *s, uint32_t clientTid)
 {
-    struct SensorsClientRequest *req = slabAllocatorAlloc(mCliSensMatrix);
+    struct SensorsClientRequest *req;
+
+    for (req = s->requests; req; req = req->next)
+        if (req->clientTid == clientTid)
+            return req;
+
+    return NULL;
+}
+
+static bool sensorAddRequestor(struct Sensor *s, uint32_t clientTid, uint32_t rate, uint64_t latency)
+{
+    struct SensorsClientRequest *req = heapAlloc(sizeof(struct SensorsClientRequest));
 
     if (!req)
         return false;
 
-    req->handle = sensorHandle;
+    memset(req, 0, sizeof(*req));
     req->clientTid = clientTid;
-    mem_reorder_barrier();
     req->rate = rate;
     req->latency = latency;
+    req->next = s->requests;
+    mem_reorder_barrier();
+    s->requests = req;
 
     return true;
 }
 
-static bool sensorGetCurRequestorRate(uint32_t sensorHandle, uint32_t clientTid, uint32_t *rateP, uint64_t *latencyP)
+static bool sensorGetCurRequestorRate(struct Sensor *s, uint32_t clientTid, uint32_t *rateP, uint64_t *latencyP)
 {
-    uint32_t i;
+    struct SensorsClientRequest *req = sensorFindRequestor(s, clientTid);
 
-    for (i = 0; i < MAX_CLI_SENS_MATRIX_SZ; i++) {
-        struct SensorsClientRequest *req = slabAllocatorGetNth(mCliSensMatrix, i);
+    if (!req)
+        return false;
 
-        if (req && req->handle == sensorHandle && req->clientTid == clientTid) {
-            if (rateP) {
-                *rateP = req->rate;
-                *latencyP = req->latency;
-            }
-            return true;
-        }
+    if (rateP) {
+        *rateP = req->rate;
+        *latencyP = req->latency;
     }
 
-    return false;
+    return true;
 }
 
-static bool sensorAmendRequestor(uint32_t sensorHandle, uint32_t clientTid, uint32_t newRate, uint64_t newLatency)
+static bool sensorAmendRequestor(struct Sensor *s, uint32_t clientTid, uint32_t newRate, uint64_t newLatency)
 {
-    uint32_t i;
+    struct SensorsClientRequest *req = sensorFindRequestor(s, clientTid);
 
-    for (i = 0; i < MAX_CLI_SENS_MATRIX_SZ; i++) {
-        struct SensorsClientRequest *req = slabAllocatorGetNth(mCliSensMatrix, i);
+    if (!req)
+        return false;
 
-        if (req && req->handle == sensorHandle && req->clientTid == clientTid) {
-            req->rate = newRate;
-            req->latency = newLatency;
-            return true;
-        }
-    }
+    req->rate = newRate;
+    req->latency = newLatency;
+    req->decimPhase = 0;
+    req->decimCnt = 0;
+    req->decimSum[0] = req->decimSum[1] = req->decimSum[2] = 0.0f;
 
-    return false;
+    return true;
 }
 
-static bool sensorDeleteRequestor(uint32_t sensorHandle, uint32_t clientTid)
+static bool sensorDeleteRequestor(struct Sensor *s, uint32_t clientTid)
 {
-    uint32_t i;
+    struct SensorsClientRequest **reqP, *req;
 
-    for (i = 0; i < MAX_CLI_SENS_MATRIX_SZ; i++) {
-        struct SensorsClientRequest *req = slabAllocatorGetNth(mCliSensMatrix, i);
-
-        if (req && req->handle == sensorHandle && req->clientTid == clientTid) {
-            req->rate = SENSOR_RATE_OFF;
-            req->latency = SENSOR_LATENCY_INVALID;
+    for (reqP = &s->requests; (req = *reqP); reqP = &req->next) {
+        if (req->clientTid == clientTid) {
+            *reqP = req->next;
             mem_reorder_barrier();
-            slabAllocatorFree(mCliSensMatrix, req);
+            heapFree(req);
             return true;
         }
     }
@@ -577,7 +766,7 @@ bool sensorRequest(uint32_t clientTid, uint32_t sensorHandle, uint32_t rate, uin
         return false;
 
     /* record the request */
-    if (!sensorAddRequestor(sensorHandle, clientTid, rate, latency))
+    if (!sensorAddRequestor(s, clientTid, rate, latency))
         return false;
 
     /* update actual sensor if needed */
@@ -601,7 +790,7 @@ bool sensorRequestRateChange(uint32_t clientTid, uint32_t sensorHandle, uint32_t
 
 
     /* get current rate */
-    if (!sensorGetCurRequestorRate(sensorHandle, clientTid, &oldRate, &oldLatency))
+    if (!sensorGetCurRequestorRate(s, clientTid, &oldRate, &oldLatency))
         return false;
 
     /* verify the new rate is possible given all othe rongoing requests */
@@ -610,7 +799,7 @@ bool sensorRequestRateChange(uint32_t clientTid, uint32_t sensorHandle, uint32_t
         return false;
 
     /* record the request */
-    if (!sensorAmendRequestor(sensorHandle, clientTid, newRate, newLatency))
+    if (!sensorAmendRequestor(s, clientTid, newRate, newLatency))
         return false;
 
     /* update actual sensor if needed */
@@ -625,7 +814,7 @@ bool sensorRelease(uint32_t clientTid, uint32_t sensorHandle)
         return false;
 
     /* record the request */
-    if (!sensorDeleteRequestor(sensorHandle, clientTid))
+    if (!sensorDeleteRequestor(s, clientTid))
         return false;
 
     /* update actual sensor if needed */
@@ -636,17 +825,12 @@ bool sensorRelease(uint32_t clientTid, uint32_t sensorHandle)
 bool sensorTriggerOndemand(uint32_t clientTid, uint32_t sensorHandle)
 {
     struct Sensor* s = sensorFindByHandle(sensorHandle);
-    uint32_t i;
 
     if (!s || !s->hasOndemand)
         return false;
 
-    for (i = 0; i < MAX_CLI_SENS_MATRIX_SZ; i++) {
-        struct SensorsClientRequest *req = slabAllocatorGetNth(mCliSensMatrix, i);
-
-        if (req && req->handle == sensorHandle && req->clientTid == clientTid)
-            return sensorCallFuncTrigger(s);
-    }
+    if (sensorFindRequestor(s, clientTid))
+        return sensorCallFuncTrigger(s);
 
     // not found -> do not report
     return false;
@@ -659,6 +843,10 @@ bool sensorFlush(uint32_t sensorHandle)
     if (!s)
         return false;
 
+    /* batched data goes out ahead of whatever the driver flushes */
+    if (s->batch && s->batch->count)
+        sensorBatchDeliver(s);
+
     return sensorCallFuncFlush(s);
 }
 
@@ -692,3 +880,278 @@ bool sensorGetInitComplete(uint32_t sensorHandle)
 
     return s ? s->initComplete : false;
 }
+
+static struct Sensor* sensorFindClientRequest(uint32_t sensorType, uint32_t clientTid, struct SensorsClientRequest **reqP)
+{
+    uint32_t i;
+
+    if (sensorType >= SENSOR_NUM_TYPES)
+        return NULL;
+
+    for (i = mSensorsByType[sensorType]; i != SENSOR_SLOT_NONE; i = mSensors[i].nextOfType)
+        if (mSensors[i].handle && (*reqP = sensorFindRequestor(mSensors + i, clientTid)))
+            return mSensors + i;
+
+    return NULL;
+}
+
+static void* sensorDecimGetBuf(uint32_t sz)
+{
+    if (sz > mDecimBufSz) {
+        heapFree(mDecimBuf);
+        mDecimBuf = heapAlloc(sz);
+        mDecimBufSz = mDecimBuf ? sz : 0;
+    }
+
+    return mDecimBuf;
+}
+
+static bool sensorDecimKeepSample(struct SensorsClientRequest *req, uint32_t hwRate)
+{
+    req->decimPhase += req->rate;
+    if (req->decimPhase < hwRate)
+        return false;
+
+    req->decimPhase -= hwRate;
+    if (req->decimPhase >= hwRate) /* hw rate went down under us */
+        req->decimPhase = 0;
+
+    return true;
+}
+
+static const void* sensorDecimateSingle(struct SensorsClientRequest *req, uint32_t hwRate, bool avg, const struct SingleAxisDataEvent *src)
+{
+    const struct SingleAxisDataPoint *in = src->samples;
+    uint32_t i, n = 0, numSamples = in[0].firstSample.numSamples;
+    struct SingleAxisDataEvent *dst;
+    struct SingleAxisDataPoint *out;
+    uint64_t t, lastT = 0;
+
+    dst = sensorDecimGetBuf(sizeof(struct SingleAxisDataEvent) + numSamples * sizeof(struct SingleAxisDataPoint));
+    if (!dst)
+        return src;
+
+    out = dst->samples;
+    out[0].firstSample = in[0].firstSample;
+    out[0].firstSample.biasPresent = 0;
+
+    for (i = 0, t = src->referenceTime; i < numSamples; i++) {
+        if (i)
+            t += in[i].deltaTime;
+
+        if (in[0].firstSample.biasPresent && in[0].firstSample.biasSample == i) {
+            /* bias updates are never decimated away */
+            out[0].firstSample.biasPresent = 1;
+            out[0].firstSample.biasSample = n;
+            out[n].idata = in[i].idata;
+        }
+        else {
+            if (avg) {
+                req->decimSum[0] += in[i].fdata;
+                req->decimCnt++;
+            }
+            if (!sensorDecimKeepSample(req, hwRate))
+                continue;
+            if (avg) {
+                out[n].fdata = req->decimSum[0] / req->decimCnt;
+                req->decimSum[0] = 0.0f;
+                req->decimCnt = 0;
+            }
+            else
+                out[n].idata = in[i].idata;
+        }
+
+        if (n)
+            out[n].deltaTime = t - lastT;
+        else
+            dst->referenceTime = t;
+        lastT = t;
+        n++;
+    }
+
+    if (!n)
+        return NULL;
+
+    out[0].firstSample.numSamples = n;
+    return dst;
+}
+
+static const void* sensorDecimateTriple(struct SensorsClientRequest *req, uint32_t hwRate, bool avg, const struct TripleAxisDataEvent *src)
+{
+    const struct TripleAxisDataPoint *in = src->samples;
+    uint32_t i, n = 0, numSamples = in[0].firstSample.numSamples;
+    struct TripleAxisDataEvent *dst;
+    struct TripleAxisDataPoint *out;
+    uint64_t t, lastT = 0;
+
+    dst = sensorDecimGetBuf(sizeof(struct TripleAxisDataEvent) + numSamples * sizeof(struct TripleAxisDataPoint));
+    if (!dst)
+        return src;
+
+    out = dst->samples;
+    out[0].firstSample = in[0].firstSample;
+    out[0].firstSample.biasPresent = 0;
+
+    for (i = 0, t = src->referenceTime; i < numSamples; i++) {
+        if (i)
+            t += in[i].deltaTime;
+
+        if (in[0].firstSample.biasPresent && in[0].firstSample.biasSample == i) {
+            /* bias updates are never decimated away */
+            out[0].firstSample.biasPresent = 1;
+            out[0].firstSample.biasSample = n;
+            out[n].ix = in[i].ix;
+            out[n].iy = in[i].iy;
+            out[n].iz = in[i].iz;
+        }
+        else {
+            if (avg) {
+                req->decimSum[0] += in[i].x;
+                req->decimSum[1] += in[i].y;
+                req->decimSum[2] += in[i].z;
+                req->decimCnt++;
+            }
+            if (!sensorDecimKeepSample(req, hwRate))
+                continue;
+            if (avg) {
+                out[n].x = req->decimSum[0] / req->decimCnt;
+                out[n].y = req->decimSum[1] / req->decimCnt;
+                out[n].z = req->decimSum[2] / req->decimCnt;
+                req->decimSum[0] = req->decimSum[1] = req->decimSum[2] = 0.0f;
+                req->decimCnt = 0;
+            }
+            else {
+                out[n].ix = in[i].ix;
+                out[n].iy = in[i].iy;
+                out[n].iz = in[i].iz;
+            }
+        }
+
+        if (n)
+            out[n].deltaTime = t - lastT;
+        else
+            dst->referenceTime = t;
+        lastT = t;
+        n++;
+    }
+
+    if (!n)
+        return NULL;
+
+    out[0].firstSample.numSamples = n;
+    return dst;
+}
+
+const void* sensorDecimateForClient(uint32_t clientTid, uint32_t evtType, const void *evtData)
+{
+    struct SensorsClientRequest *req;
+    struct Sensor *s;
+    uint32_t hwRate;
+    bool avg;
+
+    if (evtType <= EVT_NO_FIRST_SENSOR_EVENT || evtType >= EVT_NO_SENSOR_CONFIG_EVENT || evtData == SENSOR_DATA_EVENT_FLUSH)
+        return evtData;
+
+    /* clients that never requested this sensor (or requested it with no real rate) see everything */
+    s = sensorFindClientRequest(evtType - EVT_NO_FIRST_SENSOR_EVENT, clientTid, &req);
+    if (!s)
+        return evtData;
+
+    hwRate = s->currentRate;
+    if (!req->rate || req->rate >= SENSOR_RATE_ONDEMAND || hwRate >= SENSOR_RATE_ONDEMAND || req->rate >= hwRate)
+        return evtData;
+
+    avg = !!(s->si->flags1 & SENSOR_INFO_FLAGS1_DECIM_AVG);
+
+    switch (s->si->numAxis) {
+    case NUM_AXIS_ONE:
+        return sensorDecimateSingle(req, hwRate, avg, evtData);
+    case NUM_AXIS_THREE:
+        return sensorDecimateTriple(req, hwRate, avg, evtData);
+    default:
+        return evtData;
+    }
+}
+
+static struct SensorBatch* sensorBatchGet(struct Sensor *s)
+{
+    struct SensorBatch *b;
+    uint32_t size, sampleSz;
+
+    if (s->batch)
+        return s->batch;
+
+    switch (s->si->numAxis) {
+    case NUM_AXIS_ONE:
+        sampleSz = sizeof(struct SingleAxisDataPoint) - sizeof(uint32_t);
+        break;
+    case NUM_AXIS_THREE:
+        sampleSz = sizeof(struct TripleAxisDataPoint) - sizeof(uint32_t);
+        break;
+    default:
+        return NULL;
+    }
+
+    size = s->si->minSamples;
+    if (size > SENSOR_BATCH_MAX_SAMPLES)
+        size = SENSOR_BATCH_MAX_SAMPLES;
+    else if (!size)
+        size = 1;
+
+    b = heapAlloc(sizeof(struct SensorBatch) + size * (sizeof(uint64_t) + sampleSz));
+    if (!b)
+        return NULL;
+
+    b->since = 0;
+    b->deadline = 0;
+    b->size = size;
+    b->head = 0;
+    b->count = 0;
+    b->watermark = size - size / 4; /* leave room for samples arriving while a delivery cannot be enqueued */
+    b->sampleSz = sampleSz;
+    s->batch = b;
+
+    return b;
+}
+
+bool sensorBatchSample(uint32_t handle, uint64_t time, const void *sample)
+{
+    struct Sensor *s = sensorFindByHandle(handle);
+    struct SensorBatch *b;
+    uint32_t idx;
+
+    if (!s || !(b = sensorBatchGet(s)))
+        return false;
+
+    /* full ring (deliveries failing) -> drop oldest */
+    if (b->count == b->size) {
+        b->head = (b->head + 1) % b->size;
+        b->count--;
+    }
+
+    idx = (b->head + b->count) % b->size;
+    b->times[idx] = time;
+    memcpy((uint8_t*)(b->times + b->size) + idx * b->sampleSz, sample, b->sampleSz);
+
+    if (!b->count++) {
+        b->since = timGetTime();
+        sensorBatchSetDeadline(b, sensorCalcHwLatency(s));
+    }
+
+    if (b->count >= b->watermark)
+        sensorBatchDeliver(s);
+    else
+        sensorBatchArmTimer(b->deadline);
+
+    return true;
+}
+
+bool sensorBatchFlush(uint32_t handle)
+{
+    struct Sensor *s = sensorFindByHandle(handle);
+
+    if (!s)
+        return false;
+
+    return !s->batch || !s->batch->count || sensorBatchDeliver(s);
+}
@@ -33,6 +33,7 @@
 #include <slab.h>
 #include <cpu.h>
 #include <crc.h>
+#include <appIndex.h>
 
 
 /*
@@ -169,6 +170,45 @@ static uint32_t osGetFreeTid(void)
     return mNextTidInfo;
 }
 
+static const uint8_t *mUncheckedApps[MAX_TASKS]; /* segments started on the strength of the app index alone */
+static uint32_t mNumUncheckedApps;
+
+/*
+ * Keep a task from handling any more events: broadcast or private. Its end()
+ * is not called, its code is not to be trusted, and its GOT stays as timers
+ * it set may still use it.
+ */
+static void osTaskDisable(struct Task *task)
+{
+    if (task->subbedEvents != task->subbedEventsInt)
+        heapFree(task->subbedEvents);
+    task->subbedEvents = NULL;
+    task->subbedEvtCount = 0;
+    task->tid = 0;
+}
+
+static void osCheckAppsLazily(void *cookie)
+{
+    const uint8_t *seg;
+    uint32_t i;
+
+    if (!mNumUncheckedApps)
+        return;
+
+    seg = mUncheckedApps[--mNumUncheckedApps];
+    if (crc32(seg, appIndexSegSize(seg), ~0) != CRC_RESIDUE) {
+        osLog(LOG_ERROR, "App @ %p failed its CRC check, stopped and will not be loaded again\n", seg + sizeof(uint32_t));
+        appIndexInvalidate(seg);
+        for (i = 0; i < MAX_TASKS; i++) {
+            if (mTasks[i].subbedEvents && (const uint8_t *)mTasks[i].appHdr == seg + sizeof(uint32_t))
+                osTaskDisable(mTasks + i);
+        }
+    }
+
+    if (mNumUncheckedApps)
+        osDefer(osCheckAppsLazily, NULL, false);
+}
+
 static void osStartTasks(void)
 {
     extern char __shared_start[];
@@ -183,6 +223,8 @@ static void osStartTasks(void)
     uint8_t *shared;
     int len, total_len;
     uint8_t id1, id2;
+    const struct AppIndexEntry *index;
+    uint32_t numIndex = 0;
 
     /* first enum all internal apps, making sure to check for dupes */
     osLog(LOG_DEBUG, "Reading internal app list...\n");
@@ -201,6 +243,7 @@ static void osStartTasks(void)
 
     /* then enum all external apps, making sure to find the latest (by position in flash) and checking for conflicts with internal apps */
     osLog(LOG_DEBUG, "Reading external app list...\n");
+    index = appIndexFind(&numIndex);
     for (shared = shared_start;
          shared < shared_end && shared[0] != 0xFF;
          shared += total_len) {
@@ -216,7 +259,8 @@ static void osStartTasks(void)
         if (id1 != id2 || id1 != BL_FLASH_APP_ID)
             continue;
 
-        if (crc32(shared, total_len, ~0) == CRC_RESIDUE) {
+        //apps the index vouches for get their full CRC check after boot
+        if (appIndexIsVerified(index, numIndex, shared) || crc32(shared, total_len, ~0) == CRC_RESIDUE) {
             app = (const struct AppHdr *)&shared[4];
             if (len >= sizeof(struct AppHdr) && !memcmp(magic, app->magic, sizeof(magic) - 1) && app->fmtVer == APP_HDR_VER_CUR) {
 
@@ -284,6 +328,14 @@ static void osStartTasks(void)
     }
 
     osLog(LOG_DEBUG, "Started %lu apps\n", nTasks);
+
+    for (i = 0; i < nTasks; i++) {
+        shared = (uint8_t *)mTasks[i].appHdr - sizeof(uint32_t);
+        if (mTasks[i].appHdr->marker != APP_HDR_MARKER_INTERNAL && appIndexIsVerified(index, numIndex, shared))
+            mUncheckedApps[mNumUncheckedApps++] = shared;
+    }
+    if (mNumUncheckedApps)
+        osDefer(osCheckAppsLazily, NULL, false);
 }
 
 static void osInternalEvtHandle(uint32_t evtType, void *evtData)
@@ -350,6 +402,7 @@ void abort(void)
 void __attribute__((noreturn)) osMain(void)
 {
     TaggedPtr evtFreeingInfo;
+    const void *taskEvtData;
     uint32_t evtType, i, j;
     void *evtData;
 
@@ -377,13 +430,16 @@ void __attribute__((noreturn)) osMain(void)
             osInternalEvtHandle(evtType, evtData);
         }
         else {
-            /* send this event to all tasks who want it (decimation could happen here) */
+            /* send this event to all tasks who want it, sensor data decimated down to the rate each task requested */
             for (i = 0; i < MAX_TASKS; i++) {
                 if (!mTasks[i].subbedEvents) /* only check real tasks */
                     continue;
                 for (j = 0; j < mTasks[i].subbedEvtCount; j++) {
                     if (mTasks[i].subbedEvents[j] == (evtType & ~EVENT_TYPE_BIT_DISCARDABLE)) {
-                        cpuAppHandle(mTasks[i].appHdr, &mTasks[i].platInfo, evtType & ~EVENT_TYPE_BIT_DISCARDABLE, evtData);
+                        /* NULL data (EVT_APP_START, an embedded 0) has nothing to decimate and is passed on as is */
+                        taskEvtData = evtData ? sensorDecimateForClient(mTasks[i].tid, evtType & ~EVENT_TYPE_BIT_DISCARDABLE, evtData) : NULL;
+                        if (taskEvtData || !evtData)
+                            cpuAppHandle(mTasks[i].appHdr, &mTasks[i].platInfo, evtType & ~EVENT_TYPE_BIT_DISCARDABLE, taskEvtData);
                         break;
                     }
                 }
@@ -32,101 +32,173 @@ void sha2init(struct Sha2state *state)
     state->bufBytesUsed = 0;
 }
 
-#ifdef ARM
+//plain C rotates compile to a single ror on both ARM and x86
+#define ror(v, b)       (((v) >> (b)) | ((v) << (32 - (b))))
+
+#define bigS0(x)        (ror(x, 2) ^ ror(x, 13) ^ ror(x, 22))
+#define bigS1(x)        (ror(x, 6) ^ ror(x, 11) ^ ror(x, 25))
+#define smallS0(x)      (ror(x, 7) ^ ror(x, 18) ^ ((x) >> 3))
+#define smallS1(x)      (ror(x, 17) ^ ror(x, 19) ^ ((x) >> 10))
+#define ch(e, f, g)     ((g) ^ ((e) & ((f) ^ (g))))
+#define maj(a, b, c)    (((a) & (b)) | ((c) & ((a) | (b))))
+
+//the message schedule only ever looks 16 words back, so keep it as a ring
+#define W(n)            w[(n) & 15]
+#define LOAD(n)         (W(n) = sha2load(data + (n) * sizeof(uint32_t)))
+#define EXPAND(n)       (W(n) += smallS1(W((n) - 2)) + W((n) - 7) + smallS0(W((n) - 15)))
+
+//instead of shuffling a..h every round, rotate the names we pass in
+#define ROUND(a, b, c, d, e, f, g, h, n, wn)                              \
+    do {                                                                  \
+        uint32_t t1 = h + bigS1(e) + ch(e, f, g) + k[i + (n)] + (wn);     \
+        d += t1;                                                          \
+        h = t1 + bigS0(a) + maj(a, b, c);                                 \
+    } while (0)
+
+#define ROUNDS16(getW)                                                    \
+    do {                                                                  \
+        ROUND(a, b, c, d, e, f, g, h,  0, getW( 0));                      \
+        ROUND(h, a, b, c, d, e, f, g,  1, getW( 1));                      \
+        ROUND(g, h, a, b, c, d, e, f,  2, getW( 2));                      \
+        ROUND(f, g, h, a, b, c, d, e,  3, getW( 3));                      \
+        ROUND(e, f, g, h, a, b, c, d,  4, getW( 4));                      \
+        ROUND(d, e, f, g, h, a, b, c,  5, getW( 5));                      \
+        ROUND(c, d, e, f, g, h, a, b,  6, getW( 6));                      \
+        ROUND(b, c, d, e, f, g, h, a,  7, getW( 7));                      \
+        ROUND(a, b, c, d, e, f, g, h,  8, getW( 8));                      \
+        ROUND(h, a, b, c, d, e, f, g,  9, getW( 9));                      \
+        ROUND(g, h, a, b, c, d, e, f, 10, getW(10));                      \
+        ROUND(f, g, h, a, b, c, d, e, 11, getW(11));                      \
+        ROUND(e, f, g, h, a, b, c, d, 12, getW(12));                      \
+        ROUND(d, e, f, g, h, a, b, c, 13, getW(13));                      \
+        ROUND(c, d, e, f, g, h, a, b, 14, getW(14));                      \
+        ROUND(b, c, d, e, f, g, h, a, 15, getW(15));                      \
+    } while (0)
+
+static const uint32_t k[] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static inline uint32_t sha2load(const uint8_t *p)
+{
+    uint32_t v;
 
-    #define STRINFIGY2(b) #b
-    #define STRINGIFY(b) STRINFIGY2(b)
-    #define ror(v, b) ({uint32_t ret; if (b) asm("ror %0, #" STRINGIFY(b) :"=r"(ret):"0"(v)); else ret = v; ret;})
+    //a single (unaligned-capable) load and byteswap, as we're on a little endian cpu
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap32(v);
+}
 
-#else
+#if defined(__x86_64__) && defined(__SHA__)
 
-    inline static uint32_t ror(uint32_t val, uint32_t by)
-    {
-        if (!by)
-            return val;
+//host tools built with -msha (make SHA_NI=1) use the cpu's sha256 instructions
+
+#include <immintrin.h>
+
+static void sha2processBlocks(uint32_t *hash, const uint8_t *data, uint32_t numBlocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0, state1, msg, tmp, msg0, msg1, msg2, msg3, save0, save1;
+    uint32_t i;
 
-        val = (val >> by) | (val << (32 - by));
+    //the instructions want {abef} and {cdgh}
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&hash[0]), 0xB1);
+    state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&hash[4]), 0x1B);
+    state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; numBlocks; numBlocks--, data += SHA2_BLOCK_SIZE) {
+        save0 = state0;
+        save1 = state1;
+
+        msg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), bswap);
+        msg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), bswap);
+        msg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), bswap);
+        msg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), bswap);
+
+        //16 groups of 4 rounds, rotating msg0..3 as the schedule advances
+        for (i = 0; i < 16; i++) {
+            msg = _mm_add_epi32(msg0, _mm_loadu_si128((const __m128i *)&k[i * 4]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            if (i >= 3 && i < 15) {
+                tmp = _mm_alignr_epi8(msg0, msg3, 4);
+                msg1 = _mm_add_epi32(msg1, tmp);
+                msg1 = _mm_sha256msg2_epu32(msg1, msg0);
+            }
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+            if (i >= 1 && i < 13)
+                msg3 = _mm_sha256msg1_epu32(msg3, msg0);
+
+            tmp = msg0;
+            msg0 = msg1;
+            msg1 = msg2;
+            msg2 = msg3;
+            msg3 = tmp;
+        }
 
-        return val;
+        state0 = _mm_add_epi32(state0, save0);
+        state1 = _mm_add_epi32(state1, save1);
     }
 
-#endif
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128((__m128i *)&hash[0], _mm_blend_epi16(tmp, state1, 0xF0));
+    _mm_storeu_si128((__m128i *)&hash[4], _mm_alignr_epi8(state1, tmp, 8));
+}
 
+#else
 
-static void sha2processBlock(struct Sha2state *state)
+static void sha2processBlocks(uint32_t *hash, const uint8_t *data, uint32_t numBlocks)
 {
-    static const uint32_t k[] = {
-        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
-        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
-        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
-        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
-        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
-        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
-        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
-        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
-    };
-    uint32_t i, a, b, c, d, e, f, g, h;
-
-    //byteswap the input (if we're on a little endian cpu, as we are)
-    for (i = 0; i < SHA2_BLOCK_SIZE / sizeof(uint32_t); i++)
-        state->w[i] = __builtin_bswap32(state->w[i]);
-
-    //expand input
-    for (;i < SHA2_WORDS_STATE_SIZE; i++) {
-        uint32_t s0 = ror(state->w[i-15], 7) ^ ror(state->w[i-15], 18) ^ (state->w[i-15] >> 3);
-        uint32_t s1 = ror(state->w[i-2], 17) ^ ror(state->w[i-2], 19) ^ (state->w[i-2] >> 10);
-        state->w[i] = state->w[i - 16] + s0 + state->w[i - 7] + s1;
+    uint32_t i, a, b, c, d, e, f, g, h, w[16];
+
+    for (; numBlocks; numBlocks--, data += SHA2_BLOCK_SIZE) {
+
+        //init working variables
+        a = hash[0];
+        b = hash[1];
+        c = hash[2];
+        d = hash[3];
+        e = hash[4];
+        f = hash[5];
+        g = hash[6];
+        h = hash[7];
+
+        //64 rounds, 16 at a time so all schedule indices are constants
+        i = 0;
+        ROUNDS16(LOAD);
+        for (i = 16; i < 64; i += 16)
+            ROUNDS16(EXPAND);
+
+        //put result back into state
+        hash[0] += a;
+        hash[1] += b;
+        hash[2] += c;
+        hash[3] += d;
+        hash[4] += e;
+        hash[5] += f;
+        hash[6] += g;
+        hash[7] += h;
     }
-
-    //init working variables
-    a = state->h[0];
-    b = state->h[1];
-    c = state->h[2];
-    d = state->h[3];
-    e = state->h[4];
-    f = state->h[5];
-    g = state->h[6];
-    h = state->h[7];
-
-    //64 rounds
-    for (i = 0; i < 64; i++) {
-        uint32_t s1 = ror(e, 6) ^ ror(e, 11) ^ ror(e, 25);
-        uint32_t ch = (e & f) ^ ((~e) & g);
-        uint32_t temp1 = h + s1 + ch + k[i] + state->w[i];
-        uint32_t s0 = ror(a, 2) ^ ror(a, 13) ^ ror(a, 22);
-        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
-        uint32_t temp2 = s0 + maj;
- 
-        h = g;
-        g = f;
-        f = e;
-        e = d + temp1;
-        d = c;
-        c = b;
-        b = a;
-        a = temp1 + temp2;
-    }
-
-    //put result back into state
-    state->h[0] += a;
-    state->h[1] += b;
-    state->h[2] += c;
-    state->h[3] += d;
-    state->h[4] += e;
-    state->h[5] += f;
-    state->h[6] += g;
-    state->h[7] += h;
 }
 
+#endif
+
 void sha2processBytes(struct Sha2state *state, const void *bytes, uint32_t numBytes)
 {
     const uint8_t *inBytes = (const uint8_t*)bytes;
+    uint32_t bytesToCopy;
 
     state->msgLen += numBytes;
-    while (numBytes) {
-        uint32_t bytesToCopy;
 
-        //step 1: copy data into state if there is space & there is data
+    //step 1: top up a partially filled block first
+    if (state->bufBytesUsed) {
         bytesToCopy = numBytes;
         if (bytesToCopy > SHA2_BLOCK_SIZE - state->bufBytesUsed)
             bytesToCopy = SHA2_BLOCK_SIZE - state->bufBytesUsed;
@@ -135,12 +207,24 @@ void sha2processBytes(struct Sha2state *state, const void *bytes, uint32_t numBy
         numBytes -= bytesToCopy;
         state->bufBytesUsed += bytesToCopy;
 
-        //step 2: if there is a full block, process it
-        if (state->bufBytesUsed == SHA2_BLOCK_SIZE) {
-            sha2processBlock(state);
-            state->bufBytesUsed = 0;
-        }
+        if (state->bufBytesUsed != SHA2_BLOCK_SIZE)
+            return;
+
+        sha2processBlocks(state->h, state->b, 1);
+        state->bufBytesUsed = 0;
     }
+
+    //step 2: hash whole blocks straight out of the caller's buffer
+    if (numBytes >= SHA2_BLOCK_SIZE) {
+        bytesToCopy = numBytes - numBytes % SHA2_BLOCK_SIZE;
+        sha2processBlocks(state->h, inBytes, bytesToCopy / SHA2_BLOCK_SIZE);
+        inBytes += bytesToCopy;
+        numBytes -= bytesToCopy;
+    }
+
+    //step 3: keep the tail for next time
+    memcpy(state->b, inBytes, numBytes);
+    state->bufBytesUsed = numBytes;
 }
 
 const uint32_t* sha2finish(struct Sha2state *state)
@@ -162,7 +246,7 @@ const uint32_t* sha2finish(struct Sha2state *state)
         state->b[63 - i] = dataLenInBits;
 
     //process last block
-    sha2processBlock(state);
+    sha2processBlocks(state->h, state->b, 1);
 
     //return pointer to hash
     return state->h;
@@ -0,0 +1,160 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <plat/inc/bl.h>
+#include <string.h>
+
+#include <appIndex.h>
+#include <crc.h>
+#include <heap.h>
+#include <mpu.h>
+#include <rsa.h>
+#include <seos.h>
+#include <sha2.h>
+#include <sigCache.h>
+
+struct SigCacheEntry {
+    uint32_t imageHash[SHA2_HASH_WORDS];
+    uint32_t rootKeyHash[SHA2_HASH_WORDS];
+};
+
+struct SigCacheHdr {
+    uint32_t keysHash[SHA2_HASH_WORDS];  /* of all of .pubkeys when the table was written */
+    struct SigCacheEntry entries[0];
+};
+
+extern char __shared_start[];
+extern char __shared_end[];
+
+static bool sigCacheKeysHash(uint32_t *hash)
+{
+    struct Sha2state sha;
+    const uint32_t *keys;
+    uint32_t numKeys = 0;
+
+    keys = BL.blGetPubKeysInfo(&numKeys);
+    if (!keys || !numKeys)
+        return false;
+
+    sha2init(&sha);
+    sha2processBytes(&sha, keys, numKeys * RSA_BYTES);
+    memcpy(hash, sha2finish(&sha), SHA2_HASH_SIZE);
+
+    return true;
+}
+
+//newest intact table that was written for the keys we have now, NULL if there is none
+static const struct SigCacheHdr *sigCacheLoad(uint32_t *numEntries)
+{
+    uint8_t *shared_end = (uint8_t *)&__shared_end;
+    const uint8_t *shared, *table = NULL;
+    uint32_t keysHash[SHA2_HASH_WORDS];
+    uint32_t len;
+
+    for (shared = (uint8_t *)&__shared_start;
+         shared < shared_end && shared[0] != 0xFF && shared + appIndexSegSize(shared) <= shared_end;
+         shared += appIndexSegSize(shared)) {
+        if (shared[0] == ((SIG_CACHE_SEG_ID << 4) | SIG_CACHE_SEG_ID) && crc32(shared, appIndexSegSize(shared), ~0) == CRC_RESIDUE)
+            table = shared;
+    }
+
+    if (!table)
+        return NULL;
+
+    len = (table[1] << 16) | (table[2] << 8) | table[3];
+    if (len < sizeof(struct SigCacheHdr) || !sigCacheKeysHash(keysHash) ||
+        memcmp(keysHash, ((const struct SigCacheHdr *)(table + sizeof(uint32_t)))->keysHash, SHA2_HASH_SIZE))
+        return NULL;
+
+    *numEntries = (len - sizeof(struct SigCacheHdr)) / sizeof(struct SigCacheEntry);
+    return (const struct SigCacheHdr *)(table + sizeof(uint32_t));
+}
+
+bool sigCacheFind(const uint32_t *imageHash, uint32_t *rootKeyHash)
+{
+    const struct SigCacheHdr *table;
+    uint32_t i, numEntries = 0;
+
+    table = sigCacheLoad(&numEntries);
+    if (!table)
+        return false;
+
+    for (i = 0; i < numEntries; i++) {
+        if (!memcmp(table->entries[i].imageHash, imageHash, SHA2_HASH_SIZE)) {
+            memcpy(rootKeyHash, table->entries[i].rootKeyHash, SHA2_HASH_SIZE);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool sigCacheWrite(uint8_t *at, const uint32_t *imageHash, const uint32_t *rootKeyHash)
+{
+    uint8_t *shared_end = (uint8_t *)&__shared_end;
+    const struct SigCacheHdr *old;
+    struct SigCacheHdr *table;
+    uint32_t i, numOld = 0, num = 0, len, crc;
+    uint8_t *buf;
+    int ret;
+
+    buf = heapAlloc(sizeof(uint32_t) + sizeof(struct SigCacheHdr) + SIG_CACHE_MAX_ENTRIES * sizeof(struct SigCacheEntry) + sizeof(uint32_t));
+    if (!buf)
+        return false;
+
+    table = (struct SigCacheHdr *)(buf + sizeof(uint32_t));
+    if (!sigCacheKeysHash(table->keysHash)) {
+        heapFree(buf);
+        return false;
+    }
+
+    //newest first, the oldest entries fall off the end
+    memcpy(table->entries[num].imageHash, imageHash, SHA2_HASH_SIZE);
+    memcpy(table->entries[num].rootKeyHash, rootKeyHash, SHA2_HASH_SIZE);
+    num++;
+
+    old = sigCacheLoad(&numOld);
+    for (i = 0; old && i < numOld && num < SIG_CACHE_MAX_ENTRIES; i++) {
+        if (!memcmp(old->entries[i].imageHash, imageHash, SHA2_HASH_SIZE))
+            continue;
+        table->entries[num++] = old->entries[i];
+    }
+
+    len = sizeof(struct SigCacheHdr) + num * sizeof(struct SigCacheEntry);
+    if (at + sizeof(uint32_t) + len + sizeof(uint32_t) > shared_end) {
+        heapFree(buf);
+        return false;
+    }
+
+    buf[0] = (SIG_CACHE_SEG_ID << 4) | SIG_CACHE_SEG_ID;
+    buf[1] = len >> 16;
+    buf[2] = len >> 8;
+    buf[3] = len;
+
+    crc = ~crc32(buf, sizeof(uint32_t) + len, ~0);
+    memcpy(buf + sizeof(uint32_t) + len, &crc, sizeof(crc));
+
+    mpuAllowRamExecution(true);
+    mpuAllowRomWrite(true);
+    ret = BL.blProgramShared(at, buf, sizeof(uint32_t) + len + sizeof(uint32_t), BL_FLASH_KEY1, BL_FLASH_KEY2);
+    mpuAllowRomWrite(false);
+    mpuAllowRamExecution(false);
+
+    heapFree(buf);
+
+    return ret >= 0;
+}
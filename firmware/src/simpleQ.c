@@ -113,6 +113,14 @@ bool simpleQueueDequeue(struct SimpleQueue* sq, void *data)
     return true;
 }
 
+const void* simpleQueuePeek(struct SimpleQueue* sq)
+{
+    if (sq->head == SIMPLE_QUEUE_IDX_NONE)
+        return NULL;
+
+    return simpleQueueGetNth(sq, sq->head)->data;
+}
+
 //if this is called, we need to discard at least one entry. we prefer to discard the oldest item
 static struct SimpleQueueEntry* simpleQueueAllocWithDiscard(struct SimpleQueue* sq)
 {
@@ -21,7 +21,12 @@ include $(CLEAR_VARS)
 LOCAL_SHARED_LIBRARIES := libc
 
 LOCAL_SRC_FILES := \
-        postprocess.c
+        postprocess.c \
+        lzCompress.c \
+        relocPack.c \
+        ../../firmware/src/lz.c
+
+LOCAL_C_INCLUDES := $(LOCAL_PATH)/../../firmware/inc
 
 LOCAL_MODULE := nanoapp_postprocess
 
@@ -0,0 +1,114 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "../../firmware/inc/lz.h"
+#include "lzCompress.h"
+
+#define LZ_HASH_BITS		12
+#define LZ_MAX_CHAIN		64	//match candidates tried per position
+
+static uint32_t lzHash(const uint8_t *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t *lzPutLen(uint8_t *dst, uint32_t len)
+{
+	len -= LZ_LEN_MORE;
+	while (len >= 0xFF) {
+		*dst++ = 0xFF;
+		len -= 0xFF;
+	}
+	*dst++ = len;
+
+	return dst;
+}
+
+static uint8_t *lzPutSeq(uint8_t *dst, const uint8_t *lit, uint32_t litLen, uint32_t matchLen, uint32_t offset)
+{
+	uint32_t litNib = litLen < LZ_LEN_MORE ? litLen : LZ_LEN_MORE;
+	uint32_t matchNib = 0;
+
+	if (matchLen)
+		matchNib = matchLen - LZ_MIN_MATCH < LZ_LEN_MORE ? matchLen - LZ_MIN_MATCH : LZ_LEN_MORE;
+
+	*dst++ = (litNib << 4) | matchNib;
+	if (litNib == LZ_LEN_MORE)
+		dst = lzPutLen(dst, litLen);
+	memcpy(dst, lit, litLen);
+	dst += litLen;
+
+	if (matchLen) {
+		*dst++ = offset;
+		*dst++ = offset >> 8;
+		if (matchNib == LZ_LEN_MORE)
+			dst = lzPutLen(dst, matchLen - LZ_MIN_MATCH);
+	}
+
+	return dst;
+}
+
+//greedy LZ with hash chains, in the format firmware/src/lz.c decodes
+uint32_t lzCompress(const uint8_t *src, uint32_t srcLen, uint8_t *dst)
+{
+	int32_t head[1 << LZ_HASH_BITS], prev[LZ_WINDOW_SIZE], cand, next;
+	uint32_t i, litStart = 0, best, bestOfst, len, chain, p;
+	uint8_t *out = dst;
+
+	for (i = 0; i < (1 << LZ_HASH_BITS); i++)
+		head[i] = -1;
+
+	for (i = 0; i + LZ_MIN_MATCH <= srcLen;) {
+		uint32_t h = lzHash(src + i);
+
+		best = 0;
+		bestOfst = 0;
+		for (cand = head[h], chain = 0; cand >= 0 && i - cand <= LZ_WINDOW_SIZE && chain < LZ_MAX_CHAIN; chain++) {
+			for (len = 0; i + len < srcLen && src[cand + len] == src[i + len]; len++);
+			if (len > best) {
+				best = len;
+				bestOfst = i - cand;
+			}
+			next = prev[cand % LZ_WINDOW_SIZE];
+			if (next >= cand)
+				break;
+			cand = next;
+		}
+
+		if (best < LZ_MIN_MATCH)
+			best = 1;
+		else {
+			out = lzPutSeq(out, src + litStart, i - litStart, best, bestOfst);
+			litStart = i + best;
+		}
+
+		//every position goes into the chains, matched or not
+		for (p = i, i += best; p < i && p + LZ_MIN_MATCH <= srcLen; p++) {
+			h = lzHash(src + p);
+			prev[p % LZ_WINDOW_SIZE] = head[h];
+			head[h] = p;
+		}
+	}
+
+	//whatever is left goes out as the final, literals-only sequence
+	out = lzPutSeq(out, src + litStart, srcLen - litStart, 0, 0);
+
+	return out - dst;
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LZ_COMPRESS_H_
+#define _LZ_COMPRESS_H_
+
+#include <stdint.h>
+
+//worst case output size for srcLen bytes of input
+#define LZ_COMPRESS_BOUND(srcLen)	((srcLen) + (srcLen) / 255 + 16)
+
+//host side of firmware/inc/lz.h: compress src into dst, which must hold LZ_COMPRESS_BOUND(srcLen) bytes. returns the compressed length
+uint32_t lzCompress(const uint8_t *src, uint32_t srcLen, uint8_t *dst);
+
+#endif
@@ -15,6 +15,9 @@
  */
 
 #include "../../firmware/inc/cpu/cortexm4f/appRelocFormat.h"
+#include "../../firmware/inc/lz.h"
+#include "lzCompress.h"
+#include "relocPack.h"
 #include <sys/types.h>
 #include <stdbool.h>
 #include <unistd.h>
@@ -49,6 +52,9 @@
 #define NANO_RELOC_LAST		2 //must be <= (RELOC_TYPE_MASK >> RELOC_TYPE_SHIFT)
 
 
+#define COMP_HDR_SIZE		32	//same as all other appSec headers
+
+
 struct AppHeader {
 	uint32_t magic[4];
 
@@ -92,22 +98,60 @@ struct SymtabEntry {
 
 
 
-struct NanoRelocEntry {
-	uint32_t ofstInRam;
-	uint8_t type;
+struct CompHdr {
+	char magic[8];
+	uint32_t compressedLen;
+	uint32_t origLen;
+	uint8_t rfu[COMP_HDR_SIZE - 16];
 };
 
+struct LzCheck {
+	const uint8_t *expected;
+	uint32_t pos, len;
+};
+
+static bool lzCheckWrite(void *userData, const void *data, uint32_t len)
+{
+	struct LzCheck *chk = (struct LzCheck*)userData;
+
+	if (len > chk->len - chk->pos || memcmp(chk->expected + chk->pos, data, len))
+		return false;
+	chk->pos += len;
+
+	return true;
+}
+
+//run the compressed stream through the firmware's own decoder
+static bool lzCheck(const uint8_t *comp, uint32_t compLen, const uint8_t *orig, uint32_t origLen)
+{
+	struct LzCheck chk = {.expected = orig, .pos = 0, .len = origLen};
+	struct LzDecoder dec;
+	uint8_t *window;
+	bool ok;
+
+	window = malloc(LZ_WINDOW_SIZE);
+	if (!window)
+		return false;
+
+	lzDecInit(&dec, window, compLen, origLen);
+	ok = lzDecProcess(&dec, comp, compLen, lzCheckWrite, &chk) && lzDecFinish(&dec, lzCheckWrite, &chk) && chk.pos == origLen;
+	free(window);
+
+	return ok;
+}
+
 
 int main(int argc, char **argv)
 {
-	uint32_t i, numRelocs, numSyms, outNumRelocs = 0, packedNanoRelocSz, j, k, lastOutType = 0, origin = 0;
+	uint32_t i, numRelocs, numSyms, outNumRelocs = 0, packedNanoRelocSz, j, k;
 	struct NanoRelocEntry *nanoRelocs = NULL;
 	struct RelocEntry *relocs;
 	struct SymtabEntry *syms;
-	uint8_t *packedNanoRelocs;
-	uint32_t t, bufUsed = 0;
+	uint8_t *packedNanoRelocs, *comp = NULL;
+	uint32_t t, bufUsed = 0, compLen;
 	struct AppHeader *hdr;
-	bool verbose = false;
+	struct CompHdr *compHdr;
+	bool verbose = false, compress = false;
 	uint8_t *buf = NULL;
 	uint32_t bufSz = 0;
 	uint64_t appId = 0;
@@ -122,11 +166,15 @@ int main(int argc, char **argv)
 			verbose = true;
 			continue;
 		}
+		if (!strcmp(argv[i], "-c")) {
+			compress = true;
+			continue;
+		}
 		appId = strtoul(argv[i], NULL, 16);
 	}
 
 	if (!appId) {
-		fprintf(stderr, "USAGE: %s [-v] 0123456789abcdef < app.bin >app.ap\n\twhere 0123456789abcdef is app ID in hex\n", argv[-1]);
+		fprintf(stderr, "USAGE: %s [-v] [-c] 0123456789abcdef < app.bin >app.ap\n\twhere 0123456789abcdef is app ID in hex\n\t-c compresses the app, it is unpacked as it is uploaded\n", argv[-1]);
 		return -2;
 	}
 
@@ -329,81 +377,13 @@ int main(int argc, char **argv)
 	}
 
 	//produce output nanorelocs in packed format
-	packedNanoRelocs = malloc(outNumRelocs * 6); //definitely big enough
-	packedNanoRelocSz = 0;
-        for (i = 0; i < outNumRelocs; i++) {
-
-		uint32_t displacement;
-
-		if (lastOutType != nanoRelocs[i].type) {		//output type if ti changed
-			if (nanoRelocs[i].type - lastOutType == 1) {
-				packedNanoRelocs[packedNanoRelocSz++] = TOKEN_RELOC_TYPE_NEXT;
-				if (verbose)
-					fprintf(stderr, "Out: RelocTC (1) // to 0x%02X\n", nanoRelocs[i].type);
-			}
-			else {
-				packedNanoRelocs[packedNanoRelocSz++] = TOKEN_RELOC_TYPE_CHG;
-				packedNanoRelocs[packedNanoRelocSz++] = nanoRelocs[i].type - lastOutType - 1;
-				if (verbose)
-					fprintf(stderr, "Out: RelocTC (0x%02X)  // to 0x%02X\n", nanoRelocs[i].type - lastOutType - 1, nanoRelocs[i].type);
-			}
-			lastOutType = nanoRelocs[i].type;
-			origin = 0;
-		}
-		displacement = nanoRelocs[i].ofstInRam - origin;
-		origin = nanoRelocs[i].ofstInRam + 4;
-		if (displacement & 3) {
-			fprintf(stderr, "Unaligned relocs are not possible!\n");
-			exit(-5);
-		}
-		displacement /= 4;
+	packedNanoRelocs = malloc(RELOC_PACK_BOUND(outNumRelocs));
+	if (!relocsPack(nanoRelocs, outNumRelocs, packedNanoRelocs, &packedNanoRelocSz, verbose))
+		exit(-5);
 
-		//might be start of a run. look into that
-		if (!displacement) {
-			for (j = 1; j + i < outNumRelocs && j < MAX_RUN_LEN && nanoRelocs[j + i].type == lastOutType && nanoRelocs[j + i].ofstInRam - nanoRelocs[j + i - 1].ofstInRam == 4; j++);
-			if (j >= MIN_RUN_LEN) {
-				if (verbose)
-					fprintf(stderr, "Out: Reloc0  x%u\n", j);
-				packedNanoRelocs[packedNanoRelocSz++] = TOKEN_CONSECUTIVE;
-				packedNanoRelocs[packedNanoRelocSz++] = j - MIN_RUN_LEN;
-				origin = nanoRelocs[j + i - 1].ofstInRam + 4;	//reset origin to last one
-				i += j - 1;	//loop will increment anyways, hence +1
-				continue;
-			}
-		}
-
-		//produce output
-		if (displacement <= MAX_8_BIT_NUM) {
-			if (verbose)
-				fprintf(stderr, "Out: Reloc8  0x%02X\n", displacement);
-			packedNanoRelocs[packedNanoRelocSz++] = displacement;
-		}
-		else if (displacement <= MAX_16_BIT_NUM) {
-			if (verbose)
-				fprintf(stderr, "Out: Reloc16 0x%06X\n", displacement);
-                        displacement -= MAX_8_BIT_NUM;
-			packedNanoRelocs[packedNanoRelocSz++] = TOKEN_16BIT_OFST;
-			packedNanoRelocs[packedNanoRelocSz++] = displacement;
-			packedNanoRelocs[packedNanoRelocSz++] = displacement >> 8;
-		}
-		else if (displacement <= MAX_24_BIT_NUM) {
-			if (verbose)
-				fprintf(stderr, "Out: Reloc24 0x%08X\n", displacement);
-                        displacement -= MAX_16_BIT_NUM;
-			packedNanoRelocs[packedNanoRelocSz++] = TOKEN_24BIT_OFST;
-			packedNanoRelocs[packedNanoRelocSz++] = displacement;
-			packedNanoRelocs[packedNanoRelocSz++] = displacement >> 8;
-			packedNanoRelocs[packedNanoRelocSz++] = displacement >> 16;
-		}
-		else  {
-			if (verbose)
-				fprintf(stderr, "Out: Reloc32 0x%08X\n", displacement);
-			packedNanoRelocs[packedNanoRelocSz++] = TOKEN_32BIT_OFST;
-			packedNanoRelocs[packedNanoRelocSz++] = displacement;
-			packedNanoRelocs[packedNanoRelocSz++] = displacement >> 8;
-			packedNanoRelocs[packedNanoRelocSz++] = displacement >> 16;
-			packedNanoRelocs[packedNanoRelocSz++] = displacement >> 24;
-		}
+	if (!relocsCheck(packedNanoRelocs, packedNanoRelocSz, nanoRelocs, outNumRelocs)) {
+		fprintf(stderr, "Packed relocs do not unpack to what was packed!\n");
+		goto out;
 	}
 
 	//put in app id
@@ -462,6 +442,33 @@ int main(int argc, char **argv)
 		fprintf(stderr,"Runtime RAM use: %u bytes\n", gotSz + bssSz);
 	}
 
+	//compress if asked to, and make sure it unpacks to exactly what we had
+	if (compress) {
+		comp = malloc(sizeof(struct CompHdr) + LZ_COMPRESS_BOUND(bufUsed));
+		if (!comp) {
+			fprintf(stderr, "Failed to allocate a compression buffer\n");
+			goto out;
+		}
+
+		compLen = lzCompress(buf, bufUsed, comp + sizeof(struct CompHdr));
+		if (!lzCheck(comp + sizeof(struct CompHdr), compLen, buf, bufUsed)) {
+			fprintf(stderr, "Compressed app does not decompress to the original!\n");
+			goto out;
+		}
+
+		compHdr = (struct CompHdr*)comp;
+		memset(compHdr, 0, sizeof(struct CompHdr));
+		memcpy(compHdr->magic, "PackdApp", sizeof(compHdr->magic));
+		compHdr->compressedLen = compLen;
+		compHdr->origLen = bufUsed;
+
+		fprintf(stderr, "Compressed to %u bytes (%u%%)\n", (unsigned)compLen, (unsigned)(100ULL * compLen / bufUsed));
+
+		free(buf);
+		buf = comp;
+		bufUsed = sizeof(struct CompHdr) + compLen;
+	}
+
 	//output the data
 	for (i = 0; i < bufUsed; i++)
 		putchar(buf[i]);
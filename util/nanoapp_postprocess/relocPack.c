@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "../../firmware/inc/cpu/cortexm4f/appRelocFormat.h"
+#include "relocPack.h"
+
+static uint32_t relocNumCost(uint32_t num)
+{
+	if (num <= MAX_8_BIT_NUM)
+		return 1;
+	else if (num <= MAX_16_BIT_NUM)
+		return 3;
+	else if (num <= MAX_24_BIT_NUM)
+		return 4;
+	else
+		return 5;
+}
+
+//bytes the existing tokens need for 'len' relocs that each directly follow the one before
+static uint32_t relocConsecutiveCost(uint32_t len)
+{
+	uint32_t rem = len % MAX_RUN_LEN;
+
+	return 2 * (len / MAX_RUN_LEN) + (rem >= MIN_RUN_LEN ? 2 : rem);
+}
+
+//unpack the packed relocs the way the loader does, and make sure we get back exactly what we packed
+bool relocsCheck(const uint8_t *packed, uint32_t packedSz, const struct NanoRelocEntry *relocs, uint32_t numRelocs)
+{
+	uint32_t pos = 0, num = 0, type = 0, ofst = 0, val, count;
+
+	while (pos < packedSz) {
+		uint8_t tok = packed[pos++];
+
+		count = 1;
+		if (tok <= MAX_8_BIT_NUM)
+			val = tok;
+		else switch (tok) {
+			case TOKEN_32BIT_OFST:
+				if (packedSz - pos < 4)
+					return false;
+				val = packed[pos] | (packed[pos + 1] << 8) | (packed[pos + 2] << 16) | ((uint32_t)packed[pos + 3] << 24);
+				pos += 4;
+				break;
+			case TOKEN_24BIT_OFST:
+				if (packedSz - pos < 3)
+					return false;
+				val = (packed[pos] | (packed[pos + 1] << 8) | (packed[pos + 2] << 16)) + MAX_16_BIT_NUM;
+				pos += 3;
+				break;
+			case TOKEN_16BIT_OFST:
+				if (packedSz - pos < 2)
+					return false;
+				val = (packed[pos] | (packed[pos + 1] << 8)) + MAX_8_BIT_NUM;
+				pos += 2;
+				break;
+			case TOKEN_CONSECUTIVE:
+				if (packedSz - pos < 1)
+					return false;
+				val = 0;
+				count = packed[pos++] + MIN_RUN_LEN;
+				break;
+			case TOKEN_RELOC_TYPE_CHG:
+				if (packedSz - pos < 1)
+					return false;
+				if (packed[pos] == RELOC_EXT_STRIDE_RUN) {
+					if (packedSz - pos < 4 || packed[pos + 1] > MAX_STRIDE_GAP)
+						return false;
+					val = packed[pos + 1];
+					count = (packed[pos + 2] | (packed[pos + 3] << 8)) + MIN_STRIDE_RUN;
+					pos += 4;
+					break;
+				}
+				type += packed[pos++] + 1;
+				ofst = 0;
+				continue;
+			default: //TOKEN_RELOC_TYPE_NEXT
+				type++;
+				ofst = 0;
+				continue;
+		}
+
+		while (count--) {
+			ofst += val * 4;
+			if (num == numRelocs || relocs[num].type != type || relocs[num].ofstInRam != ofst)
+				return false;
+			ofst += 4;
+			num++;
+		}
+	}
+
+	return num == numRelocs;
+}
+
+//pack relocs sorted by type and then offset into packed, which must hold RELOC_PACK_BOUND(numRelocs) bytes
+bool relocsPack(const struct NanoRelocEntry *relocs, uint32_t numRelocs, uint8_t *packed, uint32_t *packedSzP, bool verbose)
+{
+	uint32_t i, j, sz = 0, lastOutType = 0, origin = 0;
+
+	for (i = 0; i < numRelocs; i++) {
+
+		uint32_t displacement;
+
+		if (lastOutType != relocs[i].type) {		//output type if ti changed
+			if (relocs[i].type - lastOutType == 1) {
+				packed[sz++] = TOKEN_RELOC_TYPE_NEXT;
+				if (verbose)
+					fprintf(stderr, "Out: RelocTC (1) // to 0x%02X\n", relocs[i].type);
+			}
+			else {
+				packed[sz++] = TOKEN_RELOC_TYPE_CHG;
+				packed[sz++] = relocs[i].type - lastOutType - 1;
+				if (verbose)
+					fprintf(stderr, "Out: RelocTC (0x%02X)  // to 0x%02X\n", relocs[i].type - lastOutType - 1, relocs[i].type);
+			}
+			lastOutType = relocs[i].type;
+			origin = 0;
+		}
+		displacement = relocs[i].ofstInRam - origin;
+		origin = relocs[i].ofstInRam + 4;
+		if (displacement & 3) {
+			fprintf(stderr, "Unaligned relocs are not possible!\n");
+			return false;
+		}
+		displacement /= 4;
+
+		//relocs at a fixed stride (GOTs, arrays of pointers, ...) go out as one stride run if that is smaller
+		if (displacement <= MAX_STRIDE_GAP) {
+			for (j = 1; j + i < numRelocs && j < MAX_STRIDE_RUN && relocs[j + i].type == lastOutType && relocs[j + i].ofstInRam - relocs[j + i - 1].ofstInRam == 4 * (displacement + 1); j++);
+			if (j >= MIN_STRIDE_RUN && 5 < (displacement ? j * relocNumCost(displacement) : relocConsecutiveCost(j))) {
+				if (verbose)
+					fprintf(stderr, "Out: RelocSR 0x%02X x%u\n", displacement, j);
+				packed[sz++] = TOKEN_RELOC_TYPE_CHG;
+				packed[sz++] = RELOC_EXT_STRIDE_RUN;
+				packed[sz++] = displacement;
+				packed[sz++] = j - MIN_STRIDE_RUN;
+				packed[sz++] = (j - MIN_STRIDE_RUN) >> 8;
+				origin = relocs[j + i - 1].ofstInRam + 4;
+				i += j - 1;
+				continue;
+			}
+		}
+
+		//might be start of a run. look into that
+		if (!displacement) {
+			for (j = 1; j + i < numRelocs && j < MAX_RUN_LEN && relocs[j + i].type == lastOutType && relocs[j + i].ofstInRam - relocs[j + i - 1].ofstInRam == 4; j++);
+			if (j >= MIN_RUN_LEN) {
+				if (verbose)
+					fprintf(stderr, "Out: Reloc0  x%u\n", j);
+				packed[sz++] = TOKEN_CONSECUTIVE;
+				packed[sz++] = j - MIN_RUN_LEN;
+				origin = relocs[j + i - 1].ofstInRam + 4;	//reset origin to last one
+				i += j - 1;	//loop will increment anyways, hence +1
+				continue;
+			}
+		}
+
+		//produce output
+		if (displacement <= MAX_8_BIT_NUM) {
+			if (verbose)
+				fprintf(stderr, "Out: Reloc8  0x%02X\n", displacement);
+			packed[sz++] = displacement;
+		}
+		else if (displacement <= MAX_16_BIT_NUM) {
+			if (verbose)
+				fprintf(stderr, "Out: Reloc16 0x%06X\n", displacement);
+                        displacement -= MAX_8_BIT_NUM;
+			packed[sz++] = TOKEN_16BIT_OFST;
+			packed[sz++] = displacement;
+			packed[sz++] = displacement >> 8;
+		}
+		else if (displacement <= MAX_24_BIT_NUM) {
+			if (verbose)
+				fprintf(stderr, "Out: Reloc24 0x%08X\n", displacement);
+                        displacement -= MAX_16_BIT_NUM;
+			packed[sz++] = TOKEN_24BIT_OFST;
+			packed[sz++] = displacement;
+			packed[sz++] = displacement >> 8;
+			packed[sz++] = displacement >> 16;
+		}
+		else  {
+			if (verbose)
+				fprintf(stderr, "Out: Reloc32 0x%08X\n", displacement);
+			packed[sz++] = TOKEN_32BIT_OFST;
+			packed[sz++] = displacement;
+			packed[sz++] = displacement >> 8;
+			packed[sz++] = displacement >> 16;
+			packed[sz++] = displacement >> 24;
+		}
+	}
+
+	*packedSzP = sz;
+
+	return true;
+}
@@ -0,0 +1,36 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _RELOC_PACK_H_
+#define _RELOC_PACK_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct NanoRelocEntry {
+	uint32_t ofstInRam;
+	uint8_t type;
+};
+
+#define RELOC_PACK_BOUND(numRelocs)	((numRelocs) * 6)	//definitely big enough
+
+//host side of firmware/inc/cpu/cortexm4f/appRelocFormat.h
+bool relocsPack(const struct NanoRelocEntry *relocs, uint32_t numRelocs, uint8_t *packed, uint32_t *packedSzP, bool verbose);
+
+//unpack the packed relocs the way the loader does, true if we get back exactly relocs
+bool relocsCheck(const uint8_t *packed, uint32_t packedSz, const struct NanoRelocEntry *relocs, uint32_t numRelocs);
+
+#endif
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <aes.h>
+
+/*
+ * aesCbcDecrBlocks against the NIST SP 800-38A CBC-AES256 known answer, whole
+ * and split across calls, into another buffer and in place. Then random data
+ * encrypted with aesCbcEncr must decrypt back whatever way the blocks are cut
+ * up, as appSec does with its in-place runs of blocks.
+ */
+
+#define NUM_ROUNDS      200
+#define MAX_BLOCKS      64
+
+//each word is four bytes of the NIST vectors read big-endian
+static const uint32_t mKey[AES_KEY_WORDS] = {
+    0x603deb10, 0x15ca71be, 0x2b73aef0, 0x857d7781, 0x1f352c07, 0x3b6108d7, 0x2d9810a3, 0x0914dff4,
+};
+static const uint32_t mIv[AES_BLOCK_WORDS] = { 0x00010203, 0x04050607, 0x08090a0b, 0x0c0d0e0f };
+static const uint32_t mPlain[4 * AES_BLOCK_WORDS] = {
+    0x6bc1bee2, 0x2e409f96, 0xe93d7e11, 0x7393172a, 0xae2d8a57, 0x1e03ac9c, 0x9eb76fac, 0x45af8e51,
+    0x30c81c46, 0xa35ce411, 0xe5fbc119, 0x1a0a52ef, 0xf69f2445, 0xdf4f9b17, 0xad2b417b, 0xe66c3710,
+};
+static const uint32_t mCipher[4 * AES_BLOCK_WORDS] = {
+    0xf58c4c04, 0xd6e5f1ba, 0x779eabfb, 0x5f7bfbd6, 0x9cfc4e96, 0x7edb808d, 0x679f777b, 0xc6702c7d,
+    0x39f23369, 0xa9d9bacf, 0xa530e263, 0x04231461, 0xb2eb05e2, 0xc39be9fc, 0xda6c1907, 0x8c6a9d1b,
+};
+
+static unsigned mFailed;
+static uint32_t mRand = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    mRand = mRand * 1103515245 + 12345;
+    return (mRand >> 8) % n;
+}
+
+static void expect(bool ok, const char *what, unsigned round)
+{
+    if (!ok) {
+        fprintf(stderr, "aes_test: %s (round %u)\n", what, round);
+        mFailed++;
+    }
+}
+
+//decrypt numBlocks from src to dst in runs of random length
+static void decrypt(struct AesCbcContext *ctx, const uint32_t *src, uint32_t *dst, uint32_t numBlocks)
+{
+    uint32_t run;
+
+    for (; numBlocks; numBlocks -= run, src += run * AES_BLOCK_WORDS, dst += run * AES_BLOCK_WORDS) {
+        run = 1 + rnd(numBlocks);
+        aesCbcDecrBlocks(ctx, src, dst, run);
+    }
+}
+
+static void knownAnswer(void)
+{
+    struct AesCbcContext ctx;
+    uint32_t buf[4 * AES_BLOCK_WORDS];
+    uint32_t i;
+
+    aesCbcInitForDecr(&ctx, mKey, mIv);
+    aesCbcDecrBlocks(&ctx, mCipher, buf, 4);
+    expect(!memcmp(buf, mPlain, sizeof(buf)), "known answer", 0);
+    expect(!memcmp(ctx.iv, mCipher + 3 * AES_BLOCK_WORDS, sizeof(ctx.iv)), "iv not chained", 0);
+
+    memcpy(buf, mCipher, sizeof(buf));
+    aesCbcInitForDecr(&ctx, mKey, mIv);
+    aesCbcDecrBlocks(&ctx, buf, buf, 4);
+    expect(!memcmp(buf, mPlain, sizeof(buf)), "known answer in place", 0);
+
+    //one block at a time through aesCbcDecr, then 1 + 3
+    aesCbcInitForDecr(&ctx, mKey, mIv);
+    for (i = 0; i < 4; i++)
+        aesCbcDecr(&ctx, mCipher + i * AES_BLOCK_WORDS, buf + i * AES_BLOCK_WORDS);
+    expect(!memcmp(buf, mPlain, sizeof(buf)), "known answer by block", 0);
+
+    memcpy(buf, mCipher, sizeof(buf));
+    aesCbcInitForDecr(&ctx, mKey, mIv);
+    aesCbcDecrBlocks(&ctx, buf, buf, 1);
+    aesCbcDecrBlocks(&ctx, buf + AES_BLOCK_WORDS, buf + AES_BLOCK_WORDS, 3);
+    expect(!memcmp(buf, mPlain, sizeof(buf)), "known answer split", 0);
+
+    //no blocks leaves everything alone
+    aesCbcInitForDecr(&ctx, mKey, mIv);
+    aesCbcDecrBlocks(&ctx, mCipher, buf, 0);
+    expect(!memcmp(buf, mPlain, sizeof(buf)) && !memcmp(ctx.iv, mIv, sizeof(ctx.iv)), "zero blocks", 0);
+
+    aesCbcInitForEncr(&ctx, mKey, mIv);
+    for (i = 0; i < 4; i++)
+        aesCbcEncr(&ctx, mPlain + i * AES_BLOCK_WORDS, buf + i * AES_BLOCK_WORDS);
+    expect(!memcmp(buf, mCipher, sizeof(buf)), "known answer encrypt", 0);
+}
+
+static void roundTrip(unsigned round)
+{
+    static uint32_t plain[MAX_BLOCKS * AES_BLOCK_WORDS], cipher[MAX_BLOCKS * AES_BLOCK_WORDS], out[MAX_BLOCKS * AES_BLOCK_WORDS];
+    uint32_t key[AES_KEY_WORDS], iv[AES_BLOCK_WORDS];
+    struct AesCbcContext ctx;
+    uint32_t i, numBlocks = 1 + rnd(MAX_BLOCKS);
+
+    for (i = 0; i < AES_KEY_WORDS; i++)
+        key[i] = rnd(0x10000) << 16 | rnd(0x10000);
+    for (i = 0; i < AES_BLOCK_WORDS; i++)
+        iv[i] = rnd(0x10000) << 16 | rnd(0x10000);
+    for (i = 0; i < numBlocks * AES_BLOCK_WORDS; i++)
+        plain[i] = rnd(0x10000) << 16 | rnd(0x10000);
+
+    aesCbcInitForEncr(&ctx, key, iv);
+    for (i = 0; i < numBlocks; i++)
+        aesCbcEncr(&ctx, plain + i * AES_BLOCK_WORDS, cipher + i * AES_BLOCK_WORDS);
+
+    aesCbcInitForDecr(&ctx, key, iv);
+    decrypt(&ctx, cipher, out, numBlocks);
+    expect(!memcmp(out, plain, numBlocks * sizeof(uint32_t[AES_BLOCK_WORDS])), "round trip", round);
+
+    memcpy(out, cipher, numBlocks * sizeof(uint32_t[AES_BLOCK_WORDS]));
+    aesCbcInitForDecr(&ctx, key, iv);
+    decrypt(&ctx, out, out, numBlocks);
+    expect(!memcmp(out, plain, numBlocks * sizeof(uint32_t[AES_BLOCK_WORDS])), "round trip in place", round);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned round;
+
+    if (argc > 1)
+        mRand = strtoul(argv[1], NULL, 0);
+
+    knownAnswer();
+    for (round = 1; round <= NUM_ROUNDS; round++)
+        roundTrip(round);
+
+    printf("aes_test: %u rounds, %s\n", NUM_ROUNDS, mFailed ? "FAILED" : "ok");
+
+    return mFailed ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <seos.h>
+#include <timer.h>
+
+/*
+ * The bench app (drivers/bench) run on the host: gBenchApp instead of an
+ * .internal_app_init entry, with a real clock and just the seos calls it
+ * makes. host_os would not do, its time stands still while a case runs.
+ * Writes the CSV to NANOHUB_BENCH, stdout if unset.
+ */
+#undef INTERNAL_APP_INIT
+#define INTERNAL_APP_INIT(_id, _ver, _init, _end, _event) \
+    const struct AppFuncs gBenchApp = { .init = (_init), .end = (_end), .handle = (_event) }
+
+#include "../../firmware/src/drivers/bench/bench.c"
+
+#define MAX_DEFERRED    16
+
+static struct {
+    OsDeferCbkF cbk;
+    void *cookie;
+} mDeferred[MAX_DEFERRED];
+static uint32_t mDeferHead, mDeferCount;
+
+uint64_t timGetTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+bool osDefer(OsDeferCbkF callback, void *cookie, bool urgent)
+{
+    uint32_t idx;
+
+    if (mDeferCount == MAX_DEFERRED)
+        return false;
+
+    if (urgent) {
+        mDeferHead = (mDeferHead + MAX_DEFERRED - 1) % MAX_DEFERRED;
+        idx = mDeferHead;
+    } else {
+        idx = (mDeferHead + mDeferCount) % MAX_DEFERRED;
+    }
+    mDeferred[idx].cbk = callback;
+    mDeferred[idx].cookie = cookie;
+    mDeferCount++;
+
+    return true;
+}
+
+bool osEventSubscribe(uint32_t tid, uint32_t evtType)
+{
+    return true;
+}
+
+bool osEventUnsubscribe(uint32_t tid, uint32_t evtType)
+{
+    return true;
+}
+
+void osLogv(enum LogLevel level, const char *str, va_list vl)
+{
+    vfprintf(stderr, str, vl);
+}
+
+void osLog(enum LogLevel level, const char *str, ...)
+{
+    va_list vl;
+
+    va_start(vl, str);
+    osLogv(level, str, vl);
+    va_end(vl);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t idx;
+
+    setenv("NANOHUB_BENCH", "-", 0);
+    if (!gBenchApp.init(1))
+        return 1;
+
+    gBenchApp.handle(EVT_APP_START, NULL);
+    while (mDeferCount) {
+        idx = mDeferHead;
+        mDeferHead = (mDeferHead + 1) % MAX_DEFERRED;
+        mDeferCount--;
+        mDeferred[idx].cbk(mDeferred[idx].cookie);
+    }
+    gBenchApp.end();
+
+    return 0;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <crc.h>
+
+/*
+ * crc32 and crc32Copy against the nibble-table crc32 they replaced, over
+ * random data, lengths, source and destination alignments and seeds. Also
+ * checks that crc32Copy copies exactly size bytes, and that a CRC chained
+ * over word-sized pieces matches one over the whole buffer.
+ */
+
+#define NUM_ROUNDS      2000
+#define MAX_LEN         1100
+#define GUARD           8
+
+static unsigned mFailed;
+static uint32_t mRand = 1;
+
+/* the old crc32, kept here as the reference */
+static const uint32_t mRefTab[] =
+{
+    0x00000000, 0x04C11DB7, 0x09823B6E, 0x0D4326D9, 0x130476DC, 0x17C56B6B, 0x1A864DB2, 0x1E475005,
+    0x2608EDB8, 0x22C9F00F, 0x2F8AD6D6, 0x2B4BCB61, 0x350C9B64, 0x31CD86D3, 0x3C8EA00A, 0x384FBDBD,
+};
+
+static uint32_t refCrcOneWord(uint32_t crc, uint32_t data, int cnt)
+{
+    uint32_t i;
+
+    crc = crc ^ data;
+    for (i = 0; i < cnt; i++)
+        crc = (crc << 4) ^ mRefTab[crc >> 28];
+
+    return crc;
+}
+
+static uint32_t refCrc32(const void *buf, size_t size, uint32_t crc)
+{
+    const uint8_t *data8 = buf;
+    uint32_t word, i;
+
+    for (i = 0; i < size / 4; i++, data8 += 4) {
+        memcpy(&word, data8, sizeof(word));
+        crc = refCrcOneWord(crc, word, 8);
+    }
+
+    if (size & 0x3) {
+        for (i *= 4, word = 0; i < size; i++)
+            word |= (*data8++) << ((i & 0x3) * 8);
+        crc = refCrcOneWord(crc, word, 8);
+    }
+
+    return crc;
+}
+
+static uint32_t rnd(uint32_t n)
+{
+    mRand = mRand * 1103515245 + 12345;
+    return (mRand >> 8) % n;
+}
+
+static void expect(bool ok, const char *what, unsigned round)
+{
+    if (!ok) {
+        fprintf(stderr, "crc_test: %s (round %u)\n", what, round);
+        mFailed++;
+    }
+}
+
+static uint32_t rndLen(void)
+{
+    //short tails and whole blocks are where table code goes wrong
+    switch (rnd(3)) {
+    case 0:
+        return rnd(24);
+    case 1:
+        return rnd(MAX_LEN / 8) * 8 + rnd(8);
+    default:
+        return rnd(MAX_LEN);
+    }
+}
+
+static void testRound(unsigned round)
+{
+    static uint8_t src[MAX_LEN + GUARD], dst[MAX_LEN + 2 * GUARD];
+    uint32_t i, len = rndLen(), srcOfs = rnd(GUARD), dstOfs = rnd(GUARD);
+    uint32_t seed = rnd(4) ? rnd(0x10000) << 16 | rnd(0x10000) : CRC_INIT;
+    uint32_t crc, expected, piece;
+
+    for (i = 0; i < sizeof(src); i++)
+        src[i] = rnd(256);
+    memset(dst, 0xA5, sizeof(dst));
+
+    expected = refCrc32(src + srcOfs, len, seed);
+    expect(crc32(src + srcOfs, len, seed) == expected, "crc32 differs from the reference", round);
+
+    crc = crc32Copy(dst + GUARD + dstOfs, src + srcOfs, len, seed);
+    expect(crc == expected, "crc32Copy differs from the reference", round);
+    expect(!memcmp(dst + GUARD + dstOfs, src + srcOfs, len), "crc32Copy did not copy", round);
+    for (i = 0; i < sizeof(dst); i++) {
+        if ((i < GUARD + dstOfs || i >= GUARD + dstOfs + len) && dst[i] != 0xA5) {
+            expect(false, "crc32Copy wrote outside dst", round);
+            break;
+        }
+    }
+
+    //only the last piece may be short of a word, the rest carry the CRC on
+    for (i = 0, crc = seed; i < len; i += piece) {
+        piece = (rnd(64) + 1) * 4;
+        if (piece > len - i)
+            piece = len - i;
+        crc = (i & 4) ? crc32Copy(dst, src + srcOfs + i, piece, crc) : crc32(src + srcOfs + i, piece, crc);
+    }
+    expect(crc == expected, "chained crc differs", round);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned round;
+
+    if (argc > 1)
+        mRand = strtoul(argv[1], NULL, 0);
+
+    //the usual check string, odd length and not word sized
+    expect(refCrc32("123456789", 9, CRC_INIT) == crc32("123456789", 9, CRC_INIT), "check string", 0);
+
+    for (round = 1; round <= NUM_ROUNDS; round++)
+        testRound(round);
+
+    printf("crc_test: %u rounds, %s\n", NUM_ROUNDS, mFailed ? "FAILED" : "ok");
+
+    return mFailed ? 1 : 0;
+}
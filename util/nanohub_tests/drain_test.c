@@ -0,0 +1,1135 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <float.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <apInt.h>
+#include <crc.h>
+#include <heap.h>
+#include <hostIntf.h>
+#include <hostIntf_priv.h>
+#include <nanohubPacket.h>
+#include <sensors.h>
+#include <seos.h>
+#include <timer.h>
+
+#include "host_os.h"
+
+/*
+ * Fills the real hostIntf output queue to its MAX_NUM_BLOCKS limit and drains
+ * it over a simulated bus, through the real nanohubCommand.c handlers, three
+ * ways: READ_EVENT one event at a time, READ_EVENT with
+ * NANOHUB_READ_EVENT_CAP_MULTI, and READ_EVENTS_BULK. Each drain runs in a
+ * fork of the same full hub. All three must hand the AP the same events, with
+ * every packet and bulk frame CRC intact, and a bulk retransmit must resend
+ * the whole transfer. Prints the bus transfers, bytes and modeled drain time
+ * of each; the bulk read must need far fewer transfers and less bus time.
+ * Then with the queue empty and only partly filled buffers left, one from each
+ * sensor, a single multi READ_EVENT must carry all of them intact.
+ * Last, an upload request that comes while the hub is busy must be NAKed
+ * unless the AP asked for parking, and a parked response must only answer
+ * its own reason and seq, and not outlive the next upload request.
+ * A flood of non-wakeup data must then only ever drop the oldest non-wakeup
+ * packets, never a wakeup one, and the drop counts must add up to what was
+ * lost. Partly filled buffers read one at a time must come oldest first,
+ * whatever order the sensors made them in. Finally the gyro is switched to
+ * compact packets and fed samples at and past the edges of the scale, NaN,
+ * infinities and uneven times; decoded on the AP side each must come back
+ * within half a step, or exactly when escaped.
+ */
+
+#define MS                  1000000ULL
+#define FILL_TIME           (30000 * MS)
+#define AP_TIME_OFFSET      (5000 * MS)     //AP boot time minus hub time
+#define QUEUE_BLOCKS        350             //MAX_NUM_BLOCKS in hostIntf.c
+#define BULK_MAX_BYTES      65536           //more than the hub sends at once
+#define MAX_REQUESTS        10000
+#define FLOOD_ROUNDS        600             //gyro events, four times the non-wakeup queue
+#define FLOOD_WAKEUP_EVERY  6               //rounds per accel event, half the wakeup queue in all
+#define FLOOD_SOURCES       2               //the wakeup accel and the gyro
+#define PACKET_SAMPLES      15              //triple axis samples in one hostIntf packet
+
+//bus model: 8 Mbit/s SPI, and a fixed cost per transfer for chip select, the AP driver and the hub ISR
+#define BUS_NS_PER_BYTE     1000
+#define BUS_NS_PER_XFER     50000
+
+extern const struct AppFuncs gHostIntfApp;
+
+//the AP side's idea of the hostIntf config event
+struct ConfigCmd {
+    uint64_t latency;
+    uint32_t rate;
+    uint8_t sensType;
+    uint8_t enabled : 1;
+    uint8_t flush : 1;
+    uint8_t calibrate : 1;
+    uint8_t compact : 1;
+    uint8_t reserved : 4;
+} __attribute__((packed));
+
+struct Source {
+    struct SensorInfo info;
+    uint32_t rates[2];
+    uint64_t period;        //between events
+    uint32_t samplesPerEvt;
+    uint32_t handle;
+    uint32_t timer;
+    uint32_t seq;
+};
+
+struct Stats {
+    uint32_t requests;
+    uint32_t transfers;
+    uint64_t bytes;
+    uint32_t events;
+    uint32_t samples;
+    uint32_t hash;          //over every event the AP got, in order
+    uint64_t cpuNs;
+    unsigned failed;
+};
+
+enum Method {
+    READ_SINGLE,
+    READ_MULTI,
+    READ_BULK,
+    NUM_METHODS
+};
+
+static const char * const mMethodNames[NUM_METHODS] = { "read_event", "read_event multi", "read_events_bulk" };
+
+//wakeup data gets 200 blocks; non-wakeup asks for 210 and is cut to the 150 left
+static struct Source mSources[] = {
+    { .info = { .sensorType = SENS_TYPE_ACCEL, .numAxis = NUM_AXIS_THREE, .interrupt = NANOHUB_INT_WAKEUP, .minSamples = 3000 },
+      .rates = { SENSOR_HZ(200) }, .period = 50 * MS, .samplesPerEvt = 10 },
+    { .info = { .sensorType = SENS_TYPE_GYRO, .numAxis = NUM_AXIS_THREE, .interrupt = NANOHUB_INT_NONWAKEUP, .minSamples = 3000 },
+      .rates = { SENSOR_HZ(200) }, .period = 50 * MS, .samplesPerEvt = 10 },
+    { .info = { .sensorType = SENS_TYPE_BARO, .numAxis = NUM_AXIS_ONE, .interrupt = NANOHUB_INT_NONWAKEUP, .minSamples = 300 },
+      .rates = { SENSOR_HZ(10) }, .period = 500 * MS, .samplesPerEvt = 5 },
+};
+
+#define NUM_SOURCES (sizeof(mSources) / sizeof(mSources[0]))
+
+struct CompactCase {
+    float v[3];
+    uint64_t delta;         //since the sample before, 0 starts the next event
+    bool escape;
+};
+
+//one event per packet; each packet's scale comes from its first sample and the largest of the packet before
+static const struct CompactCase mCompactCases[] = {
+    //2.0 full scale
+    { { 1.0f, -0.5f, 0.25f }, 0, false },
+    { { 2.0f, -2.0f, 0.0f }, 5 * MS, false },
+    { { 2.0001f, 0.0f, 0.0f }, 5 * MS, true },
+    { { 0.0f, 0.0f, -2.0001f }, 5 * MS, true },
+    { { 1e-7f, -1e-7f, 3e-5f }, 5 * MS, false },
+    { { NAN, 0.0f, 0.0f }, 4 * MS, true },
+    { { 0.0f, INFINITY, 0.0f }, 6 * MS, true },
+    { { 0.0f, 0.0f, -INFINITY }, 1000 * MS, true },
+    { { FLT_MAX, 0.0f, 0.0f }, 5 * MS, true },
+    { { -1.99995f, 1.5f, -0.75f }, 5 * MS, false },
+    //4.0002 from the packet before, none of the non-finite or huge values
+    { { NAN, 2e-4f, -1e-4f }, 0, true },
+    { { 1e-4f, -2e-4f, 0.0f }, 5 * MS, false },
+    { { 0.0f, 3e38f, 0.0f }, 5 * MS, true },
+    { { -2e-4f, 1e-4f, 2e-4f }, 5 * MS, false },
+    //smallest full scale
+    { { 1e-6f, -2e-6f, 1e-4f }, 0, false },
+    { { 0.00099f, -0.00099f, 5e-4f }, 5 * MS, false },
+    { { 0.0011f, 0.0f, 0.0f }, 5 * MS, true },
+    { { 0.0f, 0.0f, 0.0f }, 5 * MS, false },
+};
+
+static const float mCompactScales[] = { 1.0f * 2.0f / 32767.0f, 2.0001f * 2.0f / 32767.0f, 0.001f / 32767.0f };
+
+#define NUM_COMPACT_CASES (sizeof(mCompactCases) / sizeof(mCompactCases[0]))
+#define NUM_COMPACT_EVENTS (sizeof(mCompactScales) / sizeof(mCompactScales[0]))
+
+//what the AP read in a flood, per source
+struct Received {
+    uint32_t events;
+    uint32_t firstSeq;      //of the first event read
+    bool inOrder;           //each event carried on from the one before
+};
+
+//a sample as the AP decodes it
+struct ApSample {
+    uint64_t time;
+    float v[3];
+    bool escaped;
+};
+
+static struct {
+    void *rxBuf;
+    size_t rxSize;
+    HostIntfCommCallbackF rxCbk;
+    const void *txBuf;
+    size_t txSize;
+    HostIntfCommCallbackF txCbk;
+} mBus;
+
+static uint8_t mApBuf[2 * (NANOHUB_PACKET_SIZE_MAX + BULK_MAX_BYTES)];
+static uint32_t mApSeq;
+static struct Stats mStats;
+
+static unsigned mFailed;
+static uint32_t mRand = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    mRand = mRand * 1103515245 + 12345;
+    return ((mRand >> 8) & 0xFFFFFF) % n;
+}
+
+static void expect(bool ok, const char *what, const char *method)
+{
+    if (!ok) {
+        fprintf(stderr, "drain_test: %s (%s)\n", what, method);
+        mFailed++;
+    }
+}
+
+void apIntSet(bool wakeup)
+{
+}
+
+void apIntClear(bool wakeup)
+{
+}
+
+static int busRequest(void)
+{
+    return 0;
+}
+
+static int busRxPacket(void *rxBuf, size_t rxSize, HostIntfCommCallbackF callback)
+{
+    mBus.rxBuf = rxBuf;
+    mBus.rxSize = rxSize;
+    mBus.rxCbk = callback;
+
+    return 0;
+}
+
+static int busTxPacket(const void *txBuf, size_t txSize, HostIntfCommCallbackF callback)
+{
+    mBus.txBuf = txBuf;
+    mBus.txSize = txSize;
+    mBus.txCbk = callback;
+
+    return 0;
+}
+
+static int busRelease(void)
+{
+    return 0;
+}
+
+static const struct HostIntfComm mBusComm = {
+    .request = busRequest,
+    .rxPacket = busRxPacket,
+    .txPacket = busTxPacket,
+    .release = busRelease,
+};
+
+const struct HostIntfComm *platHostIntfInit()
+{
+    return &mBusComm;
+}
+
+//one AP write: the hub must be waiting to receive
+static void apWrite(const void *buf, size_t len, const char *method)
+{
+    HostIntfCommCallbackF cbk = mBus.rxCbk;
+
+    hostOsRunAll();
+    expect(cbk && len <= mBus.rxSize, "hub not receiving", method);
+    if (!cbk || len > mBus.rxSize)
+        return;
+
+    memcpy(mBus.rxBuf, buf, len);
+    mBus.rxCbk = NULL;
+    mStats.transfers++;
+    mStats.bytes += len;
+    cbk(len, 0);
+    hostOsRunAll();
+}
+
+//one AP read of whatever the hub has ready to send
+static size_t apRead(uint8_t *buf, size_t size, const char *method)
+{
+    HostIntfCommCallbackF cbk;
+    size_t len;
+
+    hostOsRunAll();
+    cbk = mBus.txCbk;
+    len = mBus.txSize;
+    expect(cbk && len <= size, "hub not sending", method);
+    if (!cbk || len > size)
+        return 0;
+
+    memcpy(buf, mBus.txBuf, len);
+    mBus.txCbk = NULL;
+    mStats.transfers++;
+    mStats.bytes += len;
+    cbk(len, 0);
+    hostOsRunAll();
+
+    return len;
+}
+
+//the packet after the preamble, if its CRC is good; *end is where the bytes after it start
+static const struct NanohubPacket *apParse(const uint8_t *buf, size_t len, size_t *end)
+{
+    const struct NanohubPacket *packet;
+    uint32_t crc;
+    size_t i;
+
+    for (i = 0; i < len && buf[i] == NANOHUB_PREAMBLE_BYTE; i++)
+        ;
+    packet = (const struct NanohubPacket *)(buf + i);
+    if (len - i < NANOHUB_PACKET_SIZE(0) || packet->sync != NANOHUB_SYNC_BYTE || len - i < NANOHUB_PACKET_SIZE(packet->len))
+        return NULL;
+
+    memcpy(&crc, packet->data + packet->len, sizeof(crc));
+    if (crc != crc32(packet, sizeof(*packet) + packet->len, CRC_INIT))
+        return NULL;
+
+    *end = i + NANOHUB_PACKET_SIZE(packet->len);
+    return packet;
+}
+
+static void apBuildRequest(uint8_t *buf, uint32_t seq, uint32_t reason, const void *data, uint8_t len)
+{
+    struct NanohubPacket *packet = (struct NanohubPacket *)buf;
+    uint32_t crc;
+
+    packet->sync = NANOHUB_SYNC_BYTE;
+    packet->seq = seq;
+    packet->reason = reason;
+    packet->len = len;
+    memcpy(packet->data, data, len);
+    crc = crc32(packet, sizeof(*packet) + len, CRC_INIT);
+    memcpy(packet->data + len, &crc, sizeof(crc));
+}
+
+//request, ACK, response; *extra and *extraLen are what came after the response packet
+static const struct NanohubPacket *apCommand(uint32_t reason, const void *data, uint8_t len, const uint8_t **extra, size_t *extraLen, const char *method)
+{
+    uint8_t req[NANOHUB_PACKET_SIZE_MAX];
+    const struct NanohubPacket *ack, *resp;
+    size_t n, end;
+    uint32_t seq = ++mApSeq;
+
+    mStats.requests++;
+    apBuildRequest(req, seq, reason, data, len);
+    apWrite(req, NANOHUB_PACKET_SIZE(len), method);
+
+    n = apRead(mApBuf, sizeof(mApBuf), method);
+    ack = apParse(mApBuf, n, &end);
+    expect(ack && ack->reason == NANOHUB_REASON_ACK && ack->seq == seq, "request not ACKed", method);
+    if (!ack || ack->reason != NANOHUB_REASON_ACK)
+        return NULL;
+
+    n = apRead(mApBuf, sizeof(mApBuf), method);
+    resp = apParse(mApBuf, n, &end);
+    expect(resp && resp->reason == reason && resp->seq == seq, "bad response", method);
+    if (!resp || resp->reason != reason)
+        return NULL;
+
+    *extra = mApBuf + end;
+    *extraLen = n - end;
+
+    return resp;
+}
+
+//request and the packet that answers it first
+static uint32_t apSend(uint32_t seq, uint32_t reason, const void *data, uint8_t len, const char *method)
+{
+    uint8_t req[NANOHUB_PACKET_SIZE_MAX];
+    const struct NanohubPacket *packet;
+    size_t n, end;
+
+    apBuildRequest(req, seq, reason, data, len);
+    apWrite(req, NANOHUB_PACKET_SIZE(len), method);
+    n = apRead(mApBuf, sizeof(mApBuf), method);
+    packet = apParse(mApBuf, n, &end);
+    expect(packet && packet->seq == seq, "no answer", method);
+
+    return packet ? packet->reason : NANOHUB_REASON_NAK;
+}
+
+//the response that follows an ACK
+static uint32_t apResponse(const char *method)
+{
+    const struct NanohubPacket *packet;
+    size_t n, end;
+
+    n = apRead(mApBuf, sizeof(mApBuf), method);
+    packet = apParse(mApBuf, n, &end);
+
+    return packet ? packet->reason : NANOHUB_REASON_NAK;
+}
+
+static void apGotEvent(uint32_t evtType, const uint8_t *data, uint32_t len, const char *method)
+{
+    const struct SensorFirstSample *first = (const struct SensorFirstSample *)(data + sizeof(uint64_t));
+
+    expect(evtType > EVT_NO_FIRST_SENSOR_EVENT && evtType < EVT_NO_SENSOR_CONFIG_EVENT && len >= sizeof(uint64_t) + sizeof(*first),
+           "not a sensor event", method);
+
+    mStats.hash = crc32(&evtType, sizeof(evtType), mStats.hash);
+    mStats.hash = crc32(data, len, mStats.hash);
+    mStats.events++;
+    if (len >= sizeof(uint64_t) + sizeof(*first))
+        mStats.samples += first->numSamples;
+}
+
+//false once the hub has nothing left
+static bool readSingle(uint64_t apTime)
+{
+    const char *method = mMethodNames[READ_SINGLE];
+    const struct NanohubPacket *resp;
+    const uint8_t *extra;
+    size_t extraLen;
+    uint32_t evtType;
+
+    resp = apCommand(NANOHUB_REASON_READ_EVENT, &apTime, sizeof(apTime), &extra, &extraLen, method);
+    if (!resp || !resp->len)
+        return false;
+
+    memcpy(&evtType, resp->data, sizeof(evtType));
+    apGotEvent(evtType, resp->data + sizeof(evtType), resp->len - sizeof(evtType), method);
+
+    return true;
+}
+
+static bool readMulti(uint64_t apTime)
+{
+    const char *method = mMethodNames[READ_MULTI];
+    struct NanohubReadEventRequest req = { .apBootTime = apTime, .caps = NANOHUB_READ_EVENT_CAP_MULTI };
+    const struct NanohubReadEventMultiResponse *multi;
+    const struct NanohubReadEventMultiEntry *entry;
+    const struct NanohubPacket *resp;
+    const uint8_t *extra, *p;
+    size_t extraLen;
+    uint32_t evtType, i;
+
+    resp = apCommand(NANOHUB_REASON_READ_EVENT, &req, sizeof(req), &extra, &extraLen, method);
+    if (!resp || !resp->len)
+        return false;
+
+    memcpy(&evtType, resp->data, sizeof(evtType));
+    if (evtType != NANOHUB_EVT_MULTI) {
+        apGotEvent(evtType, resp->data + sizeof(evtType), resp->len - sizeof(evtType), method);
+        return true;
+    }
+
+    multi = (const struct NanohubReadEventMultiResponse *)resp->data;
+    expect(multi->version == NANOHUB_READ_EVENT_MULTI_VERSION && multi->numEvents > 1, "bad multi response", method);
+    for (i = 0, p = multi->evtData; i < multi->numEvents; i++, p += sizeof(*entry) + entry->len) {
+        entry = (const struct NanohubReadEventMultiEntry *)p;
+        if (p + sizeof(*entry) + entry->len > resp->data + resp->len) {
+            expect(false, "multi entry runs past the packet", method);
+            break;
+        }
+        apGotEvent(entry->evtType, entry->evtData, entry->len, method);
+    }
+
+    return true;
+}
+
+//a lost response is asked for again with the same seq: the whole transfer must come back, without an ACK
+static void bulkRetransmit(const struct NanohubReadEventsBulkRequest *req, size_t len)
+{
+    const char *method = mMethodNames[READ_BULK];
+    uint32_t transfers = mStats.transfers;
+    uint64_t bytes = mStats.bytes;
+    uint8_t packet[NANOHUB_PACKET_SIZE_MAX];
+    static uint8_t first[sizeof(mApBuf)];
+
+    memcpy(first, mApBuf, len);
+    apBuildRequest(packet, mApSeq, NANOHUB_REASON_READ_EVENTS_BULK, req, sizeof(*req));
+    apWrite(packet, NANOHUB_PACKET_SIZE(sizeof(*req)), method);
+    expect(apRead(mApBuf, sizeof(mApBuf), method) == len && !memcmp(first, mApBuf, len), "retransmit is not the same transfer", method);
+
+    //not part of the drain proper
+    mStats.transfers = transfers;
+    mStats.bytes = bytes;
+}
+
+static bool readBulk(uint64_t apTime, bool retransmit)
+{
+    const char *method = mMethodNames[READ_BULK];
+    struct NanohubReadEventsBulkRequest req = { .apBootTime = apTime, .maxBytes = BULK_MAX_BYTES };
+    const struct NanohubReadEventsBulkResponse *bulk;
+    const struct NanohubBulkFrame *frame;
+    const struct NanohubPacket *resp;
+    const uint8_t *extra, *p;
+    size_t extraLen;
+    uint32_t crc, i;
+
+    resp = apCommand(NANOHUB_REASON_READ_EVENTS_BULK, &req, sizeof(req), &extra, &extraLen, method);
+    if (!resp)
+        return false;
+
+    if (retransmit)
+        bulkRetransmit(&req, extra + extraLen - mApBuf);
+
+    bulk = (const struct NanohubReadEventsBulkResponse *)resp->data;
+    expect(resp->len == sizeof(*bulk) && bulk->length == extraLen, "frames not all in the same transfer", method);
+    if (resp->len != sizeof(*bulk) || bulk->length > extraLen)
+        return false;
+
+    for (i = 0, p = extra; i < bulk->numFrames; i++, p += sizeof(*frame) + frame->len + sizeof(crc)) {
+        frame = (const struct NanohubBulkFrame *)p;
+        if (p + sizeof(*frame) + frame->len + sizeof(crc) > extra + bulk->length) {
+            expect(false, "frame runs past the transfer", method);
+            return false;
+        }
+        memcpy(&crc, frame->evtData + frame->len, sizeof(crc));
+        expect(crc == crc32(frame, sizeof(*frame) + frame->len, CRC_INIT), "bad frame CRC", method);
+        apGotEvent(frame->evtType, frame->evtData, frame->len, method);
+    }
+    expect(p == extra + bulk->length, "frames do not add up to the length", method);
+
+    return bulk->numFrames != 0;
+}
+
+static struct Stats drain(enum Method method)
+{
+    uint64_t apTime = timGetTime() + AP_TIME_OFFSET;
+    struct timespec start, end;
+    uint32_t i;
+    bool more = true;
+
+    memset(&mStats, 0, sizeof(mStats));
+    mStats.hash = CRC_INIT;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &start);
+
+    for (i = 0; i < MAX_REQUESTS && more; i++) {
+        switch (method) {
+        case READ_SINGLE:
+            more = readSingle(apTime);
+            break;
+        case READ_MULTI:
+            more = readMulti(apTime);
+            break;
+        default:
+            more = readBulk(apTime, !i);
+            break;
+        }
+    }
+    expect(!more, "queue never ran dry", mMethodNames[method]);
+
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &end);
+    mStats.cpuNs = (end.tv_sec - start.tv_sec) * 1000000000ULL + end.tv_nsec - start.tv_nsec;
+
+    return mStats;
+}
+
+static void sourceEmit(struct Source *src)
+{
+    struct TripleAxisDataEvent *triple;
+    struct SingleAxisDataEvent *single;
+    uint32_t i, n = src->samplesPerEvt;
+    uint64_t spacing = src->period / n;
+
+    switch (src->info.numAxis) {
+    case NUM_AXIS_THREE:
+        triple = heapAlloc(sizeof(*triple) + n * sizeof(triple->samples[0]));
+        memset(triple, 0, sizeof(*triple) + n * sizeof(triple->samples[0]));
+        triple->referenceTime = timGetTime() - (n - 1) * spacing;
+        triple->samples[0].firstSample.numSamples = n;
+        for (i = 0; i < n; i++) {
+            if (i)
+                triple->samples[i].deltaTime = spacing;
+            triple->samples[i].ix = src->seq++;
+            triple->samples[i].iy = rnd(1 << 16);
+            triple->samples[i].iz = rnd(1 << 16);
+        }
+        osEnqueueEvt(EVENT_TYPE_BIT_DISCARDABLE | sensorGetMyEventType(src->info.sensorType), triple, heapFree);
+        break;
+    default:
+        single = heapAlloc(sizeof(*single) + n * sizeof(single->samples[0]));
+        memset(single, 0, sizeof(*single) + n * sizeof(single->samples[0]));
+        single->referenceTime = timGetTime() - (n - 1) * spacing;
+        single->samples[0].firstSample.numSamples = n;
+        for (i = 0; i < n; i++) {
+            if (i)
+                single->samples[i].deltaTime = spacing;
+            single->samples[i].idata = src->seq++;
+        }
+        osEnqueueEvt(EVENT_TYPE_BIT_DISCARDABLE | sensorGetMyEventType(src->info.sensorType), single, heapFree);
+        break;
+    }
+}
+
+static void sourceTimerCbk(uint32_t timerId, void *data)
+{
+    sourceEmit(data);
+}
+
+static bool sourcePower(bool on, void *cookie)
+{
+    struct Source *src = cookie;
+
+    if (!on && src->timer) {
+        timTimerCancel(src->timer);
+        src->timer = 0;
+    }
+
+    return sensorSignalInternalEvt(src->handle, SENSOR_INTERNAL_EVT_POWER_STATE_CHG, on, 0);
+}
+
+static bool sourceFirmwareUpload(void *cookie)
+{
+    struct Source *src = cookie;
+
+    return sensorSignalInternalEvt(src->handle, SENSOR_INTERNAL_EVT_FW_STATE_CHG, 1, 0);
+}
+
+static bool sourceSetRate(uint32_t rate, uint64_t latency, void *cookie)
+{
+    struct Source *src = cookie;
+
+    if (!src->timer)
+        src->timer = timTimerSet(src->period, 0, 50, sourceTimerCbk, src, false);
+
+    return sensorSignalInternalEvt(src->handle, SENSOR_INTERNAL_EVT_RATE_CHG, rate, latency);
+}
+
+static bool sourceFlush(void *cookie)
+{
+    struct Source *src = cookie;
+
+    return osEnqueueEvt(sensorGetMyEventType(src->info.sensorType), SENSOR_DATA_EVENT_FLUSH, NULL);
+}
+
+static const struct SensorOps mSourceOps = {
+    .sensorPower = sourcePower,
+    .sensorFirmwareUpload = sourceFirmwareUpload,
+    .sensorSetRate = sourceSetRate,
+    .sensorFlush = sourceFlush,
+};
+
+//the AP enables every source, with a latency long enough that only the queue filling up matters
+static void fill(void)
+{
+    struct {
+        uint32_t evtType;
+        struct ConfigCmd cmd;
+    } __attribute__((packed)) req;
+    struct NanohubWriteEventResponse *accepted;
+    const struct NanohubPacket *resp;
+    const uint8_t *extra;
+    size_t extraLen;
+    uint32_t i;
+
+    for (i = 0; i < NUM_SOURCES; i++) {
+        mSources[i].info.sensorName = "Source";
+        mSources[i].info.supportedRates = mSources[i].rates;
+        mSources[i].handle = sensorRegister(&mSources[i].info, &mSourceOps, mSources + i, true);
+    }
+
+    expect(hostOsStartApp(&gHostIntfApp), "hostIntf did not start", "fill");
+    osEnqueueEvt(EVT_APP_START, NULL, NULL);
+    hostOsRunAll();
+
+    for (i = 0; i < NUM_SOURCES; i++) {
+        memset(&req, 0, sizeof(req));
+        req.evtType = EVT_NO_SENSOR_CONFIG_EVENT;
+        req.cmd.latency = 3600000 * MS;
+        req.cmd.rate = mSources[i].rates[0];
+        req.cmd.sensType = mSources[i].info.sensorType;
+        req.cmd.enabled = true;
+        resp = apCommand(NANOHUB_REASON_WRITE_EVENT, &req, sizeof(req), &extra, &extraLen, "fill");
+        accepted = resp ? (struct NanohubWriteEventResponse *)resp->data : NULL;
+        expect(accepted && accepted->accepted, "config not accepted", "fill");
+    }
+
+    hostOsRunUntil(timGetTime() + FILL_TIME);
+}
+
+//a couple of samples from every source, then one multi READ_EVENT for all of them
+static void partialMulti(void)
+{
+    static const char method[] = "multi partial";
+    struct NanohubReadEventRequest req = { .apBootTime = timGetTime() + AP_TIME_OFFSET, .caps = NANOHUB_READ_EVENT_CAP_MULTI };
+    const struct NanohubReadEventMultiResponse *multi;
+    const struct NanohubReadEventMultiEntry *entry;
+    const struct TripleAxisDataPoint *triple;
+    const struct SingleAxisDataPoint *single;
+    const struct NanohubPacket *resp;
+    const uint8_t *extra, *p;
+    uint32_t firstSeq[NUM_SOURCES], perEvt[NUM_SOURCES], yz[NUM_SOURCES][2][2], seen = 0, rand, i, j, k;
+    size_t extraLen;
+
+    drain(READ_BULK);
+
+    rand = mRand;
+    for (i = 0; i < NUM_SOURCES; i++) {
+        perEvt[i] = mSources[i].samplesPerEvt;
+        mSources[i].samplesPerEvt = 2;
+        firstSeq[i] = mSources[i].seq;
+        sourceEmit(mSources + i);
+    }
+    hostOsRunAll();
+
+    //draw again the y and z sourceEmit drew, then carry on where it left off
+    j = mRand;
+    mRand = rand;
+    rand = j;
+    for (i = 0; i < NUM_SOURCES; i++) {
+        for (j = 0; j < 2 && mSources[i].info.numAxis == NUM_AXIS_THREE; j++) {
+            yz[i][j][0] = rnd(1 << 16);
+            yz[i][j][1] = rnd(1 << 16);
+        }
+    }
+    mRand = rand;
+
+    resp = apCommand(NANOHUB_REASON_READ_EVENT, &req, sizeof(req), &extra, &extraLen, method);
+    multi = resp ? (const struct NanohubReadEventMultiResponse *)resp->data : NULL;
+    expect(multi && resp->len > sizeof(multi->evtType) && multi->evtType == NANOHUB_EVT_MULTI &&
+           multi->version == NANOHUB_READ_EVENT_MULTI_VERSION && multi->numEvents == NUM_SOURCES,
+           "partly filled buffers not sent together", method);
+    if (!multi || multi->evtType != NANOHUB_EVT_MULTI)
+        goto out;
+
+    for (k = 0, p = multi->evtData; k < multi->numEvents; k++, p += sizeof(*entry) + entry->len) {
+        entry = (const struct NanohubReadEventMultiEntry *)p;
+        if (p + sizeof(*entry) + entry->len > resp->data + resp->len) {
+            expect(false, "multi entry runs past the packet", method);
+            break;
+        }
+
+        for (i = 0; i < NUM_SOURCES && entry->evtType != sensorGetMyEventType(mSources[i].info.sensorType); i++)
+            ;
+        expect(i < NUM_SOURCES && !(seen & (1 << i)), "unexpected event", method);
+        if (i == NUM_SOURCES || (seen & (1 << i)))
+            continue;
+        seen |= 1 << i;
+
+        //samples come through as the source made them, only the times are the AP's
+        if (mSources[i].info.numAxis == NUM_AXIS_THREE) {
+            triple = (const struct TripleAxisDataPoint *)(entry->evtData + sizeof(uint64_t));
+            expect(entry->len == sizeof(uint64_t) + 2 * sizeof(*triple) && triple[0].firstSample.numSamples == 2,
+                   "wrong triple axis event size", method);
+            for (j = 0; j < 2 && entry->len >= sizeof(uint64_t) + 2 * sizeof(*triple); j++)
+                expect(triple[j].ix == firstSeq[i] + j && triple[j].iy == yz[i][j][0] && triple[j].iz == yz[i][j][1],
+                       "wrong triple axis sample", method);
+        } else {
+            single = (const struct SingleAxisDataPoint *)(entry->evtData + sizeof(uint64_t));
+            expect(entry->len == sizeof(uint64_t) + 2 * sizeof(*single) && single[0].firstSample.numSamples == 2,
+                   "wrong single axis event size", method);
+            for (j = 0; j < 2 && entry->len >= sizeof(uint64_t) + 2 * sizeof(*single); j++)
+                expect(single[j].idata == firstSeq[i] + j, "wrong single axis sample", method);
+        }
+    }
+    expect(p == resp->data + resp->len, "entries do not add up to the packet", method);
+
+    resp = apCommand(NANOHUB_REASON_READ_EVENT, &req, sizeof(req), &extra, &extraLen, method);
+    expect(resp && !resp->len, "data left after the multi response", method);
+
+out:
+    for (i = 0; i < NUM_SOURCES; i++)
+        mSources[i].samplesPerEvt = perEvt[i];
+}
+
+//the upload is refused at once, so START_FIRMWARE_UPLOAD leaves the hub as it was
+static void parking(void)
+{
+    static const char method[] = "park";
+    struct NanohubStartFirmwareUploadRequest start = { .type = 0xFF };
+    const uint8_t len = offsetof(struct NanohubStartFirmwareUploadRequest, flags);
+    const uint32_t up = NANOHUB_REASON_START_FIRMWARE_UPLOAD, hw = NANOHUB_REASON_GET_OS_HW_VERSIONS;
+    const uint32_t seq = mApSeq;    //new ones, not retransmits
+
+    //not asked for: everything is NAKed while busy, as before parking
+    hostIntfSetBusy(true);
+    expect(apSend(seq + 1, hw, NULL, 0, method) == NANOHUB_REASON_NAK_BUSY, "served while busy", method);
+    expect(apSend(seq + 2, up, &start, len, method) == NANOHUB_REASON_NAK_BUSY, "parked without the flag", method);
+
+    hostIntfSetParking(true);
+    expect(apSend(seq + 3, up, &start, len, method) == NANOHUB_REASON_ACK, "not parked", method);
+    expect(apSend(seq + 3, up, &start, len, method) == NANOHUB_REASON_NAK_BUSY, "collected before it ran", method);
+
+    //same seq, other reason: a new request, not the parked one
+    expect(apSend(seq + 3, hw, NULL, 0, method) == NANOHUB_REASON_ACK && apResponse(method) == hw,
+           "parked request answered another reason", method);
+
+    hostIntfSetBusy(false);
+    hostOsRunAll();
+    expect(apSend(seq + 3, up, &start, len, method) == up, "parked response not collected", method);
+
+    //an uncollected response is dropped by the next upload request
+    hostIntfSetBusy(true);
+    expect(apSend(seq + 4, up, &start, len, method) == NANOHUB_REASON_ACK, "not parked", method);
+    hostIntfSetBusy(false);
+    hostOsRunAll();
+    expect(apSend(seq + 5, up, &start, len, method) == NANOHUB_REASON_ACK && apResponse(method) == up, "not served", method);
+    expect(apSend(seq + 4, up, &start, len, method) == NANOHUB_REASON_ACK && apResponse(method) == up,
+           "stale parked response answered", method);
+
+    hostIntfSetParking(false);
+}
+
+//whole packets from the gyro and the wakeup accel, none from the baro
+static void flood(void)
+{
+    static const char method[] = "flood";
+    const uint64_t step = mSources[1].period;
+    uint64_t apTime = timGetTime() + AP_TIME_OFFSET;
+    const struct TripleAxisDataPoint *triple;
+    const struct NanohubPacket *resp;
+    const uint8_t *extra;
+    struct Received got[NUM_SOURCES];
+    uint32_t perEvt[NUM_SOURCES], firstSeq[NUM_SOURCES], emitted[NUM_SOURCES] = { 0 };
+    uint32_t wakeDropped, nonWakeDropped, wake, nonWake, evtType, seq, i, j;
+    size_t extraLen;
+
+    drain(READ_BULK);
+    hostIntfGetDropCounts(&wakeDropped, &nonWakeDropped);
+
+    //emitted by hand from here on, one event per packet
+    for (i = 0; i < NUM_SOURCES; i++) {
+        if (mSources[i].timer) {
+            timTimerCancel(mSources[i].timer);
+            mSources[i].timer = 0;
+        }
+        perEvt[i] = mSources[i].samplesPerEvt;
+        mSources[i].samplesPerEvt = PACKET_SAMPLES;
+        firstSeq[i] = mSources[i].seq;
+        memset(got + i, 0, sizeof(got[i]));
+        got[i].inOrder = true;
+    }
+
+    for (i = 0; i < FLOOD_ROUNDS; i++) {
+        hostOsRunUntil(timGetTime() + step);
+        for (j = 0; j < FLOOD_SOURCES; j++) {
+            if (mSources[j].info.interrupt == NANOHUB_INT_WAKEUP && i % FLOOD_WAKEUP_EVERY)
+                continue;
+            sourceEmit(mSources + j);
+            emitted[j]++;
+        }
+        hostOsRunAll();
+    }
+
+    for (i = 0; i < MAX_REQUESTS; i++) {
+        resp = apCommand(NANOHUB_REASON_READ_EVENT, &apTime, sizeof(apTime), &extra, &extraLen, method);
+        if (!resp || resp->len < sizeof(evtType) + sizeof(uint64_t) + sizeof(*triple))
+            break;
+
+        memcpy(&evtType, resp->data, sizeof(evtType));
+        for (j = 0; j < FLOOD_SOURCES && evtType != sensorGetMyEventType(mSources[j].info.sensorType); j++)
+            ;
+        triple = (const struct TripleAxisDataPoint *)(resp->data + sizeof(evtType) + sizeof(uint64_t));
+        expect(j < FLOOD_SOURCES && triple[0].firstSample.numSamples == PACKET_SAMPLES, "unexpected event", method);
+        if (j == FLOOD_SOURCES)
+            continue;
+
+        seq = triple[0].ix;
+        if (!got[j].events++)
+            got[j].firstSeq = seq;
+        else if (seq != got[j].firstSeq + (got[j].events - 1) * PACKET_SAMPLES)
+            got[j].inOrder = false;
+    }
+    expect(resp && !resp->len, "queue never ran dry", method);
+
+    hostIntfGetDropCounts(&wake, &nonWake);
+    wake -= wakeDropped;
+    nonWake -= nonWakeDropped;
+
+    printf("drain_test: flood            %4u of %4u wakeup events, %4u of %4u non-wakeup events, %u dropped\n",
+           got[0].events, emitted[0], got[1].events, emitted[1], nonWake);
+
+    for (j = 0; j < FLOOD_SOURCES; j++) {
+        expect(got[j].inOrder, "events missing from the middle", method);
+        if (mSources[j].info.interrupt == NANOHUB_INT_WAKEUP) {
+            expect(got[j].events == emitted[j] && got[j].firstSeq == firstSeq[j], "wakeup events dropped", method);
+            expect(!wake, "wakeup drops counted", method);
+        } else {
+            //drop-oldest: the AP gets the newest ones
+            expect(got[j].events < emitted[j] && got[j].firstSeq == firstSeq[j] + (emitted[j] - got[j].events) * PACKET_SAMPLES,
+                   "not the oldest non-wakeup events dropped", method);
+            expect(nonWake == emitted[j] - got[j].events, "wrong non-wakeup drop count", method);
+        }
+    }
+
+    for (i = 0; i < NUM_SOURCES; i++)
+        mSources[i].samplesPerEvt = perEvt[i];
+}
+
+//partly filled buffers go out oldest data first: gyro, accel and baro made in turn, with time passing before each
+static void partialOrder(const uint64_t *advance, const char *method)
+{
+    static const uint32_t order[NUM_SOURCES] = { 1, 0, 2 };
+    uint64_t apTime = timGetTime() + AP_TIME_OFFSET, refTime[NUM_SOURCES];
+    const struct NanohubPacket *resp;
+    const uint8_t *extra;
+    size_t extraLen;
+    uint32_t evtType, i, j, oldest, sent = 0;
+
+    for (i = 0; i < NUM_SOURCES; i++) {
+        hostOsRunUntil(timGetTime() + advance[i]);
+        j = order[i];
+        refTime[j] = timGetTime() - (mSources[j].samplesPerEvt - 1) * (mSources[j].period / mSources[j].samplesPerEvt);
+        sourceEmit(mSources + j);
+    }
+    hostOsRunAll();
+
+    for (i = 0; i < NUM_SOURCES; i++) {
+        for (j = 0, oldest = NUM_SOURCES; j < NUM_SOURCES; j++)
+            if (!(sent & (1 << j)) && (oldest == NUM_SOURCES || refTime[j] < refTime[oldest]))
+                oldest = j;
+        sent |= 1 << oldest;
+
+        resp = apCommand(NANOHUB_REASON_READ_EVENT, &apTime, sizeof(apTime), &extra, &extraLen, method);
+        if (resp && resp->len >= sizeof(evtType))
+            memcpy(&evtType, resp->data, sizeof(evtType));
+        expect(resp && resp->len >= sizeof(evtType) && evtType == sensorGetMyEventType(mSources[oldest].info.sensorType),
+               "partly filled buffers out of order", method);
+    }
+
+    resp = apCommand(NANOHUB_REASON_READ_EVENT, &apTime, sizeof(apTime), &extra, &extraLen, method);
+    expect(resp && !resp->len, "data left after the partly filled buffers", method);
+}
+
+static void partialAge(void)
+{
+    //baro's older first sample lands between gyro and accel, then ahead of them both
+    static const uint64_t middle[NUM_SOURCES] = { 0, 400 * MS, 0 }, first[NUM_SOURCES] = { 0, 100 * MS, 0 };
+    uint32_t perEvt[NUM_SOURCES], i;
+
+    for (i = 0; i < NUM_SOURCES; i++) {
+        perEvt[i] = mSources[i].samplesPerEvt;
+        mSources[i].samplesPerEvt = 2;
+    }
+
+    partialOrder(middle, "partial middle");
+    partialOrder(first, "partial first");
+
+    for (i = 0; i < NUM_SOURCES; i++)
+        mSources[i].samplesPerEvt = perEvt[i];
+}
+
+//one NANOHUB_SENSOR_ENCODING_COMPACT event as the AP would decode it, false if malformed
+static bool apDecodeCompact(const uint8_t *data, uint32_t len, struct ApSample *out, uint32_t max, uint32_t *num, float *scale)
+{
+    const struct SensorFirstSample *first = (const struct SensorFirstSample *)(data + sizeof(uint64_t));
+    const uint8_t *p = data + sizeof(uint64_t) + sizeof(*first) + sizeof(*scale), *end = data + len;
+    uint32_t delta = 0, zigzag, shift, i, j;
+    uint64_t time;
+    int16_t q;
+
+    if (len < p - data || first->encoding != NANOHUB_SENSOR_ENCODING_COMPACT || first->numSamples > max)
+        return false;
+    memcpy(&time, data, sizeof(time));
+    memcpy(scale, p - sizeof(*scale), sizeof(*scale));
+
+    for (i = 0; i < first->numSamples; i++) {
+        if (i) {
+            for (zigzag = 0, shift = 0; ; shift += 7) {
+                if (p == end || shift > 28)
+                    return false;
+                zigzag |= (uint32_t)(*p & 0x7F) << shift;
+                if (!(*p++ & 0x80))
+                    break;
+            }
+            delta += (zigzag >> 1) ^ -(zigzag & 1);
+            time += delta;
+        }
+        out[i].time = time;
+
+        if (end - p < 3 * sizeof(q))
+            return false;
+        memcpy(&q, p, sizeof(q));
+        out[i].escaped = (uint16_t)q == NANOHUB_COMPACT_ESCAPE;
+        if (out[i].escaped) {
+            if (end - p < sizeof(q) + sizeof(out[i].v))
+                return false;
+            memcpy(out[i].v, p + sizeof(q), sizeof(out[i].v));
+            p += sizeof(q) + sizeof(out[i].v);
+        } else {
+            for (j = 0; j < 3; j++, p += sizeof(q)) {
+                memcpy(&q, p, sizeof(q));
+                out[i].v[j] = q * *scale;
+            }
+        }
+    }
+    *num = first->numSamples;
+
+    return p == end;
+}
+
+//the cases from first to the next event, as the hub would get them from a driver
+static uint32_t compactEmit(uint32_t first, uint64_t *times)
+{
+    struct TripleAxisDataEvent *triple;
+    uint32_t i, n;
+
+    for (n = 1; first + n < NUM_COMPACT_CASES && mCompactCases[first + n].delta; n++)
+        ;
+
+    triple = heapAlloc(sizeof(*triple) + n * sizeof(triple->samples[0]));
+    memset(triple, 0, sizeof(*triple) + n * sizeof(triple->samples[0]));
+    triple->referenceTime = timGetTime();
+    triple->samples[0].firstSample.numSamples = n;
+    for (i = 0; i < n; i++) {
+        if (i)
+            triple->samples[i].deltaTime = mCompactCases[first + i].delta;
+        times[i] = i ? times[i - 1] + mCompactCases[first + i].delta : triple->referenceTime;
+        triple->samples[i].x = mCompactCases[first + i].v[0];
+        triple->samples[i].y = mCompactCases[first + i].v[1];
+        triple->samples[i].z = mCompactCases[first + i].v[2];
+    }
+    osEnqueueEvt(EVENT_TYPE_BIT_DISCARDABLE | sensorGetMyEventType(SENS_TYPE_GYRO), triple, heapFree);
+    hostOsRunAll();
+
+    return n;
+}
+
+static void compact(void)
+{
+    static const char method[] = "compact";
+    struct {
+        uint32_t evtType;
+        struct ConfigCmd cmd;
+    } __attribute__((packed)) config;
+    uint64_t apTime = timGetTime() + AP_TIME_OFFSET, times[NUM_COMPACT_CASES];
+    struct ApSample got[NUM_COMPACT_CASES];
+    const struct CompactCase *c;
+    const struct NanohubPacket *resp;
+    const uint8_t *extra;
+    size_t extraLen;
+    uint32_t first, evt, n, num, evtType = 0, i, j;
+    float scale, err;
+
+    memset(&config, 0, sizeof(config));
+    config.evtType = EVT_NO_SENSOR_CONFIG_EVENT;
+    config.cmd.latency = 3600000 * MS;
+    config.cmd.rate = mSources[1].rates[0];
+    config.cmd.sensType = SENS_TYPE_GYRO;
+    config.cmd.enabled = true;
+    config.cmd.compact = true;
+    resp = apCommand(NANOHUB_REASON_WRITE_EVENT, &config, sizeof(config), &extra, &extraLen, method);
+    expect(resp && ((struct NanohubWriteEventResponse *)resp->data)->accepted, "config not accepted", method);
+
+    for (first = 0, evt = 0; first < NUM_COMPACT_CASES; first += n, evt++) {
+        n = compactEmit(first, times);
+
+        //the event is all there is, so it goes out as one packet
+        resp = apCommand(NANOHUB_REASON_READ_EVENT, &apTime, sizeof(apTime), &extra, &extraLen, method);
+        if (resp && resp->len > sizeof(evtType))
+            memcpy(&evtType, resp->data, sizeof(evtType));
+        expect(resp && resp->len > sizeof(evtType) && evtType == sensorGetMyEventType(SENS_TYPE_GYRO), "no gyro event", method);
+        if (!resp || resp->len <= sizeof(evtType) || evtType != sensorGetMyEventType(SENS_TYPE_GYRO))
+            continue;
+        if (!apDecodeCompact(resp->data + sizeof(evtType), resp->len - sizeof(evtType), got, NUM_COMPACT_CASES, &num, &scale)) {
+            expect(false, "malformed compact event", method);
+            continue;
+        }
+        expect(num == n, "wrong number of samples", method);
+        expect(evt < NUM_COMPACT_EVENTS && scale == mCompactScales[evt], "wrong scale", method);
+
+        for (i = 0; i < n && i < num; i++) {
+            c = mCompactCases + first + i;
+            expect(got[i].time - got[0].time == times[i] - times[0], "wrong sample time", method);
+            expect(got[i].escaped == c->escape, c->escape ? "not escaped" : "escaped", method);
+            if (got[i].escaped) {
+                expect(!memcmp(got[i].v, c->v, sizeof(c->v)), "escaped sample changed", method);
+                continue;
+            }
+            for (j = 0; j < 3; j++) {
+                err = got[i].v[j] > c->v[j] ? got[i].v[j] - c->v[j] : c->v[j] - got[i].v[j];
+                expect(err <= 0.5f * 1.001f * scale, "sample off by more than half a step", method);
+            }
+        }
+
+        resp = apCommand(NANOHUB_REASON_READ_EVENT, &apTime, sizeof(apTime), &extra, &extraLen, method);
+        expect(resp && !resp->len, "more than one packet", method);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct Stats stats[NUM_METHODS];
+    enum Method m;
+    uint64_t busNs[NUM_METHODS];
+    int fds[2], status;
+    pid_t pid;
+
+    if (argc > 1)
+        mRand = strtoul(argv[1], NULL, 0);
+
+    sensorsInit();
+    fill();
+
+    //each drain gets a copy of the same full hub
+    for (m = 0; m < NUM_METHODS; m++) {
+        memset(stats + m, 0, sizeof(stats[m]));
+        if (pipe(fds) || (pid = fork()) < 0) {
+            perror("drain_test");
+            return 1;
+        }
+        if (!pid) {
+            close(fds[0]);
+            stats[m] = drain(m);
+            stats[m].failed = mFailed;
+            if (write(fds[1], stats + m, sizeof(stats[m])) != sizeof(stats[m]))
+                _exit(1);
+            _exit(0);
+        }
+        close(fds[1]);
+        if (read(fds[0], stats + m, sizeof(stats[m])) != sizeof(stats[m]) || waitpid(pid, &status, 0) != pid || status)
+            expect(false, "drain did not finish", mMethodNames[m]);
+        close(fds[0]);
+        mFailed += stats[m].failed;
+
+        busNs[m] = stats[m].transfers * (uint64_t)BUS_NS_PER_XFER + stats[m].bytes * BUS_NS_PER_BYTE;
+        printf("drain_test: %-16s %5u events %6u samples, %4u requests %5u transfers %6llu bytes, bus %6.1f ms, cpu %5.2f ms\n",
+               mMethodNames[m], stats[m].events, stats[m].samples, stats[m].requests, stats[m].transfers,
+               (unsigned long long)stats[m].bytes, busNs[m] / 1e6, stats[m].cpuNs / 1e6);
+    }
+
+    expect(stats[READ_SINGLE].events >= QUEUE_BLOCKS, "queue was not full", mMethodNames[READ_SINGLE]);
+    for (m = READ_MULTI; m < NUM_METHODS; m++)
+        expect(stats[m].events == stats[READ_SINGLE].events && stats[m].samples == stats[READ_SINGLE].samples &&
+               stats[m].hash == stats[READ_SINGLE].hash, "different events", mMethodNames[m]);
+
+    //HOSTINTF_BULK_MAX caps a transfer at 4K, so a full queue still takes a couple of dozen
+    expect(stats[READ_BULK].transfers * 10 < stats[READ_SINGLE].transfers, "bulk read saves no transfers", mMethodNames[READ_BULK]);
+    expect(busNs[READ_BULK] * 3 < busNs[READ_SINGLE] * 2 && busNs[READ_BULK] * 3 < busNs[READ_MULTI] * 2, "bulk read saves no bus time", mMethodNames[READ_BULK]);
+
+    partialMulti();
+    parking();
+    flood();
+    partialAge();
+    compact();
+
+    printf("drain_test: %s\n", mFailed ? "FAILED" : "ok");
+
+    return mFailed ? 1 : 0;
+}
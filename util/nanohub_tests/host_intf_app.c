@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <atomicBitset.h>
+#include <atomic.h>
+#include <cpu.h>
+#include <platform.h>
+#include <seos.h>
+#include <timer.h>
+#include <plat/inc/bl.h>
+#include <plat/inc/rtc.h>
+
+/*
+ * hostIntf as a host_os app: gHostIntfApp instead of an .internal_app_init
+ * entry. It comes with nanohubCommand.c, so the platform and seos bits both
+ * call and the x86 port lacks are stood in for here. The test provides the
+ * transport (platHostIntfInit) and the AP interrupt line (apIntSet/Clear).
+ */
+#undef INTERNAL_APP_INIT
+#define INTERNAL_APP_INIT(_id, _ver, _init, _end, _event) \
+    const struct AppFuncs gHostIntfApp = { .init = (_init), .end = (_end), .handle = (_event) }
+
+#include "../../firmware/src/hostIntf.c"
+
+//no app uploads here, so the shared area is empty and there is no eedata
+char __shared_start[4] __attribute__((aligned(4)));
+__asm__(".globl __shared_end\n .set __shared_end, __shared_start\n"
+        ".globl __eedata_start\n .set __eedata_start, __shared_start\n"
+        ".globl __eedata_end\n .set __eedata_end, __shared_start\n");
+
+struct BlVecTable BL;
+
+void atomicBitsetSetBit(struct AtomicBitset *set, uint32_t num)
+{
+    uint32_t idx = num / 32, mask = 1UL << (num & 31);
+    uint32_t *wordPtr = set->words + idx;
+    uint32_t old;
+
+    if (num >= set->numBits)
+        return;
+
+    do {
+        old = *wordPtr;
+    } while (!atomicCmpXchg32bits(wordPtr, old, old | mask));
+}
+
+bool atomicBitsetXchg(struct AtomicBitset *atomicallyAccessedSet, struct AtomicBitset *otherSet)
+{
+    uint32_t idx, numWords = (atomicallyAccessedSet->numBits + 31) / 32;
+
+    if (atomicallyAccessedSet->numBits != otherSet->numBits)
+        return false;
+
+    for (idx = 0; idx < numWords; idx++)
+        otherSet->words[idx] = atomicXchg32bits(&atomicallyAccessedSet->words[idx], otherSet->words[idx]);
+
+    return true;
+}
+
+uint64_t rtcGetTime(void)
+{
+    return timGetTime();
+}
+
+uint64_t cpuIntsOff(void)
+{
+    return 0;
+}
+
+void cpuIntsRestore(uint64_t state)
+{
+}
+
+bool platRequestDevInSleepMode(uint32_t sleepDevID, uint32_t maxWakeupTime)
+{
+    return true;
+}
+
+uint16_t platHwType(void)
+{
+    return PLATFORM_HW_TYPE;
+}
+
+uint16_t platHwVer(void)
+{
+    return PLATFORM_HW_VER;
+}
+
+uint16_t platBlVer(void)
+{
+    return 0;
+}
+
+bool osAppInfoById(uint64_t appId, uint32_t *appIdx, uint32_t *appVer, uint32_t *appSize)
+{
+    return false;
+}
+
+bool osAppInfoByIndex(uint32_t appIdx, uint64_t *appId, uint32_t *appVer, uint32_t *appSize)
+{
+    return false;
+}
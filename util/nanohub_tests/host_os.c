@@ -0,0 +1,343 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <eventQ.h>
+#include <heap.h>
+#include <mpu.h>
+#include <seos.h>
+#include <timer.h>
+
+#include "host_os.h"
+
+#define MAX_QUEUED      1024
+#define MAX_TASKS       16
+#define MAX_SUBS        32
+
+struct Queued {
+    OsDeferCbkF callback;   //a deferred call if set, an event otherwise
+    void *data;
+    uint32_t evtType;
+    EventFreeF evtFreeF;
+    uint32_t toTid;         //0 for a broadcast
+};
+
+struct Task {
+    const struct AppFuncs *funcs;
+    uint32_t tid;
+    uint32_t subs[MAX_SUBS];
+    uint32_t numSubs;
+};
+
+struct Timer {
+    uint32_t id;
+    uint64_t expires;
+    uint64_t period;        //0 for one-shot
+    TimTimerCbkF cbk;
+    void *data;
+};
+
+//seos hands every client its own decimated copy of sensor data, when there is a sensors.c to ask
+const void* sensorDecimateForClient(uint32_t clientTid, uint32_t evtType, const void *evtData) __attribute__((weak));
+
+static struct Queued mQueue[MAX_QUEUED];
+static unsigned mHead, mUsed;
+static struct Task mTasks[MAX_TASKS];
+static uint32_t mNextTid = 1;
+static struct Timer mTimers[MAX_TIMERS];
+static uint32_t mNextTimerId = 1;
+static uint64_t mNow;
+
+static bool enqueue(const struct Queued *q, bool urgent)
+{
+    unsigned i;
+
+    if (mUsed == MAX_QUEUED)
+        return false;
+
+    if (urgent) {
+        mHead = (mHead + MAX_QUEUED - 1) % MAX_QUEUED;
+        i = mHead;
+    } else {
+        i = (mHead + mUsed) % MAX_QUEUED;
+    }
+    mQueue[i] = *q;
+    mUsed++;
+
+    return true;
+}
+
+static struct Task* findTask(uint32_t tid)
+{
+    uint32_t i;
+
+    for (i = 0; i < MAX_TASKS; i++)
+        if (mTasks[i].funcs && mTasks[i].tid == tid)
+            return mTasks + i;
+
+    return NULL;
+}
+
+static bool subscribed(const struct Task *task, uint32_t evtType)
+{
+    uint32_t i;
+
+    for (i = 0; i < task->numSubs; i++)
+        if (task->subs[i] == evtType)
+            return true;
+
+    return false;
+}
+
+static void deliver(const struct Queued *q)
+{
+    uint32_t evtType = q->evtType & ~EVENT_TYPE_BIT_DISCARDABLE;
+    struct Task *task;
+    const void *data;
+    uint32_t i;
+
+    if (q->toTid) {
+        task = findTask(q->toTid);
+        if (task)
+            task->funcs->handle(evtType, q->data);
+    } else {
+        for (i = 0; i < MAX_TASKS; i++) {
+            task = mTasks + i;
+            if (!task->funcs || !subscribed(task, evtType))
+                continue;
+            data = q->data && sensorDecimateForClient ? sensorDecimateForClient(task->tid, evtType, q->data) : q->data;
+            if (data || !q->data)
+                task->funcs->handle(evtType, data);
+        }
+    }
+
+    if (q->evtFreeF)
+        q->evtFreeF(q->data);
+}
+
+bool hostOsRunOne(void)
+{
+    struct Queued q;
+
+    if (!mUsed)
+        return false;
+
+    q = mQueue[mHead];
+    mHead = (mHead + 1) % MAX_QUEUED;
+    mUsed--;
+
+    if (q.callback)
+        q.callback(q.data);
+    else
+        deliver(&q);
+
+    return true;
+}
+
+void hostOsRunAll(void)
+{
+    while (hostOsRunOne())
+        ;
+}
+
+unsigned hostOsPending(void)
+{
+    return mUsed;
+}
+
+void hostOsRunUntil(uint64_t time)
+{
+    struct Timer *next;
+    uint32_t i, id;
+
+    while (true) {
+        hostOsRunAll();
+
+        next = NULL;
+        for (i = 0; i < MAX_TIMERS; i++)
+            if (mTimers[i].id && mTimers[i].expires <= time && (!next || mTimers[i].expires < next->expires))
+                next = mTimers + i;
+        if (!next)
+            break;
+
+        if (next->expires > mNow)
+            mNow = next->expires;
+        //a one-shot timer is gone by the time its callback runs
+        id = next->id;
+        if (next->period)
+            next->expires += next->period;
+        else
+            next->id = 0;
+        next->cbk(id, next->data);
+    }
+
+    if (time > mNow)
+        mNow = time;
+}
+
+uint32_t hostOsStartApp(const struct AppFuncs *funcs)
+{
+    uint32_t i;
+
+    for (i = 0; i < MAX_TASKS && mTasks[i].funcs; i++)
+        ;
+    if (i == MAX_TASKS)
+        return 0;
+
+    memset(mTasks + i, 0, sizeof(mTasks[i]));
+    mTasks[i].funcs = funcs;
+    mTasks[i].tid = mNextTid++;
+    if (!funcs->init(mTasks[i].tid)) {
+        mTasks[i].funcs = NULL;
+        return 0;
+    }
+
+    return mTasks[i].tid;
+}
+
+void hostOsStopApp(uint32_t tid)
+{
+    struct Task *task = findTask(tid);
+
+    if (task) {
+        task->funcs->end();
+        task->funcs = NULL;
+    }
+}
+
+//seos takes these through the queue; here they take effect at once
+bool osEventSubscribe(uint32_t tid, uint32_t evtType)
+{
+    struct Task *task = findTask(tid);
+
+    if (!task || (!subscribed(task, evtType) && task->numSubs == MAX_SUBS))
+        return false;
+    if (!subscribed(task, evtType))
+        task->subs[task->numSubs++] = evtType;
+
+    return true;
+}
+
+bool osEventUnsubscribe(uint32_t tid, uint32_t evtType)
+{
+    struct Task *task = findTask(tid);
+    uint32_t i;
+
+    if (!task)
+        return false;
+    for (i = 0; i < task->numSubs; i++)
+        if (task->subs[i] == evtType)
+            task->subs[i--] = task->subs[--task->numSubs];
+
+    return true;
+}
+
+bool osEnqueueEvt(uint32_t evtType, void *evtData, EventFreeF evtFreeF)
+{
+    struct Queued q = { .evtType = evtType, .data = evtData, .evtFreeF = evtFreeF };
+
+    return enqueue(&q, false);
+}
+
+bool osEnqueuePrivateEvt(uint32_t evtType, void *evtData, EventFreeF evtFreeF, uint32_t toTid)
+{
+    struct Queued q = { .evtType = evtType, .data = evtData, .evtFreeF = evtFreeF, .toTid = toTid };
+
+    return enqueue(&q, false);
+}
+
+bool osDefer(OsDeferCbkF callback, void *cookie, bool urgent)
+{
+    struct Queued q = { .callback = callback, .data = cookie };
+
+    return enqueue(&q, urgent);
+}
+
+uint64_t timGetTime(void)
+{
+    return mNow;
+}
+
+uint32_t timTimerSet(uint64_t length, uint32_t jitterPpm, uint32_t driftPpm, TimTimerCbkF cbk, void* data, bool oneShot)
+{
+    uint32_t i;
+
+    for (i = 0; i < MAX_TIMERS && mTimers[i].id; i++)
+        ;
+    if (i == MAX_TIMERS)
+        return 0;
+
+    mTimers[i].id = mNextTimerId++;
+    mTimers[i].expires = mNow + length;
+    mTimers[i].period = oneShot ? 0 : length;
+    mTimers[i].cbk = cbk;
+    mTimers[i].data = data;
+
+    return mTimers[i].id;
+}
+
+bool timTimerCancel(uint32_t timerId)
+{
+    uint32_t i;
+
+    for (i = 0; i < MAX_TIMERS; i++) {
+        if (timerId && mTimers[i].id == timerId) {
+            mTimers[i].id = 0;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void osLogv(enum LogLevel level, const char *str, va_list vl)
+{
+    if (getenv("NANOHUB_TEST_LOG")) {
+        fprintf(stderr, "%c: ", level);
+        vfprintf(stderr, str, vl);
+    }
+}
+
+void osLog(enum LogLevel level, const char *str, ...)
+{
+    va_list vl;
+
+    va_start(vl, str);
+    osLogv(level, str, vl);
+    va_end(vl);
+}
+
+void* heapAlloc(uint32_t sz)
+{
+    return malloc(sz);
+}
+
+void heapFree(void* ptr)
+{
+    free(ptr);
+}
+
+void mpuAllowRamExecution(bool allowSvcExecute)
+{
+}
+
+void mpuAllowRomWrite(bool allowSvcWrite)
+{
+}
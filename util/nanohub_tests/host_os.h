@@ -0,0 +1,42 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _HOST_OS_H_
+#define _HOST_OS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct AppFuncs;
+
+/*
+ * Just enough of seos for host tests. Events and osDefer() calls share one
+ * FIFO that runs only when the test says so, time stands still in between
+ * and timers fire as the test moves it on. Broadcasts go through
+ * sensorDecimateForClient() when sensors.c is linked in, like seos does.
+ * The heap is malloc, the MPU is not there and osLog() only prints with
+ * NANOHUB_TEST_LOG set in the environment.
+ */
+
+bool hostOsRunOne(void);    //run the oldest queued event or call, false if there was none
+void hostOsRunAll(void);    //until none are left, including those queued meanwhile
+unsigned hostOsPending(void);
+void hostOsRunUntil(uint64_t time); //run the queue, firing timers in order, until time
+
+uint32_t hostOsStartApp(const struct AppFuncs *funcs); //tid, 0 if its init failed
+void hostOsStopApp(uint32_t tid);
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <lz.h>
+#include "../nanoapp_postprocess/lzCompress.h"
+
+/*
+ * Round trip through the host compressor and the firmware decoder. The
+ * compressed stream is fed to lzDecProcess in random sized chunks, as it
+ * arrives over the host bus, and every byte handed to the write callback is
+ * checked. Damaged streams must fail cleanly without writing past origLen.
+ */
+
+#define MAX_LEN     (64 * 1024)
+#define NUM_ROUNDS  200
+
+struct Output {
+    const uint8_t *expected;
+    uint32_t pos, len;
+    uint32_t maxWrite;
+    bool check;
+};
+
+static uint32_t mRand = 1;
+static uint8_t mIn[MAX_LEN], mComp[LZ_COMPRESS_BOUND(MAX_LEN)], mWindow[LZ_WINDOW_SIZE];
+static unsigned mFailed;
+
+static uint32_t rnd(uint32_t n)
+{
+    mRand = mRand * 1103515245 + 12345;
+    return ((mRand >> 8) & 0xFFFFFF) % n;
+}
+
+static bool outputWrite(void *userData, const void *data, uint32_t len)
+{
+    struct Output *out = (struct Output*)userData;
+
+    if (len > out->len - out->pos)
+        return false;
+    if (out->check && memcmp(out->expected + out->pos, data, len))
+        return false;
+    if (len > out->maxWrite)
+        out->maxWrite = len;
+    out->pos += len;
+
+    return true;
+}
+
+//random chunks from 1 byte up to the whole stream, biased to small ones
+static bool decode(const uint8_t *comp, uint32_t compLen, struct Output *out)
+{
+    struct LzDecoder dec;
+    uint32_t pos = 0, n;
+
+    lzDecInit(&dec, mWindow, compLen, out->len);
+    while (pos < compLen) {
+        n = rnd(4) ? 1 + rnd(64) : 1 + rnd(compLen);
+        if (n > compLen - pos)
+            n = compLen - pos;
+        if (!lzDecProcess(&dec, comp + pos, n, outputWrite, out))
+            return false;
+        pos += n;
+    }
+
+    return lzDecFinish(&dec, outputWrite, out);
+}
+
+static void fill(uint8_t *buf, uint32_t len, uint32_t kind)
+{
+    uint32_t i, j, n;
+
+    switch (kind) {
+    case 0: //incompressible
+        for (i = 0; i < len; i++)
+            buf[i] = rnd(256);
+        break;
+    case 1: //long runs
+        memset(buf, rnd(256), len);
+        break;
+    case 2: //short repeats from a small alphabet, like text
+        for (i = 0; i < len; i++)
+            buf[i] = 'a' + rnd(6);
+        break;
+    default: //copies of earlier data, inside and past the window, between a few random bytes
+        for (i = 0; i < len; i += n) {
+            n = i && rnd(2) ? 1 + rnd(300) : 1 + rnd(8);
+            if (n > len - i)
+                n = len - i;
+            if (n > 8) {
+                uint32_t from = i - 1 - rnd(i < 2 * LZ_WINDOW_SIZE ? i : 2 * LZ_WINDOW_SIZE);
+                for (j = 0; j < n; j++)
+                    buf[i + j] = buf[from + j];
+            } else {
+                for (j = 0; j < n; j++)
+                    buf[i + j] = rnd(256);
+            }
+        }
+        break;
+    }
+}
+
+static void fail(const char *what, uint32_t round, uint32_t len)
+{
+    fprintf(stderr, "lz_test: %s (round %u, %u bytes)\n", what, (unsigned)round, (unsigned)len);
+    mFailed++;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t round, len, compLen, totalIn = 0, totalComp = 0, i;
+    struct Output out;
+
+    if (argc > 1)
+        mRand = strtoul(argv[1], NULL, 0);
+
+    for (round = 0; round < NUM_ROUNDS; round++) {
+        len = round < 8 ? 1 + round : 1 + rnd(rnd(4) ? 8192 : MAX_LEN);
+        fill(mIn, len, round % 4);
+        compLen = lzCompress(mIn, len, mComp);
+        if (compLen > LZ_COMPRESS_BOUND(len)) {
+            fail("compressed past the bound", round, len);
+            continue;
+        }
+        totalIn += len;
+        totalComp += compLen;
+
+        memset(&out, 0, sizeof(out));
+        out.expected = mIn;
+        out.len = len;
+        out.check = true;
+        if (!decode(mComp, compLen, &out) || out.pos != len)
+            fail("round trip", round, len);
+        if (out.maxWrite > LZ_WINDOW_SIZE)
+            fail("write larger than the window", round, len);
+
+        //a stream cut short must not pass
+        if (compLen > 1) {
+            memset(&out, 0, sizeof(out));
+            out.len = len;
+            if (decode(mComp, compLen - 1 - rnd(compLen - 1), &out) && out.pos == len)
+                fail("truncated stream accepted", round, len);
+        }
+
+        //damage must be caught or at least stay within origLen
+        for (i = 0; i < 4; i++) {
+            memset(&out, 0, sizeof(out));
+            out.len = len;
+            mComp[rnd(compLen)] ^= 1 << rnd(8);
+            decode(mComp, compLen, &out);
+            if (out.pos > len)
+                fail("damaged stream wrote past origLen", round, len);
+        }
+    }
+
+    printf("lz_test: %u rounds, %u bytes in %u compressed, %s\n", NUM_ROUNDS, (unsigned)totalIn, (unsigned)totalComp,
+           mFailed ? "FAILED" : "ok");
+
+    return mFailed ? 1 : 0;
+}
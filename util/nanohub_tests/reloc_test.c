@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <cpu/inc/appRelocFormat.h>
+#include "../nanoapp_postprocess/relocPack.h"
+
+/*
+ * Relocations on synthetic images: reloc lists shaped like long GOTs,
+ * arrays of structs holding pointers, sparse pointers far apart and random
+ * mixes of those are packed by nanoapp_postprocess's packer and applied by
+ * the firmware loader. Every word must come out with exactly the right base
+ * added. Malformed streams must be refused.
+ */
+
+#define MEM_WORDS       (1 << 20)   //far enough apart for 24-bit offsets
+#define MAX_RELOCS      20000
+#define NUM_RANDOM      200
+#define FLASH_BASE      0x10000000
+#define RAM_BASE        0x20000000
+
+static uint32_t mMem[MEM_WORDS], mExpected[MEM_WORDS];
+static struct NanoRelocEntry mRelocs[MAX_RELOCS];
+static uint8_t mPacked[RELOC_PACK_BOUND(MAX_RELOCS)];
+static uint32_t mNum, mType, mWord, mRand = 1;
+static unsigned mFailed;
+
+static uint32_t rnd(uint32_t n)
+{
+    mRand = mRand * 1103515245 + 12345;
+    return ((mRand >> 8) & 0xFFFFFF) % n;
+}
+
+static void start(void)
+{
+    mNum = 0;
+    mType = 0;
+    mWord = 0;
+}
+
+//relocs of the current type, 'count' of them, 'gap' words apart, the first 'skip' words on
+static void add(uint32_t skip, uint32_t gap, uint32_t count)
+{
+    mWord += skip;
+    while (count-- && mNum < MAX_RELOCS && mWord < MEM_WORDS) {
+        mRelocs[mNum].ofstInRam = mWord * 4;
+        mRelocs[mNum].type = mType;
+        mNum++;
+        mWord += gap + 1;
+    }
+}
+
+static void nextType(void)
+{
+    mType++;
+    mWord = 0;
+}
+
+static void check(const char *what)
+{
+    uint32_t i, sz, w;
+
+    for (i = 0; i < MEM_WORDS; i++)
+        mMem[i] = mExpected[i] = i * 2654435761u;
+    for (i = 0; i < mNum; i++) {
+        w = mRelocs[i].ofstInRam / 4;
+        mExpected[w] += mRelocs[i].type ? FLASH_BASE : RAM_BASE;
+    }
+
+    if (!relocsPack(mRelocs, mNum, mPacked, &sz, false) || !relocsCheck(mPacked, sz, mRelocs, mNum)) {
+        fprintf(stderr, "reloc_test: %s: packing failed\n", what);
+        mFailed++;
+        return;
+    }
+    if (!appRelocsApply(mPacked, mPacked + sz, FLASH_BASE, RAM_BASE, mMem) || memcmp(mMem, mExpected, sizeof(mMem))) {
+        fprintf(stderr, "reloc_test: %s: wrong words after relocation\n", what);
+        mFailed++;
+        return;
+    }
+
+    if (strcmp(what, "random"))
+        printf("reloc_test: %-20s %5u relocs in %5u bytes\n", what, (unsigned)mNum, (unsigned)sz);
+}
+
+static void refuse(const char *what, const uint8_t *rel, uint32_t len)
+{
+    memset(mMem, 0, sizeof(mMem));
+    if (appRelocsApply(rel, rel + len, FLASH_BASE, RAM_BASE, mMem)) {
+        fprintf(stderr, "reloc_test: %s: accepted\n", what);
+        mFailed++;
+    }
+}
+
+static void shapes(void)
+{
+    uint32_t i;
+
+    start();
+    add(4, 0, 2000);
+    nextType();
+    add(2010, 0, 300);
+    check("long GOT");
+
+    start();
+    add(100, 2, 600);
+    check("stride 3 array");
+
+    start();
+    for (i = 0; i < 40; i++)
+        add(i * 37, 7 + i % 5, 50 + i);
+    check("many stride runs");
+
+    start();
+    add(0, 0, 1);
+    add(0xF9, 0, 1);             //largest 8-bit number
+    add(0xFA, 0, 1);             //smallest 16-bit one
+    add(0xFFFF + 0xF9, 0, 1);    //largest 16-bit one
+    add(0xFFFF + 0xFA, 0, 1);    //smallest 24-bit one
+    nextType();
+    add(5, 0, 2);
+    add(0, 1, 3);
+    check("offset widths");
+
+    start();
+    add(0, 0, 258 + 2);          //one past the longest consecutive run
+    add(1, 0xF9, 7);             //largest stride gap
+    add(1, 0xFA, 7);             //too far apart for a stride run
+    check("run limits");
+}
+
+static void randomMixes(void)
+{
+    uint32_t round, n;
+
+    for (round = 0; round < NUM_RANDOM; round++) {
+        start();
+        for (n = 1 + rnd(30); n; n--) {
+            switch (rnd(4)) {
+            case 0:
+                add(rnd(8), 0, 1 + rnd(600));
+                break;
+            case 1:
+                add(rnd(300), rnd(12), 1 + rnd(200));
+                break;
+            case 2:
+                add(rnd(rnd(2) ? 0x200 : 0x20000), 0, 1);
+                break;
+            default:
+                if (!mType && rnd(3) == 0)
+                    nextType();
+                break;
+            }
+        }
+        check("random");
+    }
+    printf("reloc_test: %u random images\n", NUM_RANDOM);
+}
+
+static void malformed(void)
+{
+    static const uint8_t trunc32[] = {TOKEN_32BIT_OFST, 1, 0, 0};
+    static const uint8_t trunc24[] = {TOKEN_24BIT_OFST, 1, 0};
+    static const uint8_t trunc16[] = {TOKEN_16BIT_OFST, 1};
+    static const uint8_t truncRun[] = {0, TOKEN_CONSECUTIVE};
+    static const uint8_t truncChg[] = {TOKEN_RELOC_TYPE_CHG};
+    static const uint8_t truncStride[] = {TOKEN_RELOC_TYPE_CHG, RELOC_EXT_STRIDE_RUN, 2, 0};
+    static const uint8_t bigGap[] = {TOKEN_RELOC_TYPE_CHG, RELOC_EXT_STRIDE_RUN, MAX_STRIDE_GAP + 1, 0, 0};
+    static const uint8_t badType[] = {TOKEN_RELOC_TYPE_NEXT, TOKEN_RELOC_TYPE_NEXT, 0};
+    static const uint8_t ok32[] = {TOKEN_32BIT_OFST, 3, 0, 0, 0, TOKEN_RELOC_TYPE_NEXT, 1};
+
+    refuse("truncated 32-bit offset", trunc32, sizeof(trunc32));
+    refuse("truncated 24-bit offset", trunc24, sizeof(trunc24));
+    refuse("truncated 16-bit offset", trunc16, sizeof(trunc16));
+    refuse("truncated run", truncRun, sizeof(truncRun));
+    refuse("truncated type change", truncChg, sizeof(truncChg));
+    refuse("truncated stride run", truncStride, sizeof(truncStride));
+    refuse("stride gap too big", bigGap, sizeof(bigGap));
+    refuse("unknown reloc type", badType, sizeof(badType));
+
+    //the packer never makes a 32-bit offset this small, but it is valid
+    memset(mMem, 0, sizeof(mMem));
+    if (!appRelocsApply(ok32, ok32 + sizeof(ok32), FLASH_BASE, RAM_BASE, mMem) ||
+            mMem[3] != RAM_BASE || mMem[1] != FLASH_BASE || mMem[0] || mMem[2] || mMem[4]) {
+        fprintf(stderr, "reloc_test: 32-bit offset misapplied\n");
+        mFailed++;
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        mRand = strtoul(argv[1], NULL, 0);
+
+    shapes();
+    randomMixes();
+    malformed();
+
+    printf("reloc_test: %s\n", mFailed ? "FAILED" : "ok");
+
+    return mFailed ? 1 : 0;
+}
@@ -0,0 +1,399 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <heap.h>
+#include <sensors.h>
+#include <seos.h>
+#include <timer.h>
+
+#include "host_os.h"
+
+/*
+ * Records a few simulated sensors (a batching accel with jittered sample
+ * spacing, a barometer and a step counter, plus a flush) through
+ * sensor_record and plays the file back through sensor_replay, through the
+ * real sensors.c, at 1x, 4x and as fast as possible. A client app must get
+ * the same events with the same data both times. Sample timestamps and
+ * delivery times must be the recorded ones moved into the replay timeline
+ * and divided by the speedup, and keep going forward within each sensor.
+ */
+
+#define MS                  1000000ULL
+#define RECORD_TIME         (10000 * MS)
+#define FLUSH_AT            (4321 * MS)
+#define MAX_RX              8192
+
+extern const struct AppFuncs gSensorRecordApp, gSensorReplayApp;
+
+struct Source {
+    struct SensorInfo info;
+    uint32_t rates[2];
+    uint64_t period;        //between events
+    uint32_t samplesPerEvt;
+    uint64_t spacing;       //between samples
+    uint32_t handle;
+    uint32_t timer;
+    uint32_t seq;
+};
+
+struct Rx {
+    uint32_t sensorType;
+    bool flush;
+    bool timed;             //embedded data has no timestamp
+    uint64_t recvTime;
+    uint64_t sampleTime;
+    int32_t v[3];
+};
+
+static struct Source mSources[] = {
+    { .info = { .sensorType = SENS_TYPE_ACCEL, .numAxis = NUM_AXIS_THREE, .minSamples = 300 },
+      .rates = { SENSOR_HZ(100) }, .period = 50 * MS, .samplesPerEvt = 5, .spacing = 10 * MS },
+    { .info = { .sensorType = SENS_TYPE_BARO, .numAxis = NUM_AXIS_ONE, .minSamples = 300 },
+      .rates = { SENSOR_HZ(10) }, .period = 200 * MS, .samplesPerEvt = 2, .spacing = 100 * MS },
+    { .info = { .sensorType = SENS_TYPE_STEP_COUNT, .numAxis = NUM_AXIS_EMBEDDED, .minSamples = 20 },
+      .rates = { SENSOR_HZ(1) }, .period = 700 * MS },
+};
+
+#define NUM_SOURCES (sizeof(mSources) / sizeof(mSources[0]))
+
+static struct Rx mRecorded[MAX_RX], mReplayed[MAX_RX];
+static struct Rx *mRx;
+static uint32_t mNumRx, mNumRecorded;
+static uint32_t mClientTid;
+
+static unsigned mFailed;
+static uint32_t mRand = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    mRand = mRand * 1103515245 + 12345;
+    return ((mRand >> 8) & 0xFFFFFF) % n;
+}
+
+static void expect(bool ok, const char *what, uint32_t speed)
+{
+    if (!ok) {
+        fprintf(stderr, "replay_test: %s (speed %u)\n", what, speed);
+        mFailed++;
+    }
+}
+
+static void sourceEmit(struct Source *src)
+{
+    struct TripleAxisDataEvent *triple;
+    struct SingleAxisDataEvent *single;
+    uint32_t i, n = src->samplesPerEvt;
+    uint64_t t = timGetTime() - (n - 1) * src->spacing - rnd(MS);
+
+    switch (src->info.numAxis) {
+    case NUM_AXIS_THREE:
+        triple = heapAlloc(sizeof(*triple) + n * sizeof(triple->samples[0]));
+        memset(triple, 0, sizeof(*triple) + n * sizeof(triple->samples[0]));
+        triple->referenceTime = t;
+        triple->samples[0].firstSample.numSamples = n;
+        for (i = 0; i < n; i++) {
+            //odd spacings so that scaling has something to round
+            if (i)
+                triple->samples[i].deltaTime = src->spacing - MS / 2 + rnd(MS);
+            triple->samples[i].ix = src->seq++;
+            triple->samples[i].iy = rnd(1 << 16);
+            triple->samples[i].iz = -(int32_t)rnd(1 << 16);
+        }
+        osEnqueueEvt(EVENT_TYPE_BIT_DISCARDABLE | sensorGetMyEventType(src->info.sensorType), triple, heapFree);
+        break;
+    case NUM_AXIS_ONE:
+        single = heapAlloc(sizeof(*single) + n * sizeof(single->samples[0]));
+        memset(single, 0, sizeof(*single) + n * sizeof(single->samples[0]));
+        single->referenceTime = t;
+        single->samples[0].firstSample.numSamples = n;
+        for (i = 0; i < n; i++) {
+            if (i)
+                single->samples[i].deltaTime = src->spacing + rnd(MS);
+            single->samples[i].idata = src->seq++;
+        }
+        osEnqueueEvt(EVENT_TYPE_BIT_DISCARDABLE | sensorGetMyEventType(src->info.sensorType), single, heapFree);
+        break;
+    default:
+        osEnqueueEvt(sensorGetMyEventType(src->info.sensorType), (void *)(uintptr_t)src->seq++, NULL);
+        break;
+    }
+}
+
+static void sourceTimerCbk(uint32_t timerId, void *data)
+{
+    sourceEmit(data);
+}
+
+static bool sourcePower(bool on, void *cookie)
+{
+    struct Source *src = cookie;
+
+    if (!on && src->timer) {
+        timTimerCancel(src->timer);
+        src->timer = 0;
+    }
+
+    return sensorSignalInternalEvt(src->handle, SENSOR_INTERNAL_EVT_POWER_STATE_CHG, on, 0);
+}
+
+static bool sourceFirmwareUpload(void *cookie)
+{
+    struct Source *src = cookie;
+
+    return sensorSignalInternalEvt(src->handle, SENSOR_INTERNAL_EVT_FW_STATE_CHG, 1, 0);
+}
+
+static bool sourceSetRate(uint32_t rate, uint64_t latency, void *cookie)
+{
+    struct Source *src = cookie;
+
+    if (!src->timer)
+        src->timer = timTimerSet(src->period, 0, 50, sourceTimerCbk, src, false);
+
+    return sensorSignalInternalEvt(src->handle, SENSOR_INTERNAL_EVT_RATE_CHG, rate, latency);
+}
+
+static bool sourceFlush(void *cookie)
+{
+    struct Source *src = cookie;
+
+    return osEnqueueEvt(sensorGetMyEventType(src->info.sensorType), SENSOR_DATA_EVENT_FLUSH, NULL);
+}
+
+static const struct SensorOps mSourceOps = {
+    .sensorPower = sourcePower,
+    .sensorFirmwareUpload = sourceFirmwareUpload,
+    .sensorSetRate = sourceSetRate,
+    .sensorFlush = sourceFlush,
+};
+
+static void clientAdd(uint32_t sensorType, bool timed, uint64_t sampleTime, int32_t x, int32_t y, int32_t z)
+{
+    struct Rx *rx = mRx + mNumRx;
+
+    if (mNumRx == MAX_RX)
+        return;
+
+    memset(rx, 0, sizeof(*rx));
+    rx->sensorType = sensorType;
+    rx->recvTime = timGetTime();
+    rx->timed = timed;
+    rx->sampleTime = sampleTime;
+    rx->v[0] = x;
+    rx->v[1] = y;
+    rx->v[2] = z;
+    mNumRx++;
+}
+
+static void clientHandle(uint32_t evtType, const void *evtData)
+{
+    const struct TripleAxisDataEvent *triple = evtData;
+    const struct SingleAxisDataEvent *single = evtData;
+    uint32_t sensorType = evtType - EVT_NO_FIRST_SENSOR_EVENT, i;
+    uint64_t t;
+
+    if (evtData == SENSOR_DATA_EVENT_FLUSH) {
+        clientAdd(sensorType, false, 0, 0, 0, 0);
+        mRx[mNumRx - 1].flush = true;
+    } else if (sensorType == SENS_TYPE_ACCEL) {
+        for (i = 0, t = triple->referenceTime; i < triple->samples[0].firstSample.numSamples; i++) {
+            if (i)
+                t += triple->samples[i].deltaTime;
+            clientAdd(sensorType, true, t, triple->samples[i].ix, triple->samples[i].iy, triple->samples[i].iz);
+        }
+    } else if (sensorType == SENS_TYPE_BARO) {
+        for (i = 0, t = single->referenceTime; i < single->samples[0].firstSample.numSamples; i++) {
+            if (i)
+                t += single->samples[i].deltaTime;
+            clientAdd(sensorType, true, t, single->samples[i].idata, 0, 0);
+        }
+    } else {
+        clientAdd(sensorType, false, 0, (uint32_t)(uintptr_t)evtData, 0, 0);
+    }
+}
+
+static bool clientInit(uint32_t tid)
+{
+    uint32_t i;
+
+    for (i = 0; i < NUM_SOURCES; i++)
+        osEventSubscribe(tid, sensorGetMyEventType(mSources[i].info.sensorType));
+
+    return true;
+}
+
+static void clientEnd(void)
+{
+}
+
+static const struct AppFuncs mClientApp = {
+    .init = clientInit,
+    .end = clientEnd,
+    .handle = clientHandle,
+};
+
+//the sensor of this type that is not one of our sources, or 0
+static uint32_t findReplaySensor(uint32_t sensorType, const struct SensorInfo *source)
+{
+    const struct SensorInfo *si;
+    uint32_t i, handle;
+
+    for (i = 0; (si = sensorFind(sensorType, i, &handle)) != NULL; i++)
+        if (si != source)
+            return handle;
+
+    return 0;
+}
+
+static void clientRequest(const uint32_t *handles, bool on)
+{
+    uint32_t i;
+
+    for (i = 0; i < NUM_SOURCES; i++) {
+        if (on)
+            sensorRequest(mClientTid, handles[i], mSources[i].rates[0], 0);
+        else
+            sensorRelease(mClientTid, handles[i]);
+    }
+    hostOsRunAll();
+}
+
+static void record(const char *path)
+{
+    uint32_t handles[NUM_SOURCES], recTid, i;
+
+    for (i = 0; i < NUM_SOURCES; i++) {
+        mSources[i].info.sensorName = "Source";
+        mSources[i].info.supportedRates = mSources[i].rates;
+        mSources[i].handle = handles[i] = sensorRegister(&mSources[i].info, &mSourceOps, mSources + i, true);
+    }
+
+    setenv("NANOHUB_RECORD_FILE", path, 1);
+    recTid = hostOsStartApp(&gSensorRecordApp);
+    clientRequest(handles, true);
+
+    mRx = mRecorded;
+    mNumRx = 0;
+    osEnqueueEvt(EVT_APP_START, NULL, NULL);
+    hostOsRunUntil(timGetTime() + FLUSH_AT);
+    sensorFlush(handles[0]);
+    hostOsRunUntil(timGetTime() + RECORD_TIME - FLUSH_AT);
+    mNumRecorded = mNumRx;
+
+    clientRequest(handles, false);
+    hostOsStopApp(recTid);
+}
+
+static void replay(const char *path, uint32_t speed)
+{
+    uint32_t handles[NUM_SOURCES], repTid, shift, i, first = 0;
+    char speedStr[16];
+    const struct Rx *r, *p;
+    int64_t err, worst = 0;
+    uint64_t last[SENS_TYPE_LAST_USER + 1] = { 0 };
+
+    for (shift = 0; speed >> (shift + 1); shift++)
+        ;
+    snprintf(speedStr, sizeof(speedStr), "%u", speed);
+    setenv("NANOHUB_REPLAY_FILE", path, 1);
+    setenv("NANOHUB_REPLAY_SPEED", speedStr, 1);
+    repTid = hostOsStartApp(&gSensorReplayApp);
+
+    for (i = 0; i < NUM_SOURCES; i++) {
+        handles[i] = findReplaySensor(mSources[i].info.sensorType, &mSources[i].info);
+        expect(handles[i], "sensor not replayed", speed);
+    }
+    clientRequest(handles, true);
+
+    mRx = mReplayed;
+    mNumRx = 0;
+    osEnqueueEvt(EVT_APP_START, NULL, NULL);
+    hostOsRunUntil(timGetTime() + RECORD_TIME + 1000 * MS);
+
+    clientRequest(handles, false);
+    hostOsStopApp(repTid);
+
+    expect(mNumRx == mNumRecorded, "different number of samples", speed);
+    if (mNumRx != mNumRecorded)
+        return;
+
+    while (first < mNumRx && !mRecorded[first].timed)
+        first++;
+
+    for (i = 0; i < mNumRx; i++) {
+        r = mRecorded + i;
+        p = mReplayed + i;
+        expect(r->sensorType == p->sensorType && r->flush == p->flush && !memcmp(r->v, p->v, sizeof(r->v)), "different data", speed);
+
+        //paced playback delivers each event as long after the first as it was recorded, divided by the speedup
+        if (speed) {
+            err = (int64_t)(p->recvTime - mReplayed[0].recvTime) - (int64_t)((r->recvTime - mRecorded[0].recvTime) >> shift);
+            expect(err >= -1 && err <= 1, "delivered at the wrong time", speed);
+        }
+
+        if (!r->timed)
+            continue;
+
+        //timestamps are floored once each, in their own direction from the first record's time
+        err = (int64_t)(p->sampleTime - mReplayed[first].sampleTime) - (int64_t)((r->sampleTime - mRecorded[first].sampleTime) >> shift);
+        if (llabs(err) > worst)
+            worst = llabs(err);
+        expect(p->sampleTime > last[p->sensorType], "sample times went backwards", speed);
+        last[p->sensorType] = p->sampleTime;
+    }
+    expect(worst <= 2, "sample times not moved and scaled", speed);
+
+    printf("replay_test: speed %u, %u samples, worst timestamp error %lld ns\n", speed, mNumRx, (long long)worst);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint32_t speeds[] = { 1, 4, 0 };
+    char path[] = "/tmp/replay_testXXXXXX";
+    uint32_t i;
+    int fd;
+
+    if (argc > 1)
+        mRand = strtoul(argv[1], NULL, 0);
+
+    fd = mkstemp(path);
+    if (fd < 0) {
+        perror("replay_test: mkstemp");
+        return 1;
+    }
+    close(fd);
+
+    sensorsInit();
+    mClientTid = hostOsStartApp(&mClientApp);
+
+    record(path);
+    expect(mNumRecorded > 1000 && mRecorded[mNumRecorded - 1].recvTime - mRecorded[0].recvTime > RECORD_TIME / 2, "nothing recorded", 1);
+
+    for (i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+        replay(path, speeds[i]);
+
+    unlink(path);
+    printf("replay_test: %s\n", mFailed ? "FAILED" : "ok");
+
+    return mFailed ? 1 : 0;
+}
@@ -0,0 +1,416 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Uploads apps through startFirmwareUpload/firmwareChunk, stop-and-wait and
+ * windowed, into a shared flash area whose every program and erase is also
+ * written to a file. Each upload is cut short once or twice at a random
+ * point and started again with the RESUME flag; it must carry on from where
+ * it stopped without a second erase and end up as the same valid segment as
+ * an uninterrupted one. Also checks that a different image, or a restart
+ * without the flag, starts over without programming over the abandoned data,
+ * that a lost windowed chunk is asked for again, and that flash is only ever
+ * programmed where it is erased.
+ */
+
+#include "../../firmware/src/nanohubCommand.c"
+#include "host_os.h"
+
+#define SHARED_SIZE         (128 * 1024)
+#define CHUNK_SIZE          128
+#define MAX_IMAGE           (40 * 1024)
+#define ROUNDS              60
+
+char __shared_start[SHARED_SIZE] __attribute__((aligned(4)));
+
+//the linker script gives us these on the hub; there is no eedata here, so no AES keys either
+__asm__(".globl __shared_end\n .set __shared_end, __shared_start + 131072\n"
+        ".globl __eedata_start\n .set __eedata_start, __shared_start\n"
+        ".globl __eedata_end\n .set __eedata_end, __shared_start\n");
+
+static FILE *mFlashFile;
+static unsigned mErases, mBadPrograms;
+static bool mBusy;
+static bool mParking;
+
+static unsigned mFailed;
+static uint32_t mRand = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    mRand = mRand * 1103515245 + 12345;
+    return ((mRand >> 8) & 0xFFFFFF) % n;
+}
+
+static void expect(bool ok, const char *what, unsigned round)
+{
+    if (!ok) {
+        fprintf(stderr, "resume_test: %s (round %u)\n", what, round);
+        mFailed++;
+    }
+}
+
+static void flashMirror(uint32_t offset, uint32_t len)
+{
+    fseek(mFlashFile, offset, SEEK_SET);
+    fwrite(__shared_start + offset, 1, len, mFlashFile);
+    fflush(mFlashFile);
+}
+
+//flash bits only go from 1 to 0 until the next erase
+static int blProgramShared(uint8_t *dst, uint8_t *src, uint32_t length, uint32_t key1, uint32_t key2)
+{
+    uint32_t offset = dst - (uint8_t *)__shared_start, i;
+
+    if (key1 != BL_FLASH_KEY1 || key2 != BL_FLASH_KEY2 || dst < (uint8_t *)__shared_start || offset + length > SHARED_SIZE)
+        return -1;
+
+    for (i = 0; i < length; i++) {
+        if (src[i] & ~dst[i]) {
+            mBadPrograms++;
+            return -1;
+        }
+    }
+
+    memcpy(dst, src, length);
+    flashMirror(offset, length);
+
+    return 0;
+}
+
+static int blEraseShared(uint32_t key1, uint32_t key2)
+{
+    if (key1 != BL_FLASH_KEY1 || key2 != BL_FLASH_KEY2)
+        return -1;
+
+    memset(__shared_start, 0xFF, SHARED_SIZE);
+    flashMirror(0, SHARED_SIZE);
+    mErases++;
+
+    return 0;
+}
+
+static const uint32_t* blGetPubKeysInfo(uint32_t *numKeys)
+{
+    *numKeys = 0;
+    return NULL;
+}
+
+struct BlVecTable BL = {
+    .blProgramShared = blProgramShared,
+    .blEraseShared = blEraseShared,
+    .blGetPubKeysInfo = blGetPubKeysInfo,
+};
+
+void hostIntfSetBusy(bool busy)
+{
+    mBusy = busy;
+}
+
+void hostIntfSetParking(bool park)
+{
+    mParking = park;
+}
+
+void hostIntfSetInterrupt(uint32_t bit)
+{
+}
+
+static bool flashFileMatches(void)
+{
+    static uint8_t buf[SHARED_SIZE];
+
+    fseek(mFlashFile, 0, SEEK_SET);
+    return fread(buf, 1, SHARED_SIZE, mFlashFile) == SHARED_SIZE && !memcmp(buf, __shared_start, SHARED_SIZE);
+}
+
+static uint32_t segmentSize(uint32_t len)
+{
+    return sizeof(uint32_t) + ((len + 3) & ~3) + sizeof(uint32_t);
+}
+
+//what the hub had before the upload: an erased area, or one app segment of len bytes
+static uint8_t *prefill(uint32_t len)
+{
+    uint8_t *seg = (uint8_t *)__shared_start;
+    uint32_t crc, i;
+
+    memset(__shared_start, 0xFF, SHARED_SIZE);
+    if (len) {
+        seg[0] = (BL_FLASH_APP_ID << 4) | BL_FLASH_APP_ID;
+        seg[1] = len >> 16;
+        seg[2] = len >> 8;
+        seg[3] = len;
+        for (i = 0; i < ((len + 3) & ~3); i++)
+            seg[4 + i] = i < len ? rnd(256) : 0;
+        crc = ~crc32(seg, 4 + len, ~0);
+        memcpy(seg + segmentSize(len) - sizeof(crc), &crc, sizeof(crc));
+        seg += segmentSize(len);
+    }
+    flashMirror(0, SHARED_SIZE);
+
+    return seg;
+}
+
+static void makeImage(uint8_t *img, uint32_t size)
+{
+    static const char magic[] = APP_HDR_MAGIC;
+    uint32_t i;
+
+    for (i = 0; i < size; i++)
+        img[i] = rnd(256);
+    memcpy(img, magic, sizeof(magic) - 1);
+    img[offsetof(struct AppHdr, fmtVer)] = APP_HDR_VER_CUR;
+    img[offsetof(struct AppHdr, marker)] = APP_HDR_MARKER_UPLOADING & 0xFF;
+    img[offsetof(struct AppHdr, marker) + 1] = APP_HDR_MARKER_UPLOADING >> 8;
+}
+
+//the hub parks requests while it is busy and serves them once it is idle; it gets through about a deferred call per request
+static size_t command(size_t (*handler)(void *, uint8_t, void *, uint64_t), void *req, uint8_t len, void *resp, unsigned round)
+{
+    size_t ret;
+
+    while (mBusy) {
+        if (!hostOsRunOne()) {
+            expect(false, "busy with nothing to do", round);
+            mBusy = false;
+        }
+    }
+
+    ret = handler(req, len, resp, 0);
+    if (rnd(2))
+        hostOsRunOne();
+
+    return ret;
+}
+
+struct Upload {
+    const uint8_t *img;
+    uint32_t size;
+    uint32_t crc;
+    bool windowed;
+    uint32_t offset;    //next byte to send
+};
+
+static bool start(struct Upload *up, bool resume, struct NanohubStartFirmwareUploadResponse *resp, unsigned round)
+{
+    struct NanohubStartFirmwareUploadRequest req = {
+        .size = htole32(up->size),
+        .crc = htole32(up->crc),
+        .type = BL_FLASH_APP_ID,
+        .flags = (up->windowed ? NANOHUB_FIRMWARE_UPLOAD_FLAG_WINDOWED | NANOHUB_FIRMWARE_UPLOAD_FLAG_PARK : 0) |
+                 (resume ? NANOHUB_FIRMWARE_UPLOAD_FLAG_RESUME : 0),
+    };
+    size_t len;
+
+    memset(resp, 0, sizeof(*resp));
+    len = command(startFirmwareUpload, &req, sizeof(req), resp, round);
+    expect(len == sizeof(*resp) && resp->accepted, "upload not accepted", round);
+    expect(!(resp->flags & NANOHUB_FIRMWARE_UPLOAD_FLAG_WINDOWED) == !up->windowed, "windowed flag not granted", round);
+    expect(!(resp->flags & NANOHUB_FIRMWARE_UPLOAD_FLAG_PARK) == !up->windowed && mParking == up->windowed, "park flag not granted", round);
+    up->offset = (resp->flags & NANOHUB_FIRMWARE_UPLOAD_FLAG_RESUME) ? le32toh(resp->resumeOffset) : 0;
+
+    return resp->flags & NANOHUB_FIRMWARE_UPLOAD_FLAG_RESUME;
+}
+
+/*
+ * Send chunks until stopAt (the host goes away there) or the end. Windowed
+ * uploads end with an empty chunk that is answered once all is in flash, and
+ * the chunk at dropAt never makes it to the hub. Returns the last reply.
+ */
+static uint8_t sendChunks(struct Upload *up, uint32_t stopAt, uint32_t dropAt, unsigned round)
+{
+    struct NanohubFirmwareChunkRequest req;
+    struct NanohubFirmwareChunkWindowResponse resp;
+    uint32_t n;
+
+    while (up->offset < stopAt || (up->offset == up->size && up->windowed)) {
+        n = up->size - up->offset < CHUNK_SIZE ? up->size - up->offset : CHUNK_SIZE;
+        req.offset = htole32(up->offset);
+        memcpy(req.data, up->img + up->offset, n);
+
+        if (up->windowed && n && up->offset == dropAt) {
+            up->offset += n;
+            dropAt = ~0;
+            continue;
+        }
+
+        command(firmwareChunk, &req, sizeof(req.offset) + n, &resp, round);
+        switch (resp.chunkReply) {
+        case NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED:
+            if (!n)
+                return resp.chunkReply;
+            up->offset += n;
+            expect(!up->windowed || le32toh(resp.nextOffset) == up->offset, "accepted chunk not counted", round);
+            break;
+        case NANOHUB_FIRMWARE_CHUNK_REPLY_WAIT:
+            break;
+        case NANOHUB_FIRMWARE_CHUNK_REPLY_RESEND_FROM:
+            expect(up->windowed && le32toh(resp.nextOffset) < up->offset, "resend from a bad offset", round);
+            up->offset = le32toh(resp.nextOffset);
+            break;
+        default:
+            return resp.chunkReply;
+        }
+    }
+
+    return NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED;
+}
+
+//the image must be in flash at seg as a valid app segment
+static void checkSegment(const uint8_t *seg, const uint8_t *img, uint32_t size, unsigned round)
+{
+    uint32_t crc, len = (seg[1] << 16) | (seg[2] << 8) | seg[3];
+    uint16_t marker;
+
+    expect(seg[0] == ((BL_FLASH_APP_ID << 4) | BL_FLASH_APP_ID) && len == size, "bad segment header", round);
+    if (len != size)
+        return;
+
+    memcpy(&marker, seg + 4 + offsetof(struct AppHdr, marker), sizeof(marker));
+    expect(marker == APP_HDR_MARKER_VALID, "app not marked valid", round);
+    expect(!memcmp(seg + 4, img, offsetof(struct AppHdr, marker)), "app header damaged", round);
+    expect(!memcmp(seg + 6 + offsetof(struct AppHdr, marker), img + 2 + offsetof(struct AppHdr, marker), size - 2 - offsetof(struct AppHdr, marker)), "app data damaged", round);
+
+    memcpy(&crc, seg + segmentSize(len) - sizeof(crc), sizeof(crc));
+    expect(crc == ~crc32(seg, 4 + len, ~0), "bad segment CRC", round);
+}
+
+static void checkFlash(unsigned round)
+{
+    expect(!mBadPrograms, "programmed flash that was not erased", round);
+    expect(flashFileMatches(), "flash file does not match", round);
+    expect(!mDownloadState, "upload still open", round);
+}
+
+/*
+ * One app, cut short at up to two random points (the hub may or may not
+ * have flushed what it had by then) and resumed each time.
+ */
+static void resumes(unsigned round)
+{
+    static uint8_t img[MAX_IMAGE];
+    struct NanohubStartFirmwareUploadResponse resp;
+    struct Upload up = { .img = img, .windowed = round & 1 };
+    bool mustErase = round & 2;
+    uint32_t stops[2], written, i;
+    uint8_t *seg;
+
+    up.size = sizeof(struct AppHdr) + rnd(MAX_IMAGE - sizeof(struct AppHdr));
+    makeImage(img, up.size);
+    up.crc = ~crc32(img, up.size, ~0);
+
+    //an old app that leaves either room to spare or too little of it
+    seg = prefill(mustErase ? SHARED_SIZE - segmentSize(up.size) : 1 + rnd(SHARED_SIZE - 2 * MAX_IMAGE));
+    if (mustErase)
+        seg = (uint8_t *)__shared_start;
+    mErases = mBadPrograms = 0;
+
+    //both short of the end, so the upload is never quite done when the host goes away
+    stops[0] = rnd((up.size - 1) / CHUNK_SIZE + 1) * CHUNK_SIZE;
+    stops[1] = stops[0] + rnd((up.size - 1 - stops[0]) / CHUNK_SIZE + 1) * CHUNK_SIZE;
+
+    start(&up, false, &resp, round);
+    for (i = 0; i < 2; i++) {
+        expect(sendChunks(&up, stops[i], ~0, round) == NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED, "upload failed", round);
+        if (rnd(2))
+            hostOsRunAll();
+
+        expect(start(&up, true, &resp, round), "resume refused", round);
+        expect(up.offset == stops[i], "resumed at the wrong offset", round);
+        written = le32toh(resp.written);
+        expect(written <= up.offset && !memcmp(seg + 4, img, written), "wrong written count", round);
+    }
+
+    expect(sendChunks(&up, up.size, up.windowed ? rnd(up.size) & ~(CHUNK_SIZE - 1) : ~0, round) == NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED, "upload failed", round);
+    hostOsRunAll();
+
+    expect(mErases == mustErase, "wrong number of erases", round);
+    checkSegment(seg, img, up.size, round);
+    checkFlash(round);
+}
+
+/*
+ * Cut short, then the host starts over: with a different image under the
+ * RESUME flag, or the same one without it. Either way the hub starts from 0
+ * and the abandoned data stays out of the way.
+ */
+static void startsOver(unsigned round)
+{
+    static uint8_t img[2][MAX_IMAGE];
+    struct NanohubStartFirmwareUploadResponse resp;
+    struct Upload up = { .windowed = round & 1 };
+    bool sameImage = round & 2;
+    uint8_t *seg;
+
+    seg = prefill(0);
+    mErases = mBadPrograms = 0;
+
+    up.img = img[0];
+    up.size = 4 * 1024 + rnd(MAX_IMAGE - 4 * 1024);
+    makeImage(img[0], up.size);
+    up.crc = ~crc32(img[0], up.size, ~0);
+    start(&up, false, &resp, round);
+    expect(sendChunks(&up, 2 * 1024, ~0, round) == NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED, "upload failed", round);
+    hostOsRunAll();
+
+    if (!sameImage) {
+        up.img = img[1];
+        up.size = 4 * 1024 + rnd(MAX_IMAGE - 4 * 1024);
+        makeImage(img[1], up.size);
+        up.crc = ~crc32(img[1], up.size, ~0);
+    }
+    expect(!start(&up, !sameImage, &resp, round) && !up.offset, "did not start over", round);
+    expect(!resp.resumeOffset && !resp.written, "restart reports progress", round);
+    expect(sendChunks(&up, up.size, ~0, round) == NANOHUB_FIRMWARE_CHUNK_REPLY_ACCEPTED, "upload failed", round);
+    hostOsRunAll();
+
+    //the abandoned upload is closed as a deleted segment and the new one follows it
+    expect(!(seg[0] & 0xF0), "abandoned upload not closed", round);
+    seg += segmentSize((seg[1] << 16) | (seg[2] << 8) | seg[3]);
+    checkSegment(seg, up.img, up.size, round);
+    checkFlash(round);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned i;
+
+    if (argc > 1)
+        mRand = strtoul(argv[1], NULL, 0);
+
+    mFlashFile = tmpfile();
+    if (!mFlashFile) {
+        perror("resume_test: tmpfile");
+        return 1;
+    }
+
+    for (i = 0; i < ROUNDS; i++) {
+        resumes(i);
+        startsOver(i);
+    }
+
+    fclose(mFlashFile);
+    printf("resume_test: %u rounds %s\n", ROUNDS, mFailed ? "FAILED" : "ok");
+
+    return mFailed ? 1 : 0;
+}
@@ -0,0 +1,347 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include <rsa.h>
+
+/*
+ * rsaPubOp known answers, a cross-check against the plain multiply and
+ * shift-subtract reduction it used before Montgomery multiplication, and a
+ * benchmark of the two. The known answers were made with a bignum library
+ * independent of this code. Pass -q to skip the benchmark.
+ */
+
+#define NUM_CROSS_CHECKS    64
+#define BENCH_MIN_NS        500000000ULL
+
+//a real 2048-bit key: sig = msg ^ d mod n, so the public op must give back msg
+static const uint32_t mKeyN[RSA_LIMBS] = {
+    0xee4ddc4d, 0xff923d87, 0x90a82e99, 0xeb6c84f1, 0xbbcf67fb, 0x3668ef39, 0x087f49a8, 0x6ca857c7,
+    0x5c430061, 0xc8360843, 0x4384aeaf, 0xe0f9ac3e, 0xa2b4a90a, 0x4fded6d6, 0x05b6462b, 0x7de1b311,
+    0x02961663, 0xdd1a21b7, 0xb1377de4, 0x559ae005, 0xf44264f4, 0x09024e53, 0x24629216, 0xdfbbfa97,
+    0xc0d096da, 0x6c623c6b, 0x5a1a6fbe, 0x5593933b, 0xe73ec933, 0xfc9ed64d, 0x7d5cb839, 0x15bfbbeb,
+    0x09671824, 0xb1050ba5, 0xf1d0d7d4, 0x9d77a2bd, 0x0cccb4c0, 0x8ee0e276, 0x5a066288, 0x9e2b13a7,
+    0x45023adc, 0xa02cb349, 0xc6412cc1, 0xb079cdf9, 0x1adb33b8, 0xa743d2bb, 0x0a8c1dfd, 0x14bef35e,
+    0x3932fdbd, 0x3796e5da, 0x0f0daaca, 0x07c21465, 0x4e3b12a0, 0x3d07d14e, 0x97f6172e, 0x0529a648,
+    0xcf52b7f1, 0x643d1d53, 0x35c36f68, 0xfd1eceac, 0xd1b437f6, 0x17a5de25, 0x871f1dbf, 0xb4750958,
+};
+static const uint32_t mKeySig[RSA_LIMBS] = {
+    0xd7492392, 0xf6aa9072, 0x20cced0b, 0x5a8aea37, 0x89394d54, 0xec546e51, 0x20556e69, 0x20001c63,
+    0xe9740fea, 0x6b2e10f1, 0x92f1b9c9, 0x603bab48, 0x3798f82f, 0x4b58f7eb, 0xde340491, 0x63aa9524,
+    0x3b87fc83, 0xeb421729, 0x481582b9, 0xc64e3afb, 0xe5da20d7, 0xdb76a834, 0x44632228, 0x7519b007,
+    0x3ba5f169, 0x22e88ef1, 0xe13ba759, 0x1bf04e48, 0x9c57bfd4, 0xb9040719, 0xba408063, 0x81eafe15,
+    0x057ef557, 0x47b421c5, 0x427bd549, 0xc8d1684f, 0xf5da10d8, 0xe0484ede, 0x410af0c7, 0x6af6361f,
+    0xeffb9e9f, 0xf4f25070, 0xb2e02de2, 0x49cdbdc1, 0x98f4ba91, 0x761c5879, 0x4f0cc973, 0x6c1e6f42,
+    0x2de38728, 0x86f16fd5, 0x1841b861, 0x389ace44, 0x40461c52, 0x6663cf7e, 0x33f44e7d, 0x1e45141b,
+    0xa6743b5a, 0x57e8de75, 0x206f38e5, 0x9dea643b, 0x455b0572, 0xb1f4b6d0, 0xa853ead2, 0x4aff2afa,
+};
+static const uint32_t mKeyMsg[RSA_LIMBS] = {
+    0x5aa7e16e, 0xecc52ce5, 0xc64b83a8, 0x0c753191, 0x63828b25, 0xeb7b6cf6, 0x2ca303a0, 0x63babc28,
+    0x47007839, 0xce92e243, 0xe1e3b6c9, 0xc041b087, 0x03c87c8d, 0x91f9d56a, 0x397c49db, 0x2637bedf,
+    0xc08af4b2, 0xd7351372, 0x0b186135, 0xcd31a056, 0x7d49c69b, 0xbfe8fdb1, 0xbea93194, 0xc56a20f6,
+    0xbd15f752, 0x5bd25ad3, 0x31c92b2c, 0x70d4bc1a, 0x60bd605b, 0xf9aad9ea, 0x15c9315e, 0x83dd1da3,
+    0x899d7ae0, 0xa2f4c4db, 0x9a0d049d, 0x2be39200, 0x2cd9d73b, 0x280f9649, 0x664f160a, 0x5cc8d3e6,
+    0xb080e99d, 0x7d56f633, 0x9cd5af7a, 0xfaace4ab, 0xb10613b5, 0xe3a69b6c, 0x0eb48cab, 0xb9f48014,
+    0x80c8edbb, 0x49683d2a, 0x9b7b8914, 0xfbaf55b4, 0x7369682b, 0xe8f2e2c5, 0x7821bca0, 0xac0816c7,
+    0xab669a70, 0xd2b62c0d, 0x11929831, 0xd09bdfaf, 0xf243c0f9, 0xfbde7ec9, 0x2e5d548b, 0x00355868,
+};
+
+//a random modulus
+static const uint32_t mRndN[RSA_LIMBS] = {
+    0x96563ba9, 0xf6e146b8, 0x81dd3320, 0xa5680be3, 0x093090ed, 0x81f5171b, 0x55e96950, 0x007e52ef,
+    0x609f5b9c, 0x910037cd, 0xa669a500, 0xdd527a46, 0xdddcce2b, 0x9eb86b5c, 0x70fc1aa5, 0xd72469f6,
+    0x05880d1d, 0x222abdd1, 0x6f35fcce, 0x64725188, 0xa1947d09, 0xc0466763, 0xb9a104a8, 0x1202021f,
+    0x0f262881, 0x14ea66ca, 0x5ba5ac07, 0x8585d9f0, 0x6ea4e41d, 0x0a2e65f2, 0x690923f5, 0xc5a5a0ac,
+    0x37452857, 0xbf3d410d, 0xb6800e83, 0x71d37c5e, 0x81539b70, 0xd7f0a6ad, 0x2f9f96ee, 0x0a505bf2,
+    0x826b1f57, 0x1404c075, 0xb6994d99, 0x8190d8c7, 0xb1de3a8a, 0x522b7b35, 0x326838fb, 0x45964d85,
+    0x6079bdfd, 0x46b47669, 0x91a9e98e, 0x0bc08190, 0x8004756e, 0x01e43d81, 0x7a94bb65, 0x506f6bbb,
+    0x6458b8a4, 0x2c03f7c4, 0xd73383ba, 0xf0539891, 0x5a88dbe3, 0x3cc5a853, 0x118312b2, 0x8ef4f5a6,
+};
+static const uint32_t mRndA[RSA_LIMBS] = {
+    0x260e8131, 0xfa9241ce, 0x884081cc, 0x3424fb66, 0xfc11345c, 0x9a425257, 0xe01786d0, 0x2df82d67,
+    0xf9dc672a, 0xc0e311a3, 0x73e53f7b, 0xc6697664, 0x32311990, 0xe877177d, 0x9e217b13, 0x7ca9cf95,
+    0xd4c57552, 0x55cb49c3, 0x716b1301, 0x7ac268de, 0x77b8ef5a, 0xd3ebaa16, 0xea468c37, 0x7b178d6a,
+    0x0281bed3, 0x16457b05, 0xd8d24f5a, 0x176c0716, 0x0bebb462, 0xda3a724e, 0x8af3a003, 0xba1e98c2,
+    0xedf2e445, 0x3631fd76, 0xee60ad44, 0xd64186fa, 0xabe12289, 0x31386be3, 0x467cc81c, 0xc456156b,
+    0x87830aa0, 0x17ed899a, 0xc4170249, 0x8b6e3e63, 0x1f42f9f4, 0xb3cf0a70, 0x8c6f4de1, 0x3189a0df,
+    0x6372cb97, 0x1a046046, 0x25d68efa, 0x0205491b, 0x01a58077, 0x224987f0, 0x58be9598, 0x9a2160bb,
+    0xbd7e7dd4, 0x542ca626, 0x5bfc718e, 0xca5bc01f, 0x40414dfc, 0xda5f145b, 0x7767461d, 0x878214ec,
+};
+static const uint32_t mRndRes[RSA_LIMBS] = {
+    0xbce44e5f, 0xaef36ac2, 0x138749d8, 0x990ec262, 0xd0280526, 0x416bd16b, 0xf62dcfc9, 0x8a03ad5c,
+    0xd632b197, 0x3691d3db, 0x763de0ca, 0x2456aa0a, 0xeaa7252e, 0x71b0cd03, 0x55af2b3c, 0x4732b3a9,
+    0xc2509b9d, 0xc769c305, 0x6d3097e5, 0xdabc1d5a, 0x4ff6f073, 0xf90e7e95, 0xb276bca5, 0x4c40f401,
+    0xa7ecad88, 0x8255b330, 0xd7669981, 0x59e6ff8e, 0x36e2dae1, 0xcdb19d84, 0xe82b7070, 0x4213e163,
+    0xaeb4142c, 0x4dd79a8d, 0x6648cfb4, 0xe020022e, 0xcb53afcc, 0x060c4846, 0x854a20bd, 0x072e6278,
+    0xfb333a56, 0x9744ae92, 0x565ed614, 0xbb5aa70d, 0xaa601606, 0xe3e1d8d0, 0xc832dc63, 0x0f2edbab,
+    0x2795a411, 0x3d262c31, 0x1541f6c7, 0x1a0dc43c, 0x8b755d78, 0x1e5c3c77, 0xab04fcc1, 0xce7d72fe,
+    0xc2244a3b, 0x0e6502a8, 0x0a1dd70b, 0x60a18da1, 0x14acdac0, 0x7b0ae509, 0xa547bb22, 0x370a2837,
+};
+
+//an input above the modulus
+static const uint32_t mBigRes[RSA_LIMBS] = {
+    0x7ef3d7a1, 0xd328cdb5, 0x792b510b, 0x1e2a4fa2, 0xc0c9190a, 0x3ebad65f, 0x9cb9b1d9, 0x5b818a6b,
+    0xb9a951b1, 0x76601d45, 0x7e3c622d, 0x1153b090, 0x3024fc26, 0x3a51c1dc, 0x00d3ce91, 0x3384f5b6,
+    0x8e69817b, 0x9ddae66e, 0xb63fc4e6, 0xcce550cc, 0xb04704ac, 0xa3cee161, 0xdd151119, 0x67918df3,
+    0x83274496, 0xa943d2a6, 0x33165ebd, 0x9e472240, 0xe0228fd0, 0xda1a8294, 0xaf039812, 0x8413d046,
+    0xa691a864, 0x71016a78, 0xc5f634e1, 0x31397cfe, 0x36066d6f, 0x3bc777b1, 0x94df164b, 0x7bba93da,
+    0x2bcddf11, 0x07c2e57a, 0x3c3bf32c, 0xe6fbb388, 0x020e4c2a, 0x86a7b12a, 0xbea1fd36, 0x9a874e61,
+    0x37bb3bae, 0xfa2417ec, 0x29ec9991, 0x984aabfa, 0xfad09a99, 0x0e3162f1, 0x11f59455, 0x02e8fbd5,
+    0xc5419631, 0x04736a9c, 0xf00d4703, 0x12f22869, 0x0b28555f, 0x72e5588f, 0xdda29478, 0x313159f1,
+};
+
+//the largest modulus, 2 ^ 2048 - 1, with a = 2
+static const uint32_t mOnesRes[RSA_LIMBS] = {
+    0x00000002, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+    0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000,
+};
+
+static unsigned mChecks, mFailed;
+static uint32_t mRand = 1;
+
+/* the old rsaPubOp, kept here as the reference */
+
+static void refBiMod(uint32_t *num, const uint32_t *denum, uint32_t *tmp) //num %= denum where num is RSA_LEN * 2 and denum is RSA_LEN and tmp is RSA_LEN + limb_sz
+{
+    uint32_t bitsh = 32, limbsh = RSA_LIMBS - 1;
+    int64_t t;
+    int32_t i;
+
+    //initially set it up left shifted as far as possible
+    memcpy(tmp + 1, denum, RSA_BYTES);
+    tmp[0] = 0;
+    bitsh = 32;
+
+    while (!(tmp[RSA_LIMBS] & 0x80000000)) {
+        for (i = RSA_LIMBS; i > 0; i--) {
+            tmp[i] <<= 1;
+            if (tmp[i - 1] & 0x80000000)
+                tmp[i]++;
+        }
+        //no need to adjust tmp[0] as it is still zero
+        bitsh++;
+    }
+
+    while (1) {
+
+        //check if we should subtract (uses less space than subtracting and unroling it later)
+        for (i = RSA_LIMBS; i >= 0; i--) {
+            if (num[limbsh + i] < tmp[i])
+                goto dont_subtract;
+            if (num[limbsh + i] > tmp[i])
+                break;
+        }
+
+        //subtract
+        t = 0;
+        for (i = 0; i <= RSA_LIMBS; i++) {
+            t += (uint64_t)num[limbsh + i];
+            t -= (uint64_t)tmp[i];
+            num[limbsh + i] = t;
+            t >>= 32;
+        }
+
+        //carry the subtraction's carry to the end
+        for (i = RSA_LIMBS + limbsh + 1; i < RSA_LIMBS * 2; i++) {
+            t += (uint64_t)num[i];
+            num[i] = t;
+            t >>= 32;
+        }
+
+dont_subtract:
+        //handle bitshifts/refills
+        if (!bitsh) {                          // tmp = denum << 32
+            if (!limbsh)
+                break;
+
+            memcpy(tmp + 1, denum, RSA_BYTES);
+            tmp[0] = 0;
+            bitsh = 32;
+            limbsh--;
+        }
+        else {                                 // tmp >>= 1
+            for (i = 0; i < RSA_LIMBS; i++) {
+                tmp[i] >>= 1;
+                if (tmp[i + 1] & 1)
+                    tmp[i] += 0x80000000;
+            }
+            tmp[i] >>= 1;
+            bitsh--;
+        }
+    }
+}
+
+static void refBiMul(uint32_t *ret, const uint32_t *a, const uint32_t *b) //ret = a * b
+{
+    uint32_t i, j, c;
+    uint64_t r;
+
+    //zero the result
+    memset(ret, 0, RSA_BYTES * 2);
+
+    for (i = 0; i < RSA_LIMBS; i++) {
+
+        //produce a partial sum & add it in
+        c = 0;
+        for (j = 0; j < RSA_LIMBS; j++) {
+            r = (uint64_t)a[i] * b[j] + c + ret[i + j];
+            ret[i + j] = r;
+            c = r >> 32;
+        }
+
+        //carry the carry to the end
+        for (j = i + RSA_LIMBS; j < RSA_LIMBS * 2; j++) {
+            r = (uint64_t)ret[j] + c;
+            ret[j] = r;
+            c = r >> 32;
+        }
+    }
+}
+
+static const uint32_t* refRsaPubOp(struct RsaState* state, const uint32_t *a, const uint32_t *c)
+{
+    uint32_t i;
+
+    //calculate a ^ 65536 mod c into state->tmpB
+    memcpy(state->tmpB, a, RSA_BYTES);
+    for (i = 0; i < 16; i++) {
+        refBiMul(state->tmpA, state->tmpB, state->tmpB);
+        refBiMod(state->tmpA, c, state->tmpB);
+        memcpy(state->tmpB, state->tmpA, RSA_BYTES);
+    }
+
+    //calculate a ^ 65537 mod c into state->tmpA [ at this point this means do state->tmpA = (state->tmpB * a) % c ]
+    refBiMul(state->tmpA, state->tmpB, a);
+    refBiMod(state->tmpA, c, state->tmpB);
+
+    //return result
+    return state->tmpA;
+}
+
+static uint32_t rnd32(void)
+{
+    mRand = mRand * 1103515245 + 12345;
+    return (mRand >> 16) | ((mRand * 1103515245 + 12345) & 0xFFFF0000);
+}
+
+static void check(const char *what, const uint32_t *a, const uint32_t *n, const uint32_t *expected)
+{
+    struct RsaState state;
+
+    mChecks++;
+    if (memcmp(rsaPubOp(&state, a, n), expected, RSA_BYTES)) {
+        fprintf(stderr, "rsa_test: %s: wrong result\n", what);
+        mFailed++;
+    }
+}
+
+static void knownAnswers(void)
+{
+    uint32_t a[RSA_LIMBS], n[RSA_LIMBS];
+
+    check("signature", mKeySig, mKeyN, mKeyMsg);
+    check("random", mRndA, mRndN, mRndRes);
+
+    memset(a, 0xFF, RSA_BYTES);
+    check("input above modulus", a, mRndN, mBigRes);
+
+    memset(n, 0xFF, RSA_BYTES);
+    memset(a, 0, RSA_BYTES);
+    a[0] = 2;
+    check("largest modulus", a, n, mOnesRes);
+
+    //0, 1 and n - 1 are their own powers for an odd exponent
+    memset(a, 0, RSA_BYTES);
+    check("zero", a, mKeyN, a);
+    a[0] = 1;
+    check("one", a, mKeyN, a);
+    memcpy(a, mKeyN, RSA_BYTES);
+    a[0]--;
+    check("n - 1", a, mKeyN, a);
+}
+
+static void crossChecks(void)
+{
+    uint32_t a[RSA_LIMBS], n[RSA_LIMBS], expected[RSA_LIMBS];
+    struct RsaState state;
+    uint32_t i, j;
+
+    for (i = 0; i < NUM_CROSS_CHECKS; i++) {
+        for (j = 0; j < RSA_LIMBS; j++) {
+            n[j] = rnd32();
+            a[j] = rnd32();
+        }
+        n[0] |= 1;
+        n[RSA_LIMBS - 1] |= 0x80000000UL;
+        if (i & 1) //sparse words find carry bugs that random ones miss
+            for (j = 0; j < RSA_LIMBS; j++)
+                a[j] = (rnd32() & 3) ? 0xFFFFFFFFUL * (rnd32() & 1) : a[j];
+
+        memcpy(expected, refRsaPubOp(&state, a, n), RSA_BYTES);
+        check("cross check", a, n, expected);
+    }
+}
+
+static uint64_t nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static double benchNsPerOp(const uint32_t* (*op)(struct RsaState*, const uint32_t*, const uint32_t*))
+{
+    struct RsaState state;
+    uint64_t start = nowNs(), elapsed;
+    uint32_t ops = 0;
+
+    do {
+        op(&state, mKeySig, mKeyN);
+        ops++;
+        elapsed = nowNs() - start;
+    } while (elapsed < BENCH_MIN_NS);
+
+    return (double)elapsed / ops;
+}
+
+int main(int argc, char **argv)
+{
+    double oldNs, newNs;
+
+    knownAnswers();
+    crossChecks();
+    printf("rsa_test: %u results checked, %s\n", mChecks, mFailed ? "FAILED" : "ok");
+
+    if (!mFailed && !(argc > 1 && !strcmp(argv[1], "-q"))) {
+        oldNs = benchNsPerOp(refRsaPubOp);
+        newNs = benchNsPerOp(rsaPubOp);
+        printf("rsa_test: rsaPubOp %.1f us, biMul/biMod %.1f us, %.1fx faster\n", newNs / 1000, oldNs / 1000, oldNs / newNs);
+    }
+
+    return mFailed ? 1 : 0;
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <seos.h>
+
+/* the driver as a host_os app: gSensorRecordApp instead of an .internal_app_init entry */
+#undef INTERNAL_APP_INIT
+#define INTERNAL_APP_INIT(_id, _ver, _init, _end, _event) \
+    const struct AppFuncs gSensorRecordApp = { .init = (_init), .end = (_end), .handle = (_event) }
+
+#include "../../firmware/src/drivers/sensor_replay/sensor_record.c"
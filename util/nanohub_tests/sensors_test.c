@@ -0,0 +1,514 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <heap.h>
+#include <sensors.h>
+#include <seos.h>
+#include <timer.h>
+
+#include "host_os.h"
+
+/*
+ * Focused checks of sensors.c through its public API, with sensors driven by
+ * the test and client apps that record what they get:
+ *  - framework batching holds samples for the tightest latency asked for, and
+ *    a client joining with a tighter one pulls the pending delivery in.
+ *  - more requests on one sensor than the old 64-entry client/sensor matrix
+ *    held; amending or releasing any of them, first, last or in the middle
+ *    of the list, leaves the others and the hw rate and latency right.
+ *  - a slower client gets every hw rate / client rate sample, averaged over
+ *    the ones it skipped when the sensor asks for that, with the phase carried
+ *    across events and started over when the client changes its rate. Bias
+ *    samples always get through, and events without data (an embedded 0)
+ *    still reach everyone.
+ *  - sensorFind walks each type in slot order as sensors come and go, and a
+ *    handle kept after its sensor unregistered is refused once the slot is
+ *    reused.
+ */
+
+#define MS                  1000000ULL
+#define NUM_CLIENTS         2
+#define NUM_REQUESTS        80              //more than MAX_CLI_SENS_MATRIX_SZ was
+#define REQUEST_TID         1000            //made up client tids, clear of the real apps
+#define GYRO_PERIOD         (10 * MS)       //100Hz
+#define MAX_KEPT            64
+
+struct Client {
+    uint32_t tid;
+    uint32_t events;
+    uint32_t samples;
+    uint64_t lastTime;      //when the last event came
+    uint32_t kept;          //gyro samples, as decimated for this client
+    float keptX[MAX_KEPT];
+    uint64_t keptTime[MAX_KEPT];
+    uint32_t steps;         //step counter events, those without data too
+    uint32_t lastStep;
+};
+
+static const uint32_t mAccelRates[] = { SENSOR_HZ(25), SENSOR_HZ(50), SENSOR_HZ(100), 0 };
+
+static const struct SensorInfo mAccelInfo = {
+    .sensorName = "Accel", .supportedRates = mAccelRates, .sensorType = SENS_TYPE_ACCEL,
+    .numAxis = NUM_AXIS_THREE, .minSamples = 20,
+};
+
+//averages what a slower client skips
+static const struct SensorInfo mGyroInfo = {
+    .sensorName = "Gyro", .supportedRates = mAccelRates, .sensorType = SENS_TYPE_GYRO,
+    .numAxis = NUM_AXIS_THREE, .minSamples = 20, .flags1 = SENSOR_INFO_FLAGS1_DECIM_AVG,
+};
+
+static const struct SensorInfo mAlsInfo = {
+    .sensorName = "Als", .supportedRates = mAccelRates, .sensorType = SENS_TYPE_ALS, .numAxis = NUM_AXIS_ONE,
+};
+
+static const struct SensorInfo mHallInfo = {
+    .sensorName = "Hall", .supportedRates = mAccelRates, .sensorType = SENS_TYPE_HALL, .numAxis = NUM_AXIS_ONE,
+};
+
+static struct Client mClients[NUM_CLIENTS];
+static uint32_t mAccel, mGyro;
+static uint32_t mGyroSeq;
+
+static unsigned mFailed;
+
+static void expect(bool ok, const char *what, const char *ctx)
+{
+    if (!ok) {
+        fprintf(stderr, "sensors_test: %s (%s)\n", what, ctx);
+        mFailed++;
+    }
+}
+
+static void clientHandle(struct Client *c, uint32_t evtType, const void *evtData)
+{
+    const struct TripleAxisDataEvent *triple = evtData;
+    uint64_t time;
+    uint32_t i;
+
+    if (evtType == sensorGetMyEventType(SENS_TYPE_STEP_COUNT)) {
+        c->steps++;
+        c->lastStep = (uintptr_t)evtData;
+        return;
+    }
+
+    if (evtType == sensorGetMyEventType(SENS_TYPE_GYRO) && evtData != SENSOR_DATA_EVENT_FLUSH) {
+        for (i = 0, time = triple->referenceTime; i < triple->samples[0].firstSample.numSamples && c->kept < MAX_KEPT; i++, c->kept++) {
+            if (i)
+                time += triple->samples[i].deltaTime;
+            c->keptX[c->kept] = triple->samples[i].x;
+            c->keptTime[c->kept] = time;
+        }
+        return;
+    }
+
+    if (evtType != sensorGetMyEventType(SENS_TYPE_ACCEL) || evtData == SENSOR_DATA_EVENT_FLUSH)
+        return;
+
+    c->events++;
+    c->samples += triple->samples[0].firstSample.numSamples;
+    c->lastTime = timGetTime();
+}
+
+static void client0Handle(uint32_t evtType, const void *evtData)
+{
+    clientHandle(mClients + 0, evtType, evtData);
+}
+
+static void client1Handle(uint32_t evtType, const void *evtData)
+{
+    clientHandle(mClients + 1, evtType, evtData);
+}
+
+static bool clientStart(uint32_t tid)
+{
+    return osEventSubscribe(tid, sensorGetMyEventType(SENS_TYPE_ACCEL)) &&
+           osEventSubscribe(tid, sensorGetMyEventType(SENS_TYPE_GYRO)) &&
+           osEventSubscribe(tid, sensorGetMyEventType(SENS_TYPE_STEP_COUNT));
+}
+
+static void clientEnd(void)
+{
+}
+
+static const struct AppFuncs mClientApps[NUM_CLIENTS] = {
+    { .init = clientStart, .end = clientEnd, .handle = client0Handle },
+    { .init = clientStart, .end = clientEnd, .handle = client1Handle },
+};
+
+static bool accelPower(bool on, void *cookie)
+{
+    return sensorSignalInternalEvt(*(uint32_t *)cookie, SENSOR_INTERNAL_EVT_POWER_STATE_CHG, on, 0);
+}
+
+static bool accelFirmwareUpload(void *cookie)
+{
+    return sensorSignalInternalEvt(*(uint32_t *)cookie, SENSOR_INTERNAL_EVT_FW_STATE_CHG, 1, 0);
+}
+
+static bool accelSetRate(uint32_t rate, uint64_t latency, void *cookie)
+{
+    return sensorSignalInternalEvt(*(uint32_t *)cookie, SENSOR_INTERNAL_EVT_RATE_CHG, rate, latency);
+}
+
+static bool accelFlush(void *cookie)
+{
+    return osEnqueueEvt(sensorGetMyEventType(SENS_TYPE_ACCEL), SENSOR_DATA_EVENT_FLUSH, NULL);
+}
+
+static const struct SensorOps mAccelOps = {
+    .sensorPower = accelPower,
+    .sensorFirmwareUpload = accelFirmwareUpload,
+    .sensorSetRate = accelSetRate,
+    .sensorFlush = accelFlush,
+};
+
+static void resetClients(void)
+{
+    uint32_t i;
+
+    for (i = 0; i < NUM_CLIENTS; i++) {
+        mClients[i].events = 0;
+        mClients[i].samples = 0;
+        mClients[i].lastTime = 0;
+        mClients[i].kept = 0;
+        mClients[i].steps = 0;
+    }
+}
+
+static void batchSamples(uint32_t n)
+{
+    struct TripleAxisDataPoint point;
+    uint32_t i;
+
+    for (i = 0; i < n; i++) {
+        memset(&point, 0, sizeof(point));
+        point.ix = i;
+        expect(sensorBatchSample(mAccel, timGetTime() - (n - i) * 20 * MS, &point.x), "sample not taken", "batch");
+    }
+    hostOsRunAll();
+}
+
+static void testBatchLatency(void)
+{
+    uint64_t start;
+
+    resetClients();
+    expect(sensorRequest(mClients[0].tid, mAccel, SENSOR_HZ(50), 1000 * MS), "request refused", "batch");
+    hostOsRunAll();
+
+    //held for client 0's second
+    start = timGetTime();
+    batchSamples(5);
+    hostOsRunUntil(start + 900 * MS);
+    expect(!mClients[0].events, "delivered before the latency was up", "batch");
+    hostOsRunUntil(start + 1000 * MS);
+    expect(mClients[0].events == 1 && mClients[0].samples == 5 && mClients[0].lastTime == start + 1000 * MS,
+           "not delivered when the latency was up", "batch");
+
+    //client 1 wants 200ms while a batch waits: it must not wait for the old deadline
+    resetClients();
+    start = timGetTime();
+    batchSamples(5);
+    hostOsRunUntil(start + 100 * MS);
+    expect(sensorRequest(mClients[1].tid, mAccel, SENSOR_HZ(50), 200 * MS), "request refused", "batch");
+    hostOsRunUntil(start + 150 * MS);
+    expect(!mClients[1].events, "delivered before the new latency was up", "batch");
+    hostOsRunUntil(start + 250 * MS);
+    expect(mClients[0].events == 1 && mClients[1].events == 1 && mClients[1].samples == 5 && mClients[1].lastTime == start + 200 * MS,
+           "tighter latency did not pull the delivery in", "batch");
+
+    //a flush sends what is held right away
+    resetClients();
+    batchSamples(3);
+    expect(!mClients[1].events, "delivered before the latency was up", "flush");
+    expect(sensorBatchFlush(mAccel), "flush failed", "flush");
+    hostOsRunAll();
+    expect(mClients[0].samples == 3 && mClients[1].samples == 3, "flush did not deliver", "flush");
+
+    //back to client 0's second once client 1 leaves
+    resetClients();
+    start = timGetTime();
+    batchSamples(2);
+    expect(sensorRelease(mClients[1].tid, mAccel), "release refused", "batch");
+    hostOsRunUntil(start + 500 * MS);
+    expect(!mClients[0].events, "delivered on the released latency", "batch");
+    hostOsRunUntil(start + 1000 * MS);
+    expect(mClients[0].samples == 2, "not delivered when the latency was up", "batch");
+
+    expect(sensorRelease(mClients[0].tid, mAccel), "release refused", "batch");
+    hostOsRunAll();
+}
+
+static void expectHw(uint32_t rate, uint64_t latency, const char *ctx)
+{
+    hostOsRunAll();
+    expect(sensorGetCurRate(mAccel) == rate, "wrong hw rate", ctx);
+    expect(sensorGetCurLatency(mAccel) == latency, "wrong hw latency", ctx);
+}
+
+static void testRequests(void)
+{
+    uint32_t i;
+
+    //the list puts the newest first, so REQUEST_TID is last
+    for (i = 0; i < NUM_REQUESTS; i++)
+        expect(sensorRequest(REQUEST_TID + i, mAccel, SENSOR_HZ(25), (2000 + i) * MS), "request refused", "requests");
+    expectHw(SENSOR_HZ(25), 2000 * MS, "requests");
+
+    //one in the middle asks for more, and gets it back when it leaves
+    expect(sensorRequestRateChange(REQUEST_TID + 40, mAccel, SENSOR_HZ(100), 500 * MS), "amend refused", "amend");
+    expectHw(SENSOR_HZ(100), 500 * MS, "amend");
+    expect(sensorRelease(REQUEST_TID + 40, mAccel), "release refused", "delete");
+    expectHw(SENSOR_HZ(25), 2000 * MS, "delete");
+    expect(!sensorRelease(REQUEST_TID + 40, mAccel), "released twice", "delete");
+    expect(!sensorRequestRateChange(REQUEST_TID + 40, mAccel, SENSOR_HZ(50), 500 * MS), "amended once released", "delete");
+    expect(!sensorRequestRateChange(REQUEST_TID + NUM_REQUESTS, mAccel, SENSOR_HZ(50), 500 * MS), "amended without a request", "amend");
+
+    //the last and the first of the list
+    expect(sensorRelease(REQUEST_TID, mAccel), "release refused", "delete last");
+    expectHw(SENSOR_HZ(25), 2001 * MS, "delete last");
+    expect(sensorRelease(REQUEST_TID + NUM_REQUESTS - 1, mAccel), "release refused", "delete first");
+    expect(sensorRequestRateChange(REQUEST_TID + NUM_REQUESTS - 2, mAccel, SENSOR_HZ(50), 1500 * MS), "amend refused", "amend first");
+    expect(sensorRequestRateChange(REQUEST_TID + 1, mAccel, SENSOR_HZ(25), 3000 * MS), "amend refused", "amend last");
+    expectHw(SENSOR_HZ(50), 1500 * MS, "amend");
+
+    //everyone else, then the sensor goes off
+    for (i = 1; i < NUM_REQUESTS - 1; i++)
+        expect(sensorRelease(REQUEST_TID + i, mAccel) == (i != 40), "wrong release", "delete all");
+    hostOsRunAll();
+    expect(!sensorGetCurRate(mAccel), "still on", "delete all");
+}
+
+//gyro sample k is k, -k, 2k at k * GYRO_PERIOD
+static void gyroEmit(uint32_t n)
+{
+    struct TripleAxisDataEvent *triple = heapAlloc(sizeof(*triple) + n * sizeof(triple->samples[0]));
+    uint32_t i;
+
+    memset(triple, 0, sizeof(*triple) + n * sizeof(triple->samples[0]));
+    triple->referenceTime = mGyroSeq * GYRO_PERIOD;
+    triple->samples[0].firstSample.numSamples = n;
+    for (i = 0; i < n; i++, mGyroSeq++) {
+        if (i)
+            triple->samples[i].deltaTime = GYRO_PERIOD;
+        triple->samples[i].x = mGyroSeq;
+        triple->samples[i].y = -(float)mGyroSeq;
+        triple->samples[i].z = 2.0f * mGyroSeq;
+    }
+    osEnqueueEvt(sensorGetMyEventType(SENS_TYPE_GYRO), triple, heapFree);
+    hostOsRunAll();
+}
+
+//what a client at 100Hz / ratio got: each kept sample is the mean of the ratio ending at it
+static void expectAveraged(const struct Client *c, uint32_t from, uint32_t firstSeq, uint32_t ratio, uint32_t n, const char *ctx)
+{
+    uint32_t i, last;
+
+    expect(c->kept == from + n, "wrong number of samples", ctx);
+    for (i = 0; i < n && from + i < c->kept; i++) {
+        last = firstSeq + (i + 1) * ratio - 1;
+        expect(c->keptX[from + i] == last - (ratio - 1) / 2.0f, "wrong average", ctx);
+        expect(c->keptTime[from + i] == last * GYRO_PERIOD, "wrong sample time", ctx);
+    }
+}
+
+static void testDecimation(void)
+{
+    struct TripleAxisDataEvent *triple;
+    const struct TripleAxisDataEvent *out;
+    uint32_t i, k, n;
+    uint64_t time;
+
+    resetClients();
+    mGyroSeq = 0;
+    expect(sensorRequest(mClients[0].tid, mGyro, SENSOR_HZ(100), 0), "request refused", "decimation");
+    expect(sensorRequest(mClients[1].tid, mGyro, SENSOR_HZ(25), 0), "request refused", "decimation");
+    hostOsRunAll();
+    expect(sensorGetCurRate(mGyro) == SENSOR_HZ(100), "wrong hw rate", "decimation");
+
+    //one in four, the phase running on from one 10-sample event to the next
+    for (i = 0; i < 5; i++)
+        gyroEmit(10);
+    expectAveraged(mClients + 0, 0, 0, 1, 50, "full rate");
+    expectAveraged(mClients + 1, 0, 0, 4, 12, "quarter rate");
+
+    //a new rate starts over, without the two samples left over from the old one
+    expect(sensorRequestRateChange(mClients[1].tid, mGyro, SENSOR_HZ(50), 0), "amend refused", "decimation");
+    hostOsRunAll();
+    gyroEmit(10);
+    gyroEmit(10);
+    expectAveraged(mClients + 1, 12, 50, 2, 10, "half rate");
+
+    expect(sensorRelease(mClients[0].tid, mGyro) && sensorRelease(mClients[1].tid, mGyro), "release refused", "decimation");
+    hostOsRunAll();
+
+    //plain picks at an uneven ratio, straight through sensorDecimateForClient; the bias sample is not one of them
+    expect(sensorRequest(REQUEST_TID, mAccel, SENSOR_HZ(30), 0), "request refused", "decimation");
+    hostOsRunAll();
+    expect(sensorGetCurRate(mAccel) == SENSOR_HZ(50), "wrong hw rate", "decimation");
+
+    n = 100;
+    triple = heapAlloc(sizeof(*triple) + n * sizeof(triple->samples[0]));
+    memset(triple, 0, sizeof(*triple) + n * sizeof(triple->samples[0]));
+    triple->referenceTime = 1000 * MS;
+    triple->samples[0].firstSample.numSamples = n;
+    triple->samples[0].firstSample.biasPresent = 1;
+    triple->samples[0].firstSample.biasSample = 1;
+    for (i = 0; i < n; i++) {
+        if (i)
+            triple->samples[i].deltaTime = 20 * MS;
+        triple->samples[i].ix = i;
+    }
+
+    expect(sensorDecimateForClient(REQUEST_TID + 1, sensorGetMyEventType(SENS_TYPE_ACCEL), triple) == triple,
+           "decimated for a client without a request", "decimation");
+    out = sensorDecimateForClient(REQUEST_TID, sensorGetMyEventType(SENS_TYPE_ACCEL), triple);
+    expect(out && out != triple && out->samples[0].firstSample.numSamples == 60, "wrong number of samples", "uneven");
+    if (out && out != triple) {
+        expect(out->samples[0].firstSample.biasPresent && out->samples[out->samples[0].firstSample.biasSample].ix == 1,
+               "bias sample dropped", "uneven");
+        for (i = 0, k = 0, time = out->referenceTime; i < out->samples[0].firstSample.numSamples; i++) {
+            if (i)
+                time += out->samples[i].deltaTime;
+            expect((uint32_t)out->samples[i].ix < n && (!i || (uint32_t)out->samples[i].ix > k), "samples out of order", "uneven");
+            expect(time == triple->referenceTime + out->samples[i].ix * 20 * MS, "wrong sample time", "uneven");
+            k = out->samples[i].ix;
+        }
+    }
+    heapFree(triple);
+
+    expect(sensorRelease(REQUEST_TID, mAccel), "release refused", "decimation");
+    hostOsRunAll();
+
+    //a step counter value of 0 is NULL event data, and must still be delivered
+    resetClients();
+    osEnqueueEvt(sensorGetMyEventType(SENS_TYPE_STEP_COUNT), NULL, NULL);
+    hostOsRunAll();
+    expect(mClients[0].steps == 1 && mClients[1].steps == 1 && !mClients[1].lastStep, "event without data not delivered", "null");
+    osEnqueueEvt(sensorGetMyEventType(SENS_TYPE_STEP_COUNT), (void *)7, NULL);
+    hostOsRunAll();
+    expect(mClients[0].steps == 2 && mClients[1].steps == 2 && mClients[1].lastStep == 7, "event not delivered", "null");
+}
+
+//the handles sensorFind gives for a type, in order, match handles[] where keep[] is set
+static void expectFind(uint32_t sensorType, const uint32_t *handles, const bool *keep, uint32_t n, const char *ctx)
+{
+    uint32_t i, idx, handle;
+
+    for (i = 0, idx = 0; i < n; i++) {
+        if (!keep[i])
+            continue;
+        expect(sensorFind(sensorType, idx++, &handle) && handle == handles[i], "wrong sensor found", ctx);
+    }
+    expect(!sensorFind(sensorType, idx, &handle), "too many sensors found", ctx);
+}
+
+static void testRegistry(void)
+{
+    uint32_t handles[MAX_REGISTERED_SENSORS];
+    bool als[MAX_REGISTERED_SENSORS], hall[MAX_REGISTERED_SENSORS];
+    uint32_t i, n, stale, handle;
+
+    //every slot left, the two types interleaved
+    for (n = 0; n < MAX_REGISTERED_SENSORS; n++) {
+        als[n] = n % 3 != 1;
+        hall[n] = !als[n];
+        handles[n] = sensorRegister(als[n] ? &mAlsInfo : &mHallInfo, &mAccelOps, handles + n, true);
+        if (!handles[n])
+            break;
+    }
+    expect(n == MAX_REGISTERED_SENSORS - 2, "could not fill every slot", "registry");
+    if (n != MAX_REGISTERED_SENSORS - 2)
+        return;     //a slot handed out twice would loop its type chain
+    expectFind(SENS_TYPE_ALS, handles, als, n, "registry");
+    expectFind(SENS_TYPE_HALL, handles, hall, n, "registry");
+    expect(!sensorFind(SENS_TYPE_PROX, 0, &handle) && !sensorFind(300, 0, &handle), "found a type never registered", "registry");
+
+    //the only free slot goes to a sensor of the other type
+    stale = handles[0];
+    expect(sensorUnregister(stale), "unregister failed", "stale");
+    handles[0] = sensorRegister(&mHallInfo, &mAccelOps, handles, true);
+    als[0] = false;
+    hall[0] = true;
+    expect(handles[0] && handles[0] != stale, "handle reused", "stale");
+    expect(!sensorRegister(&mHallInfo, &mAccelOps, &handle, true), "registered with no slot free", "stale");
+    expectFind(SENS_TYPE_ALS, handles, als, n, "stale");
+    expectFind(SENS_TYPE_HALL, handles, hall, n, "stale");
+
+    expect(sensorRequest(mClients[0].tid, handles[0], SENSOR_HZ(25), 0), "request refused", "stale");
+    hostOsRunAll();
+    expect(sensorGetCurRate(handles[0]) == SENSOR_HZ(25), "wrong hw rate", "stale");
+
+    //nothing reaches the new sensor through the old handle
+    expect(!sensorRequest(mClients[1].tid, stale, SENSOR_HZ(50), 0), "request on a stale handle", "stale");
+    expect(!sensorRequestRateChange(mClients[0].tid, stale, SENSOR_HZ(50), 0), "amend on a stale handle", "stale");
+    expect(!sensorRelease(mClients[0].tid, stale), "release on a stale handle", "stale");
+    expect(!sensorGetCurRate(stale) && !sensorGetInitComplete(stale), "state of a stale handle", "stale");
+    expect(!sensorRegisterInitComplete(stale) && !sensorFlush(stale) && !sensorCalibrate(stale), "call on a stale handle", "stale");
+    expect(!sensorUnregister(stale), "unregistered a stale handle", "stale");
+    hostOsRunAll();
+    expect(sensorGetCurRate(handles[0]) == SENSOR_HZ(25), "stale handle changed its successor", "stale");
+    expectFind(SENS_TYPE_HALL, handles, hall, n, "stale");
+    expect(sensorRelease(mClients[0].tid, handles[0]), "release refused", "stale");
+    hostOsRunAll();
+
+    //holes in both chains, their first and last included
+    for (i = 0; i < n; i++) {
+        if (i % 2 && i != n - 1)
+            continue;
+        expect(sensorUnregister(handles[i]), "unregister failed", "holes");
+        als[i] = hall[i] = false;
+    }
+    expectFind(SENS_TYPE_ALS, handles, als, n, "holes");
+    expectFind(SENS_TYPE_HALL, handles, hall, n, "holes");
+
+    for (i = 0; i < n; i++)
+        expect((als[i] || hall[i]) == sensorUnregister(handles[i]), "wrong unregister", "cleanup");
+    expect(!sensorFind(SENS_TYPE_ALS, 0, &handle) && !sensorFind(SENS_TYPE_HALL, 0, &handle), "sensors left", "cleanup");
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t i;
+
+    sensorsInit();
+    mAccel = sensorRegister(&mAccelInfo, &mAccelOps, &mAccel, true);
+    expect(mAccel != 0, "register failed", "setup");
+    mGyro = sensorRegister(&mGyroInfo, &mAccelOps, &mGyro, true);   //the accel ops only use the cookie
+    expect(mGyro != 0, "register failed", "setup");
+
+    for (i = 0; i < NUM_CLIENTS; i++) {
+        mClients[i].tid = hostOsStartApp(mClientApps + i);
+        expect(mClients[i].tid != 0, "client did not start", "setup");
+    }
+    hostOsRunAll();
+
+    testBatchLatency();
+    testRequests();
+    testDecimation();
+    testRegistry();
+
+    printf("sensors_test: %s\n", mFailed ? "FAILED" : "ok");
+
+    return mFailed ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <sha2.h>
+
+/*
+ * SHA-256 known answers for lengths around the padding and block edges and
+ * one large input, each hashed in one go and fed in odd-sized chunks so
+ * partial blocks, whole blocks straight from the caller's buffer and the
+ * tails between them all get used. The answers were made with Python's
+ * hashlib. Built twice: sha2_test with the portable core and sha2_test_shani
+ * with -msha, which skips if the cpu has no SHA extensions.
+ */
+
+#define NUM_SPLITS      20
+#define MAX_LEN         100003
+
+struct KnownAnswer {
+    uint32_t len;
+    uint32_t hash[SHA2_HASH_WORDS];
+};
+
+//input byte i is (i * 7 + (i >> 7) * 13) & 0xff
+static const struct KnownAnswer mAnswers[] = {
+    {      0, { 0xe3b0c442, 0x98fc1c14, 0x9afbf4c8, 0x996fb924, 0x27ae41e4, 0x649b934c, 0xa495991b, 0x7852b855 } },
+    {      1, { 0x6e340b9c, 0xffb37a98, 0x9ca544e6, 0xbb780a2c, 0x78901d3f, 0xb3373876, 0x8511a306, 0x17afa01d } },
+    {     55, { 0x576a1bf8, 0xd4478657, 0xe6dc4af9, 0x39854476, 0x5c2a92cd, 0xe28478b0, 0x19235cfe, 0xd315fc09 } },
+    {     56, { 0x9b20501d, 0xfd1d9916, 0x1c257950, 0xf3444f3e, 0x49230c35, 0x1c5c8e09, 0x43ef369f, 0x85f5205d } },
+    {     57, { 0xa5534a9d, 0x0694341d, 0xfde5b1bb, 0x3d8addcb, 0x38bd46f4, 0x4a629dc9, 0x7b3f8fb2, 0x721b0720 } },
+    {     63, { 0x30b34590, 0x6b493f06, 0xf69444b6, 0x52111351, 0x1c242f30, 0xe2984046, 0x29500350, 0x43682f1e } },
+    {     64, { 0xd8bc63b4, 0xfc1156e5, 0xe7d95a41, 0x8b9bf54c, 0xd3174bed, 0xbc2db40f, 0x74895349, 0xb229b3c0 } },
+    {     65, { 0x1ee23b0f, 0xbcaecc1a, 0xff4a9e8f, 0x1645f35a, 0xb2c8e136, 0x09cd73b6, 0x8df8b5e3, 0xf63ce073 } },
+    {    127, { 0x67d79933, 0xe3c9aa8e, 0x89f481e0, 0x71cfca1e, 0x9a16c09d, 0x7263b5ef, 0xa3bb01f1, 0xa9f8d065 } },
+    {    128, { 0x54c9eb04, 0x1badfd70, 0x64645067, 0xb107661f, 0xed611319, 0x7ce2dd06, 0x6ba69618, 0xabd3732f } },
+    {    129, { 0x8cb477af, 0xb05269d2, 0xbb1b3561, 0xf478009d, 0xcfde4c00, 0x08fff716, 0x0e101d71, 0xed3afbff } },
+    { MAX_LEN, { 0x9b4ec7b9, 0xb3f59bdd, 0xcfff16f2, 0x475335cf, 0xf1a2a3e7, 0x538f4a8b, 0xd0cbfa2d, 0x2e7b21c2 } },
+};
+
+//FIPS 180-2 appendix B.1
+static const uint32_t mAbcHash[SHA2_HASH_WORDS] = {
+    0xba7816bf, 0x8f01cfea, 0x414140de, 0x5dae2223, 0xb00361a3, 0x96177a9c, 0xb410ff61, 0xf20015ad,
+};
+
+static uint8_t mData[MAX_LEN];
+static unsigned mChecks, mFailed;
+static uint32_t mRand = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    mRand = mRand * 1103515245 + 12345;
+    return (mRand >> 8) % n;
+}
+
+static void check(const uint32_t *hash, const uint32_t *expected, uint32_t len, const char *how)
+{
+    mChecks++;
+    if (memcmp(hash, expected, SHA2_HASH_SIZE)) {
+        fprintf(stderr, "sha2_test: wrong hash of %u bytes (%s)\n", len, how);
+        mFailed++;
+    }
+}
+
+static void testAnswer(const struct KnownAnswer *ka)
+{
+    struct Sha2state state;
+    uint32_t split, pos, chunk;
+
+    sha2init(&state);
+    sha2processBytes(&state, mData, ka->len);
+    check(sha2finish(&state), ka->hash, ka->len, "one go");
+
+    //odd chunks up to a few blocks, sometimes from an odd address
+    for (split = 0; split < NUM_SPLITS; split++) {
+        sha2init(&state);
+        for (pos = 0; pos < ka->len; pos += chunk) {
+            chunk = 2 * rnd(split < NUM_SPLITS / 2 ? 8 : 2 * SHA2_BLOCK_SIZE) + 1;
+            if (chunk > ka->len - pos)
+                chunk = ka->len - pos;
+            sha2processBytes(&state, mData + pos, chunk);
+        }
+        check(sha2finish(&state), ka->hash, ka->len, "odd chunks");
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct Sha2state state;
+    uint32_t i;
+
+    if (argc > 1)
+        mRand = strtoul(argv[1], NULL, 0);
+
+#ifdef __SHA__
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("sha")) {
+        printf("sha2_test: sha-ni: no SHA extensions on this cpu, skipped\n");
+        return 0;
+    }
+#endif
+
+    for (i = 0; i < MAX_LEN; i++)
+        mData[i] = i * 7 + (i >> 7) * 13;
+
+    sha2init(&state);
+    sha2processBytes(&state, "abc", 3);
+    check(sha2finish(&state), mAbcHash, 3, "abc");
+
+    for (i = 0; i < sizeof(mAnswers) / sizeof(mAnswers[0]); i++)
+        testAnswer(mAnswers + i);
+
+#ifdef __SHA__
+    printf("sha2_test: sha-ni: %u hashes checked, %s\n", mChecks, mFailed ? "FAILED" : "ok");
+#else
+    printf("sha2_test: %u hashes checked, %s\n", mChecks, mFailed ? "FAILED" : "ok");
+#endif
+
+    return mFailed ? 1 : 0;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/*
+ * Simulated AP/hub clock pairs through addDelta/getDelta. The AP clock runs
+ * at a set drift from the hub's; every request is timestamped by the AP when
+ * sent and by the hub some bus and scheduling jitter later. Checks that the
+ * fit tracks drift to within twice the jitter, that the skew is clamped to 500ppm,
+ * that single samples over 2ms off are dropped and that 4 in a row restart
+ * the fit.
+ */
+
+#include "../../firmware/src/nanohubCommand.c"
+
+#define MS                  1000000ULL
+#define REQ_INTERVAL        (100 * MS)
+#define MAX_JITTER          500000ULL   //0.5ms
+#define AP_OFFSET           (1000000 * MS)
+#define NUM_REQUESTS        1000
+
+struct Clocks {
+    uint64_t hub;           //true time, the hub clock has no error
+    int64_t apStep;         //AP clock jumps
+    double driftPpm;
+};
+
+static unsigned mFailed;
+static uint32_t mRand = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    mRand = mRand * 1103515245 + 12345;
+    return ((mRand >> 8) & 0xFFFFFF) % n;
+}
+
+static uint64_t apAt(const struct Clocks *clk, uint64_t hub)
+{
+    return AP_OFFSET + clk->apStep + hub + (int64_t)(hub * clk->driftPpm / 1e6);
+}
+
+//one READ_EVENT request, extraHubDelay on top of the usual jitter
+static void request(struct TimeSync *sync, struct Clocks *clk, uint64_t extraHubDelay)
+{
+    uint64_t ap;
+
+    clk->hub += REQ_INTERVAL - MAX_JITTER + rnd(2 * MAX_JITTER);
+    ap = apAt(clk, clk->hub);
+    addDelta(sync, ap, clk->hub + rnd(MAX_JITTER) + extraHubDelay);
+}
+
+//how far the AP time we would put on an event at hub time t is from the truth
+static int64_t error(struct TimeSync *sync, const struct Clocks *clk, uint64_t t)
+{
+    return (int64_t)(t + getDelta(sync, t) - apAt(clk, t));
+}
+
+static void expect(bool ok, const char *what, double drift)
+{
+    if (!ok) {
+        fprintf(stderr, "time_sync_test: %s (drift %.0fppm)\n", what, drift);
+        mFailed++;
+    }
+}
+
+static bool within(int64_t v, int64_t limit)
+{
+    return v <= limit && v >= -limit;
+}
+
+static void tracksDrift(double drift)
+{
+    struct TimeSync sync = {};
+    struct Clocks clk = {.hub = 5000 * MS, .driftPpm = drift};
+    int64_t worst = 0, e;
+    double skewSum = 0;
+    uint32_t i;
+
+    for (i = 0; i < SYNC_DATAPOINTS; i++)
+        request(&sync, &clk, 0);
+
+    for (i = 0; i < NUM_REQUESTS; i++) {
+        request(&sync, &clk, 0);
+        //events are stamped between requests, up to a second after the last one
+        e = error(&sync, &clk, clk.hub + rnd(1000) * MS);
+        if (e > worst || -e > worst)
+            worst = e > 0 ? e : -e;
+        skewSum += sync.skew;
+    }
+
+    //one window's skew is only good to about 100ppm with this much jitter, but it must not be biased
+    expect(within(worst, 2 * MAX_JITTER), "error beyond twice the jitter", drift);
+    if (drift > -400 && drift < 400)
+        expect(within((int64_t)(skewSum / NUM_REQUESTS * 1e6 - drift), 20), "skew biased", drift);
+    printf("time_sync_test: drift %5.0fppm, mean skew %6.1fppm, worst error %3lld us\n", drift,
+           skewSum / NUM_REQUESTS * 1e6, (long long)(worst / 1000));
+}
+
+static void clampsSkew(double drift)
+{
+    struct TimeSync sync = {};
+    struct Clocks clk = {.hub = 5000 * MS, .driftPpm = drift};
+    uint32_t i;
+
+    for (i = 0; i < 3 * SYNC_DATAPOINTS; i++)
+        request(&sync, &clk, 0);
+    getDelta(&sync, clk.hub);
+
+    expect(sync.skew == (drift > 0 ? SYNC_MAX_SKEW : -SYNC_MAX_SKEW), "skew not clamped", drift);
+}
+
+static void dropsOutliers(void)
+{
+    struct TimeSync sync = {};
+    struct Clocks clk = {.hub = 5000 * MS, .driftPpm = 50};
+    uint64_t at, before;
+    uint8_t cnt, tail;
+    uint32_t i;
+
+    for (i = 0; i < SYNC_DATAPOINTS; i++)
+        request(&sync, &clk, 0);
+
+    //a request held up 3ms on the hub is not drift
+    cnt = sync.cnt;
+    tail = sync.tail;
+    at = clk.hub + 1000 * MS;
+    before = getDelta(&sync, at);
+    request(&sync, &clk, 3 * MS);
+    expect(sync.tail == tail && sync.cnt == cnt && sync.outliers == 1, "3ms late sample kept", 50);
+    expect(getDelta(&sync, at) == before, "fit moved by a dropped sample", 50);
+
+    //one that is 1ms late is within the fit's tolerance
+    request(&sync, &clk, 1 * MS);
+    expect(sync.tail == (tail + 1) % SYNC_DATAPOINTS && sync.outliers == 0, "1ms late sample dropped", 50);
+
+    //three outliers in a row are still dropped, a good one in between clears the count
+    for (i = 0; i < SYNC_MAX_OUTLIERS - 1; i++)
+        request(&sync, &clk, 3 * MS);
+    expect(sync.outliers == SYNC_MAX_OUTLIERS - 1 && sync.cnt == SYNC_DATAPOINTS, "outliers not dropped", 50);
+    request(&sync, &clk, 0);
+    expect(sync.outliers == 0, "outlier count not cleared", 50);
+}
+
+static void restartsOnJump(void)
+{
+    struct TimeSync sync = {};
+    struct Clocks clk = {.hub = 5000 * MS, .driftPpm = -80};
+    uint32_t i;
+
+    for (i = 0; i < SYNC_DATAPOINTS; i++)
+        request(&sync, &clk, 0);
+
+    //the AP clock is set forward 50ms: the first 3 samples look like outliers, the 4th starts over
+    clk.apStep = 50 * MS;
+    for (i = 0; i < SYNC_MAX_OUTLIERS - 1; i++) {
+        request(&sync, &clk, 0);
+        expect(sync.cnt == SYNC_DATAPOINTS, "fit restarted too early", -80);
+    }
+    request(&sync, &clk, 0);
+    expect(sync.cnt == 1 && sync.outliers == 0, "fit not restarted after 4 outliers", -80);
+
+    for (i = 0; i < SYNC_MIN_FIT; i++)
+        request(&sync, &clk, 0);
+    expect(within(error(&sync, &clk, clk.hub), MAX_JITTER), "new offset not picked up", -80);
+
+    //and an AP reboot starts over at once
+    clk.apStep = -(int64_t)AP_OFFSET + 10 * MS;
+    request(&sync, &clk, 0);
+    expect(sync.cnt == 1, "fit kept across an AP reboot", -80);
+}
+
+int main(int argc, char **argv)
+{
+    static const double drifts[] = {0, 20, -20, 100, -100, 300, -450};
+    uint32_t i;
+
+    if (argc > 1)
+        mRand = strtoul(argv[1], NULL, 0);
+
+    for (i = 0; i < sizeof(drifts) / sizeof(drifts[0]); i++)
+        tracksDrift(drifts[i]);
+    clampsSkew(2000);
+    clampsSkew(-800);
+    dropsOutliers();
+    restartsOnJump();
+
+    printf("time_sync_test: %s\n", mFailed ? "FAILED" : "ok");
+
+    return mFailed ? 1 : 0;
+}
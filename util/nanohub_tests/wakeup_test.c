@@ -0,0 +1,417 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include <apInt.h>
+#include <heap.h>
+#include <hostIntf.h>
+#include <hostIntf_priv.h>
+#include <nanohubPacket.h>
+#include <sensors.h>
+#include <seos.h>
+#include <timer.h>
+
+#include "host_os.h"
+
+/*
+ * Runs batching sensors with similar latencies on the wakeup interrupt through
+ * the real hostIntf for ten minutes of hub time. The AP wakes when the
+ * interrupt goes up and drains everything queued, as the kernel driver does.
+ * Next to hostIntf, a second app applies the old per-sensor rule (each sensor
+ * raises the interrupt on its own latency timeline) to the same events. Prints
+ * the AP wakeups per minute of both; coalescing must at least halve them while
+ * every sample still reaches the AP within its latency.
+ */
+
+#define MS                  1000000ULL
+#define RUN_TIME            (600000 * MS)
+#define MINUTE              (60000 * MS)
+
+extern const struct AppFuncs gHostIntfApp;
+
+//the AP side's idea of the hostIntf config event
+struct ConfigCmd {
+    uint64_t latency;
+    uint32_t rate;
+    uint8_t sensType;
+    uint8_t enabled : 1;
+    uint8_t flush : 1;
+    uint8_t calibrate : 1;
+    uint8_t compact : 1;
+    uint8_t reserved : 4;
+} __attribute__((packed));
+
+//the AP side's idea of a dequeued hostIntf packet
+struct ApPacket {
+    uint8_t sensType;
+    uint8_t length;
+    uint16_t pad;
+    uint64_t referenceTime;
+    union {
+        struct SensorFirstSample firstSample;
+        struct SingleAxisDataPoint single[NANOHUB_SENSOR_DATA_MAX / sizeof(struct SingleAxisDataPoint)];
+        struct TripleAxisDataPoint triple[NANOHUB_SENSOR_DATA_MAX / sizeof(struct TripleAxisDataPoint)];
+    };
+} __attribute__((packed));
+
+struct Source {
+    struct SensorInfo info;
+    uint32_t rates[2];
+    uint64_t period;        //hw FIFO delivery, also the latency the driver reports
+    uint32_t samplesPerEvt;
+    uint64_t latency;       //what the AP asks for
+    uint32_t handle;
+    uint32_t timer;
+    uint32_t emitted;
+    uint32_t received;
+    uint64_t maxWait;       //longest a sample took to reach the AP
+    uint64_t oldLastInterrupt;
+};
+
+//periods that drift against each other, and a slow sensor that only rides along
+static struct Source mSources[] = {
+    { .info = { .sensorName = "Accel", .sensorType = SENS_TYPE_ACCEL, .numAxis = NUM_AXIS_THREE, .interrupt = NANOHUB_INT_WAKEUP, .minSamples = 300 },
+      .rates = { SENSOR_HZ(50) }, .period = 200 * MS, .samplesPerEvt = 10, .latency = 1000 * MS },
+    { .info = { .sensorName = "Gyro", .sensorType = SENS_TYPE_GYRO, .numAxis = NUM_AXIS_THREE, .interrupt = NANOHUB_INT_WAKEUP, .minSamples = 300 },
+      .rates = { SENSOR_HZ(50) }, .period = 160 * MS, .samplesPerEvt = 8, .latency = 1000 * MS },
+    { .info = { .sensorName = "Mag", .sensorType = SENS_TYPE_MAG, .numAxis = NUM_AXIS_THREE, .interrupt = NANOHUB_INT_WAKEUP, .minSamples = 300 },
+      .rates = { SENSOR_HZ(25) }, .period = 240 * MS, .samplesPerEvt = 6, .latency = 1100 * MS },
+    { .info = { .sensorName = "Baro", .sensorType = SENS_TYPE_BARO, .numAxis = NUM_AXIS_ONE, .interrupt = NANOHUB_INT_WAKEUP, .minSamples = 300 },
+      .rates = { SENSOR_HZ(10) }, .period = 500 * MS, .samplesPerEvt = 5, .latency = 5000 * MS },
+};
+
+#define NUM_SOURCES (sizeof(mSources) / sizeof(mSources[0]))
+
+static bool mApAwake;
+static uint32_t mWakeups;       //with hostIntf coalescing
+static uint32_t mOldWakeups;    //with the old per-sensor rule
+static uint64_t mOldLastWake = UINT64_MAX;
+
+static unsigned mFailed;
+static uint32_t mRand = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    mRand = mRand * 1103515245 + 12345;
+    return ((mRand >> 8) & 0xFFFFFF) % n;
+}
+
+static void expect(bool ok, const char *what, const char *ctx)
+{
+    if (!ok) {
+        fprintf(stderr, "wakeup_test: %s (%s)\n", what, ctx);
+        mFailed++;
+    }
+}
+
+static struct Source *findSource(uint32_t sensType)
+{
+    uint32_t i;
+
+    for (i = 0; i < NUM_SOURCES; i++)
+        if (mSources[i].info.sensorType == sensType)
+            return mSources + i;
+
+    return NULL;
+}
+
+//everything queued, oldest first
+static void apReadAll(void)
+{
+    struct ApPacket packet;
+    struct Source *src;
+    uint64_t now = timGetTime(), time;
+    uint32_t i, n;
+
+    while (hostIntfPacketDequeue(&packet, sizeof(packet))) {
+        src = findSource(packet.sensType);
+        expect(src != NULL, "not a source packet", "ap");
+        if (!src)
+            continue;
+
+        n = packet.firstSample.numSamples;
+        for (i = 0, time = packet.referenceTime; i < n; i++) {
+            if (i)
+                time += src->info.numAxis == NUM_AXIS_ONE ? packet.single[i].deltaTime : packet.triple[i].deltaTime;
+            if (now - time > src->maxWait)
+                src->maxWait = now - time;
+        }
+        src->received += n;
+    }
+}
+
+//the AP reads the interrupt bits, then everything queued, then goes back to sleep
+static void apWake(void *cookie)
+{
+    ATOMIC_BITSET_DECL(interrupts, MAX_INTERRUPTS,);
+
+    hostIntfCopyClearInterrupts(interrupts, MAX_INTERRUPTS);
+    expect(atomicBitsetGetBit(interrupts, NANOHUB_INT_WAKEUP), "woken without the wakeup interrupt", "ap");
+    apReadAll();
+    mApAwake = false;
+}
+
+void apIntSet(bool wakeup)
+{
+    if (wakeup && !mApAwake) {
+        mApAwake = true;
+        mWakeups++;
+        osDefer(apWake, NULL, false);
+    }
+}
+
+void apIntClear(bool wakeup)
+{
+}
+
+static int commRequest(void)
+{
+    return 0;
+}
+
+static int commRxPacket(void *rxBuf, size_t rxSize, HostIntfCommCallbackF callback)
+{
+    return 0;
+}
+
+static int commTxPacket(const void *txBuf, size_t txSize, HostIntfCommCallbackF callback)
+{
+    return 0;
+}
+
+static int commRelease(void)
+{
+    return 0;
+}
+
+static const struct HostIntfComm mComm = {
+    .request = commRequest,
+    .rxPacket = commRxPacket,
+    .txPacket = commTxPacket,
+    .release = commRelease,
+};
+
+const struct HostIntfComm *platHostIntfInit()
+{
+    return &mComm;
+}
+
+/*
+ * What hostIntf did before coalescing, for each sensor on its own: raise once
+ * its latency is up, or if the next hw delivery would come too late, and move
+ * its own window on by one latency. Raises at the same moment wake the AP once.
+ */
+static void oldRuleHandleEvent(uint32_t evtType, const void *evtData)
+{
+    struct Source *src;
+    uint64_t now = timGetTime(), hwLatency;
+
+    if (evtType <= EVT_NO_FIRST_SENSOR_EVENT || evtType >= EVT_NO_SENSOR_CONFIG_EVENT || evtData == SENSOR_DATA_EVENT_FLUSH)
+        return;
+    if (!(src = findSource(evtType - EVT_NO_FIRST_SENSOR_EVENT)))
+        return;
+
+    hwLatency = sensorGetCurLatency(src->handle);
+    if (now >= src->oldLastInterrupt + src->latency ||
+        (src->latency > hwLatency && now + hwLatency > src->oldLastInterrupt + src->latency)) {
+        if (now != mOldLastWake)
+            mOldWakeups++;
+        mOldLastWake = now;
+        src->oldLastInterrupt += src->latency;
+    }
+}
+
+static bool oldRuleStart(uint32_t tid)
+{
+    uint32_t i;
+
+    for (i = 0; i < NUM_SOURCES; i++)
+        osEventSubscribe(tid, sensorGetMyEventType(mSources[i].info.sensorType));
+
+    return true;
+}
+
+static void oldRuleEnd(void)
+{
+}
+
+static const struct AppFuncs mOldRuleApp = {
+    .init = oldRuleStart,
+    .end = oldRuleEnd,
+    .handle = oldRuleHandleEvent,
+};
+
+static void sourceEmit(struct Source *src)
+{
+    struct TripleAxisDataEvent *triple;
+    struct SingleAxisDataEvent *single;
+    uint32_t i, n = src->samplesPerEvt;
+    uint64_t spacing = src->period / n;
+
+    switch (src->info.numAxis) {
+    case NUM_AXIS_THREE:
+        triple = heapAlloc(sizeof(*triple) + n * sizeof(triple->samples[0]));
+        memset(triple, 0, sizeof(*triple) + n * sizeof(triple->samples[0]));
+        triple->referenceTime = timGetTime() - (n - 1) * spacing;
+        triple->samples[0].firstSample.numSamples = n;
+        for (i = 0; i < n; i++) {
+            if (i)
+                triple->samples[i].deltaTime = spacing;
+            triple->samples[i].ix = rnd(1 << 16);
+        }
+        osEnqueueEvt(EVENT_TYPE_BIT_DISCARDABLE | sensorGetMyEventType(src->info.sensorType), triple, heapFree);
+        break;
+    default:
+        single = heapAlloc(sizeof(*single) + n * sizeof(single->samples[0]));
+        memset(single, 0, sizeof(*single) + n * sizeof(single->samples[0]));
+        single->referenceTime = timGetTime() - (n - 1) * spacing;
+        single->samples[0].firstSample.numSamples = n;
+        for (i = 0; i < n; i++) {
+            if (i)
+                single->samples[i].deltaTime = spacing;
+            single->samples[i].idata = rnd(1 << 16);
+        }
+        osEnqueueEvt(EVENT_TYPE_BIT_DISCARDABLE | sensorGetMyEventType(src->info.sensorType), single, heapFree);
+        break;
+    }
+    src->emitted += n;
+}
+
+static void sourceTimerCbk(uint32_t timerId, void *data)
+{
+    struct Source *src = data;
+
+    //the first delivery comes at a random point of the period, the rest follow it
+    if (!src->emitted)
+        src->timer = timTimerSet(src->period, 0, 50, sourceTimerCbk, src, false);
+    sourceEmit(src);
+}
+
+static bool sourcePower(bool on, void *cookie)
+{
+    struct Source *src = cookie;
+
+    if (!on && src->timer) {
+        timTimerCancel(src->timer);
+        src->timer = 0;
+    }
+
+    return sensorSignalInternalEvt(src->handle, SENSOR_INTERNAL_EVT_POWER_STATE_CHG, on, 0);
+}
+
+static bool sourceFirmwareUpload(void *cookie)
+{
+    struct Source *src = cookie;
+
+    return sensorSignalInternalEvt(src->handle, SENSOR_INTERNAL_EVT_FW_STATE_CHG, 1, 0);
+}
+
+//a FIFO driver batches on its own period whatever the latency asked for
+static bool sourceSetRate(uint32_t rate, uint64_t latency, void *cookie)
+{
+    struct Source *src = cookie;
+
+    if (!src->timer)
+        src->timer = timTimerSet(1 + rnd(src->period), 0, 50, sourceTimerCbk, src, true);
+
+    return sensorSignalInternalEvt(src->handle, SENSOR_INTERNAL_EVT_RATE_CHG, rate, src->period);
+}
+
+static bool sourceFlush(void *cookie)
+{
+    struct Source *src = cookie;
+
+    return osEnqueueEvt(sensorGetMyEventType(src->info.sensorType), SENSOR_DATA_EVENT_FLUSH, NULL);
+}
+
+static const struct SensorOps mSourceOps = {
+    .sensorPower = sourcePower,
+    .sensorFirmwareUpload = sourceFirmwareUpload,
+    .sensorSetRate = sourceSetRate,
+    .sensorFlush = sourceFlush,
+};
+
+static void configure(void)
+{
+    struct ConfigCmd *cmd;
+    uint32_t i;
+
+    for (i = 0; i < NUM_SOURCES; i++) {
+        mSources[i].info.supportedRates = mSources[i].rates;
+        mSources[i].handle = sensorRegister(&mSources[i].info, &mSourceOps, mSources + i, true);
+    }
+
+    expect(hostOsStartApp(&gHostIntfApp), "hostIntf did not start", "config");
+    expect(hostOsStartApp(&mOldRuleApp), "old rule app did not start", "config");
+    osEnqueueEvt(EVT_APP_START, NULL, NULL);
+    hostOsRunAll();
+
+    for (i = 0; i < NUM_SOURCES; i++) {
+        cmd = heapAlloc(sizeof(*cmd));
+        memset(cmd, 0, sizeof(*cmd));
+        cmd->latency = mSources[i].latency;
+        cmd->rate = mSources[i].rates[0];
+        cmd->sensType = mSources[i].info.sensorType;
+        cmd->enabled = true;
+        osEnqueueEvt(EVT_NO_SENSOR_CONFIG_EVENT, cmd, heapFree);
+        mSources[i].oldLastInterrupt = timGetTime();
+    }
+    hostOsRunAll();
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t start;
+    uint32_t i, wakeDrops, nonWakeDrops;
+    struct Source *src;
+
+    if (argc > 1)
+        mRand = strtoul(argv[1], NULL, 0);
+
+    sensorsInit();
+    configure();
+
+    start = timGetTime();
+    hostOsRunUntil(start + RUN_TIME);
+
+    //whatever came in since the last wakeup
+    apReadAll();
+
+    for (i = 0; i < NUM_SOURCES; i++) {
+        src = mSources + i;
+        printf("wakeup_test: sensor %2u latency %4llu ms, %6u samples, longest wait %4llu ms\n", src->info.sensorType,
+               (unsigned long long)(src->latency / MS), src->received, (unsigned long long)(src->maxWait / MS));
+        expect(src->emitted > 0 && src->received == src->emitted, "samples lost", src->info.sensorName);
+        //a sample may sit one hw period in the FIFO before the hub sees it
+        expect(src->maxWait <= src->latency + src->period, "latency missed", src->info.sensorName);
+    }
+
+    hostIntfGetDropCounts(&wakeDrops, &nonWakeDrops);
+    expect(!wakeDrops && !nonWakeDrops, "packets dropped", "queue");
+
+    printf("wakeup_test: AP wakeups per minute: %.1f per sensor, %.1f coalesced\n",
+           mOldWakeups * (double)MINUTE / RUN_TIME, mWakeups * (double)MINUTE / RUN_TIME);
+    expect(mWakeups * 2 <= mOldWakeups, "coalescing saves too few wakeups", "ap");
+
+    printf("wakeup_test: %s\n", mFailed ? "FAILED" : "ok");
+
+    return mFailed ? 1 : 0;
+}